@@ -0,0 +1,401 @@
+/**
+ * BACnet/IP frame parsing
+ * --------------------------------------
+ * See BACnetFrame.h
+ */
+
+#include "BACnetFrame.h"
+
+#include <string.h>
+
+bool BACnetFrameParse(const uint8_t* message, uint16_t length, BACnetFrame* frame)
+{
+    if (length < 4 || message[0] != BVLC_TYPE_BACNET_IP) {
+        return false;
+    }
+    uint16_t offset = 4;
+    frame->broadcast = message[1] != BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    if (message[1] == BVLC_FUNCTION_FORWARDED_NPDU) {
+        offset += 6; // Original source B/IP address
+    } else if (message[1] != BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU && message[1] != BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU) {
+        return false;
+    }
+
+    // NPDU
+    if (offset + 2 > length || message[offset] != NPDU_VERSION) {
+        return false;
+    }
+    uint8_t control = message[offset + 1];
+    if (control & NPDU_CONTROL_NETWORK_MESSAGE) {
+        return false;
+    }
+    offset += 2;
+    frame->hasDestinationNetwork = (control & NPDU_CONTROL_DESTINATION_SPECIFIER) != 0;
+    frame->hasSourceNetwork = (control & NPDU_CONTROL_SOURCE_SPECIFIER) != 0;
+    frame->destinationNetwork = 0;
+    frame->destinationAddressOffset = 0;
+    frame->destinationAddressLength = 0;
+    if (frame->hasDestinationNetwork) {
+        if (offset + 3 > length) {
+            return false;
+        }
+        frame->destinationNetwork = (uint16_t)(message[offset] << 8 | message[offset + 1]);
+        frame->destinationAddressOffset = offset + 3;
+        frame->destinationAddressLength = message[offset + 2];
+        offset += 3 + message[offset + 2];
+    }
+    if (frame->hasSourceNetwork) {
+        if (offset + 3 > length) {
+            return false;
+        }
+        offset += 3 + message[offset + 2];
+    }
+    if (frame->hasDestinationNetwork) {
+        offset += 1; // Hop count
+    }
+
+    // APDU header
+    if (offset + 2 > length) {
+        return false;
+    }
+    const uint8_t* apdu = message + offset;
+    frame->apduOffset = offset;
+    frame->apduLength = length - offset;
+    frame->apduType = apdu[0] & 0xF0;
+    frame->invokeId = 0;
+    frame->serviceChoice = 0;
+
+    uint16_t serviceOffset;
+    switch (frame->apduType) {
+        case APDU_TYPE_CONFIRMED_REQUEST:
+            frame->invokeId = frame->apduLength > 2 ? apdu[2] : 0;
+            serviceOffset = (apdu[0] & APDU_FLAG_SEGMENTED) ? 5 : 3;
+            break;
+        case APDU_TYPE_UNCONFIRMED_REQUEST:
+            serviceOffset = 1;
+            break;
+        case APDU_TYPE_COMPLEX_ACK:
+            frame->invokeId = apdu[1];
+            serviceOffset = (apdu[0] & APDU_FLAG_SEGMENTED) ? 4 : 2;
+            break;
+        case APDU_TYPE_SIMPLE_ACK:
+        case APDU_TYPE_ERROR:
+        case APDU_TYPE_REJECT:
+        case APDU_TYPE_ABORT:
+            frame->invokeId = apdu[1];
+            serviceOffset = 2;
+            break;
+        default:
+            frame->invokeId = apdu[1];
+            return true; // Segment ack, no service choice
+    }
+    if (serviceOffset >= frame->apduLength) {
+        return false;
+    }
+    frame->serviceChoice = apdu[serviceOffset];
+    return true;
+}
+
+uint16_t BACnetMaxAPDUAccepted(uint8_t headerByte)
+{
+    static const uint16_t MAX_APDU[] = { 50, 128, 206, 480, 1024, 1476 };
+    uint8_t code = headerByte & 0x0F;
+    return code < sizeof(MAX_APDU) / sizeof(MAX_APDU[0]) ? MAX_APDU[code] : MAX_APDU[0];
+}
+
+// Encoding
+// ---------------------------------------------------------------------------
+// Tag byte followed by an unsigned value in the fewest big endian bytes
+static uint16_t BACnetEncodeTaggedUnsigned(uint8_t* buffer, uint16_t maxLength, uint8_t tag, uint32_t value)
+{
+    uint8_t length = value <= 0xFF ? 1 : value <= 0xFFFF ? 2 : value <= 0xFFFFFF ? 3 : 4;
+    if (maxLength < 1 + length) {
+        return 0;
+    }
+    buffer[0] = (uint8_t)(tag | length);
+    for (uint8_t byte = 0; byte < length; byte++) {
+        buffer[length - byte] = (uint8_t)(value >> (8 * byte));
+    }
+    return 1 + length;
+}
+
+static uint16_t BACnetEncodeTaggedObjectIdentifier(uint8_t* buffer, uint16_t maxLength, uint8_t tag, uint16_t objectType, uint32_t objectInstance)
+{
+    if (maxLength < 5) {
+        return 0;
+    }
+    uint32_t objectIdentifier = ((uint32_t)objectType << 22) | (objectInstance & 0x3FFFFF);
+    buffer[0] = (uint8_t)(tag | 4);
+    buffer[1] = (uint8_t)(objectIdentifier >> 24);
+    buffer[2] = (uint8_t)(objectIdentifier >> 16);
+    buffer[3] = (uint8_t)(objectIdentifier >> 8);
+    buffer[4] = (uint8_t)objectIdentifier;
+    return 5;
+}
+
+uint16_t BACnetEncodeBoolean(uint8_t* buffer, uint16_t maxLength, bool value)
+{
+    if (maxLength < 1) {
+        return 0;
+    }
+    buffer[0] = (uint8_t)(BACNET_APPLICATION_TAG_BOOLEAN << 4 | (value ? 1 : 0)); // The value is the length field
+    return 1;
+}
+
+uint16_t BACnetEncodeUnsigned(uint8_t* buffer, uint16_t maxLength, uint32_t value)
+{
+    return BACnetEncodeTaggedUnsigned(buffer, maxLength, BACNET_APPLICATION_TAG_UNSIGNED << 4, value);
+}
+
+uint16_t BACnetEncodeEnumerated(uint8_t* buffer, uint16_t maxLength, uint32_t value)
+{
+    return BACnetEncodeTaggedUnsigned(buffer, maxLength, BACNET_APPLICATION_TAG_ENUMERATED << 4, value);
+}
+
+uint16_t BACnetEncodeReal(uint8_t* buffer, uint16_t maxLength, float value)
+{
+    if (maxLength < 5) {
+        return 0;
+    }
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buffer[0] = (uint8_t)(BACNET_APPLICATION_TAG_REAL << 4 | 4);
+    buffer[1] = (uint8_t)(bits >> 24);
+    buffer[2] = (uint8_t)(bits >> 16);
+    buffer[3] = (uint8_t)(bits >> 8);
+    buffer[4] = (uint8_t)bits;
+    return 5;
+}
+
+uint16_t BACnetEncodeObjectIdentifier(uint8_t* buffer, uint16_t maxLength, uint16_t objectType, uint32_t objectInstance)
+{
+    return BACnetEncodeTaggedObjectIdentifier(buffer, maxLength, BACNET_APPLICATION_TAG_OBJECT_IDENTIFIER << 4, objectType, objectInstance);
+}
+
+uint16_t BACnetEncodeCharacterString(uint8_t* buffer, uint16_t maxLength, const char* value, uint32_t length)
+{
+    // The content is a character set byte (0, UTF-8) followed by the string. Content lengths above 4
+    // go in the byte after the tag, from 254 on as 254 followed by a 2 byte length.
+    uint32_t contentLength = length + 1;
+    uint16_t headerLength = contentLength <= 4 ? 1 : contentLength < 254 ? 2 : 4;
+    if (contentLength > 0xFFFF || (uint32_t)headerLength + contentLength > maxLength) {
+        return 0;
+    }
+    uint8_t tag = BACNET_APPLICATION_TAG_CHARACTER_STRING << 4;
+    if (headerLength == 1) {
+        buffer[0] = (uint8_t)(tag | contentLength);
+    } else if (headerLength == 2) {
+        buffer[0] = (uint8_t)(tag | 5);
+        buffer[1] = (uint8_t)contentLength;
+    } else {
+        buffer[0] = (uint8_t)(tag | 5);
+        buffer[1] = 254;
+        buffer[2] = (uint8_t)(contentLength >> 8);
+        buffer[3] = (uint8_t)contentLength;
+    }
+    buffer[headerLength] = 0; // UTF-8
+    memcpy(buffer + headerLength + 1, value, length);
+    return (uint16_t)(headerLength + contentLength);
+}
+
+uint16_t BACnetEncodeBitString(uint8_t* buffer, uint16_t maxLength, uint8_t bitCount, const uint8_t* setBits, uint8_t setBitCount)
+{
+    // The content is the number of unused bits in the last byte followed by the bits, first bit in
+    // the top bit of the first byte
+    uint8_t dataLength = (uint8_t)((bitCount + 7) / 8);
+    uint8_t headerLength = dataLength + 1 > 4 ? 2 : 1;
+    if (maxLength < headerLength + 1 + dataLength) {
+        return 0;
+    }
+    uint16_t length = 0;
+    uint8_t tag = BACNET_APPLICATION_TAG_BIT_STRING << 4;
+    if (headerLength == 2) {
+        buffer[length++] = (uint8_t)(tag | 5);
+        buffer[length++] = (uint8_t)(dataLength + 1);
+    } else {
+        buffer[length++] = (uint8_t)(tag | (dataLength + 1));
+    }
+    buffer[length++] = (uint8_t)(dataLength * 8 - bitCount);
+    memset(buffer + length, 0, dataLength);
+    for (uint8_t bit = 0; bit < setBitCount; bit++) {
+        buffer[length + setBits[bit] / 8] |= (uint8_t)(0x80 >> (setBits[bit] % 8));
+    }
+    return length + dataLength;
+}
+
+uint16_t BACnetEncodeContextUnsigned(uint8_t* buffer, uint16_t maxLength, uint8_t tagNumber, uint32_t value)
+{
+    return BACnetEncodeTaggedUnsigned(buffer, maxLength, (uint8_t)(tagNumber << 4 | BACNET_TAG_CONTEXT), value);
+}
+
+uint16_t BACnetEncodeContextObjectIdentifier(uint8_t* buffer, uint16_t maxLength, uint8_t tagNumber, uint16_t objectType, uint32_t objectInstance)
+{
+    return BACnetEncodeTaggedObjectIdentifier(buffer, maxLength, (uint8_t)(tagNumber << 4 | BACNET_TAG_CONTEXT), objectType, objectInstance);
+}
+
+// Days since 1970-01-01 and civil dates (proleptic Gregorian calendar)
+static uint32_t BACnetDaysFromCivil(uint32_t year, uint32_t month, uint32_t day)
+{
+    year -= month <= 2 ? 1 : 0;
+    uint32_t era = year / 400;
+    uint32_t yearOfEra = year - era * 400;
+    uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static void BACnetCivilFromDays(uint32_t days, uint32_t* year, uint32_t* month, uint32_t* day)
+{
+    uint32_t shifted = days + 719468;
+    uint32_t era = shifted / 146097;
+    uint32_t dayOfEra = shifted - era * 146097;
+    uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    uint32_t monthIndex = (5 * dayOfYear + 2) / 153;
+    *day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    *month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    *year = yearOfEra + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+uint16_t BACnetEncodeDateTime(uint8_t* buffer, uint16_t maxLength, uint32_t seconds)
+{
+    if (maxLength < 10) {
+        return 0;
+    }
+    uint32_t days = seconds / 86400;
+    uint32_t secondOfDay = seconds % 86400;
+    uint32_t year;
+    uint32_t month;
+    uint32_t day;
+    BACnetCivilFromDays(days, &year, &month, &day);
+    buffer[0] = (uint8_t)(BACNET_APPLICATION_TAG_DATE << 4 | 4);
+    buffer[1] = (uint8_t)(year - 1900);
+    buffer[2] = (uint8_t)month;
+    buffer[3] = (uint8_t)day;
+    buffer[4] = (uint8_t)((days + 3) % 7 + 1); // 1970-01-01 was a Thursday, BACnet counts Monday as 1
+    buffer[5] = (uint8_t)(BACNET_APPLICATION_TAG_TIME << 4 | 4);
+    buffer[6] = (uint8_t)(secondOfDay / 3600);
+    buffer[7] = (uint8_t)(secondOfDay / 60 % 60);
+    buffer[8] = (uint8_t)(secondOfDay % 60);
+    buffer[9] = 0; // Hundredths
+    return 10;
+}
+
+// Decoding
+// ---------------------------------------------------------------------------
+// Application tag byte with a 1 to 4 byte big endian value
+static bool BACnetDecodeTaggedValue(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t applicationTag, uint32_t* value, uint8_t* valueLength)
+{
+    if (*offset >= length || (buffer[*offset] & 0xF8) != (uint8_t)(applicationTag << 4)) {
+        return false;
+    }
+    *valueLength = buffer[*offset] & 0x07;
+    if (*valueLength == 0 || *valueLength > 4 || *offset + 1 + *valueLength > length) {
+        return false;
+    }
+    *value = 0;
+    for (uint8_t byte = 0; byte < *valueLength; byte++) {
+        *value = (*value << 8) | buffer[*offset + 1 + byte];
+    }
+    *offset += 1 + *valueLength;
+    return true;
+}
+
+bool BACnetDecodeUnsigned(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint32_t* value)
+{
+    uint8_t valueLength;
+    return BACnetDecodeTaggedValue(buffer, length, offset, BACNET_APPLICATION_TAG_UNSIGNED, value, &valueLength);
+}
+
+bool BACnetDecodeSigned(const uint8_t* buffer, uint16_t length, uint16_t* offset, int32_t* value)
+{
+    uint32_t bits;
+    uint8_t valueLength;
+    if (!BACnetDecodeTaggedValue(buffer, length, offset, BACNET_APPLICATION_TAG_SIGNED, &bits, &valueLength)) {
+        return false;
+    }
+    // Sign extend from the top bit of the encoded bytes
+    uint8_t unusedBits = (uint8_t)(32 - 8 * valueLength);
+    *value = unusedBits == 0 ? (int32_t)bits : (int32_t)(bits << unusedBits) >> unusedBits;
+    return true;
+}
+
+bool BACnetDecodeEnumerated(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint32_t* value)
+{
+    uint8_t valueLength;
+    return BACnetDecodeTaggedValue(buffer, length, offset, BACNET_APPLICATION_TAG_ENUMERATED, value, &valueLength);
+}
+bool BACnetDecodeReal(const uint8_t* buffer, uint16_t length, uint16_t* offset, float* value)
+{
+    uint32_t bits;
+    uint8_t valueLength;
+    uint16_t start = *offset;
+    if (!BACnetDecodeTaggedValue(buffer, length, offset, BACNET_APPLICATION_TAG_REAL, &bits, &valueLength)) {
+        return false;
+    }
+    if (valueLength != 4) {
+        *offset = start;
+        return false;
+    }
+    memcpy(value, &bits, sizeof(*value));
+    return true;
+}
+bool BACnetDecodeDateTime(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint32_t* seconds)
+{
+    if (*offset + 10 > length || buffer[*offset] != (uint8_t)(BACNET_APPLICATION_TAG_DATE << 4 | 4) || buffer[*offset + 5] != (uint8_t)(BACNET_APPLICATION_TAG_TIME << 4 | 4)) {
+        return false;
+    }
+    const uint8_t* date = buffer + *offset + 1;
+    const uint8_t* time = buffer + *offset + 6;
+    // 0xFF marks an unspecified field; the day of week is not needed
+    if (date[0] == 0xFF || date[0] < 70 || date[1] < 1 || date[1] > 12 || date[2] < 1 || date[2] > 31 || time[0] > 23 || time[1] > 59 || time[2] > 59) {
+        return false;
+    }
+    uint32_t days = BACnetDaysFromCivil(1900 + date[0], date[1], date[2]);
+    if (days >= 0xFFFFFFFF / 86400) {
+        return false; // After 2106
+    }
+    *seconds = days * 86400 + time[0] * 3600 + time[1] * 60 + time[2];
+    *offset += 10;
+    return true;
+}
+
+bool BACnetDecodeContextUnsigned(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t tagNumber, uint32_t* value)
+{
+    if (*offset >= length || (buffer[*offset] & 0xF8) != (uint8_t)(tagNumber << 4 | BACNET_TAG_CONTEXT)) {
+        return false;
+    }
+    uint8_t valueLength = buffer[*offset] & 0x07;
+    if (valueLength == 0 || valueLength > 4 || *offset + 1 + valueLength > length) {
+        return false;
+    }
+    *value = 0;
+    for (uint8_t byte = 0; byte < valueLength; byte++) {
+        *value = (*value << 8) | buffer[*offset + 1 + byte];
+    }
+    *offset += 1 + valueLength;
+    return true;
+}
+
+bool BACnetDecodeContextObjectIdentifier(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t tagNumber, uint16_t* objectType, uint32_t* objectInstance)
+{
+    if (*offset >= length || buffer[*offset] != (uint8_t)(tagNumber << 4 | BACNET_TAG_CONTEXT | 4)) {
+        return false;
+    }
+    uint32_t objectIdentifier;
+    if (!BACnetDecodeContextUnsigned(buffer, length, offset, tagNumber, &objectIdentifier)) {
+        return false;
+    }
+    *objectType = (uint16_t)(objectIdentifier >> 22);
+    *objectInstance = objectIdentifier & 0x3FFFFF;
+    return true;
+}
+
+bool BACnetDecodeTag(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t tagNumber, uint8_t tagType)
+{
+    if (*offset >= length || buffer[*offset] != (uint8_t)(tagNumber << 4 | tagType)) {
+        return false;
+    }
+    *offset += 1;
+    return true;
+}
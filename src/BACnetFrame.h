@@ -0,0 +1,182 @@
+/**
+ * BACnet/IP frame parsing
+ * --------------------------------------
+ * Minimal, allocation-free helpers to locate the APDU inside a BACnet/IP datagram (BVLC + NPDU)
+ * and read its header, and to encode and decode the few tagged values the fast paths need. Used by
+ * the instrumentation and fast paths that look at packets before or after the CAS BACnet stack
+ * does; the stack still does the full decoding.
+ */
+
+#ifndef BACNET_FRAME_H
+#define BACNET_FRAME_H
+
+#include <stdint.h>
+
+// BVLC
+const uint8_t BVLC_TYPE_BACNET_IP = 0x81;
+const uint8_t BVLC_FUNCTION_FORWARDED_NPDU = 0x04;
+const uint8_t BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU = 0x0A;
+const uint8_t BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU = 0x0B;
+
+// NPDU
+const uint8_t NPDU_VERSION = 0x01;
+const uint8_t NPDU_CONTROL_NETWORK_MESSAGE = 0x80;
+const uint8_t NPDU_CONTROL_DESTINATION_SPECIFIER = 0x20;
+const uint8_t NPDU_CONTROL_SOURCE_SPECIFIER = 0x08;
+
+// APDU types (upper nibble of the first APDU byte)
+const uint8_t APDU_TYPE_CONFIRMED_REQUEST = 0x00;
+const uint8_t APDU_TYPE_UNCONFIRMED_REQUEST = 0x10;
+const uint8_t APDU_TYPE_SIMPLE_ACK = 0x20;
+const uint8_t APDU_TYPE_COMPLEX_ACK = 0x30;
+const uint8_t APDU_TYPE_SEGMENT_ACK = 0x40;
+const uint8_t APDU_TYPE_ERROR = 0x50;
+const uint8_t APDU_TYPE_REJECT = 0x60;
+const uint8_t APDU_TYPE_ABORT = 0x70;
+const uint8_t APDU_FLAG_SEGMENTED = 0x08;
+const uint8_t APDU_FLAG_SERVER = 0x01; // Abort sent by the server
+
+// Tags
+const uint8_t BACNET_TAG_CONTEXT = 0x08; // Class bit, set for context tags
+const uint8_t BACNET_TAG_OPENING = 0x0E; // Low nibble of an opening tag
+const uint8_t BACNET_TAG_CLOSING = 0x0F; // Low nibble of a closing tag
+const uint8_t BACNET_APPLICATION_TAG_BOOLEAN = 1;
+const uint8_t BACNET_APPLICATION_TAG_UNSIGNED = 2;
+const uint8_t BACNET_APPLICATION_TAG_SIGNED = 3;
+const uint8_t BACNET_APPLICATION_TAG_REAL = 4;
+const uint8_t BACNET_APPLICATION_TAG_BIT_STRING = 8;
+const uint8_t BACNET_APPLICATION_TAG_CHARACTER_STRING = 7;
+const uint8_t BACNET_APPLICATION_TAG_ENUMERATED = 9;
+const uint8_t BACNET_APPLICATION_TAG_DATE = 10;
+const uint8_t BACNET_APPLICATION_TAG_TIME = 11;
+const uint8_t BACNET_APPLICATION_TAG_OBJECT_IDENTIFIER = 12;
+
+// Network layer
+const uint16_t BACNET_NETWORK_GLOBAL_BROADCAST = 0xFFFF;
+const uint8_t BACNET_NETWORK_MESSAGE_WHO_IS_ROUTER_TO_NETWORK = 0x00;
+const uint8_t BACNET_NETWORK_MESSAGE_I_AM_ROUTER_TO_NETWORK = 0x01;
+
+// Services
+const uint8_t BACNET_UNCONFIRMED_SERVICE_I_AM = 0;
+const uint8_t BACNET_UNCONFIRMED_SERVICE_WHO_IS = 8;
+const uint8_t BACNET_SERVICE_SUBSCRIBE_COV = 5;
+const uint8_t BACNET_SERVICE_READ_PROPERTY = 12;
+const uint8_t BACNET_SERVICE_READ_PROPERTY_MULTIPLE = 14;
+const uint8_t BACNET_SERVICE_WRITE_PROPERTY = 15;
+const uint8_t BACNET_SERVICE_READ_RANGE = 26;
+
+// Objects
+const uint16_t BACNET_OBJECT_TYPE_ANALOG_INPUT = 0;
+const uint16_t BACNET_OBJECT_TYPE_ANALOG_VALUE = 2;
+const uint16_t BACNET_OBJECT_TYPE_BINARY_INPUT = 3;
+const uint16_t BACNET_OBJECT_TYPE_BINARY_VALUE = 5;
+const uint16_t BACNET_OBJECT_TYPE_DEVICE = 8;
+const uint16_t BACNET_OBJECT_TYPE_MULTI_STATE_INPUT = 13;
+const uint16_t BACNET_OBJECT_TYPE_MULTI_STATE_VALUE = 19;
+const uint16_t BACNET_OBJECT_TYPE_TREND_LOG = 20;
+const uint32_t BACNET_MAX_INSTANCE = 4194302;
+const uint32_t BACNET_INSTANCE_WILDCARD = 4194303; // Device object of the device addressed
+
+// Properties
+const uint32_t BACNET_PROPERTY_IDENTIFIER_ALL = 8;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_APDU_TIMEOUT = 11;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_DESCRIPTION = 28;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_DEVICE_ADDRESS_BINDING = 30;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_EVENT_STATE = 36;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_MAX_APDU_LENGTH_ACCEPTED = 62;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_APDU_RETRIES = 73;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES = 74;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER = 75;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_OBJECT_LIST = 76;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME = 77;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE = 79;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE = 81;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_POLARITY = 84;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE = 85;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_PROTOCOL_OBJECT_TYPES_SUPPORTED = 96;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_PROTOCOL_SERVICES_SUPPORTED = 97;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_PROTOCOL_VERSION = 98;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_REQUIRED = 105;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_SEGMENTATION_SUPPORTED = 107;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_STATE_TEXT = 110;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS = 111;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_SYSTEM_STATUS = 112;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_UNITS = 117;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_VENDOR_IDENTIFIER = 120;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_LOG_BUFFER = 131;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_LOG_INTERVAL = 134;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_PROTOCOL_REVISION = 139;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_RECORD_COUNT = 141;
+const uint32_t BACNET_PROPERTY_IDENTIFIER_TOTAL_RECORD_COUNT = 145;
+
+// Enumerated values
+const uint32_t BACNET_SEGMENTATION_NONE = 3;
+const uint32_t BACNET_UNITS_NO_UNITS = 95;
+
+// Errors, rejects and aborts
+const uint8_t BACNET_ERROR_CLASS_OBJECT = 1;
+const uint8_t BACNET_ERROR_CLASS_PROPERTY = 2;
+const uint8_t BACNET_ERROR_CODE_INVALID_DATA_TYPE = 9;
+const uint8_t BACNET_ERROR_CODE_UNKNOWN_OBJECT = 31;
+const uint8_t BACNET_ERROR_CODE_UNKNOWN_PROPERTY = 32;
+const uint8_t BACNET_ERROR_CODE_VALUE_OUT_OF_RANGE = 37;
+const uint8_t BACNET_ERROR_CODE_WRITE_ACCESS_DENIED = 40;
+const uint8_t BACNET_ERROR_CODE_INVALID_ARRAY_INDEX = 42;
+const uint8_t BACNET_ERROR_CODE_PROPERTY_IS_NOT_AN_ARRAY = 50;
+const uint8_t BACNET_REJECT_REASON_INVALID_TAG = 4;
+const uint8_t BACNET_REJECT_REASON_UNRECOGNIZED_SERVICE = 9;
+const uint8_t BACNET_ABORT_REASON_SEGMENTATION_NOT_SUPPORTED = 4;
+
+struct BACnetFrame {
+    bool broadcast; // Sent as a BVLC broadcast (original or forwarded)
+    uint16_t apduOffset; // Offset of the APDU in the datagram
+    uint16_t apduLength;
+    bool hasSourceNetwork; // The NPDU carries SNET/SADR (the request was routed)
+    bool hasDestinationNetwork; // The NPDU carries DNET/DADR
+    uint16_t destinationNetwork;
+    uint16_t destinationAddressOffset; // DADR in the datagram
+    uint8_t destinationAddressLength; // 0 for a broadcast on the destination network
+    uint8_t apduType;
+    uint8_t invokeId; // Not used for unconfirmed requests
+    uint8_t serviceChoice; // Reason code for Reject and Abort
+};
+
+// Returns false if the datagram is not a BACnet/IP APDU (network layer message, truncated, ...).
+bool BACnetFrameParse(const uint8_t* message, uint16_t length, BACnetFrame* frame);
+
+// Largest APDU the sender of a confirmed request accepts, from the second header byte
+uint16_t BACnetMaxAPDUAccepted(uint8_t headerByte);
+
+// Encoding
+// -----------------------------
+// Each writes one tagged value at buffer and returns its length, or 0 if it does not fit in maxLength.
+uint16_t BACnetEncodeBoolean(uint8_t* buffer, uint16_t maxLength, bool value);
+uint16_t BACnetEncodeUnsigned(uint8_t* buffer, uint16_t maxLength, uint32_t value);
+uint16_t BACnetEncodeEnumerated(uint8_t* buffer, uint16_t maxLength, uint32_t value);
+uint16_t BACnetEncodeReal(uint8_t* buffer, uint16_t maxLength, float value);
+uint16_t BACnetEncodeObjectIdentifier(uint8_t* buffer, uint16_t maxLength, uint16_t objectType, uint32_t objectInstance);
+uint16_t BACnetEncodeCharacterString(uint8_t* buffer, uint16_t maxLength, const char* value, uint32_t length); // UTF-8
+// bitCount bits with the listed bits set, e.g. Status_Flags is 4 bits with none set
+uint16_t BACnetEncodeBitString(uint8_t* buffer, uint16_t maxLength, uint8_t bitCount, const uint8_t* setBits, uint8_t setBitCount);
+uint16_t BACnetEncodeContextUnsigned(uint8_t* buffer, uint16_t maxLength, uint8_t tagNumber, uint32_t value);
+uint16_t BACnetEncodeContextObjectIdentifier(uint8_t* buffer, uint16_t maxLength, uint8_t tagNumber, uint16_t objectType, uint32_t objectInstance);
+// A BACnetDateTime (application tagged date and time) from seconds since 1970-01-01 00:00:00
+uint16_t BACnetEncodeDateTime(uint8_t* buffer, uint16_t maxLength, uint32_t seconds);
+
+// Decoding
+// -----------------------------
+// Read a context tagged value at *offset and advance it. Return false if the tag number does not match.
+bool BACnetDecodeContextUnsigned(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t tagNumber, uint32_t* value);
+bool BACnetDecodeContextObjectIdentifier(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t tagNumber, uint16_t* objectType, uint32_t* objectInstance);
+// Read an application tagged value at *offset and advance it. Return false if the tag does not match.
+bool BACnetDecodeUnsigned(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint32_t* value);
+bool BACnetDecodeSigned(const uint8_t* buffer, uint16_t length, uint16_t* offset, int32_t* value);
+bool BACnetDecodeEnumerated(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint32_t* value);
+bool BACnetDecodeReal(const uint8_t* buffer, uint16_t length, uint16_t* offset, float* value);
+// A BACnetDateTime as seconds since 1970-01-01 00:00:00. Returns false for dates with unspecified
+// fields and dates outside 1970 to 2105.
+bool BACnetDecodeDateTime(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint32_t* seconds);
+// Opening and closing tags, e.g. BACnetDecodeTag(buffer, length, &offset, 1, BACNET_TAG_OPENING)
+bool BACnetDecodeTag(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t tagNumber, uint8_t tagType);
+
+#endif // BACNET_FRAME_H
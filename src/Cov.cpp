@@ -0,0 +1,70 @@
+/**
+ * Change of value (COV) notifications
+ * --------------------------------------
+ * See Cov.h
+ */
+
+#include "Cov.h"
+
+#include "BACnetFrame.h"
+
+#include <stddef.h>
+
+static PointChangeSet gCovSubscribable;
+static uint32_t gCovPointCount = 0;
+static uint32_t gCovDeviceInstance = 0;
+static CovValueUpdatedFunction gCovValueUpdated = NULL;
+static uint32_t gCovNotificationsFlushed = 0;
+
+void CovBegin(CovValueUpdatedFunction valueUpdated, uint32_t deviceInstance)
+{
+    gCovValueUpdated = valueUpdated;
+    gCovDeviceInstance = deviceInstance;
+    gCovPointCount = 0;
+    for (uint16_t word = 0; word < POINT_STORE_CHANGE_WORDS; word++) {
+        gCovSubscribable.words[word] = 0;
+    }
+}
+
+bool CovSetSubscribable(uint16_t point)
+{
+    if (point >= PointStoreCount()) {
+        return false;
+    }
+    uint32_t bit = 1UL << (point % 32);
+    if ((gCovSubscribable.words[point / 32] & bit) == 0) {
+        gCovSubscribable.words[point / 32] |= bit;
+        gCovPointCount++;
+    }
+    return true;
+}
+
+uint32_t CovFlush(const PointChangeSet* changes)
+{
+    if (gCovValueUpdated == NULL) {
+        return 0;
+    }
+
+    uint32_t flushed = 0;
+    for (uint16_t word = 0; word < POINT_STORE_CHANGE_WORDS; word++) {
+        uint32_t changed = changes->words[word] & gCovSubscribable.words[word];
+        while (changed != 0) {
+            uint16_t point = (uint16_t)(word * 32 + __builtin_ctz(changed));
+            changed &= changed - 1;
+
+            uint16_t objectType;
+            uint32_t objectInstance;
+            PointStoreGetObject(point, &objectType, &objectInstance);
+            gCovValueUpdated(gCovDeviceInstance, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE);
+            flushed++;
+        }
+    }
+    gCovNotificationsFlushed += flushed;
+    return flushed;
+}
+
+void CovGetStatistics(CovStatistics* statistics)
+{
+    statistics->pointCount = gCovPointCount;
+    statistics->notificationsFlushed = gCovNotificationsFlushed;
+}
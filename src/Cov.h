@@ -0,0 +1,41 @@
+/**
+ * Change of value (COV) notifications
+ * --------------------------------------
+ * The CAS BACnet stack answers SubscribeCOV requests and owns the subscription table. The table has
+ * a fixed capacity and each subscription is dropped when its lifetime expires. When the stack is
+ * told that a property changed (fpValueUpdated()) it reads the new value through the property
+ * callbacks and sends one notification to every subscriber of that property.
+ *
+ * This module coalesces those updates. Points that support COV are flagged once at startup in a
+ * bitmap over the point store. Once per scan CovFlush() is given the change set taken from the
+ * point store and reports each changed, subscribable point once, so any number of changes within a
+ * scan produce a single notification per subscriber carrying the latest value.
+ */
+
+#ifndef COV_H
+#define COV_H
+
+#include "PointStore.h"
+
+#include <stdint.h>
+
+// Matches fpValueUpdated() of the CAS BACnet stack adapter.
+typedef void (*CovValueUpdatedFunction)(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier);
+
+struct CovStatistics {
+    uint32_t pointCount; // Points flagged as subscribable
+    uint32_t notificationsFlushed; // fpValueUpdated() calls, one per changed point per scan
+};
+
+void CovBegin(CovValueUpdatedFunction valueUpdated, uint32_t deviceInstance);
+
+// Reports changes of the point's present value to the stack. Returns false for an invalid point.
+bool CovSetSubscribable(uint16_t point);
+
+// Reports every changed, subscribable point. Call once per scan from the task that runs the stack.
+// Returns the number of points reported.
+uint32_t CovFlush(const PointChangeSet* changes);
+
+void CovGetStatistics(CovStatistics* statistics);
+
+#endif // COV_H
@@ -0,0 +1,124 @@
+/**
+ * Discovery responses
+ * --------------------------------------
+ * See Discovery.h
+ */
+
+#include "Discovery.h"
+
+#include <stddef.h>
+#include <string.h>
+
+void DiscoveryBegin(DiscoveryState* state, uint32_t deviceInstance)
+{
+    memset(state, 0, sizeof(*state));
+    state->deviceInstance = deviceInstance;
+    state->jitterMs = DiscoveryJitterMs(deviceInstance);
+}
+
+uint32_t DiscoveryJitterMs(uint32_t deviceInstance)
+{
+    // Multiplicative hash so consecutive device instances land far apart.
+    return ((deviceInstance * 2654435761u) >> 8) % (DISCOVERY_JITTER_MAX_MS + 1);
+}
+
+bool DiscoveryCacheIAm(DiscoveryState* state, const uint8_t* message, uint16_t length)
+{
+    BACnetFrame frame;
+    if (length > DISCOVERY_I_AM_MAX_LENGTH || !BACnetFrameParse(message, length, &frame)) {
+        return false;
+    }
+    if (frame.apduType != APDU_TYPE_UNCONFIRMED_REQUEST || frame.serviceChoice != BACNET_UNCONFIRMED_SERVICE_I_AM || frame.hasDestinationNetwork || frame.apduLength < 7) {
+        return false;
+    }
+    const uint8_t* apdu = message + frame.apduOffset;
+    uint32_t objectIdentifier = (uint32_t)apdu[3] << 24 | (uint32_t)apdu[4] << 16 | (uint32_t)apdu[5] << 8 | apdu[6];
+    if (apdu[2] != (BACNET_APPLICATION_TAG_OBJECT_IDENTIFIER << 4 | 4) || objectIdentifier != ((uint32_t)BACNET_OBJECT_TYPE_DEVICE << 22 | state->deviceInstance)) {
+        return false;
+    }
+    memcpy(state->iAm, message, length);
+    state->iAmLength = length;
+    return true;
+}
+
+bool DiscoveryHasIAm(const DiscoveryState* state)
+{
+    return state->iAmLength > 0;
+}
+
+bool DiscoveryHandleWhoIs(DiscoveryState* state, const uint8_t* message, const BACnetFrame* frame, const uint8_t* sourceAddress, uint32_t nowMs)
+{
+    if (frame->apduType != APDU_TYPE_UNCONFIRMED_REQUEST || frame->serviceChoice != BACNET_UNCONFIRMED_SERVICE_WHO_IS) {
+        return false;
+    }
+    state->statistics.whoIsReceived++;
+    if (state->iAmLength == 0 || frame->hasSourceNetwork || (frame->hasDestinationNetwork && frame->destinationNetwork != BACNET_NETWORK_GLOBAL_BROADCAST)) {
+        state->statistics.whoIsForwarded++;
+        return false;
+    }
+
+    // Optional device instance range
+    const uint8_t* apdu = message + frame->apduOffset;
+    uint16_t offset = 2;
+    if (frame->apduLength > offset) {
+        uint32_t lowLimit;
+        uint32_t highLimit;
+        if (!BACnetDecodeContextUnsigned(apdu, frame->apduLength, &offset, 0, &lowLimit) || !BACnetDecodeContextUnsigned(apdu, frame->apduLength, &offset, 1, &highLimit)) {
+            state->statistics.whoIsForwarded++;
+            return false; // Malformed, let the stack reject it
+        }
+        if (state->deviceInstance < lowLimit || state->deviceInstance > highLimit) {
+            state->statistics.whoIsNotMatching++;
+            return true;
+        }
+    }
+
+    DiscoveryScheduleReply(state, sourceAddress, frame->broadcast, nowMs);
+    return true;
+}
+
+bool DiscoveryScheduleReply(DiscoveryState* state, const uint8_t* sourceAddress, bool broadcast, uint32_t nowMs)
+{
+    // Rate limit per source
+    DiscoverySource* source = NULL;
+    for (uint8_t index = 0; index < DISCOVERY_SOURCE_CAPACITY; index++) {
+        if (state->sources[index].used && memcmp(state->sources[index].address, sourceAddress, sizeof(state->sources[index].address)) == 0) {
+            source = &state->sources[index];
+            break;
+        }
+    }
+    if (source != NULL && nowMs - source->lastReplyMs < DISCOVERY_RATE_LIMIT_MS) {
+        state->statistics.whoIsRateLimited++;
+        return false;
+    }
+    if (source == NULL) {
+        source = &state->sources[state->nextSource];
+        state->nextSource = (uint8_t)((state->nextSource + 1) % DISCOVERY_SOURCE_CAPACITY);
+        source->used = true;
+        memcpy(source->address, sourceAddress, sizeof(source->address));
+    }
+    source->lastReplyMs = nowMs;
+
+    if (state->replyPending) {
+        state->statistics.whoIsCoalesced++;
+        if (!broadcast && (int32_t)(nowMs - state->replyDueMs) < 0) {
+            state->replyDueMs = nowMs; // A directed Who-Is is answered straight away
+        }
+        return true;
+    }
+    state->replyPending = true;
+    state->replyDueMs = nowMs + (broadcast ? state->jitterMs : 0);
+    return true;
+}
+
+bool DiscoveryPoll(DiscoveryState* state, uint32_t nowMs, const uint8_t** message, uint16_t* length)
+{
+    if (!state->replyPending || (int32_t)(nowMs - state->replyDueMs) < 0) {
+        return false;
+    }
+    state->replyPending = false;
+    state->statistics.iAmSent++;
+    *message = state->iAm;
+    *length = state->iAmLength;
+    return true;
+}
@@ -0,0 +1,82 @@
+/**
+ * Discovery responses
+ * --------------------------------------
+ * Answers Who-Is without waking the CAS BACnet stack, so a Who-Is storm after a site controller
+ * reboots does not turn into an I-Am storm.
+ *
+ * - The I-Am frame is encoded once by the stack (the announcement sent at startup) and cached.
+ * - A Who-Is whose device range does not include this device is dropped after decoding the range.
+ * - Replies to broadcast Who-Is are delayed by a jitter derived from the device instance, so the
+ *   devices on a segment answer spread over DISCOVERY_JITTER_MAX_MS instead of all at once.
+ *   Several Who-Is received while a reply is pending are answered by that one reply.
+ * - A source that repeats its Who-Is within DISCOVERY_RATE_LIMIT_MS of being answered is ignored.
+ *
+ * Routed Who-Is (with a source or a specific destination network) and anything that can not be
+ * decoded are left to the stack. The state is a plain struct so several devices can each have one.
+ * Time is passed in, nothing here sends; the caller sends the frame returned by DiscoveryPoll().
+ */
+
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include "BACnetFrame.h"
+
+#include <stdint.h>
+
+const uint32_t DISCOVERY_JITTER_MAX_MS = 500;
+const uint32_t DISCOVERY_RATE_LIMIT_MS = 1000;
+const uint8_t DISCOVERY_SOURCE_CAPACITY = 8; // Most recent Who-Is sources remembered for the rate limit
+const uint16_t DISCOVERY_I_AM_MAX_LENGTH = 32; // BVLC + NPDU + the longest I-Am encoding
+
+struct DiscoveryStatistics {
+    uint32_t whoIsReceived;
+    uint32_t whoIsNotMatching; // Device range excluded this device
+    uint32_t whoIsRateLimited; // Same source answered less than DISCOVERY_RATE_LIMIT_MS ago
+    uint32_t whoIsCoalesced; // Answered by a reply that was already pending
+    uint32_t whoIsForwarded; // Left to the stack (routed, malformed, or no cached I-Am yet)
+    uint32_t iAmSent;
+};
+
+struct DiscoverySource {
+    bool used;
+    uint8_t address[6];
+    uint32_t lastReplyMs;
+};
+
+struct DiscoveryState {
+    uint32_t deviceInstance;
+    uint32_t jitterMs;
+
+    uint8_t iAm[DISCOVERY_I_AM_MAX_LENGTH];
+    uint16_t iAmLength; // 0 until an I-Am for this device has been cached
+
+    bool replyPending;
+    uint32_t replyDueMs;
+
+    DiscoverySource sources[DISCOVERY_SOURCE_CAPACITY];
+    uint8_t nextSource;
+
+    DiscoveryStatistics statistics;
+};
+
+void DiscoveryBegin(DiscoveryState* state, uint32_t deviceInstance);
+
+// Reply delay for broadcast Who-Is, the same for every call with the same device instance.
+uint32_t DiscoveryJitterMs(uint32_t deviceInstance);
+
+// Offer a frame sent by the stack. Cached if it is an I-Am for this device. Returns true if cached.
+bool DiscoveryCacheIAm(DiscoveryState* state, const uint8_t* message, uint16_t length);
+bool DiscoveryHasIAm(const DiscoveryState* state);
+
+// Offer a received frame. Returns true if it was a Who-Is handled here; the caller then drops the
+// frame instead of passing it to the stack.
+bool DiscoveryHandleWhoIs(DiscoveryState* state, const uint8_t* message, const BACnetFrame* frame, const uint8_t* sourceAddress, uint32_t nowMs);
+
+// Schedules the I-Am for a Who-Is whose range was already matched by the caller, rate limited per
+// source and jittered like DiscoveryHandleWhoIs(). Returns false if the source was rate limited.
+bool DiscoveryScheduleReply(DiscoveryState* state, const uint8_t* sourceAddress, bool broadcast, uint32_t nowMs);
+
+// Returns true when the pending I-Am is due, with the cached frame to broadcast.
+bool DiscoveryPoll(DiscoveryState* state, uint32_t nowMs, const uint8_t** message, uint16_t* length);
+
+#endif // DISCOVERY_H
@@ -0,0 +1,76 @@
+/**
+ * Event-driven scan
+ * --------------------------------------
+ * See EventLoop.h
+ */
+
+#include "EventLoop.h"
+
+#include <string.h>
+
+void EventLoopBegin(EventLoopState* state, uint32_t maxIdleMs, uint32_t nowUs)
+{
+    memset(state, 0, sizeof(*state));
+    state->maxIdleMs = maxIdleMs;
+    state->windowStartUs = nowUs;
+}
+
+// Scan
+// ---------------------------------------------------------------------------
+void EventLoopWakeBy(EventLoopState* state, uint32_t dueMs)
+{
+    if (!state->hasDeadline || (int32_t)(dueMs - state->deadlineMs) < 0) {
+        state->hasDeadline = true;
+        state->deadlineMs = dueMs;
+    }
+}
+
+uint32_t EventLoopTakeTimeoutMs(EventLoopState* state, uint32_t nowMs)
+{
+    state->statistics.scans++;
+    uint32_t timeoutMs = state->maxIdleMs;
+    if (state->hasDeadline) {
+        int32_t remainingMs = (int32_t)(state->deadlineMs - nowMs);
+        if (remainingMs <= 0) {
+            timeoutMs = 0;
+        } else if ((uint32_t)remainingMs < timeoutMs) {
+            timeoutMs = (uint32_t)remainingMs;
+        }
+    }
+    state->hasDeadline = false;
+    return timeoutMs;
+}
+
+// Waits
+// ---------------------------------------------------------------------------
+void EventLoopRecordBusy(EventLoopState* state)
+{
+    state->statistics.busyScans++;
+}
+
+void EventLoopRecordWait(EventLoopState* state, uint32_t startUs, uint32_t endUs, uint32_t timeoutMs, bool packet)
+{
+    EventLoopStatistics* statistics = &state->statistics;
+    uint32_t waitedUs = endUs - startUs;
+    statistics->idleUs += waitedUs;
+    state->windowIdleUs += waitedUs;
+    if (packet) {
+        statistics->packetWakes++;
+        return;
+    }
+
+    statistics->deadlineWakes++;
+    uint32_t timeoutUs = timeoutMs * 1000;
+    HistogramRecord(&statistics->late, waitedUs > timeoutUs ? waitedUs - timeoutUs : 0);
+}
+
+// Statistics
+// ---------------------------------------------------------------------------
+float EventLoopTakeIdlePercent(EventLoopState* state, uint32_t nowUs)
+{
+    uint32_t elapsedUs = nowUs - state->windowStartUs;
+    float idlePercent = elapsedUs > 0 ? (float)state->windowIdleUs * 100.0f / (float)elapsedUs : 0.0f;
+    state->windowStartUs = nowUs;
+    state->windowIdleUs = 0;
+    return idlePercent > 100.0f ? 100.0f : idlePercent;
+}
@@ -0,0 +1,73 @@
+/**
+ * Event-driven scan
+ * --------------------------------------
+ * Decides how long the scan may sleep between runs of the CAS BACnet stack, and measures how the
+ * sleeping goes.
+ *
+ * Everything that has to run at a given time registers its next due time with EventLoopWakeBy()
+ * during the scan. At the end of the scan EventLoopTakeTimeoutMs() returns the time until the
+ * earliest of them, capped at the stack's timer interval (the stack has no API for its own next
+ * deadline, so it is serviced at a fixed interval), and starts collecting the next scan's deadlines.
+ * The caller then blocks on the UDP socket for at most that long.
+ *
+ * Each wait is recorded: whether a datagram or the deadline ended it, how long it lasted, and for
+ * deadline wakes how late the scan resumed (the cost of waking from light sleep, or of the
+ * scheduler). The idle share is the time spent waiting over the elapsed time.
+ *
+ * Time is passed in, nothing here blocks. The state is a plain struct owned by the caller.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "Histogram.h"
+
+#include <stdint.h>
+
+struct EventLoopStatistics {
+    uint32_t scans;
+    uint32_t busyScans; // Work was already queued, the scan ran again without waiting
+    uint32_t packetWakes;
+    uint32_t deadlineWakes;
+    uint64_t idleUs; // Time spent waiting
+    Histogram late; // How late deadline wakes resumed
+};
+
+struct EventLoopState {
+    uint32_t maxIdleMs;
+
+    bool hasDeadline;
+    uint32_t deadlineMs; // Earliest due time registered during the current scan
+
+    // Idle share since the last EventLoopTakeIdlePercent()
+    uint32_t windowStartUs;
+    uint64_t windowIdleUs;
+
+    EventLoopStatistics statistics;
+};
+
+// maxIdleMs is the longest the scan may sleep, the interval at which the stack's timers are serviced.
+void EventLoopBegin(EventLoopState* state, uint32_t maxIdleMs, uint32_t nowUs);
+
+// Scan
+// -----------------------------
+// Something is due at dueMs (millis()). Due times in the past make the next timeout 0.
+void EventLoopWakeBy(EventLoopState* state, uint32_t dueMs);
+// Time from nowMs to the earliest due time registered since the last call, at most maxIdleMs.
+// Starts collecting due times for the next scan.
+uint32_t EventLoopTakeTimeoutMs(EventLoopState* state, uint32_t nowMs);
+
+// Waits
+// -----------------------------
+// The scan did not wait because work was queued.
+void EventLoopRecordBusy(EventLoopState* state);
+// The scan waited from startUs to endUs (micros()) with the given timeout. packet is true if a
+// datagram ended the wait.
+void EventLoopRecordWait(EventLoopState* state, uint32_t startUs, uint32_t endUs, uint32_t timeoutMs, bool packet);
+
+// Statistics
+// -----------------------------
+// Share of the time spent waiting since the last call (or EventLoopBegin()), 0 to 100.
+float EventLoopTakeIdlePercent(EventLoopState* state, uint32_t nowUs);
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,41 @@
+/**
+ * Latency histogram
+ * --------------------------------------
+ * See Histogram.h
+ */
+
+#include "Histogram.h"
+
+void HistogramRecord(Histogram* histogram, uint32_t valueUs)
+{
+    uint8_t bucket = valueUs == 0 ? 0 : (uint8_t)(32 - __builtin_clz(valueUs));
+    if (bucket >= HISTOGRAM_BUCKET_COUNT) {
+        bucket = HISTOGRAM_BUCKET_COUNT - 1;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    if (valueUs > histogram->maxUs) {
+        histogram->maxUs = valueUs;
+    }
+}
+
+uint32_t HistogramPercentileUs(const Histogram* histogram, uint8_t percentile)
+{
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint32_t target = (uint32_t)(((uint64_t)histogram->count * percentile + 99) / 100);
+    uint32_t count = 0;
+    for (uint8_t bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT - 1; bucket++) {
+        count += histogram->buckets[bucket];
+        if (count >= target) {
+            return HistogramBucketLimitUs(bucket);
+        }
+    }
+    return histogram->maxUs;
+}
+
+uint32_t HistogramBucketLimitUs(uint8_t bucket)
+{
+    return bucket < HISTOGRAM_BUCKET_COUNT - 1 ? (uint32_t)1 << bucket : 0;
+}
@@ -0,0 +1,35 @@
+/**
+ * Latency histogram
+ * --------------------------------------
+ * Counts microsecond durations in power-of-two buckets: bucket 0 holds 0, bucket n holds
+ * [2^(n-1), 2^n) and the last bucket has no upper bound. Recording is a leading-zero count and an
+ * increment, so it is cheap enough for interrupt and packet paths. Percentiles are reported as the
+ * upper bound of the bucket that holds them.
+ *
+ * The histogram is a plain struct owned by the caller; zero it to start.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// The last bucket starts at 2^20 us, about a second.
+const uint8_t HISTOGRAM_BUCKET_COUNT = 22;
+
+struct Histogram {
+    uint32_t count;
+    uint32_t maxUs;
+    uint32_t buckets[HISTOGRAM_BUCKET_COUNT];
+};
+
+void HistogramRecord(Histogram* histogram, uint32_t valueUs);
+
+// Upper bound of the bucket holding the given percentile (0..100), the maximum if it is in the
+// last bucket, 0 if nothing was recorded.
+uint32_t HistogramPercentileUs(const Histogram* histogram, uint8_t percentile);
+
+// Exclusive upper bound of a bucket in microseconds, 0 for the last bucket.
+uint32_t HistogramBucketLimitUs(uint8_t bucket);
+
+#endif // HISTOGRAM_H
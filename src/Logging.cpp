@@ -0,0 +1,201 @@
+/**
+ * Logging
+ * --------------------------------------
+ * See Logging.h
+ *
+ * The record ring is a bounded multi-producer/single-consumer queue. Each slot carries a sequence
+ * number; producers claim a position with a compare-and-swap and publish the slot by advancing its
+ * sequence, the drain task is the only consumer.
+ */
+
+#include "Logging.h"
+
+#include <atomic>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#include <unistd.h>
+#endif
+
+static_assert((LOG_RECORD_CAPACITY & (LOG_RECORD_CAPACITY - 1)) == 0, "LOG_RECORD_CAPACITY must be a power of two");
+
+const uint32_t LOG_TASK_STACK_SIZE = 4096;
+const uint32_t LOG_TASK_IDLE_DELAY_MS = 10;
+const uint32_t LOG_TASK_BATCH_SIZE = 16;
+
+struct LogSlot {
+    std::atomic<uint32_t> sequence;
+    LogRecord record;
+};
+
+static LogSlot gLogSlots[LOG_RECORD_CAPACITY];
+static std::atomic<uint32_t> gLogWritePosition(0);
+static uint32_t gLogReadPosition = 0; // Only used by the drain task
+static std::atomic<uint32_t> gLogWrittenCount(0);
+static std::atomic<uint32_t> gLogDroppedCount(0);
+static uint32_t gLogReportedDroppedCount = 0; // Only used by the drain task
+static bool gLogStarted = false;
+static std::atomic<bool> gLogReady(false); // Set once the slots are initialized
+
+static void LogFormatRecord(const LogRecord& record);
+
+#ifdef ARDUINO
+static void LogTask(void* parameters)
+{
+    (void)parameters;
+    for (;;) {
+        if (LogDrain(LOG_TASK_BATCH_SIZE) == 0) {
+            vTaskDelay(pdMS_TO_TICKS(LOG_TASK_IDLE_DELAY_MS));
+        }
+    }
+}
+#else
+static void LogTask()
+{
+    for (;;) {
+        if (LogDrain(LOG_TASK_BATCH_SIZE) == 0) {
+            usleep(LOG_TASK_IDLE_DELAY_MS * 1000);
+        }
+    }
+}
+#endif
+
+bool LogBegin()
+{
+    if (gLogStarted) {
+        return true;
+    }
+
+    // Slots must be initialized before any record is written. Until gLogReady is set, records are
+    // counted as dropped without touching the ring.
+    for (uint32_t offset = 0; offset < LOG_RECORD_CAPACITY; offset++) {
+        gLogSlots[offset].sequence.store(offset, std::memory_order_relaxed);
+    }
+    gLogWritePosition.store(0, std::memory_order_relaxed);
+    gLogReadPosition = 0;
+    gLogReady.store(true, std::memory_order_release);
+
+#ifdef ARDUINO
+    // Low priority, on the protocol core (0) so it never competes with the loop task on core 1.
+    if (xTaskCreatePinnedToCore(LogTask, "log", LOG_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, NULL, 0) != pdPASS) {
+        return false;
+    }
+#else
+    std::thread(LogTask).detach();
+#endif
+    gLogStarted = true;
+    return true;
+}
+
+void LogWriteRecord(uint16_t event, uint16_t shortValue, uint32_t value0, uint32_t value1, uint32_t value2, uint32_t value3)
+{
+    if (!gLogReady.load(std::memory_order_acquire)) {
+        gLogDroppedCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint32_t position = gLogWritePosition.load(std::memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &gLogSlots[position & (LOG_RECORD_CAPACITY - 1)];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int32_t difference = (int32_t)(sequence - position);
+        if (difference == 0) {
+            if (gLogWritePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // Ring is full
+            gLogDroppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = gLogWritePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->record.timestamp = micros();
+    slot->record.event = event;
+    slot->record.shortValue = shortValue;
+    slot->record.values[0] = value0;
+    slot->record.values[1] = value1;
+    slot->record.values[2] = value2;
+    slot->record.values[3] = value3;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    gLogWrittenCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t LogDrain(uint32_t maxRecords)
+{
+    uint32_t drained = 0;
+    while (drained < maxRecords) {
+        LogSlot* slot = &gLogSlots[gLogReadPosition & (LOG_RECORD_CAPACITY - 1)];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence != gLogReadPosition + 1) {
+            break; // Empty
+        }
+        LogRecord record = slot->record;
+        slot->sequence.store(gLogReadPosition + LOG_RECORD_CAPACITY, std::memory_order_release);
+        gLogReadPosition++;
+
+        LogFormatRecord(record);
+        drained++;
+    }
+
+    uint32_t dropped = gLogDroppedCount.load(std::memory_order_relaxed);
+    if (dropped != gLogReportedDroppedCount) {
+        Serial.printf("Error: Log ring full, %u records dropped (%u total)\n", dropped - gLogReportedDroppedCount, dropped);
+        gLogReportedDroppedCount = dropped;
+    }
+    return drained;
+}
+
+uint32_t LogGetWrittenCount()
+{
+    return gLogWrittenCount.load(std::memory_order_relaxed);
+}
+
+uint32_t LogGetDroppedCount()
+{
+    return gLogDroppedCount.load(std::memory_order_relaxed);
+}
+
+// Formatting, only ever called from the drain task
+// ---------------------------------------------------------------------------
+static void LogFormatRecord(const LogRecord& record)
+{
+    const uint32_t* values = record.values;
+    switch (record.event) {
+        case LOG_EVENT_PACKET_RECEIVED:
+            Serial.printf("FYI: [%u] Recived message with %u bytes from %u.%u.%u.%u:%u\n", record.timestamp, record.shortValue, (values[0] >> 24) & 0xFF, (values[0] >> 16) & 0xFF, (values[0] >> 8) & 0xFF, values[0] & 0xFF, values[1]);
+            break;
+        case LOG_EVENT_PACKET_SENT:
+            Serial.printf("FYI: [%u] Sent %smessage with %u bytes to %u.%u.%u.%u:%u\n", record.timestamp, values[2] ? "broadcast " : "", record.shortValue, (values[0] >> 24) & 0xFF, (values[0] >> 16) & 0xFF, (values[0] >> 8) & 0xFF, values[0] & 0xFF, values[1]);
+            break;
+        case LOG_EVENT_GET_PROPERTY_CHAR_STRING:
+            Serial.printf("FYI: [%u] CallbackGetPropertyCharString deviceInstance=%u, objectType=%u, objectInstance=%u, propertyIdentifier=%u\n", record.timestamp, values[0], record.shortValue, values[1], values[2]);
+            break;
+        case LOG_EVENT_GET_PROPERTY_UINT:
+            Serial.printf("FYI: [%u] CallbackGetPropertyUInt deviceInstance=%u, objectType=%u, objectInstance=%u, propertyIdentifier=%u\n", record.timestamp, values[0], record.shortValue, values[1], values[2]);
+            break;
+        case LOG_EVENT_SET_PROPERTY_UINT:
+            Serial.printf("FYI: [%u] CallbackSetPropertyUInt deviceInstance=%u, objectType=%u, objectInstance=%u, propertyIdentifier=%u, value=%u\n", record.timestamp, values[0], record.shortValue, values[1], values[2], values[3]);
+            break;
+        case LOG_EVENT_GET_PROPERTY_REAL:
+            Serial.printf("FYI: [%u] CallbackGetPropertyReal deviceInstance=%u, objectType=%u, objectInstance=%u, propertyIdentifier=%u\n", record.timestamp, values[0], record.shortValue, values[1], values[2]);
+            break;
+        case LOG_EVENT_GET_PROPERTY_ENUMERATED:
+            Serial.printf("FYI: [%u] CallbackGetPropertyEnumerated deviceInstance=%u, objectType=%u, objectInstance=%u, propertyIdentifier=%u\n", record.timestamp, values[0], record.shortValue, values[1], values[2]);
+            break;
+        case LOG_EVENT_SEND_FAILED:
+            Serial.printf("Error: [%u] Failed to send %smessage with %u bytes to %u.%u.%u.%u:%u\n", record.timestamp, values[2] ? "broadcast " : "", record.shortValue, (values[0] >> 24) & 0xFF, (values[0] >> 16) & 0xFF, (values[0] >> 8) & 0xFF, values[0] & 0xFF, values[1]);
+            break;
+        case LOG_EVENT_RECEIVE_TOO_LARGE:
+            Serial.printf("Error: [%u] Received message with %u bytes from %u.%u.%u.%u:%u does not fit the %u byte buffer\n", record.timestamp, record.shortValue, (values[0] >> 24) & 0xFF, (values[0] >> 16) & 0xFF, (values[0] >> 8) & 0xFF, values[0] & 0xFF, values[1], values[2]);
+            break;
+        default:
+            Serial.printf("FYI: [%u] Unknown log event=%u\n", record.timestamp, record.event);
+            break;
+    }
+}
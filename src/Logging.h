@@ -0,0 +1,106 @@
+/**
+ * Logging
+ * --------------------------------------
+ * Compile-time log levels and deferred binary logging for the packet and property hot paths.
+ *
+ * LOG_ERROR() and LOG_FYI() print immediately and are intended for startup and rare events. Set
+ * LOG_LEVEL in the build flags (e.g. -D LOG_LEVEL=LOG_LEVEL_ERROR) to compile out everything above
+ * that level; disabled macros are still type checked but generate no code.
+ *
+ * Hot path events (packet RX/TX, property get/set) are written with LOG_EVENT() as fixed-size
+ * binary records into a preallocated lock-free ring buffer. A low priority task drains the ring
+ * and formats the records to Serial. When the ring is full the record is dropped and counted.
+ */
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include "NativeArduino.h"
+#endif
+
+#include <stdint.h>
+
+// Log levels
+// -----------------------------
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_FYI 2
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_FYI
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) Serial.printf("Error: " format "\n", ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...)                    \
+    do {                                          \
+        if (0) {                                  \
+            Serial.printf(format, ##__VA_ARGS__); \
+        }                                         \
+    } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_FYI
+#define LOG_FYI(format, ...) Serial.printf("FYI: " format "\n", ##__VA_ARGS__)
+#define LOG_EVENT(event, shortValue, value0, value1, value2, value3) LogWriteRecord(event, shortValue, value0, value1, value2, value3)
+#else
+#define LOG_FYI(format, ...)                      \
+    do {                                          \
+        if (0) {                                  \
+            Serial.printf(format, ##__VA_ARGS__); \
+        }                                         \
+    } while (0)
+#define LOG_EVENT(event, shortValue, value0, value1, value2, value3)           \
+    do {                                                                       \
+        if (0) {                                                               \
+            LogWriteRecord(event, shortValue, value0, value1, value2, value3); \
+        }                                                                      \
+    } while (0)
+#endif
+
+// Binary records
+// -----------------------------
+// Record events. The meaning of shortValue and values[] depends on the event.
+enum LogEvent : uint16_t {
+    LOG_EVENT_PACKET_RECEIVED = 1, // shortValue=length, values={IPv4 (big endian), port}
+    LOG_EVENT_PACKET_SENT, // shortValue=length, values={IPv4 (big endian), port, broadcast}
+    LOG_EVENT_GET_PROPERTY_CHAR_STRING, // shortValue=objectType, values={deviceInstance, objectInstance, propertyIdentifier}
+    LOG_EVENT_GET_PROPERTY_UINT, // shortValue=objectType, values={deviceInstance, objectInstance, propertyIdentifier}
+    LOG_EVENT_SET_PROPERTY_UINT, // shortValue=objectType, values={deviceInstance, objectInstance, propertyIdentifier, value}
+    LOG_EVENT_GET_PROPERTY_REAL, // shortValue=objectType, values={deviceInstance, objectInstance, propertyIdentifier}
+    LOG_EVENT_GET_PROPERTY_ENUMERATED, // shortValue=objectType, values={deviceInstance, objectInstance, propertyIdentifier}
+    LOG_EVENT_SEND_FAILED, // shortValue=length, values={IPv4 (big endian), port, broadcast}
+    LOG_EVENT_RECEIVE_TOO_LARGE // shortValue=length, values={IPv4 (big endian), port, maxMessageLength}
+};
+
+struct LogRecord {
+    uint32_t timestamp; // micros()
+    uint16_t event;
+    uint16_t shortValue;
+    uint32_t values[4];
+};
+
+// Must be a power of two.
+const uint32_t LOG_RECORD_CAPACITY = 128;
+
+// Functions
+// -----------------------------
+// Starts the task that drains the record ring to Serial.
+bool LogBegin();
+
+// Writes a record into the ring. Never blocks, safe to call from any task. Records written before
+// LogBegin() are counted as dropped.
+void LogWriteRecord(uint16_t event, uint16_t shortValue, uint32_t value0, uint32_t value1, uint32_t value2, uint32_t value3);
+
+// Formats up to maxRecords records from the ring. Returns the number of records formatted.
+uint32_t LogDrain(uint32_t maxRecords);
+
+// Counters
+uint32_t LogGetWrittenCount();
+uint32_t LogGetDroppedCount();
+
+#endif // LOGGING_H
@@ -0,0 +1,56 @@
+/**
+ * Memory telemetry
+ * --------------------------------------
+ * See MemoryTelemetry.h
+ */
+
+#include "MemoryTelemetry.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include "NativeArduino.h"
+#endif
+
+static uint32_t gMemorySubsystemBytes[MEMORY_SUBSYSTEM_COUNT] = { 0 };
+static bool gMemoryAlarm = false;
+static uint32_t gMemoryAlarmCount = 0;
+
+void MemorySetSubsystemBytes(MemorySubsystem subsystem, uint32_t bytes)
+{
+    if (subsystem < MEMORY_SUBSYSTEM_COUNT) {
+        gMemorySubsystemBytes[subsystem] = bytes;
+    }
+}
+
+uint32_t MemoryGetFreeHeap()
+{
+    return ESP.getFreeHeap();
+}
+
+bool MemorySample(MemoryStatistics* statistics)
+{
+    statistics->freeHeap = ESP.getFreeHeap();
+    statistics->minimumFreeHeap = ESP.getMinFreeHeap();
+    statistics->largestFreeBlock = ESP.getMaxAllocHeap();
+    statistics->heapSize = ESP.getHeapSize();
+    for (uint8_t subsystem = 0; subsystem < MEMORY_SUBSYSTEM_COUNT; subsystem++) {
+        statistics->subsystemBytes[subsystem] = gMemorySubsystemBytes[subsystem];
+    }
+
+    bool alarm = gMemoryAlarm;
+    if (!gMemoryAlarm) {
+        alarm = statistics->largestFreeBlock < MEMORY_ALARM_LARGEST_BLOCK_BYTES || statistics->freeHeap < MEMORY_ALARM_FREE_HEAP_BYTES;
+    } else {
+        alarm = statistics->largestFreeBlock < MEMORY_ALARM_LARGEST_BLOCK_BYTES * MEMORY_ALARM_CLEAR_PERCENT / 100 || statistics->freeHeap < MEMORY_ALARM_FREE_HEAP_BYTES * MEMORY_ALARM_CLEAR_PERCENT / 100;
+    }
+    bool changed = alarm != gMemoryAlarm;
+    if (changed && alarm) {
+        gMemoryAlarmCount++;
+    }
+    gMemoryAlarm = alarm;
+
+    statistics->alarm = gMemoryAlarm;
+    statistics->alarmCount = gMemoryAlarmCount;
+    return changed;
+}
@@ -0,0 +1,47 @@
+/**
+ * Memory telemetry
+ * --------------------------------------
+ * Samples the heap (free, minimum ever free, largest free block) and keeps the number of bytes held
+ * by each subsystem. The application publishes the samples as read-only Analog Value objects so a
+ * BMS can trend memory pressure.
+ *
+ * The alarm is raised before fragmentation starts to cost responses: when the largest free block or
+ * the free heap falls below its threshold. It clears with hysteresis once both are back above
+ * MEMORY_ALARM_CLEAR_PERCENT of their thresholds.
+ */
+
+#ifndef MEMORY_TELEMETRY_H
+#define MEMORY_TELEMETRY_H
+
+#include <stdint.h>
+
+// The CAS BACnet stack allocates its response buffers from the heap; below this a full size
+// response may no longer fit in one block.
+const uint32_t MEMORY_ALARM_LARGEST_BLOCK_BYTES = 8192;
+const uint32_t MEMORY_ALARM_FREE_HEAP_BYTES = 16384;
+const uint32_t MEMORY_ALARM_CLEAR_PERCENT = 125;
+
+enum MemorySubsystem : uint8_t {
+    MEMORY_SUBSYSTEM_BACNET_STACK, // Heap used by the CAS BACnet stack for the device and its objects
+    MEMORY_SUBSYSTEM_TRANSPORT, // Receive ring packet buffers
+    MEMORY_SUBSYSTEM_LOGGING, // Deferred log record ring
+    MEMORY_SUBSYSTEM_COUNT
+};
+
+struct MemoryStatistics {
+    uint32_t freeHeap;
+    uint32_t minimumFreeHeap;
+    uint32_t largestFreeBlock;
+    uint32_t heapSize;
+    uint32_t subsystemBytes[MEMORY_SUBSYSTEM_COUNT];
+    bool alarm;
+    uint32_t alarmCount; // Times the alarm has been raised since boot
+};
+
+void MemorySetSubsystemBytes(MemorySubsystem subsystem, uint32_t bytes);
+uint32_t MemoryGetFreeHeap();
+
+// Samples the heap and updates the alarm. Returns true if the alarm was raised or cleared.
+bool MemorySample(MemoryStatistics* statistics);
+
+#endif // MEMORY_TELEMETRY_H
@@ -0,0 +1,407 @@
+/**
+ * Host-native Arduino shim
+ * --------------------------------------
+ * See NativeArduino.h
+ */
+
+#ifndef ARDUINO
+
+#include "NativeArduino.h"
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Provided by the application (src/main.cpp)
+void setup();
+void loop();
+
+NativeSerial Serial;
+NativeESP ESP;
+NativeWiFi WiFi;
+
+// GPIO
+// ---------------------------------------------------------------------------
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    (void)pin;
+    (void)value;
+}
+
+// Time
+// ---------------------------------------------------------------------------
+static uint64_t NativeMonotonicMicros()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000ULL;
+}
+static const uint64_t gNativeBootMicros = NativeMonotonicMicros();
+
+unsigned long millis()
+{
+    return (unsigned long)((NativeMonotonicMicros() - gNativeBootMicros) / 1000ULL);
+}
+unsigned long micros()
+{
+    return (unsigned long)(NativeMonotonicMicros() - gNativeBootMicros);
+}
+void delay(unsigned long ms)
+{
+    usleep(ms * 1000);
+}
+
+// IPAddress
+// ---------------------------------------------------------------------------
+IPAddress::IPAddress()
+{
+    m_address.dword = 0;
+}
+IPAddress::IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+{
+    m_address.bytes[0] = first;
+    m_address.bytes[1] = second;
+    m_address.bytes[2] = third;
+    m_address.bytes[3] = fourth;
+}
+IPAddress::IPAddress(uint32_t address)
+{
+    m_address.dword = address;
+}
+
+// Serial
+// ---------------------------------------------------------------------------
+void NativeSerial::begin(unsigned long baud)
+{
+    (void)baud;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+}
+int NativeSerial::available()
+{
+    int c = getchar();
+    if (c == EOF) {
+        clearerr(stdin);
+        return 0;
+    }
+    ungetc(c, stdin);
+    return 1;
+}
+int NativeSerial::read()
+{
+    int c = getchar();
+    if (c == EOF) {
+        clearerr(stdin);
+        return -1;
+    }
+    return c;
+}
+size_t NativeSerial::print(const char* value)
+{
+    return fputs(value, stdout) < 0 ? 0 : strlen(value);
+}
+size_t NativeSerial::print(char value)
+{
+    return fputc(value, stdout) == EOF ? 0 : 1;
+}
+size_t NativeSerial::print(int value)
+{
+    return ::printf("%d", value);
+}
+size_t NativeSerial::print(unsigned int value)
+{
+    return ::printf("%u", value);
+}
+size_t NativeSerial::print(long value)
+{
+    return ::printf("%ld", value);
+}
+size_t NativeSerial::print(unsigned long value)
+{
+    return ::printf("%lu", value);
+}
+size_t NativeSerial::print(double value)
+{
+    return ::printf("%.2f", value);
+}
+size_t NativeSerial::print(const IPAddress& value)
+{
+    return ::printf("%u.%u.%u.%u", value[0], value[1], value[2], value[3]);
+}
+size_t NativeSerial::println()
+{
+    return print('\n');
+}
+size_t NativeSerial::printf(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vprintf(format, args);
+    va_end(args);
+    return length < 0 ? 0 : (size_t)length;
+}
+
+// ESP
+// ---------------------------------------------------------------------------
+static uint32_t gNativeMinFreeHeap = 0xFFFFFFFF;
+
+uint32_t NativeESP::getFreeHeap()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    uint32_t freeHeap = (uint32_t)info.fordblks;
+#else
+    uint32_t freeHeap = 0;
+#endif
+    if (freeHeap < gNativeMinFreeHeap) {
+        gNativeMinFreeHeap = freeHeap;
+    }
+    return freeHeap;
+}
+uint32_t NativeESP::getHeapSize()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return (uint32_t)info.arena;
+#else
+    return 0;
+#endif
+}
+uint32_t NativeESP::getMinFreeHeap()
+{
+    getFreeHeap();
+    return gNativeMinFreeHeap;
+}
+uint32_t NativeESP::getMaxAllocHeap()
+{
+    // glibc's free chunks say nothing about what the next malloc() can get, it takes more from the OS
+    return NATIVE_MAX_ALLOC_HEAP;
+}
+uint64_t NativeESP::getEfuseMac()
+{
+    return 0;
+}
+
+// WiFi
+// ---------------------------------------------------------------------------
+static uint64_t NativeEnvironmentMs(const char* name)
+{
+    const char* value = getenv(name);
+    return value != NULL ? strtoull(value, NULL, 10) : 0;
+}
+
+static uint8_t gNativeWiFiBSSID[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const int32_t NATIVE_WIFI_CHANNEL = 6;
+
+wl_status_t NativeWiFi::begin(const char* ssid, const char* passphrase, int32_t channel, const uint8_t* bssid)
+{
+    (void)ssid;
+    (void)passphrase;
+    uint64_t delayMs = NativeEnvironmentMs("NATIVE_WIFI_CONNECT_MS");
+    if (channel != NATIVE_WIFI_CHANNEL || bssid == NULL || memcmp(bssid, gNativeWiFiBSSID, sizeof(gNativeWiFiBSSID)) != 0) {
+        delayMs += NativeEnvironmentMs("NATIVE_WIFI_SCAN_MS");
+    }
+    if (!m_staticIP) {
+        delayMs += NativeEnvironmentMs("NATIVE_WIFI_DHCP_MS");
+    }
+    m_started = true;
+    m_linkUpAtUs = NativeMonotonicMicros() + delayMs * 1000ULL;
+    return WL_DISCONNECTED;
+}
+bool NativeWiFi::config(IPAddress localIP, IPAddress gateway, IPAddress subnet)
+{
+    (void)gateway;
+    (void)subnet;
+    m_staticIP = (uint32_t)localIP != 0;
+    return true;
+}
+bool NativeWiFi::disconnect()
+{
+    m_started = false;
+    return true;
+}
+bool NativeWiFi::mode(wifi_mode_t mode)
+{
+    (void)mode;
+    return true;
+}
+bool NativeWiFi::persistent(bool enable)
+{
+    (void)enable;
+    return true;
+}
+bool NativeWiFi::setAutoReconnect(bool enable)
+{
+    (void)enable;
+    return true;
+}
+wl_status_t NativeWiFi::status()
+{
+    return m_started && NativeMonotonicMicros() >= m_linkUpAtUs ? WL_CONNECTED : WL_DISCONNECTED;
+}
+uint8_t* NativeWiFi::BSSID()
+{
+    return gNativeWiFiBSSID;
+}
+int32_t NativeWiFi::channel()
+{
+    return NATIVE_WIFI_CHANNEL;
+}
+IPAddress NativeWiFi::localIP()
+{
+    return IPAddress(127, 0, 0, 1);
+}
+IPAddress NativeWiFi::subnetMask()
+{
+    // The loopback network is 127.0.0.0/8, so broadcasts go to 127.255.255.255 and reach every
+    // process bound to the BACnet port on this host.
+    return IPAddress(255, 0, 0, 0);
+}
+
+// Preferences
+// ---------------------------------------------------------------------------
+Preferences::~Preferences()
+{
+    end();
+}
+bool Preferences::begin(const char* name, bool readOnly)
+{
+    end();
+    snprintf(m_path, sizeof(m_path), "%s.nvs", name);
+    m_readOnly = readOnly;
+    m_dirty = false;
+    m_dataLength = 0;
+    FILE* file = fopen(m_path, "rb");
+    if (file != NULL) {
+        m_dataLength = fread(m_data, 1, sizeof(m_data), file);
+        fclose(file);
+    } else if (readOnly) {
+        return false; // Same as the ESP32, a read-only namespace must already exist
+    }
+    m_open = true;
+    return true;
+}
+void Preferences::end()
+{
+    if (m_open && m_dirty) {
+        FILE* file = fopen(m_path, "wb");
+        if (file != NULL) {
+            fwrite(m_data, 1, m_dataLength, file);
+            fclose(file);
+        }
+    }
+    m_open = false;
+    m_dirty = false;
+}
+bool Preferences::clear()
+{
+    if (!m_open || m_readOnly) {
+        return false;
+    }
+    m_dataLength = 0;
+    m_dirty = true;
+    return true;
+}
+bool Preferences::find(const char* key, size_t* offset, size_t* length)
+{
+    size_t keyLength = strlen(key);
+    size_t position = 0;
+    while (position + 2 <= m_dataLength) {
+        size_t recordKeyLength = m_data[position];
+        if (position + 2 + recordKeyLength > m_dataLength) {
+            break;
+        }
+        size_t recordValueLength = m_data[position + 1 + recordKeyLength];
+        if (position + 2 + recordKeyLength + recordValueLength > m_dataLength) {
+            break;
+        }
+        if (recordKeyLength == keyLength && memcmp(m_data + position + 1, key, keyLength) == 0) {
+            *offset = position;
+            *length = 2 + recordKeyLength + recordValueLength;
+            return true;
+        }
+        position += 2 + recordKeyLength + recordValueLength;
+    }
+    // A truncated or corrupt file ends at the last whole record, so putBytes() appends after it
+    m_dataLength = position;
+    return false;
+}
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength)
+{
+    size_t offset;
+    size_t length;
+    if (!m_open || !find(key, &offset, &length)) {
+        return 0;
+    }
+    size_t keyLength = m_data[offset];
+    size_t valueLength = m_data[offset + 1 + keyLength];
+    if (valueLength > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, m_data + offset + 2 + keyLength, valueLength);
+    return valueLength;
+}
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue)
+{
+    uint8_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue)
+{
+    uint32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+size_t Preferences::putBytes(const char* key, const void* value, size_t length)
+{
+    size_t keyLength = strlen(key);
+    if (!m_open || m_readOnly || keyLength > 255 || length > 255) {
+        return 0;
+    }
+    size_t offset;
+    size_t recordLength;
+    if (find(key, &offset, &recordLength)) {
+        memmove(m_data + offset, m_data + offset + recordLength, m_dataLength - offset - recordLength);
+        m_dataLength -= recordLength;
+    }
+    if (m_dataLength + 2 + keyLength + length > sizeof(m_data)) {
+        return 0;
+    }
+    uint8_t* record = m_data + m_dataLength;
+    record[0] = (uint8_t)keyLength;
+    memcpy(record + 1, key, keyLength);
+    record[1 + keyLength] = (uint8_t)length;
+    memcpy(record + 2 + keyLength, value, length);
+    m_dataLength += 2 + keyLength + length;
+    m_dirty = true;
+    return length;
+}
+size_t Preferences::putUChar(const char* key, uint8_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+size_t Preferences::putUInt(const char* key, uint32_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+// Entry point
+// ---------------------------------------------------------------------------
+#ifndef NATIVE_ARDUINO_NO_MAIN
+int main()
+{
+    setup();
+    for (;;) {
+        loop();
+    }
+    return 0;
+}
+#endif // NATIVE_ARDUINO_NO_MAIN
+
+#endif // ARDUINO
@@ -0,0 +1,177 @@
+/**
+ * Host-native Arduino shim
+ * --------------------------------------
+ * The subset of the Arduino/ESP32 API used by this example, implemented for a Linux/POSIX host.
+ * This allows the same BACnet server (src/main.cpp) to be built with the PlatformIO "native"
+ * environment and exercised over 127.0.0.1 by the load generator in tools/loadgen/.
+ *
+ * The UDP transport (src/Transport.cpp) uses the BSD socket API on both targets, so it needs no
+ * shim. WiFi simulates a link to the loopback network that comes up after a configurable delay (see
+ * NativeWiFi). Preferences are kept in a file per namespace in the working directory. GPIO calls are
+ * no-ops.
+ *
+ * Host tools that bring their own main() build with -D NATIVE_ARDUINO_NO_MAIN.
+ *
+ * Only compiled when ARDUINO is not defined.
+ */
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#ifndef ARDUINO
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// GPIO
+// -----------------------------
+#define LOW 0x0
+#define HIGH 0x1
+#define OUTPUT 0x03
+#define LED_BUILTIN 13
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+// Time
+// -----------------------------
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// IPAddress
+// -----------------------------
+class IPAddress {
+public:
+    IPAddress();
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth);
+    explicit IPAddress(uint32_t address); // Network byte order, same as the ESP32 core
+
+    operator uint32_t() const { return m_address.dword; }
+    uint8_t operator[](int index) const { return m_address.bytes[index]; }
+    uint8_t& operator[](int index) { return m_address.bytes[index]; }
+    bool operator==(const IPAddress& other) const { return m_address.dword == other.m_address.dword; }
+    bool operator!=(const IPAddress& other) const { return m_address.dword != other.m_address.dword; }
+
+private:
+    union {
+        uint8_t bytes[4];
+        uint32_t dword;
+    } m_address;
+};
+
+// Serial
+// -----------------------------
+class NativeSerial {
+public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+
+    size_t print(const char* value);
+    size_t print(char value);
+    size_t print(int value);
+    size_t print(unsigned int value);
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(double value);
+    size_t print(const IPAddress& value);
+
+    size_t println();
+    template <typename T>
+    size_t println(const T& value)
+    {
+        size_t length = print(value);
+        return length + println();
+    }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+extern NativeSerial Serial;
+
+// ESP
+// -----------------------------
+const uint32_t NATIVE_MAX_ALLOC_HEAP = 0x40000000; // 1 GB
+class NativeESP {
+public:
+    uint32_t getFreeHeap();
+    uint32_t getHeapSize();
+    uint32_t getMinFreeHeap(); // Lowest getFreeHeap() seen so far
+    uint32_t getMaxAllocHeap(); // NATIVE_MAX_ALLOC_HEAP: the host heap grows on demand, so the largest block alarm never fires
+    uint64_t getEfuseMac();
+};
+extern NativeESP ESP;
+
+// WiFi
+// -----------------------------
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1
+} wifi_mode_t;
+
+// Simulated link to the loopback network. The link comes up NATIVE_WIFI_CONNECT_MS after begin(),
+// plus NATIVE_WIFI_SCAN_MS when no BSSID and channel are given and NATIVE_WIFI_DHCP_MS when no
+// static IP was configured (milliseconds, environment variables, all 0 by default). The simulated
+// access point is always found on the same BSSID and channel.
+class NativeWiFi {
+public:
+    wl_status_t begin(const char* ssid, const char* passphrase, int32_t channel = 0, const uint8_t* bssid = NULL);
+    bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet); // Only affects the simulated DHCP delay
+    bool disconnect();
+    bool mode(wifi_mode_t mode);
+    bool persistent(bool enable);
+    bool setAutoReconnect(bool enable);
+    wl_status_t status();
+    uint8_t* BSSID();
+    int32_t channel();
+    IPAddress localIP();
+    IPAddress subnetMask();
+
+private:
+    bool m_started = false;
+    bool m_staticIP = false;
+    uint64_t m_linkUpAtUs = 0;
+};
+extern NativeWiFi WiFi;
+
+// Preferences
+// -----------------------------
+// The subset of the ESP32 Preferences (NVS) API used by this example. Each namespace is kept in the
+// file "<namespace>.nvs" in the working directory and written back by end().
+class Preferences {
+public:
+    ~Preferences();
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+    bool clear();
+
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t putBytes(const char* key, const void* value, size_t length);
+    size_t putUChar(const char* key, uint8_t value);
+    size_t putUInt(const char* key, uint32_t value);
+
+private:
+    bool find(const char* key, size_t* offset, size_t* length);
+
+    bool m_open = false;
+    bool m_readOnly = true;
+    bool m_dirty = false;
+    char m_path[64];
+    // Records of: key length, key, value length, value
+    uint8_t m_data[512];
+    size_t m_dataLength = 0;
+};
+
+#endif // ARDUINO
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,177 @@
+/**
+ * Network bring-up
+ * --------------------------------------
+ * See Network.h
+ */
+
+#include "Network.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#else
+#include "NativeArduino.h"
+#endif
+
+#include <string.h>
+
+static const char NETWORK_NVS_NAMESPACE[] = "network";
+static const char NETWORK_NVS_KEY_BSSID[] = "bssid";
+static const char NETWORK_NVS_KEY_CHANNEL[] = "channel";
+static const char NETWORK_NVS_KEY_STATIC_IP[] = "ip";
+static const char NETWORK_NVS_KEY_GATEWAY[] = "gateway";
+static const char NETWORK_NVS_KEY_SUBNET_MASK[] = "subnet";
+
+// Settings
+// ---------------------------------------------------------------------------
+static void NetworkLoadSettings(NetworkState* state)
+{
+    Preferences preferences;
+    if (!preferences.begin(NETWORK_NVS_NAMESPACE, true)) {
+        return; // Nothing saved yet
+    }
+    state->channel = preferences.getUChar(NETWORK_NVS_KEY_CHANNEL, 0);
+    state->hasAccessPoint = state->channel != 0 && preferences.getBytes(NETWORK_NVS_KEY_BSSID, state->bssid, NETWORK_BSSID_LENGTH) == NETWORK_BSSID_LENGTH;
+    state->staticIP = preferences.getUInt(NETWORK_NVS_KEY_STATIC_IP, 0);
+    state->gateway = preferences.getUInt(NETWORK_NVS_KEY_GATEWAY, 0);
+    state->subnetMask = preferences.getUInt(NETWORK_NVS_KEY_SUBNET_MASK, 0);
+    preferences.end();
+}
+
+// Remembers the access point of the current connection. Only writes to flash when it changed.
+static void NetworkSaveAccessPoint(NetworkState* state)
+{
+    const uint8_t* bssid = WiFi.BSSID();
+    int32_t channel = WiFi.channel();
+    if (bssid == NULL || channel <= 0 || channel > 255) {
+        return;
+    }
+    if (state->hasAccessPoint && state->channel == (uint8_t)channel && memcmp(state->bssid, bssid, NETWORK_BSSID_LENGTH) == 0) {
+        return;
+    }
+
+    memcpy(state->bssid, bssid, NETWORK_BSSID_LENGTH);
+    state->channel = (uint8_t)channel;
+    state->hasAccessPoint = true;
+
+    Preferences preferences;
+    if (!preferences.begin(NETWORK_NVS_NAMESPACE, false)) {
+        return;
+    }
+    preferences.putBytes(NETWORK_NVS_KEY_BSSID, state->bssid, NETWORK_BSSID_LENGTH);
+    preferences.putUChar(NETWORK_NVS_KEY_CHANNEL, state->channel);
+    preferences.end();
+}
+
+void NetworkSaveStaticIP(NetworkState* state, uint32_t ip, uint32_t gateway, uint32_t subnetMask)
+{
+    state->staticIP = ip;
+    state->gateway = gateway;
+    state->subnetMask = subnetMask;
+
+    Preferences preferences;
+    if (!preferences.begin(NETWORK_NVS_NAMESPACE, false)) {
+        return;
+    }
+    if (preferences.getUInt(NETWORK_NVS_KEY_STATIC_IP, 0) == ip && preferences.getUInt(NETWORK_NVS_KEY_GATEWAY, 0) == gateway && preferences.getUInt(NETWORK_NVS_KEY_SUBNET_MASK, 0) == subnetMask) {
+        preferences.end();
+        return;
+    }
+    preferences.putUInt(NETWORK_NVS_KEY_STATIC_IP, ip);
+    preferences.putUInt(NETWORK_NVS_KEY_GATEWAY, gateway);
+    preferences.putUInt(NETWORK_NVS_KEY_SUBNET_MASK, subnetMask);
+    preferences.end();
+}
+
+void NetworkClearSettings(NetworkState* state)
+{
+    state->hasAccessPoint = false;
+    state->channel = 0;
+    state->staticIP = 0;
+    state->gateway = 0;
+    state->subnetMask = 0;
+    WiFi.config(IPAddress(), IPAddress(), IPAddress()); // 0.0.0.0 (INADDR_NONE) restarts the DHCP client
+
+    Preferences preferences;
+    if (!preferences.begin(NETWORK_NVS_NAMESPACE, false)) {
+        return;
+    }
+    preferences.clear();
+    preferences.end();
+}
+
+// Connect
+// ---------------------------------------------------------------------------
+static void NetworkConnect(NetworkState* state, uint32_t nowMs, bool useCache)
+{
+    state->phase = NETWORK_PHASE_CONNECTING;
+    state->attemptStartMs = nowMs;
+    state->usingCache = useCache && state->hasAccessPoint;
+    state->statistics.connectAttempts++;
+
+    // An all-zero address selects DHCP, in case a static address was configured earlier in this run
+    WiFi.config(IPAddress(state->staticIP), IPAddress(state->gateway), IPAddress(state->subnetMask));
+    if (state->usingCache) {
+        state->statistics.cachedConnectAttempts++;
+        WiFi.begin(state->ssid, state->password, state->channel, state->bssid);
+    } else {
+        WiFi.begin(state->ssid, state->password);
+    }
+}
+
+void NetworkBegin(NetworkState* state, const char* ssid, const char* password, uint32_t nowMs)
+{
+    memset(state, 0, sizeof(*state));
+    state->ssid = ssid;
+    state->password = password;
+
+    // The WiFi driver's own flash copy of the settings and its reconnect are not used, the state
+    // machine below does both.
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+
+    NetworkLoadSettings(state);
+    NetworkConnect(state, nowMs, true);
+}
+
+NetworkEvent NetworkPoll(NetworkState* state, uint32_t nowMs)
+{
+    bool linkUp = WiFi.status() == WL_CONNECTED;
+    switch (state->phase) {
+        case NETWORK_PHASE_CONNECTING: {
+            if (linkUp) {
+                state->phase = NETWORK_PHASE_CONNECTED;
+                state->statistics.lastConnectMs = nowMs - state->attemptStartMs;
+                NetworkSaveAccessPoint(state);
+                return NETWORK_EVENT_LINK_UP;
+            }
+            uint32_t elapsedMs = nowMs - state->attemptStartMs;
+            if (state->usingCache && elapsedMs >= NETWORK_CACHED_CONNECT_TIMEOUT_MS) {
+                // The access point moved or changed channel, scan for it
+                state->statistics.cachedConnectFailures++;
+                WiFi.disconnect();
+                NetworkConnect(state, nowMs, false);
+            } else if (elapsedMs >= NETWORK_CONNECT_TIMEOUT_MS) {
+                WiFi.disconnect();
+                NetworkConnect(state, nowMs, true);
+            }
+            return NETWORK_EVENT_NONE;
+        }
+        case NETWORK_PHASE_CONNECTED:
+            if (!linkUp) {
+                state->statistics.linkLosses++;
+                NetworkConnect(state, nowMs, true);
+                return NETWORK_EVENT_LINK_DOWN;
+            }
+            return NETWORK_EVENT_NONE;
+        default:
+            return NETWORK_EVENT_NONE;
+    }
+}
+
+bool NetworkIsConnected(const NetworkState* state)
+{
+    return state->phase == NETWORK_PHASE_CONNECTED;
+}
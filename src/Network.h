@@ -0,0 +1,79 @@
+/**
+ * Network bring-up
+ * --------------------------------------
+ * Brings the WiFi link up in the background, so the BACnet device can be created at power on and
+ * start answering as soon as the link appears instead of after a blocking connect.
+ *
+ * NetworkPoll() is called once per scan and never blocks. It reports the link coming up and going
+ * down; the caller binds the UDP port and announces the device on NETWORK_EVENT_LINK_UP.
+ *
+ * To shorten the connect, the access point (BSSID and channel) of the last successful connection is
+ * kept in NVS and the next connect goes straight to it, skipping the scan. If that access point does
+ * not answer within NETWORK_CACHED_CONNECT_TIMEOUT_MS a normal connect with a scan follows. An
+ * optional static IP address, also kept in NVS, skips DHCP.
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <stdint.h>
+
+const uint32_t NETWORK_CACHED_CONNECT_TIMEOUT_MS = 3000; // Fall back to a scan after this long
+const uint32_t NETWORK_CONNECT_TIMEOUT_MS = 15000; // Restart a connect that has not finished after this long
+const uint8_t NETWORK_BSSID_LENGTH = 6;
+
+enum NetworkPhase : uint8_t {
+    NETWORK_PHASE_IDLE,
+    NETWORK_PHASE_CONNECTING,
+    NETWORK_PHASE_CONNECTED
+};
+
+enum NetworkEvent : uint8_t {
+    NETWORK_EVENT_NONE,
+    NETWORK_EVENT_LINK_UP,
+    NETWORK_EVENT_LINK_DOWN
+};
+
+struct NetworkStatistics {
+    uint32_t connectAttempts;
+    uint32_t cachedConnectAttempts; // Attempts that went straight to the cached access point
+    uint32_t cachedConnectFailures; // Cached access point did not answer, fell back to a scan
+    uint32_t linkLosses;
+    uint32_t lastConnectMs; // Time from the start of the attempt to the link coming up
+};
+
+struct NetworkState {
+    const char* ssid;
+    const char* password;
+
+    NetworkPhase phase;
+    bool usingCache; // The current attempt skipped the scan
+    uint32_t attemptStartMs;
+
+    // Settings kept in NVS
+    bool hasAccessPoint;
+    uint8_t bssid[NETWORK_BSSID_LENGTH];
+    uint8_t channel;
+    uint32_t staticIP; // IPv4 in network byte order, 0 for DHCP
+    uint32_t gateway;
+    uint32_t subnetMask;
+
+    NetworkStatistics statistics;
+};
+
+// Loads the settings from NVS and starts the first connect. Returns immediately.
+void NetworkBegin(NetworkState* state, const char* ssid, const char* password, uint32_t nowMs);
+
+// Advances the bring-up. Returns an event when the link came up or went down.
+NetworkEvent NetworkPoll(NetworkState* state, uint32_t nowMs);
+
+bool NetworkIsConnected(const NetworkState* state);
+
+// Static IP settings, addresses in network byte order. Used from the next connect on; call before
+// NetworkBegin() to use them for the first. Only writes to flash when they changed.
+void NetworkSaveStaticIP(NetworkState* state, uint32_t ip, uint32_t gateway, uint32_t subnetMask);
+// Forgets the cached access point and the static IP, and switches the link back to DHCP at once.
+// The next connect scans.
+void NetworkClearSettings(NetworkState* state);
+
+#endif // NETWORK_H
@@ -0,0 +1,197 @@
+/**
+ * Output driver
+ * --------------------------------------
+ * See OutputDriver.h
+ *
+ * The channel table is shared between the point store's writer task, which changes modes, and the
+ * output timer, which toggles the blinking pins. Both hold the output lock while they touch it.
+ */
+
+#include "OutputDriver.h"
+
+#include "OutputHal.h"
+
+#include <stddef.h>
+#include <string.h>
+
+struct OutputChannel {
+    uint16_t point;
+    uint8_t pin;
+    OutputMode mode;
+    bool level;
+    uint8_t modeCount;
+    const OutputMode* modes;
+    uint32_t halfPeriodUs;
+    uint64_t nextEdgeUs; // Deadline of the next toggle while blinking
+};
+
+static OutputChannel gOutputChannels[OUTPUT_DRIVER_MAX_CHANNELS];
+static uint8_t gOutputChannelCount = 0;
+static OutputStatistics gOutputStatistics;
+
+// Helpers, called with the output lock held
+// ---------------------------------------------------------------------------
+static void OutputDriverWrite(OutputChannel* channel, bool level)
+{
+    channel->level = level;
+    OutputHalWrite(channel->pin, level);
+}
+
+// Arms the timer for the earliest edge of any blinking channel
+static void OutputDriverScheduleNextEdge()
+{
+    const OutputChannel* earliest = NULL;
+    for (uint8_t offset = 0; offset < gOutputChannelCount; offset++) {
+        const OutputChannel* channel = &gOutputChannels[offset];
+        if (channel->mode == OUTPUT_MODE_BLINK && (earliest == NULL || channel->nextEdgeUs < earliest->nextEdgeUs)) {
+            earliest = channel;
+        }
+    }
+    if (earliest != NULL) {
+        OutputHalSchedule(earliest->nextEdgeUs);
+    } else {
+        OutputHalCancel();
+    }
+}
+
+static void OutputDriverRecordJitter(uint64_t lateUs)
+{
+    uint32_t jitterUs = lateUs > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)lateUs;
+    gOutputStatistics.edges++;
+    gOutputStatistics.jitterTotalUs += jitterUs;
+    HistogramRecord(&gOutputStatistics.jitter, jitterUs);
+}
+
+static void OutputDriverSetMode(OutputChannel* channel, OutputMode mode)
+{
+    if (mode == channel->mode) {
+        return;
+    }
+    channel->mode = mode;
+    gOutputStatistics.modeChanges++;
+    switch (mode) {
+        case OUTPUT_MODE_ON:
+            OutputDriverWrite(channel, true);
+            break;
+        case OUTPUT_MODE_BLINK:
+            // Start with the output on, the first toggle is half a period from now
+            OutputDriverWrite(channel, true);
+            channel->nextEdgeUs = OutputHalNowUs() + channel->halfPeriodUs;
+            break;
+        default:
+            OutputDriverWrite(channel, false);
+            break;
+    }
+    OutputDriverScheduleNextEdge();
+}
+
+static OutputMode OutputDriverModeForValue(const OutputChannel* channel, uint32_t value)
+{
+    return value < channel->modeCount ? channel->modes[value] : OUTPUT_MODE_OFF;
+}
+
+// Timer
+// ---------------------------------------------------------------------------
+static void OutputDriverOnTimer(uint64_t nowUs)
+{
+    OutputHalLock();
+    for (uint8_t offset = 0; offset < gOutputChannelCount; offset++) {
+        OutputChannel* channel = &gOutputChannels[offset];
+        if (channel->mode != OUTPUT_MODE_BLINK || channel->nextEdgeUs > nowUs) {
+            continue;
+        }
+        uint64_t lateUs = nowUs - channel->nextEdgeUs;
+        OutputDriverRecordJitter(lateUs);
+        OutputDriverWrite(channel, !channel->level);
+        if (lateUs >= 2 * (uint64_t)channel->halfPeriodUs) {
+            // Missed a whole period, do not try to catch up with a burst of edges
+            gOutputStatistics.restarts++;
+            channel->nextEdgeUs = nowUs + channel->halfPeriodUs;
+        } else {
+            channel->nextEdgeUs += channel->halfPeriodUs;
+        }
+    }
+    OutputDriverScheduleNextEdge();
+    OutputHalUnlock();
+}
+
+// Setup
+// ---------------------------------------------------------------------------
+bool OutputDriverBegin()
+{
+    gOutputChannelCount = 0;
+    memset(&gOutputStatistics, 0, sizeof(gOutputStatistics));
+    return OutputHalBegin(OutputDriverOnTimer);
+}
+
+uint8_t OutputDriverAdd(uint16_t point, uint8_t pin, uint32_t blinkPeriodMs, const OutputMode* modes, uint8_t modeCount)
+{
+    if (gOutputChannelCount >= OUTPUT_DRIVER_MAX_CHANNELS || point == POINT_INVALID || blinkPeriodMs == 0) {
+        return OUTPUT_INVALID;
+    }
+    OutputHalConfigurePin(pin);
+
+    OutputHalLock();
+    uint8_t offset = gOutputChannelCount;
+    OutputChannel* channel = &gOutputChannels[offset];
+    channel->point = point;
+    channel->pin = pin;
+    channel->mode = OUTPUT_MODE_OFF;
+    channel->modeCount = modeCount;
+    channel->modes = modes;
+    channel->halfPeriodUs = blinkPeriodMs * 1000 / 2;
+    channel->nextEdgeUs = 0;
+    OutputDriverWrite(channel, false);
+    gOutputChannelCount++;
+    gOutputStatistics.channelCount = gOutputChannelCount;
+    OutputDriverSetMode(channel, OutputDriverModeForValue(channel, PointStoreGetUnsigned(point)));
+    OutputHalUnlock();
+    return offset;
+}
+
+// Mode changes
+// ---------------------------------------------------------------------------
+void OutputDriverApplyChanges(const PointChangeSet* changes)
+{
+    for (uint8_t offset = 0; offset < gOutputChannelCount; offset++) {
+        OutputChannel* channel = &gOutputChannels[offset];
+        if (!PointChangeSetContains(changes, channel->point)) {
+            continue;
+        }
+        OutputMode mode = OutputDriverModeForValue(channel, PointStoreGetUnsigned(channel->point));
+        OutputHalLock();
+        OutputDriverSetMode(channel, mode);
+        OutputHalUnlock();
+    }
+}
+
+OutputMode OutputDriverGetMode(uint8_t channel)
+{
+    if (channel >= gOutputChannelCount) {
+        return OUTPUT_MODE_OFF;
+    }
+    OutputHalLock();
+    OutputMode mode = gOutputChannels[channel].mode;
+    OutputHalUnlock();
+    return mode;
+}
+
+bool OutputDriverGetLevel(uint8_t channel)
+{
+    if (channel >= gOutputChannelCount) {
+        return false;
+    }
+    OutputHalLock();
+    bool level = gOutputChannels[channel].level;
+    OutputHalUnlock();
+    return level;
+}
+
+// Statistics
+// ---------------------------------------------------------------------------
+void OutputDriverGetStatistics(OutputStatistics* statistics)
+{
+    OutputHalLock();
+    *statistics = gOutputStatistics;
+    OutputHalUnlock();
+}
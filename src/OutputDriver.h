@@ -0,0 +1,59 @@
+/**
+ * Output driver
+ * --------------------------------------
+ * Drives digital outputs from points in the point store, so the BACnet scan no longer has to poll
+ * them. Each output channel is bound to a point and a pin; the point's present value selects the
+ * channel's mode (off, on or blinking) through a table given when the channel is added.
+ *
+ * Mode changes are applied once per scan from the point store's change set, on the point store's
+ * writer task. Blinking is timed by the output timer (see OutputHal.h): the timer is armed for the
+ * next edge of any blinking channel, toggles the pins that are due and re-arms itself, so edges do
+ * not depend on how long the stack's scan takes and nothing runs between edges.
+ *
+ * How late each edge fires compared to its deadline is measured and kept in a histogram.
+ */
+
+#ifndef OUTPUT_DRIVER_H
+#define OUTPUT_DRIVER_H
+
+#include "Histogram.h"
+#include "PointStore.h"
+
+#include <stdint.h>
+
+const uint8_t OUTPUT_DRIVER_MAX_CHANNELS = 4;
+const uint8_t OUTPUT_INVALID = 0xFF;
+
+enum OutputMode : uint8_t {
+    OUTPUT_MODE_OFF,
+    OUTPUT_MODE_ON,
+    OUTPUT_MODE_BLINK
+};
+
+struct OutputStatistics {
+    uint32_t channelCount;
+    uint32_t modeChanges;
+    uint32_t edges; // Timed edges of blinking channels
+    uint32_t restarts; // Edges more than a blink period late; the blink restarted from the late edge
+    uint64_t jitterTotalUs;
+    Histogram jitter;
+};
+
+bool OutputDriverBegin();
+
+// Binds a pin to a point. modes[value] is the mode for each present value of the point, values
+// outside the table turn the output off. The current value is applied at once. Returns the channel,
+// or OUTPUT_INVALID if every channel is in use.
+uint8_t OutputDriverAdd(uint16_t point, uint8_t pin, uint32_t blinkPeriodMs, const OutputMode* modes, uint8_t modeCount);
+
+// Applies the present value of every channel whose point is in changes. Must be called from the
+// point store's writer task.
+void OutputDriverApplyChanges(const PointChangeSet* changes);
+
+OutputMode OutputDriverGetMode(uint8_t channel);
+// Level last written to the pin
+bool OutputDriverGetLevel(uint8_t channel);
+
+void OutputDriverGetStatistics(OutputStatistics* statistics);
+
+#endif // OUTPUT_DRIVER_H
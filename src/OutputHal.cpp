@@ -0,0 +1,180 @@
+/**
+ * Output hardware abstraction
+ * --------------------------------------
+ * See OutputHal.h
+ */
+
+#include "OutputHal.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#include <stddef.h>
+
+static OutputHalTimerFunction gOutputHalOnTimer = NULL;
+
+#ifdef ARDUINO
+// ESP32
+// ---------------------------------------------------------------------------
+static esp_timer_handle_t gOutputHalTimer = NULL;
+static SemaphoreHandle_t gOutputHalLock = NULL;
+
+static void OutputHalTimerCallback(void* argument)
+{
+    (void)argument;
+    gOutputHalOnTimer((uint64_t)esp_timer_get_time());
+}
+
+bool OutputHalBegin(OutputHalTimerFunction onTimer)
+{
+    gOutputHalOnTimer = onTimer;
+    gOutputHalLock = xSemaphoreCreateMutex();
+    if (gOutputHalLock == NULL) {
+        return false;
+    }
+    esp_timer_create_args_t arguments = {};
+    arguments.callback = OutputHalTimerCallback;
+    arguments.name = "output";
+    return esp_timer_create(&arguments, &gOutputHalTimer) == ESP_OK;
+}
+
+void OutputHalConfigurePin(uint8_t pin)
+{
+    pinMode(pin, OUTPUT);
+}
+
+void OutputHalWrite(uint8_t pin, bool high)
+{
+    digitalWrite(pin, high ? HIGH : LOW);
+}
+
+uint64_t OutputHalNowUs()
+{
+    return (uint64_t)esp_timer_get_time();
+}
+
+void OutputHalSchedule(uint64_t deadlineUs)
+{
+    esp_timer_stop(gOutputHalTimer); // Fails harmlessly when nothing is pending
+    uint64_t nowUs = OutputHalNowUs();
+    esp_timer_start_once(gOutputHalTimer, deadlineUs > nowUs ? deadlineUs - nowUs : 1);
+}
+
+void OutputHalCancel()
+{
+    esp_timer_stop(gOutputHalTimer);
+}
+
+void OutputHalLock()
+{
+    xSemaphoreTake(gOutputHalLock, portMAX_DELAY);
+}
+
+void OutputHalUnlock()
+{
+    xSemaphoreGive(gOutputHalLock);
+}
+
+#else
+// Host mock
+// ---------------------------------------------------------------------------
+static const uint32_t OUTPUT_HAL_MOCK_PIN_COUNT = 256;
+
+// Allocated once and never freed: the timer thread is detached and still waits on them when the
+// process exits, and destroying a condition variable with a waiter blocks.
+static std::mutex* gOutputHalLock = new std::mutex();
+static std::mutex* gOutputHalTimerMutex = new std::mutex();
+static std::condition_variable* gOutputHalTimerCondition = new std::condition_variable();
+static bool gOutputHalScheduled = false;
+static uint64_t gOutputHalDeadlineUs = 0;
+static std::atomic<bool> gOutputHalLevels[OUTPUT_HAL_MOCK_PIN_COUNT];
+static std::atomic<uint32_t> gOutputHalEdges[OUTPUT_HAL_MOCK_PIN_COUNT];
+
+// Stands in for the hardware timer: sleeps until the deadline, then calls the driver
+static void OutputHalTimerThread()
+{
+    std::unique_lock<std::mutex> lock(*gOutputHalTimerMutex);
+    for (;;) {
+        if (!gOutputHalScheduled) {
+            gOutputHalTimerCondition->wait(lock);
+            continue;
+        }
+        if (OutputHalNowUs() < gOutputHalDeadlineUs) {
+            gOutputHalTimerCondition->wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::microseconds(gOutputHalDeadlineUs)));
+            continue;
+        }
+        gOutputHalScheduled = false;
+        lock.unlock();
+        gOutputHalOnTimer(OutputHalNowUs());
+        lock.lock();
+    }
+}
+
+bool OutputHalBegin(OutputHalTimerFunction onTimer)
+{
+    gOutputHalOnTimer = onTimer;
+    std::thread(OutputHalTimerThread).detach();
+    return true;
+}
+
+void OutputHalConfigurePin(uint8_t pin)
+{
+    (void)pin;
+}
+
+void OutputHalWrite(uint8_t pin, bool high)
+{
+    if (gOutputHalLevels[pin].exchange(high) != high) {
+        gOutputHalEdges[pin]++;
+    }
+}
+
+uint64_t OutputHalNowUs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void OutputHalSchedule(uint64_t deadlineUs)
+{
+    std::lock_guard<std::mutex> lock(*gOutputHalTimerMutex);
+    gOutputHalScheduled = true;
+    gOutputHalDeadlineUs = deadlineUs;
+    gOutputHalTimerCondition->notify_one();
+}
+
+void OutputHalCancel()
+{
+    std::lock_guard<std::mutex> lock(*gOutputHalTimerMutex);
+    gOutputHalScheduled = false;
+}
+
+void OutputHalLock()
+{
+    gOutputHalLock->lock();
+}
+
+void OutputHalUnlock()
+{
+    gOutputHalLock->unlock();
+}
+
+bool OutputHalMockGetLevel(uint8_t pin)
+{
+    return gOutputHalLevels[pin];
+}
+
+uint32_t OutputHalMockGetEdgeCount(uint8_t pin)
+{
+    return gOutputHalEdges[pin];
+}
+#endif
@@ -0,0 +1,48 @@
+/**
+ * Output hardware abstraction
+ * --------------------------------------
+ * The few hardware services the output driver (OutputDriver.h) needs: GPIO outputs, a microsecond
+ * clock and one one-shot timer that calls back at a deadline.
+ *
+ * On the ESP32 the timer is an esp_timer, which is backed by a hardware timer and runs its
+ * callbacks from the high priority esp_timer task, independent of the tasks that run the BACnet
+ * stack. On the host the timer is a thread that sleeps until the deadline, and the pin levels and
+ * edges are recorded instead of driven, so the driver's scheduling can be exercised and measured
+ * without hardware.
+ */
+
+#ifndef OUTPUT_HAL_H
+#define OUTPUT_HAL_H
+
+#include <stdint.h>
+
+// Called from the timer when the deadline passed. nowUs is OutputHalNowUs() at the call.
+typedef void (*OutputHalTimerFunction)(uint64_t nowUs);
+
+bool OutputHalBegin(OutputHalTimerFunction onTimer);
+
+// GPIO
+// -----------------------------
+void OutputHalConfigurePin(uint8_t pin);
+void OutputHalWrite(uint8_t pin, bool high);
+
+// Timer
+// -----------------------------
+uint64_t OutputHalNowUs();
+// Calls onTimer once at deadlineUs (at once if it already passed), replacing any pending deadline.
+void OutputHalSchedule(uint64_t deadlineUs);
+void OutputHalCancel();
+
+// Serializes the driver's state between the timer and the caller's task. Not recursive.
+void OutputHalLock();
+void OutputHalUnlock();
+
+#ifndef ARDUINO
+// Host mock
+// -----------------------------
+// Level written last and number of level changes of a pin.
+bool OutputHalMockGetLevel(uint8_t pin);
+uint32_t OutputHalMockGetEdgeCount(uint8_t pin);
+#endif
+
+#endif // OUTPUT_HAL_H
@@ -0,0 +1,62 @@
+/**
+ * Packet ring
+ * --------------------------------------
+ * See PacketRing.h
+ */
+
+#include "PacketRing.h"
+
+#include <stddef.h>
+
+bool PacketRingBegin(PacketRing* ring, PacketSlot* slots, uint32_t capacity)
+{
+    if (ring == NULL || slots == NULL || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+    ring->slots = slots;
+    ring->capacity = capacity;
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->highWaterMark = 0;
+    return true;
+}
+
+PacketSlot* PacketRingAcquireWrite(PacketRing* ring)
+{
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    uint32_t tail = ring->tail.load(std::memory_order_acquire);
+    if (head - tail >= ring->capacity) {
+        return NULL;
+    }
+    return &ring->slots[head & (ring->capacity - 1)];
+}
+
+void PacketRingCommitWrite(PacketRing* ring)
+{
+    uint32_t head = ring->head.load(std::memory_order_relaxed) + 1;
+    ring->head.store(head, std::memory_order_release);
+
+    uint32_t depth = head - ring->tail.load(std::memory_order_relaxed);
+    if (depth > ring->highWaterMark) {
+        ring->highWaterMark = depth;
+    }
+}
+
+PacketSlot* PacketRingPeekRead(PacketRing* ring)
+{
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail == ring->head.load(std::memory_order_acquire)) {
+        return NULL;
+    }
+    return &ring->slots[tail & (ring->capacity - 1)];
+}
+
+void PacketRingReleaseRead(PacketRing* ring)
+{
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint32_t PacketRingDepth(const PacketRing* ring)
+{
+    return ring->head.load(std::memory_order_acquire) - ring->tail.load(std::memory_order_acquire);
+}
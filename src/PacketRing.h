@@ -0,0 +1,50 @@
+/**
+ * Packet ring
+ * --------------------------------------
+ * A fixed-capacity single-producer/single-consumer ring of preallocated datagram buffers. The
+ * producer fills a slot in place and commits it, the consumer reads the slot in place and releases
+ * it; no memory is allocated after PacketRingBegin().
+ *
+ * Head and tail are atomics so the producer and consumer can run in different tasks.
+ */
+
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Largest BACnet/IP datagram (BVLC + NPDU + 1476 byte APDU) rounded up to the Ethernet MTU.
+const uint16_t PACKET_MAX_LENGTH = 1500;
+const uint8_t PACKET_ADDRESS_LENGTH = 6; // BACnet/IP connection string, IPv4 address + UDP port (big endian)
+
+struct PacketSlot {
+    uint16_t length;
+    uint8_t address[PACKET_ADDRESS_LENGTH];
+    uint32_t timestamp; // micros() when the datagram was received or queued
+    uint8_t data[PACKET_MAX_LENGTH];
+};
+
+struct PacketRing {
+    PacketSlot* slots;
+    uint32_t capacity; // Power of two
+    std::atomic<uint32_t> head; // Next slot to write, only changed by the producer
+    std::atomic<uint32_t> tail; // Next slot to read, only changed by the consumer
+
+    // Statistics, only changed by the producer
+    uint32_t highWaterMark;
+};
+
+bool PacketRingBegin(PacketRing* ring, PacketSlot* slots, uint32_t capacity);
+
+// Producer. Returns NULL if the ring is full.
+PacketSlot* PacketRingAcquireWrite(PacketRing* ring);
+void PacketRingCommitWrite(PacketRing* ring);
+
+// Consumer. Returns NULL if the ring is empty.
+PacketSlot* PacketRingPeekRead(PacketRing* ring);
+void PacketRingReleaseRead(PacketRing* ring);
+
+uint32_t PacketRingDepth(const PacketRing* ring);
+
+#endif // PACKET_RING_H
@@ -0,0 +1,41 @@
+/**
+ * Point list
+ * --------------------------------------
+ * See PointList.h
+ */
+
+#include "PointList.h"
+
+#include <string.h>
+
+const PointGroup* PointListFind(const PointGroup* groups, uint16_t groupCount, uint16_t objectType, uint32_t objectInstance)
+{
+    for (uint16_t offset = 0; offset < groupCount; offset++) {
+        const PointGroup* group = &groups[offset];
+        if (group->objectType == objectType && objectInstance >= group->firstInstance && objectInstance - group->firstInstance < group->count) {
+            return group;
+        }
+    }
+    return NULL;
+}
+
+uint32_t PointListFormatName(const PointGroup* group, uint32_t objectInstance, char* value, uint32_t maxLength)
+{
+    uint32_t length = group->name.length < maxLength ? group->name.length : maxLength;
+    memcpy(value, group->name.value, length);
+    if (group->count == 1) {
+        return length;
+    }
+
+    // Append the instance in decimal
+    char digits[10];
+    uint32_t digitCount = 0;
+    do {
+        digits[digitCount++] = (char)('0' + objectInstance % 10);
+        objectInstance /= 10;
+    } while (objectInstance > 0);
+    while (digitCount > 0 && length < maxLength) {
+        value[length++] = digits[--digitCount];
+    }
+    return length;
+}
@@ -0,0 +1,77 @@
+/**
+ * Point list
+ * --------------------------------------
+ * A declarative, compile-time list of the application's BACnet points. Each entry is a group of
+ * consecutive object instances of one type that share a name, flags, an initial value and, for
+ * Multi-state-values, a state text table. One line in the list can declare thousands of objects.
+ *
+ * The list is constexpr (kept in flash on the ESP32) and is the only place the points are
+ * described. setup() walks it to add the objects to the stack and the point store, and the property
+ * callbacks use it to serve the per-object constants. Object names are generated on request from the
+ * group name and the instance, so they cost no RAM.
+ */
+
+#ifndef POINT_LIST_H
+#define POINT_LIST_H
+
+#include "PropertyRegistry.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Types
+// -----------------------------
+enum PointFlags : uint8_t {
+    POINT_FLAG_WRITABLE = 0x01, // Present value can be written by clients
+    POINT_FLAG_SUBSCRIBABLE = 0x02 // Present value changes are reported to COV subscribers
+};
+
+struct PointGroup {
+    uint16_t objectType;
+    uint32_t firstInstance;
+    uint16_t count;
+    PropertyString name; // The object name if count is 1, otherwise a prefix followed by the instance
+    uint8_t flags;
+    bool real; // Present value is a REAL (initialReal), otherwise unsigned or enumerated (initialValue)
+    uint32_t initialValue;
+    float initialReal;
+    const PropertyString* stateText; // NULL unless the objects have states
+    uint32_t stateCount;
+};
+
+// List entry helpers
+// -----------------------------
+// Analog objects, present value is a REAL
+constexpr PointGroup PointGroupReal(uint16_t objectType, uint32_t firstInstance, uint16_t count, PropertyString name, uint8_t flags, float initialValue)
+{
+    return PointGroup { objectType, firstInstance, count, name, flags, true, 0, initialValue, NULL, 0 };
+}
+// Binary objects, present value is an enumerated 0 (inactive) or 1 (active)
+constexpr PointGroup PointGroupBinary(uint16_t objectType, uint32_t firstInstance, uint16_t count, PropertyString name, uint8_t flags, uint32_t initialValue)
+{
+    return PointGroup { objectType, firstInstance, count, name, flags, false, initialValue, 0.0f, NULL, 0 };
+}
+// Multi-state objects, present value is an unsigned from 1 to the number of states
+template <size_t N>
+constexpr PointGroup PointGroupStates(uint16_t objectType, uint32_t firstInstance, uint16_t count, PropertyString name, uint8_t flags, uint32_t initialValue, const PropertyString (&stateText)[N])
+{
+    return PointGroup { objectType, firstInstance, count, name, flags, false, initialValue, 0.0f, stateText, N };
+}
+
+// Total number of objects declared by a list, for sizing the point store at compile time.
+template <size_t N>
+constexpr uint32_t PointListCount(const PointGroup (&groups)[N], size_t index = 0)
+{
+    return index >= N ? 0 : groups[index].count + PointListCount(groups, index + 1);
+}
+
+// Functions
+// -----------------------------
+// The group declaring an object, or NULL. Scans the groups, so the cost depends on the number of
+// lines in the list, not on the number of objects.
+const PointGroup* PointListFind(const PointGroup* groups, uint16_t groupCount, uint16_t objectType, uint32_t objectInstance);
+
+// Writes the object name of an instance of group, not NUL terminated. Returns the length.
+uint32_t PointListFormatName(const PointGroup* group, uint32_t objectInstance, char* value, uint32_t maxLength);
+
+#endif // POINT_LIST_H
@@ -0,0 +1,237 @@
+/**
+ * Point store
+ * --------------------------------------
+ * See PointStore.h
+ *
+ * The sequence lock covers the whole store: the writer makes the sequence odd while it updates a
+ * point and even again when done. A reader that sees an odd sequence, or a different sequence
+ * before and after copying, retries. Writes are a handful of stores so retries are rare.
+ */
+
+#include "PointStore.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include "NativeArduino.h"
+#endif
+
+#include <atomic>
+#include <string.h>
+
+struct PointStoreArena {
+    // Read by any task
+    std::atomic<uint32_t> presentValue[POINT_STORE_CAPACITY];
+    std::atomic<uint32_t> lastChange[POINT_STORE_CAPACITY];
+    std::atomic<uint8_t> statusFlags[POINT_STORE_CAPACITY];
+
+    // Fixed after setup
+    uint32_t objectInstance[POINT_STORE_CAPACITY];
+    uint16_t objectType[POINT_STORE_CAPACITY];
+
+    // Only used by the writer
+    uint32_t dirty[POINT_STORE_CHANGE_WORDS];
+
+    // (objectType, objectInstance) to point, POINT_INVALID for empty slots
+    uint16_t index[POINT_STORE_INDEX_SIZE];
+};
+
+static PointStoreArena gPointStore;
+static uint16_t gPointStoreCount = 0;
+static std::atomic<uint32_t> gPointStoreSequence(0);
+
+static uint32_t gPointStoreWrites = 0;
+static uint32_t gPointStoreChanges = 0;
+static uint32_t gPointStoreCoalesced = 0;
+static std::atomic<uint32_t> gPointStoreReadRetries(0);
+
+static uint32_t PointStoreHash(uint16_t objectType, uint32_t objectInstance)
+{
+    return ((objectInstance * 2654435761u) ^ (objectType * 40503u)) >> 7;
+}
+
+static void PointStoreBeginWrite()
+{
+    gPointStoreSequence.store(gPointStoreSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+static void PointStoreEndWrite()
+{
+    gPointStoreSequence.store(gPointStoreSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+static void PointStoreMarkDirty(uint16_t point)
+{
+    uint32_t bit = 1UL << (point % 32);
+    gPointStoreChanges++;
+    if (gPointStore.dirty[point / 32] & bit) {
+        gPointStoreCoalesced++;
+    }
+    gPointStore.dirty[point / 32] |= bit;
+}
+
+// Setup
+// ---------------------------------------------------------------------------
+uint16_t PointStoreAdd(uint16_t objectType, uint32_t objectInstance, uint32_t initialValue)
+{
+    if (gPointStoreCount >= POINT_STORE_CAPACITY) {
+        return POINT_INVALID;
+    }
+    if (gPointStoreCount == 0) {
+        for (uint32_t slot = 0; slot < POINT_STORE_INDEX_SIZE; slot++) {
+            gPointStore.index[slot] = POINT_INVALID;
+        }
+    }
+    uint32_t slot = PointStoreHash(objectType, objectInstance) & (POINT_STORE_INDEX_SIZE - 1);
+    while (gPointStore.index[slot] != POINT_INVALID) {
+        uint16_t existing = gPointStore.index[slot];
+        if (gPointStore.objectInstance[existing] == objectInstance && gPointStore.objectType[existing] == objectType) {
+            return POINT_INVALID;
+        }
+        slot = (slot + 1) & (POINT_STORE_INDEX_SIZE - 1);
+    }
+
+    uint16_t point = gPointStoreCount;
+    gPointStore.index[slot] = point;
+    gPointStore.objectType[point] = objectType;
+    gPointStore.objectInstance[point] = objectInstance;
+    gPointStore.presentValue[point].store(initialValue, std::memory_order_relaxed);
+    gPointStore.statusFlags[point].store(0, std::memory_order_relaxed);
+    gPointStore.lastChange[point].store(millis(), std::memory_order_relaxed);
+    gPointStoreCount++;
+    return point;
+}
+
+uint16_t PointStoreFind(uint16_t objectType, uint32_t objectInstance)
+{
+    if (gPointStoreCount == 0) {
+        return POINT_INVALID;
+    }
+    uint32_t slot = PointStoreHash(objectType, objectInstance) & (POINT_STORE_INDEX_SIZE - 1);
+    while (gPointStore.index[slot] != POINT_INVALID) {
+        uint16_t point = gPointStore.index[slot];
+        if (gPointStore.objectInstance[point] == objectInstance && gPointStore.objectType[point] == objectType) {
+            return point;
+        }
+        slot = (slot + 1) & (POINT_STORE_INDEX_SIZE - 1);
+    }
+    return POINT_INVALID;
+}
+
+uint16_t PointStoreCount()
+{
+    return gPointStoreCount;
+}
+
+uint32_t PointStoreGetMemoryBytes()
+{
+    return sizeof(gPointStore);
+}
+
+void PointStoreGetObject(uint16_t point, uint16_t* objectType, uint32_t* objectInstance)
+{
+    *objectType = gPointStore.objectType[point];
+    *objectInstance = gPointStore.objectInstance[point];
+}
+
+// Writer
+// ---------------------------------------------------------------------------
+bool PointStoreWrite(uint16_t point, uint32_t presentValue)
+{
+    if (point >= gPointStoreCount) {
+        return false;
+    }
+    gPointStoreWrites++;
+    if (gPointStore.presentValue[point].load(std::memory_order_relaxed) == presentValue) {
+        return false;
+    }
+    PointStoreBeginWrite();
+    gPointStore.presentValue[point].store(presentValue, std::memory_order_relaxed);
+    gPointStore.lastChange[point].store(millis(), std::memory_order_relaxed);
+    PointStoreEndWrite();
+    PointStoreMarkDirty(point);
+    return true;
+}
+
+bool PointStoreWriteReal(uint16_t point, float presentValue)
+{
+    uint32_t bits;
+    memcpy(&bits, &presentValue, sizeof(bits));
+    return PointStoreWrite(point, bits);
+}
+
+bool PointStoreSetStatusFlags(uint16_t point, uint8_t statusFlags)
+{
+    if (point >= gPointStoreCount) {
+        return false;
+    }
+    gPointStoreWrites++;
+    if (gPointStore.statusFlags[point].load(std::memory_order_relaxed) == statusFlags) {
+        return false;
+    }
+    PointStoreBeginWrite();
+    gPointStore.statusFlags[point].store(statusFlags, std::memory_order_relaxed);
+    gPointStore.lastChange[point].store(millis(), std::memory_order_relaxed);
+    PointStoreEndWrite();
+    PointStoreMarkDirty(point);
+    return true;
+}
+
+uint32_t PointStoreTakeChanges(PointChangeSet* changes)
+{
+    uint32_t count = 0;
+    for (uint16_t word = 0; word < POINT_STORE_CHANGE_WORDS; word++) {
+        changes->words[word] = gPointStore.dirty[word];
+        gPointStore.dirty[word] = 0;
+        count += (uint32_t)__builtin_popcount(changes->words[word]);
+    }
+    return count;
+}
+
+// Readers
+// ---------------------------------------------------------------------------
+bool PointStoreRead(uint16_t point, PointSnapshot* snapshot)
+{
+    if (point >= gPointStoreCount) {
+        return false;
+    }
+    for (;;) {
+        uint32_t sequence = gPointStoreSequence.load(std::memory_order_acquire);
+        if ((sequence & 1) == 0) {
+            snapshot->presentValue = gPointStore.presentValue[point].load(std::memory_order_relaxed);
+            snapshot->statusFlags = gPointStore.statusFlags[point].load(std::memory_order_relaxed);
+            snapshot->lastChange = gPointStore.lastChange[point].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (gPointStoreSequence.load(std::memory_order_relaxed) == sequence) {
+                return true;
+            }
+        }
+        gPointStoreReadRetries.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint32_t PointStoreGetUnsigned(uint16_t point)
+{
+    if (point >= gPointStoreCount) {
+        return 0;
+    }
+    return gPointStore.presentValue[point].load(std::memory_order_relaxed);
+}
+
+float PointStoreGetReal(uint16_t point)
+{
+    uint32_t bits = PointStoreGetUnsigned(point);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void PointStoreGetStatistics(PointStoreStatistics* statistics)
+{
+    statistics->pointCount = gPointStoreCount;
+    statistics->writes = gPointStoreWrites;
+    statistics->changes = gPointStoreChanges;
+    statistics->coalesced = gPointStoreCoalesced;
+    statistics->readRetries = gPointStoreReadRetries.load(std::memory_order_relaxed);
+}
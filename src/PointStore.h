@@ -0,0 +1,99 @@
+/**
+ * Point store
+ * --------------------------------------
+ * The shadow database of every BACnet point served by this device. Values are kept in a
+ * struct-of-arrays arena (present value, status flags and last change time each in their own
+ * contiguous array) so scanning one attribute across all points touches as few cache lines as
+ * possible. A dirty bitmap records which points changed since the last scan.
+ *
+ * There is a single writer: the task that runs the CAS BACnet stack (loop() or the BACnet task in
+ * threaded mode). Other tasks read through PointStoreRead(), which returns a consistent snapshot of
+ * one point using a sequence lock; readers never block the writer.
+ *
+ * Once per scan the writer takes the change set with PointStoreTakeChanges() and hands the bitmap
+ * to the consumers (COV notifications, output drivers) instead of each comparing values itself.
+ */
+
+#ifndef POINT_STORE_H
+#define POINT_STORE_H
+
+#include <stdint.h>
+
+// Set with -D POINT_STORE_MAX_POINTS=n for large point lists. RAM use is 15 bytes per point for the
+// values and object identifiers, plus 3 to 6 bytes per point for the index (POINT_STORE_INDEX_SIZE
+// two byte slots): 18 to 21 bytes per point in all. PointStoreGetMemoryBytes() gives the exact figure.
+#ifndef POINT_STORE_MAX_POINTS
+#define POINT_STORE_MAX_POINTS 64
+#endif
+const uint16_t POINT_STORE_CAPACITY = POINT_STORE_MAX_POINTS;
+const uint16_t POINT_STORE_CHANGE_WORDS = (POINT_STORE_CAPACITY + 31) / 32;
+const uint16_t POINT_INVALID = 0xFFFF;
+static_assert(POINT_STORE_MAX_POINTS > 0 && POINT_STORE_MAX_POINTS < POINT_INVALID, "POINT_STORE_MAX_POINTS out of range");
+
+// Object lookup index: open addressing, a power of two at least 1.5 times the capacity.
+constexpr uint32_t PointStoreIndexSize(uint32_t minimum, uint32_t size = 1)
+{
+    return size >= minimum ? size : PointStoreIndexSize(minimum, size << 1);
+}
+const uint32_t POINT_STORE_INDEX_SIZE = PointStoreIndexSize(POINT_STORE_CAPACITY + POINT_STORE_CAPACITY / 2 + 1);
+
+// BACnet Status_Flags bits
+const uint8_t POINT_STATUS_IN_ALARM = 0x01;
+const uint8_t POINT_STATUS_FAULT = 0x02;
+const uint8_t POINT_STATUS_OVERRIDDEN = 0x04;
+const uint8_t POINT_STATUS_OUT_OF_SERVICE = 0x08;
+
+struct PointSnapshot {
+    uint32_t presentValue; // Unsigned/enumerated value, or the bits of a REAL (see PointStoreGetReal())
+    uint8_t statusFlags;
+    uint32_t lastChange; // millis() of the last change of presentValue or statusFlags
+};
+
+struct PointStoreStatistics {
+    uint32_t pointCount;
+    uint32_t writes;
+    uint32_t changes;
+    uint32_t coalesced; // Changes to a point that was already dirty in this scan
+    uint32_t readRetries; // Snapshot reads that overlapped a write and had to be repeated
+};
+
+// A bitmap with one bit per point, as returned by PointStoreTakeChanges().
+struct PointChangeSet {
+    uint32_t words[POINT_STORE_CHANGE_WORDS];
+};
+
+inline bool PointChangeSetContains(const PointChangeSet* changes, uint16_t point)
+{
+    return point < POINT_STORE_CAPACITY && (changes->words[point / 32] & (1UL << (point % 32))) != 0;
+}
+
+// Setup
+// -----------------------------
+// Points are added during setup, before any other task reads the store. Returns POINT_INVALID if
+// the store is full or the object is already in it.
+uint16_t PointStoreAdd(uint16_t objectType, uint32_t objectInstance, uint32_t initialValue);
+// Hashed lookup, one probe on average regardless of the number of points.
+uint16_t PointStoreFind(uint16_t objectType, uint32_t objectInstance);
+uint16_t PointStoreCount();
+uint32_t PointStoreGetMemoryBytes(); // Static RAM used by the store at its configured capacity
+void PointStoreGetObject(uint16_t point, uint16_t* objectType, uint32_t* objectInstance);
+
+// Writer
+// -----------------------------
+// Return true if the value changed; the point is then marked dirty and its timestamp updated.
+bool PointStoreWrite(uint16_t point, uint32_t presentValue);
+bool PointStoreWriteReal(uint16_t point, float presentValue);
+bool PointStoreSetStatusFlags(uint16_t point, uint8_t statusFlags);
+
+// Copies the dirty bitmap into changes and clears it. Returns the number of changed points.
+uint32_t PointStoreTakeChanges(PointChangeSet* changes);
+
+// Readers (any task)
+// -----------------------------
+bool PointStoreRead(uint16_t point, PointSnapshot* snapshot);
+uint32_t PointStoreGetUnsigned(uint16_t point);
+float PointStoreGetReal(uint16_t point);
+
+void PointStoreGetStatistics(PointStoreStatistics* statistics);
+
+#endif // POINT_STORE_H
@@ -0,0 +1,114 @@
+/**
+ * Property registry
+ * --------------------------------------
+ * See PropertyRegistry.h
+ */
+
+#include "PropertyRegistry.h"
+
+#include <string.h>
+
+bool PropertyRegistryBegin(PropertyRegistry* registry, const PropertyEntry* entries, uint16_t entryCount, uint16_t* index, uint32_t indexSize)
+{
+    if (registry == NULL || entries == NULL || index == NULL) {
+        return false;
+    }
+    // The index size must be a power of two with at least one free slot, otherwise probing never terminates.
+    if (indexSize <= entryCount || (indexSize & (indexSize - 1)) != 0 || entryCount >= PROPERTY_REGISTRY_EMPTY_SLOT) {
+        return false;
+    }
+
+    registry->entries = entries;
+    registry->entryCount = entryCount;
+    registry->index = index;
+    registry->indexMask = indexSize - 1;
+
+    for (uint32_t slot = 0; slot < indexSize; slot++) {
+        index[slot] = PROPERTY_REGISTRY_EMPTY_SLOT;
+    }
+
+    for (uint16_t offset = 0; offset < entryCount; offset++) {
+        const PropertyEntry* entry = &entries[offset];
+        uint32_t slot = PropertyRegistryHash(entry->objectType, entry->objectInstance, entry->propertyIdentifier) & registry->indexMask;
+        while (index[slot] != PROPERTY_REGISTRY_EMPTY_SLOT) {
+            const PropertyEntry* existing = &entries[index[slot]];
+            if (existing->objectType == entry->objectType && existing->objectInstance == entry->objectInstance && existing->propertyIdentifier == entry->propertyIdentifier) {
+                return false; // Duplicate entry in the table
+            }
+            slot = (slot + 1) & registry->indexMask;
+        }
+        index[slot] = offset;
+    }
+    return true;
+}
+
+const PropertyEntry* PropertyRegistryFind(const PropertyRegistry* registry, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier)
+{
+    uint32_t slot = PropertyRegistryHash(objectType, objectInstance, propertyIdentifier) & registry->indexMask;
+    while (registry->index[slot] != PROPERTY_REGISTRY_EMPTY_SLOT) {
+        const PropertyEntry* entry = &registry->entries[registry->index[slot]];
+        if (entry->objectType == objectType && entry->objectInstance == objectInstance && entry->propertyIdentifier == propertyIdentifier) {
+            return entry;
+        }
+        slot = (slot + 1) & registry->indexMask;
+    }
+    return NULL;
+}
+
+bool PropertyRegistryGetCharString(const PropertyEntry* entry, char* value, uint32_t* valueElementCount, const uint32_t maxElementCount, const bool useArrayIndex, const uint32_t propertyArrayIndex)
+{
+    const PropertyString* text = NULL;
+    if (entry->valueType == PROPERTY_VALUE_CHARACTER_STRING && useArrayIndex == false) {
+        text = &entry->characterString;
+    } else if (entry->valueType == PROPERTY_VALUE_CHARACTER_STRING_ARRAY && useArrayIndex == true) {
+        if (propertyArrayIndex > entry->characterStringArrayCount || propertyArrayIndex <= 0) {
+            return false; // Invalid range
+        }
+        text = &entry->characterStringArray[propertyArrayIndex - 1];
+    } else {
+        return false;
+    }
+
+    if (text->length > maxElementCount) {
+        return false;
+    }
+    memcpy(value, text->value, text->length);
+    *valueElementCount = text->length;
+    return true;
+}
+
+bool PropertyRegistryGetUInt(const PropertyEntry* entry, uint32_t* value, const bool useArrayIndex, const uint32_t propertyArrayIndex)
+{
+    switch (entry->valueType) {
+        case PROPERTY_VALUE_UNSIGNED_CONSTANT:
+            if (useArrayIndex == false) {
+                *value = entry->unsignedConstant;
+                return true;
+            }
+            break;
+        case PROPERTY_VALUE_UNSIGNED:
+            if (useArrayIndex == false && entry->getUInt != NULL) {
+                return entry->getUInt(value);
+            }
+            break;
+        case PROPERTY_VALUE_CHARACTER_STRING_ARRAY:
+            // Index zero of an array is the number of elements in the array
+            if (useArrayIndex == true && propertyArrayIndex == 0) {
+                *value = entry->characterStringArrayCount;
+                return true;
+            }
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+bool PropertyRegistrySetUInt(const PropertyEntry* entry, const uint32_t value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode)
+{
+    (void)propertyArrayIndex;
+    if (entry->valueType != PROPERTY_VALUE_UNSIGNED || entry->setUInt == NULL || useArrayIndex == true) {
+        return false;
+    }
+    return entry->setUInt(value, priority, errorCode);
+}
@@ -0,0 +1,127 @@
+/**
+ * Property registry
+ * --------------------------------------
+ * A compile-time table of the BACnet properties served by the property callbacks, keyed by
+ * (objectType, objectInstance, propertyIdentifier). Each entry holds either a constant value with a
+ * precomputed length, or typed getter/setter slots for live values.
+ *
+ * The table itself is constexpr (kept in flash on the ESP32). A small open addressing hash index
+ * into the table is built once at startup by PropertyRegistryBegin(), so a lookup costs one hash and,
+ * on average, about one and a half probes regardless of how many points the device exposes.
+ */
+
+#ifndef PROPERTY_REGISTRY_H
+#define PROPERTY_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Types
+// -----------------------------
+typedef bool (*PropertyGetUIntFunction)(uint32_t* value);
+typedef bool (*PropertySetUIntFunction)(const uint32_t value, const uint8_t priority, unsigned int* errorCode);
+
+// A constant string with its length computed at compile time.
+struct PropertyString {
+    const char* value;
+    uint32_t length;
+};
+
+template <size_t N>
+constexpr PropertyString MakePropertyString(const char (&value)[N])
+{
+    return PropertyString { value, N - 1 };
+}
+
+template <typename T, size_t N>
+constexpr uint32_t PropertyArrayCount(const T (&)[N])
+{
+    return N;
+}
+
+enum PropertyValueType : uint8_t {
+    PROPERTY_VALUE_CHARACTER_STRING, // Constant string, read with useArrayIndex == false
+    PROPERTY_VALUE_CHARACTER_STRING_ARRAY, // Constant string array (e.g. state_text), index 0 is the array size
+    PROPERTY_VALUE_UNSIGNED_CONSTANT, // Constant unsigned integer
+    PROPERTY_VALUE_UNSIGNED // Live unsigned integer, read and written through getter/setter slots
+};
+
+struct PropertyEntry {
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    PropertyValueType valueType;
+
+    PropertyString characterString;
+    const PropertyString* characterStringArray;
+    uint32_t characterStringArrayCount;
+    uint32_t unsignedConstant;
+    PropertyGetUIntFunction getUInt;
+    PropertySetUIntFunction setUInt; // NULL if the property is read only
+};
+
+// Table entry helpers
+// -----------------------------
+constexpr PropertyEntry PropertyCharString(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, PropertyString value)
+{
+    return PropertyEntry { objectType, objectInstance, propertyIdentifier, PROPERTY_VALUE_CHARACTER_STRING, value, NULL, 0, 0, NULL, NULL };
+}
+constexpr PropertyEntry PropertyCharStringArray(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, const PropertyString* values, uint32_t count)
+{
+    return PropertyEntry { objectType, objectInstance, propertyIdentifier, PROPERTY_VALUE_CHARACTER_STRING_ARRAY, PropertyString { NULL, 0 }, values, count, 0, NULL, NULL };
+}
+constexpr PropertyEntry PropertyUIntConstant(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t value)
+{
+    return PropertyEntry { objectType, objectInstance, propertyIdentifier, PROPERTY_VALUE_UNSIGNED_CONSTANT, PropertyString { NULL, 0 }, NULL, 0, value, NULL, NULL };
+}
+constexpr PropertyEntry PropertyUInt(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, PropertyGetUIntFunction getter, PropertySetUIntFunction setter)
+{
+    return PropertyEntry { objectType, objectInstance, propertyIdentifier, PROPERTY_VALUE_UNSIGNED, PropertyString { NULL, 0 }, NULL, 0, 0, getter, setter };
+}
+
+// Hash index
+// -----------------------------
+const uint16_t PROPERTY_REGISTRY_EMPTY_SLOT = 0xFFFF;
+
+constexpr uint32_t PropertyRegistryNextPowerOfTwo(uint32_t value, uint32_t powerOfTwo = 1)
+{
+    return powerOfTwo >= value ? powerOfTwo : PropertyRegistryNextPowerOfTwo(value, powerOfTwo << 1);
+}
+
+// Number of index slots needed for a table with entryCount entries. Keeps the load factor at or below 50%.
+constexpr uint32_t PropertyRegistryIndexSize(uint32_t entryCount)
+{
+    return PropertyRegistryNextPowerOfTwo(entryCount * 2);
+}
+
+constexpr uint32_t PropertyRegistryXorShift(uint32_t value, uint32_t shift)
+{
+    return value ^ (value >> shift);
+}
+
+// Object identifier and property combined, then the MurmurHash3 finalizer so that every key bit
+// reaches the low bits the index uses. Keys differ mostly in a few low bits of the instance and
+// property, which a plain multiply leaves clustered.
+constexpr uint32_t PropertyRegistryHash(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier)
+{
+    return PropertyRegistryXorShift(PropertyRegistryXorShift(PropertyRegistryXorShift(((uint32_t)objectType << 22 | objectInstance) ^ (propertyIdentifier * 0x9E3779B1u), 16) * 0x85EBCA6Bu, 13) * 0xC2B2AE35u, 16);
+}
+
+struct PropertyRegistry {
+    const PropertyEntry* entries;
+    uint16_t entryCount;
+    uint16_t* index;
+    uint32_t indexMask;
+};
+
+// Functions
+// -----------------------------
+// Builds the hash index. index must have PropertyRegistryIndexSize(entryCount) slots.
+bool PropertyRegistryBegin(PropertyRegistry* registry, const PropertyEntry* entries, uint16_t entryCount, uint16_t* index, uint32_t indexSize);
+const PropertyEntry* PropertyRegistryFind(const PropertyRegistry* registry, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier);
+
+bool PropertyRegistryGetCharString(const PropertyEntry* entry, char* value, uint32_t* valueElementCount, const uint32_t maxElementCount, const bool useArrayIndex, const uint32_t propertyArrayIndex);
+bool PropertyRegistryGetUInt(const PropertyEntry* entry, uint32_t* value, const bool useArrayIndex, const uint32_t propertyArrayIndex);
+bool PropertyRegistrySetUInt(const PropertyEntry* entry, const uint32_t value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode);
+
+#endif // PROPERTY_REGISTRY_H
@@ -0,0 +1,299 @@
+/**
+ * ReadRange
+ * --------------------------------------
+ * See ReadRange.h
+ */
+
+#include "ReadRange.h"
+
+#include <stddef.h>
+#include <string.h>
+
+const uint16_t READ_RANGE_HEADER_LENGTH = 6; // BVLC + NPDU of a local unicast response
+const uint16_t READ_RANGE_REQUEST_HEADER_LENGTH = 4; // Unsegmented confirmed request APDU header
+const uint8_t READ_RANGE_TAG_BY_POSITION = 3;
+const uint8_t READ_RANGE_TAG_BY_SEQUENCE_NUMBER = 6;
+const uint8_t READ_RANGE_TAG_BY_TIME = 7;
+// BACnetResultFlags, the first bit is the high bit of the byte
+const uint8_t READ_RANGE_RESULT_FIRST_ITEM = 0x80;
+const uint8_t READ_RANGE_RESULT_LAST_ITEM = 0x40;
+const uint8_t READ_RANGE_RESULT_MORE_ITEMS = 0x20;
+// Log datum choices
+const uint8_t READ_RANGE_DATUM_REAL = 2;
+const uint8_t READ_RANGE_DATUM_ENUMERATED = 3;
+const uint8_t READ_RANGE_DATUM_UNSIGNED = 4;
+// Longest encoded BACnetLogRecord: timestamp 12, datum up to 7, status flags 3
+const uint16_t READ_RANGE_MAX_RECORD_LENGTH = 22;
+// Result flags (3), item count (up to 5) and the opening tag of the items
+const uint16_t READ_RANGE_ITEMS_HEADER_LENGTH = 9;
+// Closing tag of the items and the first sequence number (up to 5)
+const uint16_t READ_RANGE_ITEMS_TRAILER_LENGTH = 6;
+
+enum ReadRangeKind : uint8_t {
+    READ_RANGE_ALL,
+    READ_RANGE_BY_POSITION,
+    READ_RANGE_BY_SEQUENCE_NUMBER,
+    READ_RANGE_BY_TIME
+};
+
+struct ReadRangeRequest {
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    bool hasArrayIndex;
+    ReadRangeKind kind;
+    uint32_t reference; // Position, sequence number or time
+    int32_t count;
+};
+
+// Request
+// ---------------------------------------------------------------------------
+static bool ReadRangeDecodeRequest(const uint8_t* apdu, uint16_t apduLength, ReadRangeRequest* request)
+{
+    uint16_t offset = READ_RANGE_REQUEST_HEADER_LENGTH;
+    if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, &offset, 0, &request->objectType, &request->objectInstance) || !BACnetDecodeContextUnsigned(apdu, apduLength, &offset, 1, &request->propertyIdentifier)) {
+        return false;
+    }
+    uint32_t arrayIndex;
+    request->hasArrayIndex = BACnetDecodeContextUnsigned(apdu, apduLength, &offset, 2, &arrayIndex);
+    request->kind = READ_RANGE_ALL;
+    request->reference = 0;
+    request->count = 0;
+    if (offset == apduLength) {
+        return true;
+    }
+
+    uint8_t tagNumber = apdu[offset] >> 4;
+    if (!BACnetDecodeTag(apdu, apduLength, &offset, tagNumber, BACNET_TAG_OPENING)) {
+        return false;
+    }
+    bool decoded;
+    switch (tagNumber) {
+        case READ_RANGE_TAG_BY_POSITION:
+            request->kind = READ_RANGE_BY_POSITION;
+            decoded = BACnetDecodeUnsigned(apdu, apduLength, &offset, &request->reference);
+            break;
+        case READ_RANGE_TAG_BY_SEQUENCE_NUMBER:
+            request->kind = READ_RANGE_BY_SEQUENCE_NUMBER;
+            decoded = BACnetDecodeUnsigned(apdu, apduLength, &offset, &request->reference);
+            break;
+        case READ_RANGE_TAG_BY_TIME:
+            request->kind = READ_RANGE_BY_TIME;
+            decoded = BACnetDecodeDateTime(apdu, apduLength, &offset, &request->reference);
+            break;
+        default:
+            return false; // By time range, from an old revision
+    }
+    return decoded && BACnetDecodeSigned(apdu, apduLength, &offset, &request->count) && request->count != 0 && BACnetDecodeTag(apdu, apduLength, &offset, tagNumber, BACNET_TAG_CLOSING) && offset == apduLength;
+}
+
+// Positions of the records the request asks for, first to last. Returns false if there are none.
+static bool ReadRangeSelect(const TrendLog* log, const ReadRangeRequest* request, uint32_t* first, uint32_t* last)
+{
+    int64_t recordCount = log->statistics.recordCount;
+    int64_t reference;
+    switch (request->kind) {
+        case READ_RANGE_ALL:
+            *first = 1;
+            *last = (uint32_t)recordCount;
+            return recordCount > 0;
+        case READ_RANGE_BY_POSITION:
+            reference = request->reference >= 1 && request->reference <= recordCount ? request->reference : 0;
+            break;
+        case READ_RANGE_BY_SEQUENCE_NUMBER:
+            reference = TrendLogPositionOfSequence(log, request->reference);
+            break;
+        default:
+            // The records after the time for a positive count, before it for a negative one
+            if (request->count > 0) {
+                reference = TrendLogCountBefore(log, request->reference, true) + 1;
+                if (reference > recordCount) {
+                    reference = 0;
+                }
+            } else {
+                reference = TrendLogCountBefore(log, request->reference, false);
+            }
+            break;
+    }
+    if (reference == 0) {
+        return false;
+    }
+
+    int64_t from = reference;
+    int64_t to = reference + request->count + (request->count > 0 ? -1 : 1);
+    if (request->count < 0) {
+        from = to;
+        to = reference;
+    }
+    *first = (uint32_t)(from < 1 ? 1 : from);
+    *last = (uint32_t)(to > recordCount ? recordCount : to);
+    return true;
+}
+
+// Response
+// ---------------------------------------------------------------------------
+// BACnetLogRecord: timestamp [0], log datum [1], status flags [2]
+static uint16_t ReadRangeEncodeRecord(TrendLogValueType valueType, const TrendLogRecord* record, uint8_t* buffer)
+{
+    uint16_t length = 0;
+    buffer[length++] = 0 << 4 | BACNET_TAG_OPENING;
+    length += BACnetEncodeDateTime(buffer + length, 10, record->timestamp);
+    buffer[length++] = 0 << 4 | BACNET_TAG_CLOSING;
+
+    buffer[length++] = 1 << 4 | BACNET_TAG_OPENING;
+    if (valueType == TREND_LOG_VALUE_REAL) {
+        buffer[length++] = READ_RANGE_DATUM_REAL << 4 | BACNET_TAG_CONTEXT | 4;
+        buffer[length++] = (uint8_t)(record->value >> 24);
+        buffer[length++] = (uint8_t)(record->value >> 16);
+        buffer[length++] = (uint8_t)(record->value >> 8);
+        buffer[length++] = (uint8_t)record->value;
+    } else {
+        length += BACnetEncodeContextUnsigned(buffer + length, 5, valueType == TREND_LOG_VALUE_ENUMERATED ? READ_RANGE_DATUM_ENUMERATED : READ_RANGE_DATUM_UNSIGNED, record->value);
+    }
+    buffer[length++] = 1 << 4 | BACNET_TAG_CLOSING;
+
+    // Bit string of 4 bits: in alarm, fault, overridden, out of service
+    uint8_t statusFlags = 0;
+    for (uint8_t bit = 0; bit < 4; bit++) {
+        if (record->statusFlags & (1 << bit)) {
+            statusFlags |= (uint8_t)(0x80 >> bit);
+        }
+    }
+    buffer[length++] = 2 << 4 | BACNET_TAG_CONTEXT | 2;
+    buffer[length++] = 4; // Unused bits
+    buffer[length++] = statusFlags;
+    return length;
+}
+
+// ReadRange-ACK: object [0], property [1], result flags [3], item count [4], items [5] and, for
+// requests by sequence number or time, the sequence number of the first item [6]
+static bool ReadRangeEncodeAck(const TrendLog* log, const ReadRangeRequest* request, uint8_t* response, uint16_t* offset, uint16_t limit, ReadRangeStatistics* statistics)
+{
+    uint16_t length = BACnetEncodeContextObjectIdentifier(response + *offset, limit - *offset, 0, request->objectType, request->objectInstance);
+    *offset += length;
+    if (length == 0) {
+        return false;
+    }
+    length = BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 1, request->propertyIdentifier);
+    *offset += length;
+    if (length == 0 || *offset + READ_RANGE_ITEMS_HEADER_LENGTH + READ_RANGE_ITEMS_TRAILER_LENGTH > limit) {
+        return false;
+    }
+
+    // The records are encoded after room for the largest header and moved down once their number is known
+    uint16_t itemsStart = *offset + READ_RANGE_ITEMS_HEADER_LENGTH;
+    uint16_t itemsLimit = limit - READ_RANGE_ITEMS_TRAILER_LENGTH;
+    uint16_t itemsLength = 0;
+    uint32_t itemCount = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t firstSequence = 0;
+    uint8_t resultFlags = 0;
+    if (ReadRangeSelect(log, request, &first, &last)) {
+        uint32_t fitting = (itemsLimit - itemsStart) / READ_RANGE_MAX_RECORD_LENGTH;
+        if (request->count < 0 && last - first + 1 > fitting) {
+            first = fitting > 0 ? last - fitting + 1 : last + 1; // Keep the records nearest the reference
+            resultFlags |= READ_RANGE_RESULT_MORE_ITEMS;
+        }
+        TrendLogCursor cursor;
+        bool more = first <= last && TrendLogSeek(log, first, &cursor);
+        if (more) {
+            firstSequence = cursor.record.sequence;
+        }
+        while (more && cursor.position <= last && itemsStart + itemsLength + READ_RANGE_MAX_RECORD_LENGTH <= itemsLimit) {
+            itemsLength += ReadRangeEncodeRecord(log->valueType, &cursor.record, response + itemsStart + itemsLength);
+            itemCount++;
+            more = TrendLogNext(log, &cursor);
+        }
+        if (itemCount > 0) {
+            if (first == 1) {
+                resultFlags |= READ_RANGE_RESULT_FIRST_ITEM;
+            }
+            if (first + itemCount - 1 == log->statistics.recordCount) {
+                resultFlags |= READ_RANGE_RESULT_LAST_ITEM;
+            }
+        }
+        if (first + itemCount - 1 < last) {
+            resultFlags |= READ_RANGE_RESULT_MORE_ITEMS;
+        }
+    }
+
+    response[(*offset)++] = 3 << 4 | BACNET_TAG_CONTEXT | 2;
+    response[(*offset)++] = 5; // Unused bits
+    response[(*offset)++] = resultFlags;
+    *offset += BACnetEncodeContextUnsigned(response + *offset, 5, 4, itemCount);
+    response[(*offset)++] = 5 << 4 | BACNET_TAG_OPENING;
+    memmove(response + *offset, response + itemsStart, itemsLength);
+    *offset += itemsLength;
+    response[(*offset)++] = 5 << 4 | BACNET_TAG_CLOSING;
+    if (itemCount > 0 && (request->kind == READ_RANGE_BY_SEQUENCE_NUMBER || request->kind == READ_RANGE_BY_TIME)) {
+        *offset += BACnetEncodeContextUnsigned(response + *offset, 5, 6, firstSequence);
+    }
+
+    statistics->recordsSent += itemCount;
+    if (resultFlags & READ_RANGE_RESULT_MORE_ITEMS) {
+        statistics->truncated++;
+    }
+    return true;
+}
+
+void ReadRangeBegin(ReadRangeState* state, const ReadRangeLog* logs, uint8_t logCount)
+{
+    memset(state, 0, sizeof(*state));
+    state->logs = logs;
+    state->logCount = logCount;
+}
+
+uint16_t ReadRangeHandleRequest(ReadRangeState* state, const uint8_t* message, const BACnetFrame* frame, uint8_t* response, uint16_t maxLength)
+{
+    if (frame->apduType != APDU_TYPE_CONFIRMED_REQUEST || frame->serviceChoice != BACNET_SERVICE_READ_RANGE) {
+        return 0;
+    }
+    const uint8_t* apdu = message + frame->apduOffset;
+    uint16_t objectOffset = READ_RANGE_REQUEST_HEADER_LENGTH;
+    uint16_t objectType;
+    uint32_t objectInstance;
+    if ((apdu[0] & APDU_FLAG_SEGMENTED) || !BACnetDecodeContextObjectIdentifier(apdu, frame->apduLength, &objectOffset, 0, &objectType, &objectInstance) || objectType != BACNET_OBJECT_TYPE_TREND_LOG) {
+        return 0;
+    }
+    const TrendLog* log = NULL;
+    for (uint8_t offset = 0; offset < state->logCount; offset++) {
+        if (state->logs[offset].objectInstance == objectInstance) {
+            log = state->logs[offset].log;
+            break;
+        }
+    }
+    if (log == NULL) {
+        return 0;
+    }
+
+    // Routed requests need the routing information copied into the response. Leave them to the stack.
+    ReadRangeRequest request;
+    if (frame->broadcast || frame->hasSourceNetwork || frame->hasDestinationNetwork || !ReadRangeDecodeRequest(apdu, frame->apduLength, &request) || request.propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_LOG_BUFFER || request.hasArrayIndex) {
+        state->statistics.passed++;
+        return 0;
+    }
+
+    // The client decides how large a response it accepts
+    uint16_t limit = READ_RANGE_HEADER_LENGTH + BACnetMaxAPDUAccepted(apdu[1]);
+    if (limit > maxLength) {
+        limit = maxLength;
+    }
+    uint16_t offset = READ_RANGE_HEADER_LENGTH;
+    response[offset++] = APDU_TYPE_COMPLEX_ACK;
+    response[offset++] = frame->invokeId;
+    response[offset++] = BACNET_SERVICE_READ_RANGE;
+    if (offset > limit || !ReadRangeEncodeAck(log, &request, response, &offset, limit, &state->statistics)) {
+        state->statistics.passed++;
+        return 0;
+    }
+
+    response[0] = BVLC_TYPE_BACNET_IP;
+    response[1] = BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    response[2] = (uint8_t)(offset >> 8);
+    response[3] = (uint8_t)offset;
+    response[4] = NPDU_VERSION;
+    response[5] = 0; // No routing information, no reply expected
+    state->statistics.answered++;
+    return offset;
+}
@@ -0,0 +1,51 @@
+/**
+ * ReadRange
+ * --------------------------------------
+ * Answers ReadRange of the Log_Buffer of the Trend Log objects kept here (TrendLog.h), without
+ * passing the request to the CAS BACnet stack.
+ *
+ * Supported are ReadRange without a range (every record), by position, by sequence number and by
+ * time, with positive and negative counts. Records are decoded from the log straight into the
+ * response buffer; nothing is allocated. A response holds as many records as the client accepts
+ * (max APDU) and sets MORE_ITEMS when records matching the request were left out. For negative
+ * counts the records nearest the reference are kept.
+ *
+ * Requests for other objects go to the stack untouched. Requests for a log here that can not be
+ * answered (another property, an array index, a count of 0, a time with unspecified fields, routed
+ * or segmented requests) go to the stack as well and are counted.
+ */
+
+#ifndef READ_RANGE_H
+#define READ_RANGE_H
+
+#include "BACnetFrame.h"
+#include "TrendLog.h"
+
+#include <stdint.h>
+
+
+struct ReadRangeLog {
+    uint32_t objectInstance; // Trend Log instance
+    const TrendLog* log;
+};
+
+struct ReadRangeStatistics {
+    uint32_t answered;
+    uint32_t passed; // ReadRange of a log here left to the stack
+    uint32_t recordsSent;
+    uint32_t truncated; // Responses that did not hold every matching record
+};
+
+struct ReadRangeState {
+    const ReadRangeLog* logs;
+    uint8_t logCount;
+    ReadRangeStatistics statistics;
+};
+
+void ReadRangeBegin(ReadRangeState* state, const ReadRangeLog* logs, uint8_t logCount);
+
+// Offer a received frame. Returns the length of the complete response datagram written to
+// response, or 0 if the request must go to the stack. The logs must not change during the call.
+uint16_t ReadRangeHandleRequest(ReadRangeState* state, const uint8_t* message, const BACnetFrame* frame, uint8_t* response, uint16_t maxLength);
+
+#endif // READ_RANGE_H
@@ -0,0 +1,546 @@
+/**
+ * Response cache
+ * --------------------------------------
+ * See ResponseCache.h
+ */
+
+#include "ResponseCache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+const uint16_t RESPONSE_CACHE_EMPTY_SLOT = 0xFFFF;
+const uint16_t RESPONSE_CACHE_HEADER_LENGTH = 6; // BVLC + NPDU of a local unicast response
+const uint16_t RESPONSE_CACHE_REQUEST_HEADER_LENGTH = 4; // Unsegmented confirmed request APDU header
+const uint16_t RESPONSE_CACHE_ACK_HEADER_LENGTH = 3; // Unsegmented complex ACK APDU header
+// The property lists of an object are kept as the values of ALL and REQUIRED, in the form
+// ResponseCacheEncodePropertyList() reads. An empty ALL at this array index marks an object whose
+// lists may be learned.
+const uint32_t RESPONSE_CACHE_LEARN_MARKER = 0xFFFFFFFE;
+
+static uint32_t ResponseCacheHash(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t arrayIndex)
+{
+    return ((objectInstance * 2654435761u) ^ (objectType * 40503u) ^ (propertyIdentifier * 0x9E3779B1u) ^ arrayIndex) >> 7;
+}
+
+// Index of the entry of a property, valid or not, or RESPONSE_CACHE_EMPTY_SLOT. *slot is left at
+// the entry, or at the free slot of the index where it would go.
+static uint16_t ResponseCacheLookup(const ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t arrayIndex, uint32_t* slot)
+{
+    *slot = ResponseCacheHash(objectType, objectInstance, propertyIdentifier, arrayIndex) & (RESPONSE_CACHE_INDEX_SIZE - 1);
+    while (cache->index[*slot] != RESPONSE_CACHE_EMPTY_SLOT) {
+        const ResponseCacheEntry* entry = &cache->entries[cache->index[*slot]];
+        if (entry->objectInstance == objectInstance && entry->propertyIdentifier == propertyIdentifier && entry->objectType == objectType && entry->arrayIndex == arrayIndex) {
+            return cache->index[*slot];
+        }
+        *slot = (*slot + 1) & (RESPONSE_CACHE_INDEX_SIZE - 1);
+    }
+    return RESPONSE_CACHE_EMPTY_SLOT;
+}
+
+static const ResponseCacheEntry* ResponseCacheFind(const ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t arrayIndex)
+{
+    uint32_t slot;
+    uint16_t offset = ResponseCacheLookup(cache, objectType, objectInstance, propertyIdentifier, arrayIndex, &slot);
+    if (offset == RESPONSE_CACHE_EMPTY_SLOT || !cache->entries[offset].valid) {
+        return NULL;
+    }
+    return &cache->entries[offset];
+}
+
+void ResponseCacheBegin(ResponseCache* cache, ResponseCacheEncodeFunction encodeVolatile)
+{
+    memset(cache, 0, sizeof(*cache));
+    for (uint32_t slot = 0; slot < RESPONSE_CACHE_INDEX_SIZE; slot++) {
+        cache->index[slot] = RESPONSE_CACHE_EMPTY_SLOT;
+    }
+    cache->encodeVolatile = encodeVolatile;
+}
+
+// Setup
+// ---------------------------------------------------------------------------
+// Adds a value, or puts a new one in place of a dropped entry if it fits the space the entry had
+static bool ResponseCacheStore(ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t arrayIndex, const uint8_t* value, uint16_t length, bool learned)
+{
+    uint32_t slot;
+    uint16_t existing = ResponseCacheLookup(cache, objectType, objectInstance, propertyIdentifier, arrayIndex, &slot);
+    if (existing != RESPONSE_CACHE_EMPTY_SLOT) {
+        ResponseCacheEntry* entry = &cache->entries[existing];
+        if (entry->valid) {
+            return false; // Already cached
+        }
+        if (length > entry->length) {
+            cache->statistics.rejected++;
+            return false;
+        }
+        if (length > 0) {
+            memcpy(cache->arena + entry->offset, value, length);
+        }
+        entry->length = length;
+        entry->valid = true;
+        entry->learned = learned;
+        return true;
+    }
+    if (cache->entryCount >= RESPONSE_CACHE_ENTRY_CAPACITY || length > RESPONSE_CACHE_ARENA_BYTES - cache->arenaUsed) {
+        cache->statistics.rejected++;
+        return false;
+    }
+
+    ResponseCacheEntry* entry = &cache->entries[cache->entryCount];
+    entry->objectType = objectType;
+    entry->valid = true;
+    entry->learned = learned;
+    entry->objectInstance = objectInstance;
+    entry->propertyIdentifier = propertyIdentifier;
+    entry->arrayIndex = arrayIndex;
+    entry->offset = cache->arenaUsed;
+    entry->length = length;
+    if (length > 0) {
+        memcpy(cache->arena + cache->arenaUsed, value, length);
+    }
+    cache->arenaUsed += length;
+    cache->index[slot] = cache->entryCount++;
+
+    cache->statistics.entries = cache->entryCount;
+    cache->statistics.arenaBytes = cache->arenaUsed;
+    return true;
+}
+
+bool ResponseCacheAdd(ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t arrayIndex, const uint8_t* value, uint16_t length)
+{
+    return ResponseCacheStore(cache, objectType, objectInstance, propertyIdentifier, arrayIndex, value, length, false);
+}
+
+bool ResponseCacheLearnPropertyLists(ResponseCache* cache, uint16_t objectType, uint32_t objectInstance)
+{
+    return ResponseCacheStore(cache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_ALL, RESPONSE_CACHE_LEARN_MARKER, NULL, 0, false);
+}
+
+void ResponseCacheInvalidate(ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier)
+{
+    for (uint16_t offset = 0; offset < cache->entryCount; offset++) {
+        ResponseCacheEntry* entry = &cache->entries[offset];
+        if (entry->valid && entry->objectInstance == objectInstance && entry->objectType == objectType && (entry->propertyIdentifier == propertyIdentifier || entry->learned)) {
+            entry->valid = false;
+            cache->statistics.invalidations++;
+        }
+    }
+}
+
+// Requests
+// ---------------------------------------------------------------------------
+// Writes the value of one property at *offset. Returns false if the property is not known here or
+// the value does not fit before limit.
+static bool ResponseCacheEncodeValue(const ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t arrayIndex, uint8_t* response, uint16_t* offset, uint16_t limit)
+{
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_ALL || propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_REQUIRED) {
+        return false; // Property lists, not values
+    }
+    const ResponseCacheEntry* entry = ResponseCacheFind(cache, objectType, objectInstance, propertyIdentifier, arrayIndex);
+    if (entry != NULL) {
+        if (entry->length > limit - *offset) {
+            return false;
+        }
+        memcpy(response + *offset, cache->arena + entry->offset, entry->length);
+        *offset += entry->length;
+        return true;
+    }
+    if (arrayIndex != RESPONSE_CACHE_NO_INDEX || cache->encodeVolatile == NULL) {
+        return false;
+    }
+    uint16_t length = cache->encodeVolatile(objectType, objectInstance, propertyIdentifier, response + *offset, limit - *offset);
+    *offset += length;
+    return length > 0;
+}
+
+// Appends a tag byte, checking the limit
+static bool ResponseCachePutTag(uint8_t* response, uint16_t* offset, uint16_t limit, uint8_t tagNumber, uint8_t tagType)
+{
+    if (*offset >= limit) {
+        return false;
+    }
+    response[(*offset)++] = (uint8_t)(tagNumber << 4 | tagType);
+    return true;
+}
+
+// A learned ALL or REQUIRED list is kept as the stack's own answer: runs of property [2] and value
+// [4] copied as they were, each but the last followed by a volatile property whose value is encoded
+// at the time of the request. A run is its 16-bit length and bytes, a volatile property its 32-bit
+// identifier.
+static bool ResponseCacheEncodePropertyList(const ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t listProperty, uint8_t* response, uint16_t* offset, uint16_t limit)
+{
+    const ResponseCacheEntry* list = ResponseCacheFind(cache, objectType, objectInstance, listProperty, RESPONSE_CACHE_NO_INDEX);
+    if (list == NULL) {
+        return false;
+    }
+    const uint8_t* segment = cache->arena + list->offset;
+    const uint8_t* end = segment + list->length;
+    while (segment < end) {
+        uint16_t runLength;
+        memcpy(&runLength, segment, sizeof(runLength));
+        segment += sizeof(runLength);
+        if (runLength > limit - *offset) {
+            return false;
+        }
+        memcpy(response + *offset, segment, runLength);
+        *offset += runLength;
+        segment += runLength;
+        if (segment == end) {
+            break;
+        }
+        uint32_t propertyIdentifier;
+        memcpy(&propertyIdentifier, segment, sizeof(propertyIdentifier));
+        segment += sizeof(propertyIdentifier);
+        uint16_t length = cache->encodeVolatile(objectType, objectInstance, propertyIdentifier, response + *offset, limit - *offset);
+        *offset += length;
+        if (length == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ReadProperty-ACK: object [0], property [1], optional array index [2], value [3]
+static bool ResponseCacheReadProperty(const ResponseCache* cache, const uint8_t* apdu, uint16_t apduLength, uint8_t* response, uint16_t* offset, uint16_t limit)
+{
+    uint16_t requestOffset = RESPONSE_CACHE_REQUEST_HEADER_LENGTH;
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    uint32_t arrayIndex = RESPONSE_CACHE_NO_INDEX;
+    if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, &requestOffset, 0, &objectType, &objectInstance) || !BACnetDecodeContextUnsigned(apdu, apduLength, &requestOffset, 1, &propertyIdentifier)) {
+        return false;
+    }
+    if (requestOffset < apduLength && !BACnetDecodeContextUnsigned(apdu, apduLength, &requestOffset, 2, &arrayIndex)) {
+        return false;
+    }
+    if (requestOffset != apduLength) {
+        return false;
+    }
+
+    uint16_t length = BACnetEncodeContextObjectIdentifier(response + *offset, limit - *offset, 0, objectType, objectInstance);
+    *offset += length;
+    if (length == 0) {
+        return false;
+    }
+    length = BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 1, propertyIdentifier);
+    *offset += length;
+    if (length == 0) {
+        return false;
+    }
+    if (arrayIndex != RESPONSE_CACHE_NO_INDEX) {
+        length = BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 2, arrayIndex);
+        *offset += length;
+        if (length == 0) {
+            return false;
+        }
+    }
+    return ResponseCachePutTag(response, offset, limit, 3, BACNET_TAG_OPENING) && ResponseCacheEncodeValue(cache, objectType, objectInstance, propertyIdentifier, arrayIndex, response, offset, limit) && ResponseCachePutTag(response, offset, limit, 3, BACNET_TAG_CLOSING);
+}
+
+// ReadPropertyMultiple-ACK: for each object, object [0] and a list [1] of property [2], optional
+// array index [3] and value [4]
+static bool ResponseCacheReadPropertyMultiple(const ResponseCache* cache, const uint8_t* apdu, uint16_t apduLength, uint8_t* response, uint16_t* offset, uint16_t limit)
+{
+    uint16_t requestOffset = RESPONSE_CACHE_REQUEST_HEADER_LENGTH;
+    if (requestOffset >= apduLength) {
+        return false;
+    }
+    while (requestOffset < apduLength) {
+        uint16_t objectType;
+        uint32_t objectInstance;
+        if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, &requestOffset, 0, &objectType, &objectInstance) || !BACnetDecodeTag(apdu, apduLength, &requestOffset, 1, BACNET_TAG_OPENING)) {
+            return false;
+        }
+        uint16_t length = BACnetEncodeContextObjectIdentifier(response + *offset, limit - *offset, 0, objectType, objectInstance);
+        *offset += length;
+        if (length == 0 || !ResponseCachePutTag(response, offset, limit, 1, BACNET_TAG_OPENING)) {
+            return false;
+        }
+
+        while (!BACnetDecodeTag(apdu, apduLength, &requestOffset, 1, BACNET_TAG_CLOSING)) {
+            uint32_t propertyIdentifier;
+            uint32_t arrayIndex = RESPONSE_CACHE_NO_INDEX;
+            if (!BACnetDecodeContextUnsigned(apdu, apduLength, &requestOffset, 0, &propertyIdentifier)) {
+                return false;
+            }
+            // An array index [1] looks like the closing tag [1] that ends the list apart from its length
+            if (requestOffset < apduLength && (apdu[requestOffset] & 0xF8) == (1 << 4 | BACNET_TAG_CONTEXT) && apdu[requestOffset] != (1 << 4 | BACNET_TAG_CLOSING) && !BACnetDecodeContextUnsigned(apdu, apduLength, &requestOffset, 1, &arrayIndex)) {
+                return false;
+            }
+
+            if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_ALL || propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_REQUIRED) {
+                if (arrayIndex != RESPONSE_CACHE_NO_INDEX || !ResponseCacheEncodePropertyList(cache, objectType, objectInstance, propertyIdentifier, response, offset, limit)) {
+                    return false;
+                }
+                continue;
+            }
+
+            length = BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 2, propertyIdentifier);
+            *offset += length;
+            if (length == 0) {
+                return false;
+            }
+            if (arrayIndex != RESPONSE_CACHE_NO_INDEX) {
+                length = BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 3, arrayIndex);
+                *offset += length;
+                if (length == 0) {
+                    return false;
+                }
+            }
+            if (!ResponseCachePutTag(response, offset, limit, 4, BACNET_TAG_OPENING) || !ResponseCacheEncodeValue(cache, objectType, objectInstance, propertyIdentifier, arrayIndex, response, offset, limit) || !ResponseCachePutTag(response, offset, limit, 4, BACNET_TAG_CLOSING)) {
+                return false;
+            }
+        }
+        if (!ResponseCachePutTag(response, offset, limit, 1, BACNET_TAG_CLOSING)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t ResponseCacheHandleRequest(ResponseCache* cache, const uint8_t* message, const BACnetFrame* frame, uint8_t* response, uint16_t maxLength)
+{
+    if (frame->apduType != APDU_TYPE_CONFIRMED_REQUEST || (frame->serviceChoice != BACNET_SERVICE_READ_PROPERTY && frame->serviceChoice != BACNET_SERVICE_READ_PROPERTY_MULTIPLE)) {
+        return 0;
+    }
+    const uint8_t* apdu = message + frame->apduOffset;
+    // Routed requests need the routing information copied into the response, and segmented ones
+    // reassembled. Leave both to the stack.
+    if (frame->broadcast || frame->hasSourceNetwork || frame->hasDestinationNetwork || (apdu[0] & APDU_FLAG_SEGMENTED) || frame->apduLength < RESPONSE_CACHE_REQUEST_HEADER_LENGTH) {
+        cache->statistics.misses++;
+        return 0;
+    }
+
+    // The client decides how large a response it accepts
+    uint16_t limit = RESPONSE_CACHE_HEADER_LENGTH + BACnetMaxAPDUAccepted(apdu[1]);
+    if (limit > maxLength) {
+        limit = maxLength;
+    }
+    if (limit < RESPONSE_CACHE_HEADER_LENGTH + 3) {
+        cache->statistics.misses++;
+        return 0;
+    }
+
+    uint16_t offset = RESPONSE_CACHE_HEADER_LENGTH;
+    response[offset++] = APDU_TYPE_COMPLEX_ACK;
+    response[offset++] = frame->invokeId;
+    response[offset++] = frame->serviceChoice;
+    bool handled;
+    if (frame->serviceChoice == BACNET_SERVICE_READ_PROPERTY) {
+        handled = ResponseCacheReadProperty(cache, apdu, frame->apduLength, response, &offset, limit);
+    } else {
+        handled = ResponseCacheReadPropertyMultiple(cache, apdu, frame->apduLength, response, &offset, limit);
+    }
+    if (!handled) {
+        cache->statistics.misses++;
+        return 0;
+    }
+
+    response[0] = BVLC_TYPE_BACNET_IP;
+    response[1] = BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    response[2] = (uint8_t)(offset >> 8);
+    response[3] = (uint8_t)offset;
+    response[4] = NPDU_VERSION;
+    response[5] = 0; // No routing information, no reply expected
+    cache->statistics.hits++;
+    return offset;
+}
+
+// Learning
+// ---------------------------------------------------------------------------
+// Skips tagged values up to and including the closing tag tagNumber that ends them
+static bool ResponseCacheSkipValues(const uint8_t* buffer, uint16_t length, uint16_t* offset, uint8_t tagNumber)
+{
+    uint16_t depth = 0;
+    while (*offset < length) {
+        uint8_t tag = buffer[(*offset)++];
+        uint8_t number = tag >> 4;
+        if (number == 0x0F) {
+            if (*offset >= length) {
+                return false;
+            }
+            number = buffer[(*offset)++];
+        }
+        uint8_t lengthValueType = tag & 0x07;
+        if (tag & BACNET_TAG_CONTEXT) {
+            if (lengthValueType == (BACNET_TAG_OPENING & 0x07)) {
+                depth++;
+                continue;
+            }
+            if (lengthValueType == (BACNET_TAG_CLOSING & 0x07)) {
+                if (depth == 0) {
+                    return number == tagNumber;
+                }
+                depth--;
+                continue;
+            }
+        } else if (number == BACNET_APPLICATION_TAG_BOOLEAN) {
+            continue; // The value is in the tag
+        }
+        uint32_t valueLength = lengthValueType;
+        if (lengthValueType == 5) { // Extended length
+            if (*offset >= length) {
+                return false;
+            }
+            valueLength = buffer[(*offset)++];
+            if (valueLength >= 254) {
+                uint8_t lengthBytes = valueLength == 254 ? 2 : 4;
+                if (length - *offset < lengthBytes) {
+                    return false;
+                }
+                valueLength = 0;
+                for (uint8_t lengthByte = 0; lengthByte < lengthBytes; lengthByte++) {
+                    valueLength = valueLength << 8 | buffer[(*offset)++];
+                }
+            }
+        }
+        if (valueLength > (uint32_t)(length - *offset)) {
+            return false;
+        }
+        *offset += (uint16_t)valueLength;
+    }
+    return false;
+}
+
+// Remembers a ReadPropertyMultiple of ALL or REQUIRED of one object whose lists may be learned and
+// are not known yet
+static void ResponseCacheRememberLearnRequest(ResponseCache* cache, const uint8_t* apdu, const BACnetFrame* frame, const uint8_t* address)
+{
+    uint16_t requestOffset = RESPONSE_CACHE_REQUEST_HEADER_LENGTH;
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    if (!BACnetDecodeContextObjectIdentifier(apdu, frame->apduLength, &requestOffset, 0, &objectType, &objectInstance) || !BACnetDecodeTag(apdu, frame->apduLength, &requestOffset, 1, BACNET_TAG_OPENING) || !BACnetDecodeContextUnsigned(apdu, frame->apduLength, &requestOffset, 0, &propertyIdentifier) || !BACnetDecodeTag(apdu, frame->apduLength, &requestOffset, 1, BACNET_TAG_CLOSING) || requestOffset != frame->apduLength) {
+        return;
+    }
+    if ((propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_ALL && propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_REQUIRED) || ResponseCacheFind(cache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_ALL, RESPONSE_CACHE_LEARN_MARKER) == NULL || ResponseCacheFind(cache, objectType, objectInstance, propertyIdentifier, RESPONSE_CACHE_NO_INDEX) != NULL) {
+        return;
+    }
+    ResponseCacheLearnRequest* request = &cache->learnRequests[cache->nextLearnRequest];
+    cache->nextLearnRequest = (uint8_t)((cache->nextLearnRequest + 1) % RESPONSE_CACHE_LEARN_CAPACITY);
+    request->active = true;
+    request->invokeId = frame->invokeId;
+    memcpy(request->address, address, RESPONSE_CACHE_ADDRESS_LENGTH);
+    request->objectType = objectType;
+    request->objectInstance = objectInstance;
+    request->propertyIdentifier = propertyIdentifier;
+}
+
+// Keeps the property list of the stack's answer to request, and the values the cache does not know
+// yet. Nothing is kept if the answer holds an error or an array index, or too many properties.
+static void ResponseCacheLearn(ResponseCache* cache, const ResponseCacheLearnRequest* request, const uint8_t* apdu, uint16_t apduLength, uint8_t* buffer, uint16_t maxLength)
+{
+    uint16_t responseOffset = RESPONSE_CACHE_ACK_HEADER_LENGTH;
+    uint16_t objectType;
+    uint32_t objectInstance;
+    if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, &responseOffset, 0, &objectType, &objectInstance) || objectType != request->objectType || objectInstance != request->objectInstance || !BACnetDecodeTag(apdu, apduLength, &responseOffset, 1, BACNET_TAG_OPENING)) {
+        return;
+    }
+    uint16_t listOffset = responseOffset;
+    uint32_t properties[RESPONSE_CACHE_LIST_CAPACITY];
+    uint16_t valueOffsets[RESPONSE_CACHE_LIST_CAPACITY];
+    uint16_t valueLengths[RESPONSE_CACHE_LIST_CAPACITY];
+    uint8_t propertyCount = 0;
+    while (!BACnetDecodeTag(apdu, apduLength, &responseOffset, 1, BACNET_TAG_CLOSING)) {
+        if (propertyCount >= RESPONSE_CACHE_LIST_CAPACITY || !BACnetDecodeContextUnsigned(apdu, apduLength, &responseOffset, 2, &properties[propertyCount]) || !BACnetDecodeTag(apdu, apduLength, &responseOffset, 4, BACNET_TAG_OPENING)) {
+            return;
+        }
+        valueOffsets[propertyCount] = responseOffset;
+        if (!ResponseCacheSkipValues(apdu, apduLength, &responseOffset, 4)) {
+            return;
+        }
+        valueLengths[propertyCount] = (uint16_t)(responseOffset - 1 - valueOffsets[propertyCount]); // Without the closing tag
+        propertyCount++;
+    }
+    if (responseOffset != apduLength) {
+        return;
+    }
+    uint16_t listEnd = (uint16_t)(responseOffset - 1);
+
+    bool isVolatile[RESPONSE_CACHE_LIST_CAPACITY];
+    for (uint8_t property = 0; property < propertyCount; property++) {
+        isVolatile[property] = false;
+        if (ResponseCacheFind(cache, objectType, objectInstance, properties[property], RESPONSE_CACHE_NO_INDEX) != NULL) {
+            continue;
+        }
+        if (cache->encodeVolatile != NULL && cache->encodeVolatile(objectType, objectInstance, properties[property], buffer, maxLength) > 0) {
+            isVolatile[property] = true;
+            continue;
+        }
+        if (!ResponseCacheStore(cache, objectType, objectInstance, properties[property], RESPONSE_CACHE_NO_INDEX, apdu + valueOffsets[property], valueLengths[property], true)) {
+            return;
+        }
+    }
+
+    // The template in buffer, which is free again now
+    uint16_t templateLength = 0;
+    uint16_t runStart = listOffset;
+    for (uint8_t property = 0; property <= propertyCount; property++) {
+        if (property < propertyCount && !isVolatile[property]) {
+            continue;
+        }
+        uint16_t runEnd = property < propertyCount ? valueOffsets[property] : listEnd;
+        uint16_t runLength = (uint16_t)(runEnd - runStart);
+        if (templateLength + sizeof(runLength) + runLength + sizeof(uint32_t) > maxLength) {
+            return;
+        }
+        memcpy(buffer + templateLength, &runLength, sizeof(runLength));
+        memcpy(buffer + templateLength + sizeof(runLength), apdu + runStart, runLength);
+        templateLength = (uint16_t)(templateLength + sizeof(runLength) + runLength);
+        if (property < propertyCount) {
+            memcpy(buffer + templateLength, &properties[property], sizeof(uint32_t));
+            templateLength = (uint16_t)(templateLength + sizeof(uint32_t));
+            runStart = (uint16_t)(valueOffsets[property] + valueLengths[property]);
+        }
+    }
+    if (ResponseCacheStore(cache, objectType, objectInstance, request->propertyIdentifier, RESPONSE_CACHE_NO_INDEX, buffer, templateLength, true)) {
+        cache->statistics.listsLearned++;
+    }
+}
+
+void ResponseCacheObserveRequest(ResponseCache* cache, const uint8_t* message, const BACnetFrame* frame, const uint8_t* address)
+{
+    if (frame->apduType != APDU_TYPE_CONFIRMED_REQUEST || frame->apduLength < RESPONSE_CACHE_REQUEST_HEADER_LENGTH) {
+        return;
+    }
+    const uint8_t* apdu = message + frame->apduOffset;
+    if (apdu[0] & APDU_FLAG_SEGMENTED) {
+        return;
+    }
+    if (frame->serviceChoice == BACNET_SERVICE_READ_PROPERTY_MULTIPLE) {
+        if (!frame->broadcast && !frame->hasSourceNetwork && !frame->hasDestinationNetwork) {
+            ResponseCacheRememberLearnRequest(cache, apdu, frame, address);
+        }
+        return;
+    }
+    if (frame->serviceChoice != BACNET_SERVICE_WRITE_PROPERTY) {
+        return;
+    }
+    uint16_t requestOffset = RESPONSE_CACHE_REQUEST_HEADER_LENGTH;
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    if (BACnetDecodeContextObjectIdentifier(apdu, frame->apduLength, &requestOffset, 0, &objectType, &objectInstance) && BACnetDecodeContextUnsigned(apdu, frame->apduLength, &requestOffset, 1, &propertyIdentifier)) {
+        ResponseCacheInvalidate(cache, objectType, objectInstance, propertyIdentifier);
+    }
+}
+
+void ResponseCacheObserveResponse(ResponseCache* cache, const uint8_t* message, const BACnetFrame* frame, const uint8_t* address, uint8_t* buffer, uint16_t maxLength)
+{
+    if (frame->apduType != APDU_TYPE_COMPLEX_ACK || frame->serviceChoice != BACNET_SERVICE_READ_PROPERTY_MULTIPLE || frame->broadcast || frame->hasSourceNetwork || frame->hasDestinationNetwork || frame->apduLength < RESPONSE_CACHE_ACK_HEADER_LENGTH) {
+        return;
+    }
+    const uint8_t* apdu = message + frame->apduOffset;
+    if (apdu[0] & APDU_FLAG_SEGMENTED) {
+        return;
+    }
+    for (uint8_t offset = 0; offset < RESPONSE_CACHE_LEARN_CAPACITY; offset++) {
+        ResponseCacheLearnRequest* request = &cache->learnRequests[offset];
+        if (request->active && request->invokeId == frame->invokeId && memcmp(request->address, address, RESPONSE_CACHE_ADDRESS_LENGTH) == 0) {
+            request->active = false;
+            ResponseCacheLearn(cache, request, apdu, frame->apduLength, buffer, maxLength);
+            return;
+        }
+    }
+}
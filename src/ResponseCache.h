@@ -0,0 +1,137 @@
+/**
+ * Response cache
+ * --------------------------------------
+ * Answers ReadProperty and ReadPropertyMultiple without waking the CAS BACnet stack when every
+ * property asked for is known here.
+ *
+ * Properties are either static or volatile. Static properties (object names, state text, number of
+ * states, ...) never change after setup; their values are encoded once at startup and kept in a
+ * fixed arena. Volatile properties (present values) are encoded on request by a function supplied
+ * by the application, straight from the point store. A request is answered from the cache only if
+ * every property in it is one or the other; anything else (an unknown property, a routed or
+ * segmented request, a response larger than the client accepts) goes to the stack as before.
+ *
+ * ReadPropertyMultiple of ALL and REQUIRED needs the list of properties the stack would return,
+ * including the ones only the stack knows (Status_Flags, Event_State, Units, ...). For the objects
+ * given to ResponseCacheLearnPropertyLists() the first such request goes to the stack, and its
+ * answer, seen by ResponseCacheObserveResponse(), is kept: the answer itself with the volatile
+ * values cut out, and the value of every property in it that is neither cached nor volatile.
+ * Later requests are answered here by copying the answer and encoding the volatile values again.
+ *
+ * Static entries are only dropped by an explicit change: ResponseCacheInvalidate(), or a
+ * WriteProperty seen by ResponseCacheObserveRequest(). The stack answers for dropped properties
+ * from then on, and what was learned for the object is learned again from the next ALL or
+ * REQUIRED answer.
+ */
+
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "BACnetFrame.h"
+
+#include <stdint.h>
+
+// Set with -D RESPONSE_CACHE_MAX_ENTRIES=n and -D RESPONSE_CACHE_MAX_BYTES=n for large point lists.
+// Values that do not fit are left to the stack. RAM use is about 24 bytes per entry plus the arena.
+// Learning the property lists of an object takes about 6 entries and 200 bytes.
+#ifndef RESPONSE_CACHE_MAX_ENTRIES
+#define RESPONSE_CACHE_MAX_ENTRIES 256
+#endif
+#ifndef RESPONSE_CACHE_MAX_BYTES
+#define RESPONSE_CACHE_MAX_BYTES 4096
+#endif
+const uint16_t RESPONSE_CACHE_ENTRY_CAPACITY = RESPONSE_CACHE_MAX_ENTRIES;
+const uint16_t RESPONSE_CACHE_ARENA_BYTES = RESPONSE_CACHE_MAX_BYTES;
+const uint32_t RESPONSE_CACHE_NO_INDEX = 0xFFFFFFFF;
+const uint8_t RESPONSE_CACHE_LEARN_CAPACITY = 4; // ALL and REQUIRED requests waiting for the stack's answer
+const uint8_t RESPONSE_CACHE_LIST_CAPACITY = 32; // Longest property list learned
+const uint8_t RESPONSE_CACHE_ADDRESS_LENGTH = 6; // BACnet/IP connection string, IPv4 address + UDP port
+static_assert(RESPONSE_CACHE_MAX_ENTRIES > 0 && RESPONSE_CACHE_MAX_ENTRIES < 0xFFFF, "RESPONSE_CACHE_MAX_ENTRIES out of range");
+static_assert(RESPONSE_CACHE_MAX_BYTES > 0 && RESPONSE_CACHE_MAX_BYTES <= 0xFFFF, "RESPONSE_CACHE_MAX_BYTES out of range");
+
+// Lookup index: open addressing, a power of two at least twice the entry capacity.
+constexpr uint32_t ResponseCacheIndexSize(uint32_t minimum, uint32_t size = 1)
+{
+    return size >= minimum ? size : ResponseCacheIndexSize(minimum, size << 1);
+}
+const uint32_t RESPONSE_CACHE_INDEX_SIZE = ResponseCacheIndexSize(2 * RESPONSE_CACHE_ENTRY_CAPACITY);
+
+// Encodes a volatile property as an application tagged value. Returns the length, or 0 if the
+// property is not known, in which case the request goes to the stack.
+typedef uint16_t (*ResponseCacheEncodeFunction)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint8_t* buffer, uint16_t maxLength);
+
+struct ResponseCacheEntry {
+    uint16_t objectType;
+    bool valid;
+    bool learned; // Taken from an answer of the stack, dropped with the object's property lists
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    uint32_t arrayIndex; // RESPONSE_CACHE_NO_INDEX for the whole property
+    uint16_t offset; // Encoded value in the arena
+    uint16_t length;
+};
+
+// A ReadPropertyMultiple of ALL or REQUIRED passed to the stack, whose answer is to be learned
+struct ResponseCacheLearnRequest {
+    bool active;
+    uint8_t invokeId;
+    uint8_t address[RESPONSE_CACHE_ADDRESS_LENGTH];
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier; // ALL or REQUIRED
+};
+
+struct ResponseCacheStatistics {
+    uint32_t entries;
+    uint32_t arenaBytes;
+    uint32_t rejected; // Static values that did not fit the cache, served by the stack
+    uint32_t hits; // Requests answered from the cache
+    uint32_t misses; // ReadProperty and ReadPropertyMultiple requests left to the stack
+    uint32_t invalidations;
+    uint32_t listsLearned; // ALL and REQUIRED property lists taken from the stack's answers
+};
+
+struct ResponseCache {
+    ResponseCacheEntry entries[RESPONSE_CACHE_ENTRY_CAPACITY];
+    uint16_t entryCount;
+    uint16_t index[RESPONSE_CACHE_INDEX_SIZE];
+    uint8_t arena[RESPONSE_CACHE_ARENA_BYTES];
+    uint16_t arenaUsed;
+    ResponseCacheEncodeFunction encodeVolatile;
+    ResponseCacheLearnRequest learnRequests[RESPONSE_CACHE_LEARN_CAPACITY];
+    uint8_t nextLearnRequest;
+    ResponseCacheStatistics statistics;
+};
+
+void ResponseCacheBegin(ResponseCache* cache, ResponseCacheEncodeFunction encodeVolatile);
+
+// Setup
+// -----------------------------
+// Adds the encoded value of a static property (application tagged, for a whole array the elements
+// one after the other). Returns false if the cache is full.
+bool ResponseCacheAdd(ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t arrayIndex, const uint8_t* value, uint16_t length);
+
+// Lets ReadPropertyMultiple of ALL and REQUIRED for an object be answered here once the stack has
+// answered one. Only for objects whose properties change through WriteProperty or are volatile;
+// not the Device object, whose Local_Time and Object_List the stack keeps up to date.
+bool ResponseCacheLearnPropertyLists(ResponseCache* cache, uint16_t objectType, uint32_t objectInstance);
+
+// Drops every cached value of a property, all array indexes included, and what was learned for the
+// object.
+void ResponseCacheInvalidate(ResponseCache* cache, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier);
+
+// Requests
+// -----------------------------
+// Offer a received frame. Returns the length of the complete response datagram written to
+// response, or 0 if the request must go to the stack.
+uint16_t ResponseCacheHandleRequest(ResponseCache* cache, const uint8_t* message, const BACnetFrame* frame, uint8_t* response, uint16_t maxLength);
+
+// Offer a frame that is going to the stack, from address. A WriteProperty invalidates the property
+// written; a ReadPropertyMultiple of ALL or REQUIRED that could be learned is remembered.
+void ResponseCacheObserveRequest(ResponseCache* cache, const uint8_t* message, const BACnetFrame* frame, const uint8_t* address);
+
+// Offer a frame the stack sends to address. The answer to a remembered ALL or REQUIRED request is
+// learned; buffer is scratch space for the volatile values, which are encoded to tell them apart.
+void ResponseCacheObserveResponse(ResponseCache* cache, const uint8_t* message, const BACnetFrame* frame, const uint8_t* address, uint8_t* buffer, uint16_t maxLength);
+
+#endif // RESPONSE_CACHE_H
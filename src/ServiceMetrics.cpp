@@ -0,0 +1,153 @@
+/**
+ * Per-service request metrics
+ * --------------------------------------
+ * See ServiceMetrics.h
+ */
+
+#include "ServiceMetrics.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include "NativeArduino.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Logging.h"
+#include "PacketRing.h"
+
+struct ServiceMetricsPending {
+    bool active;
+    uint8_t invokeId;
+    uint8_t serviceChoice;
+    uint8_t peerAddress[PACKET_ADDRESS_LENGTH];
+    uint32_t arrivalUs;
+};
+
+static ServiceMetrics gServiceMetrics[SERVICE_METRICS_SERVICE_COUNT];
+static ServiceMetricsPending gServiceMetricsPending[SERVICE_METRICS_PENDING_CAPACITY];
+static uint8_t gServiceMetricsNextPending = 0;
+static uint32_t gServiceMetricsUnmatchedResponses = 0;
+static uint32_t gServiceMetricsPendingOverflows = 0;
+
+void ServiceMetricsRecordRequest(const BACnetFrame* frame, const uint8_t* peerAddress, uint32_t arrivalUs)
+{
+    if (frame->apduType != APDU_TYPE_CONFIRMED_REQUEST || frame->serviceChoice >= SERVICE_METRICS_SERVICE_COUNT) {
+        return;
+    }
+    gServiceMetrics[frame->serviceChoice].requests++;
+
+    // Reuse a free slot; if every slot is waiting, replace the oldest one.
+    ServiceMetricsPending* pending = NULL;
+    for (uint8_t offset = 0; offset < SERVICE_METRICS_PENDING_CAPACITY; offset++) {
+        ServiceMetricsPending* candidate = &gServiceMetricsPending[(gServiceMetricsNextPending + offset) % SERVICE_METRICS_PENDING_CAPACITY];
+        if (!candidate->active) {
+            pending = candidate;
+            break;
+        }
+    }
+    if (pending == NULL) {
+        pending = &gServiceMetricsPending[gServiceMetricsNextPending];
+        gServiceMetricsPendingOverflows++;
+    }
+    gServiceMetricsNextPending = (uint8_t)((pending - gServiceMetricsPending + 1) % SERVICE_METRICS_PENDING_CAPACITY);
+
+    pending->active = true;
+    pending->invokeId = frame->invokeId;
+    pending->serviceChoice = frame->serviceChoice;
+    memcpy(pending->peerAddress, peerAddress, PACKET_ADDRESS_LENGTH);
+    pending->arrivalUs = arrivalUs;
+}
+
+void ServiceMetricsRecordResponse(const BACnetFrame* frame, const uint8_t* peerAddress)
+{
+    bool success = frame->apduType == APDU_TYPE_SIMPLE_ACK || frame->apduType == APDU_TYPE_COMPLEX_ACK;
+    bool failure = frame->apduType == APDU_TYPE_ERROR || frame->apduType == APDU_TYPE_REJECT || frame->apduType == APDU_TYPE_ABORT;
+    if (!success && !failure) {
+        return;
+    }
+
+    for (uint8_t offset = 0; offset < SERVICE_METRICS_PENDING_CAPACITY; offset++) {
+        ServiceMetricsPending* pending = &gServiceMetricsPending[offset];
+        if (!pending->active || pending->invokeId != frame->invokeId || memcmp(pending->peerAddress, peerAddress, PACKET_ADDRESS_LENGTH) != 0) {
+            continue;
+        }
+        pending->active = false;
+
+        ServiceMetrics* metrics = &gServiceMetrics[pending->serviceChoice];
+        if (failure) {
+            metrics->errors++;
+            return;
+        }
+        uint32_t latencyUs = micros() - pending->arrivalUs;
+        metrics->responses++;
+        metrics->latencyTotalUs += latencyUs;
+        HistogramRecord(&metrics->latency, latencyUs);
+        return;
+    }
+    gServiceMetricsUnmatchedResponses++;
+}
+
+const ServiceMetrics* ServiceMetricsGet(uint8_t serviceChoice)
+{
+    if (serviceChoice >= SERVICE_METRICS_SERVICE_COUNT) {
+        return NULL;
+    }
+    return &gServiceMetrics[serviceChoice];
+}
+
+uint32_t ServiceMetricsUnmatchedResponses()
+{
+    return gServiceMetricsUnmatchedResponses;
+}
+
+uint32_t ServiceMetricsPendingOverflows()
+{
+    return gServiceMetricsPendingOverflows;
+}
+
+uint32_t ServiceMetricsFormat(const ServiceMetrics* metrics, char* text, uint32_t maxLength)
+{
+    if (maxLength == 0) {
+        return 0;
+    }
+    // snprintf needs room for the terminator, which is not part of the returned text.
+    char buffer[256];
+    int length = snprintf(buffer, sizeof(buffer), "requests=%u responses=%u errors=%u max=%uus", metrics->requests, metrics->responses, metrics->errors, metrics->latency.maxUs);
+    for (uint8_t bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT && length > 0 && length < (int)sizeof(buffer); bucket++) {
+        if (metrics->latency.buckets[bucket] == 0) {
+            continue;
+        }
+        if (bucket < HISTOGRAM_BUCKET_COUNT - 1) {
+            length += snprintf(buffer + length, sizeof(buffer) - length, " <%u:%u", HistogramBucketLimitUs(bucket), metrics->latency.buckets[bucket]);
+        } else {
+            length += snprintf(buffer + length, sizeof(buffer) - length, " >=%u:%u", HistogramBucketLimitUs(bucket - 1), metrics->latency.buckets[bucket]);
+        }
+    }
+    if (length < 0) {
+        return 0;
+    }
+    uint32_t written = (uint32_t)length < sizeof(buffer) ? (uint32_t)length : sizeof(buffer) - 1;
+    if (written > maxLength) {
+        written = maxLength;
+    }
+    memcpy(text, buffer, written);
+    return written;
+}
+
+void ServiceMetricsDump()
+{
+    char text[256];
+    for (uint8_t serviceChoice = 0; serviceChoice < SERVICE_METRICS_SERVICE_COUNT; serviceChoice++) {
+        const ServiceMetrics* metrics = &gServiceMetrics[serviceChoice];
+        if (metrics->requests == 0) {
+            continue;
+        }
+        uint32_t length = ServiceMetricsFormat(metrics, text, sizeof(text) - 1);
+        text[length] = '\0';
+        LOG_FYI("Service %u: p50<%uus p99<%uus %s", serviceChoice, HistogramPercentileUs(&metrics->latency, 50), HistogramPercentileUs(&metrics->latency, 99), text);
+    }
+    LOG_FYI("Service metrics: %u unmatched responses, %u pending overflows", gServiceMetricsUnmatchedResponses, gServiceMetricsPendingOverflows);
+}
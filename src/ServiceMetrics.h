@@ -0,0 +1,49 @@
+/**
+ * Per-service request metrics
+ * --------------------------------------
+ * Measures how long the device takes to answer each BACnet confirmed service. A confirmed request
+ * is timestamped when it arrives (the receive ring records the arrival time) and remembered by
+ * invoke ID and peer address. When the stack sends the SimpleAck, ComplexAck, Error, Reject or
+ * Abort with the same invoke ID to the same peer, the elapsed time goes into a log2-bucket
+ * histogram for that service.
+ *
+ * Recording is a few byte compares and a scan of a small pending table, with no allocation. All
+ * functions must be called from the task that runs the CAS BACnet stack.
+ */
+
+#ifndef SERVICE_METRICS_H
+#define SERVICE_METRICS_H
+
+#include "BACnetFrame.h"
+#include "Histogram.h"
+
+#include <stdint.h>
+
+// Confirmed service choices 0..31 cover every service defined by the standard.
+const uint8_t SERVICE_METRICS_SERVICE_COUNT = 32;
+// Requests waiting for a response. The stack answers in order, so this only needs to cover one window.
+const uint8_t SERVICE_METRICS_PENDING_CAPACITY = 16;
+
+struct ServiceMetrics {
+    uint32_t requests;
+    uint32_t responses; // SimpleAck and ComplexAck
+    uint32_t errors; // Error, Reject and Abort
+    uint32_t latencyTotalUs;
+    Histogram latency; // Responses only
+};
+
+// Call for every frame handed to the stack. arrivalUs is micros() when it was received.
+void ServiceMetricsRecordRequest(const BACnetFrame* frame, const uint8_t* peerAddress, uint32_t arrivalUs);
+// Call for every frame the stack sends to a single peer.
+void ServiceMetricsRecordResponse(const BACnetFrame* frame, const uint8_t* peerAddress);
+
+const ServiceMetrics* ServiceMetricsGet(uint8_t serviceChoice);
+uint32_t ServiceMetricsUnmatchedResponses();
+uint32_t ServiceMetricsPendingOverflows();
+
+// Writes a one line summary of the non-empty histogram buckets, at most maxLength bytes. Returns the length written.
+uint32_t ServiceMetricsFormat(const ServiceMetrics* metrics, char* text, uint32_t maxLength);
+// Prints every service with at least one request to the serial port.
+void ServiceMetricsDump();
+
+#endif // SERVICE_METRICS_H
@@ -0,0 +1,282 @@
+/**
+ * BACnet/IP UDP transport
+ * --------------------------------------
+ * See Transport.h
+ */
+
+#include "Transport.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <lwip/sockets.h>
+#else
+#include "NativeArduino.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Logging.h"
+
+static_assert((TRANSPORT_RECEIVE_RING_CAPACITY & (TRANSPORT_RECEIVE_RING_CAPACITY - 1)) == 0, "TRANSPORT_RECEIVE_RING_CAPACITY must be a power of two");
+
+// Upper bound on datagrams handled in one TransportReceivePending() pass, so a flood can not
+// starve the rest of the loop.
+const uint32_t TRANSPORT_RECEIVE_MAX_BATCH = TRANSPORT_RECEIVE_RING_CAPACITY * 4;
+
+// Opened by the BACnet task once the link is up, polled by the network task in threaded mode.
+static std::atomic<int> gTransportSocket(-1);
+static uint16_t gTransportPort = 0;
+static PacketSlot gTransportReceiveSlots[TRANSPORT_RECEIVE_RING_CAPACITY];
+static PacketRing gTransportReceiveRing;
+
+// Broadcast address in network byte order, 0 until set. Written from the network event handler.
+static std::atomic<uint32_t> gTransportBroadcastAddress(0);
+
+static uint32_t gTransportPacketsReceived = 0;
+static uint32_t gTransportPacketsSent = 0;
+static uint32_t gTransportBroadcastsSent = 0;
+static uint32_t gTransportSendErrors = 0;
+static uint32_t gTransportSendTimeTotalUs = 0;
+static uint32_t gTransportSendTimeMaxUs = 0;
+static uint32_t gTransportReceiveLargestBatch = 0;
+static uint32_t gTransportReceiveRingFullStops = 0;
+static uint32_t gTransportReceiveSocketDrops = 0;
+
+bool TransportBegin(uint16_t port)
+{
+    if (!PacketRingBegin(&gTransportReceiveRing, gTransportReceiveSlots, TRANSPORT_RECEIVE_RING_CAPACITY)) {
+        LOG_ERROR("Could not set up the receive ring");
+        return false;
+    }
+
+    if (gTransportSocket >= 0) {
+        close(gTransportSocket);
+        gTransportSocket = -1;
+    }
+
+    int udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udpSocket < 0) {
+        LOG_ERROR("socket() failed, errno=%d", errno);
+        return false;
+    }
+
+    int enable = 1;
+    setsockopt(udpSocket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(udpSocket, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+#ifdef SO_RXQ_OVFL
+    // Linux reports the datagrams the socket buffer dropped with every datagram received
+    setsockopt(udpSocket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+#endif
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(udpSocket, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        LOG_ERROR("bind() to UDP port %u failed, errno=%d", port, errno);
+        close(udpSocket);
+        return false;
+    }
+
+    gTransportSocket = udpSocket;
+    gTransportPort = port;
+    return true;
+}
+
+bool TransportIsOpen()
+{
+    return gTransportSocket >= 0;
+}
+
+// Receive
+// ---------------------------------------------------------------------------
+bool TransportWaitReadable(uint32_t timeoutMs)
+{
+    if (gTransportSocket < 0) {
+        return false;
+    }
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(gTransportSocket, &readSet);
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(gTransportSocket + 1, &readSet, NULL, NULL, &timeout) > 0;
+}
+
+// Receives one pending datagram into a slot. Returns its length, or <= 0 if nothing is pending.
+static ssize_t TransportReceiveInto(PacketSlot* slot, struct sockaddr_in* source)
+{
+#ifdef SO_RXQ_OVFL
+    struct iovec vector;
+    vector.iov_base = slot->data;
+    vector.iov_len = sizeof(slot->data);
+    uint8_t control[CMSG_SPACE(sizeof(uint32_t))];
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_name = source;
+    header.msg_namelen = sizeof(*source);
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(gTransportSocket, &header, MSG_DONTWAIT);
+    if (received > 0) {
+        for (struct cmsghdr* message = CMSG_FIRSTHDR(&header); message != NULL; message = CMSG_NXTHDR(&header, message)) {
+            if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SO_RXQ_OVFL) {
+                memcpy(&gTransportReceiveSocketDrops, CMSG_DATA(message), sizeof(uint32_t)); // Total since the socket was opened
+            }
+        }
+    }
+    return received;
+#else
+    socklen_t sourceLength = sizeof(*source);
+    return recvfrom(gTransportSocket, slot->data, sizeof(slot->data), MSG_DONTWAIT, (struct sockaddr*)source, &sourceLength);
+#endif
+}
+
+uint32_t TransportReceivePending()
+{
+    if (gTransportSocket < 0) {
+        return 0;
+    }
+
+    uint32_t queued = 0;
+    for (uint32_t batch = 0; batch < TRANSPORT_RECEIVE_MAX_BATCH; batch++) {
+        PacketSlot* slot = PacketRingAcquireWrite(&gTransportReceiveRing);
+        if (slot == NULL) {
+            // The ring is full. Leave the rest in the socket buffer until the consumer frees a slot.
+            gTransportReceiveRingFullStops++;
+            break;
+        }
+
+        struct sockaddr_in source;
+        ssize_t received = TransportReceiveInto(slot, &source);
+        if (received <= 0) {
+            break; // Nothing pending (EWOULDBLOCK) or error
+        }
+
+        slot->length = (uint16_t)received;
+        slot->timestamp = micros();
+        memcpy(slot->address, &source.sin_addr.s_addr, 4); // Already in network (big endian) order
+        uint16_t sourcePort = ntohs(source.sin_port);
+        slot->address[4] = sourcePort / 256;
+        slot->address[5] = sourcePort % 256;
+        PacketRingCommitWrite(&gTransportReceiveRing);
+        queued++;
+    }
+
+    gTransportPacketsReceived += queued;
+    if (queued > gTransportReceiveLargestBatch) {
+        gTransportReceiveLargestBatch = queued;
+    }
+    return queued;
+}
+
+const PacketSlot* TransportPeekReceived()
+{
+    return PacketRingPeekRead(&gTransportReceiveRing);
+}
+
+void TransportReleaseReceived()
+{
+    PacketRingReleaseRead(&gTransportReceiveRing);
+}
+
+bool TransportReceiveRingFull()
+{
+    return PacketRingDepth(&gTransportReceiveRing) >= TRANSPORT_RECEIVE_RING_CAPACITY;
+}
+
+// Send
+// ---------------------------------------------------------------------------
+void TransportSetBroadcastAddress(const uint8_t* localIPAddress, const uint8_t* subnetMask)
+{
+    uint8_t broadcastIPAddress[4];
+    for (int offset = 0; offset < 4; offset++) {
+        broadcastIPAddress[offset] = localIPAddress[offset] | (uint8_t)~subnetMask[offset];
+    }
+    uint32_t address;
+    memcpy(&address, broadcastIPAddress, 4);
+    gTransportBroadcastAddress.store(address, std::memory_order_relaxed);
+}
+
+bool TransportGetBroadcastAddress(uint8_t* broadcastIPAddress)
+{
+    uint32_t address = gTransportBroadcastAddress.load(std::memory_order_relaxed);
+    memcpy(broadcastIPAddress, &address, 4);
+    return address != 0;
+}
+
+bool TransportGetBroadcastConnectionString(uint8_t* connectionString)
+{
+    if (!TransportGetBroadcastAddress(connectionString)) {
+        return false;
+    }
+    connectionString[4] = gTransportPort / 256;
+    connectionString[5] = gTransportPort % 256;
+    return true;
+}
+
+uint16_t TransportSend(const uint8_t* message, uint16_t messageLength, const uint8_t* connectionString, bool broadcast)
+{
+    if (gTransportSocket < 0) {
+        return 0;
+    }
+    uint32_t startUs = micros();
+
+    struct sockaddr_in destination;
+    memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    if (broadcast) {
+        destination.sin_addr.s_addr = gTransportBroadcastAddress.load(std::memory_order_relaxed);
+        if (destination.sin_addr.s_addr == 0) {
+            gTransportSendErrors++;
+            return 0; // No network yet
+        }
+    } else {
+        memcpy(&destination.sin_addr.s_addr, connectionString, 4);
+    }
+    destination.sin_port = htons((uint16_t)(connectionString[4] * 256 + connectionString[5]));
+
+    ssize_t sent = sendto(gTransportSocket, message, messageLength, 0, (struct sockaddr*)&destination, sizeof(destination));
+
+    uint32_t elapsedUs = micros() - startUs;
+    gTransportSendTimeTotalUs += elapsedUs;
+    if (elapsedUs > gTransportSendTimeMaxUs) {
+        gTransportSendTimeMaxUs = elapsedUs;
+    }
+
+    if (sent != (ssize_t)messageLength) {
+        gTransportSendErrors++;
+        return 0;
+    }
+    gTransportPacketsSent++;
+    if (broadcast) {
+        gTransportBroadcastsSent++;
+    }
+    return messageLength;
+}
+
+void TransportGetStatistics(TransportStatistics* statistics)
+{
+    statistics->packetsReceived = gTransportPacketsReceived;
+    statistics->packetsSent = gTransportPacketsSent;
+    statistics->broadcastsSent = gTransportBroadcastsSent;
+    statistics->sendErrors = gTransportSendErrors;
+    statistics->sendTimeTotalUs = gTransportSendTimeTotalUs;
+    statistics->sendTimeMaxUs = gTransportSendTimeMaxUs;
+    statistics->receiveRingDepth = PacketRingDepth(&gTransportReceiveRing);
+    statistics->receiveRingHighWaterMark = gTransportReceiveRing.highWaterMark;
+    statistics->receiveRingFullStops = gTransportReceiveRingFullStops;
+    statistics->receiveSocketDrops = gTransportReceiveSocketDrops;
+    statistics->receiveLargestBatch = gTransportReceiveLargestBatch;
+}
@@ -0,0 +1,75 @@
+/**
+ * BACnet/IP UDP transport
+ * --------------------------------------
+ * Owns the BACnet/IP UDP socket. Uses the BSD socket API directly (lwIP on the ESP32, POSIX on the
+ * host-native build) so datagrams are received straight into preallocated buffers.
+ *
+ * TransportReceivePending() drains every datagram waiting on the socket in one pass into a
+ * fixed-capacity ring of preallocated packet slots, tagging each with its source address and
+ * arrival time. The BACnet stack's receive callback then consumes the slots in place. The ring is
+ * single-producer/single-consumer, so the draining and the consuming may happen in different tasks.
+ * When the ring is full the drain stops and the rest stays in the socket's receive buffer, which
+ * absorbs the burst until the next drain; only what overflows the socket buffer is lost.
+ *
+ * TransportSend() sends straight from the caller's buffer to a binary destination address. The
+ * broadcast address is cached and only recalculated when the network changes
+ * (TransportSetBroadcastAddress()).
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "PacketRing.h"
+
+#include <stdint.h>
+
+// Must be a power of two.
+const uint32_t TRANSPORT_RECEIVE_RING_CAPACITY = 8;
+
+struct TransportStatistics {
+    uint32_t packetsReceived;
+    uint32_t packetsSent;
+    uint32_t broadcastsSent;
+    uint32_t sendErrors;
+    uint32_t sendTimeTotalUs; // Time spent in TransportSend(), divide by packetsSent for the per-response cost
+    uint32_t sendTimeMaxUs;
+    uint32_t receiveRingDepth;
+    uint32_t receiveRingHighWaterMark;
+    uint32_t receiveRingFullStops; // Drains that stopped with datagrams left in the socket buffer
+    uint32_t receiveSocketDrops; // Dropped by the socket buffer, where the platform reports it (not lwIP)
+    uint32_t receiveLargestBatch; // Most datagrams drained from the socket in a single pass
+};
+
+bool TransportBegin(uint16_t port);
+bool TransportIsOpen();
+
+// Receive
+// -----------------------------
+// Blocks until the socket has a datagram waiting or timeoutMs expires. Returns true if readable.
+bool TransportWaitReadable(uint32_t timeoutMs);
+// Moves every pending datagram from the socket into the receive ring. Returns the number queued.
+uint32_t TransportReceivePending();
+// Oldest received packet, or NULL. Must be released with TransportReleaseReceived() once consumed.
+const PacketSlot* TransportPeekReceived();
+void TransportReleaseReceived();
+// True when the ring has no free slot, pending datagrams wait in the socket buffer.
+bool TransportReceiveRingFull();
+
+// Send
+// -----------------------------
+// Recalculates the cached broadcast address. Call whenever the IP address or subnet mask changes.
+void TransportSetBroadcastAddress(const uint8_t* localIPAddress, const uint8_t* subnetMask);
+// Returns false if no broadcast address has been set yet.
+bool TransportGetBroadcastAddress(uint8_t* broadcastIPAddress);
+// 6 byte connection string of the broadcast address and the bound port, ready for fpSendIAm() or
+// TransportSend(). Returns false if no broadcast address has been set yet.
+bool TransportGetBroadcastConnectionString(uint8_t* connectionString);
+
+// connectionString is a 6 byte BACnet/IP address (IPv4 + port). If broadcast is set only the port
+// is used and the message goes to the cached broadcast address. Returns the number of bytes sent,
+// or 0 on error.
+uint16_t TransportSend(const uint8_t* message, uint16_t messageLength, const uint8_t* connectionString, bool broadcast);
+
+void TransportGetStatistics(TransportStatistics* statistics);
+
+#endif // TRANSPORT_H
@@ -0,0 +1,281 @@
+/**
+ * Trend log storage
+ * --------------------------------------
+ * See TrendLog.h
+ */
+
+#include "TrendLog.h"
+
+#include <stddef.h>
+#include <string.h>
+
+const uint8_t TREND_LOG_FLAG_STATUS_CHANGED = 0x01;
+const uint8_t TREND_LOG_FLAG_VALUE_CHANGED = 0x02;
+const uint8_t TREND_LOG_FLAG_BITS = 2; // The time difference follows the flags in the record header
+const uint8_t TREND_LOG_MAX_RECORD_BYTES = 5 + 5 + 1; // Header, value and status
+const uint8_t TREND_LOG_MAX_BLOCK_RECORDS = 0xFF;
+
+// Helpers
+// ---------------------------------------------------------------------------
+static TrendLogBlock* TrendLogGetBlock(const TrendLog* log, uint16_t block)
+{
+    return &log->blocks[(log->oldestBlock + block) % log->blockCount];
+}
+
+static uint32_t TrendLogOldestSequence(const TrendLog* log)
+{
+    return TrendLogGetBlock(log, 0)->firstSequence;
+}
+
+static uint8_t TrendLogPutVarint(uint8_t* buffer, uint64_t value)
+{
+    uint8_t length = 0;
+    while (value >= 0x80) {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    return length;
+}
+
+static uint64_t TrendLogGetVarint(const uint8_t* buffer, uint8_t* offset)
+{
+    uint64_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+    do {
+        byte = buffer[(*offset)++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// Difference of value to the previous value, small for small changes in either direction
+static uint32_t TrendLogValueDelta(TrendLogValueType valueType, uint32_t previous, uint32_t value)
+{
+    if (valueType == TREND_LOG_VALUE_REAL) {
+        return previous ^ value;
+    }
+    int32_t delta = (int32_t)(value - previous);
+    return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
+static uint32_t TrendLogApplyValueDelta(TrendLogValueType valueType, uint32_t previous, uint32_t delta)
+{
+    if (valueType == TREND_LOG_VALUE_REAL) {
+        return previous ^ delta;
+    }
+    return previous + ((delta >> 1) ^ (0 - (delta & 1)));
+}
+
+// Encodes a record as the difference to the newest one. Returns its length.
+static uint8_t TrendLogEncodeRecord(const TrendLog* log, uint32_t timestamp, uint32_t value, uint8_t statusFlags, uint8_t* buffer)
+{
+    uint32_t valueDelta = TrendLogValueDelta(log->valueType, log->lastValue, value);
+    uint64_t header = (uint64_t)(timestamp - log->lastTimestamp) << TREND_LOG_FLAG_BITS;
+    if (valueDelta != 0) {
+        header |= TREND_LOG_FLAG_VALUE_CHANGED;
+    }
+    if (statusFlags != log->lastStatusFlags) {
+        header |= TREND_LOG_FLAG_STATUS_CHANGED;
+    }
+    uint8_t length = TrendLogPutVarint(buffer, header);
+    if (valueDelta != 0) {
+        length += TrendLogPutVarint(buffer + length, valueDelta);
+    }
+    if (statusFlags != log->lastStatusFlags) {
+        buffer[length++] = statusFlags;
+    }
+    return length;
+}
+
+// Cursor on the first record of a block
+static void TrendLogCursorAtBlock(const TrendLog* log, uint16_t block, TrendLogCursor* cursor)
+{
+    const TrendLogBlock* data = TrendLogGetBlock(log, block);
+    cursor->position = data->firstSequence - TrendLogOldestSequence(log) + 1;
+    cursor->block = block;
+    cursor->recordInBlock = 0;
+    cursor->dataOffset = 0;
+    cursor->record.sequence = data->firstSequence;
+    cursor->record.timestamp = data->firstTimestamp;
+    cursor->record.value = data->firstValue;
+    cursor->record.statusFlags = data->firstStatusFlags;
+}
+
+// Setup
+// ---------------------------------------------------------------------------
+void TrendLogBegin(TrendLog* log, TrendLogValueType valueType, TrendLogBlock* blocks, uint16_t blockCount, TrendLogFlushFunction flush, void* flushContext)
+{
+    memset(log, 0, sizeof(*log));
+    log->valueType = valueType;
+    log->blocks = blocks;
+    log->blockCount = blockCount;
+    log->flush = flush;
+    log->flushContext = flushContext;
+}
+
+// Writer
+// ---------------------------------------------------------------------------
+void TrendLogAppend(TrendLog* log, uint32_t timestamp, uint32_t value, uint8_t statusFlags)
+{
+    if (log->blockCount == 0) {
+        return;
+    }
+    TrendLogStatistics* statistics = &log->statistics;
+    if (statistics->totalRecords > 0 && timestamp < log->lastTimestamp) {
+        statistics->clockSteps++;
+        timestamp = log->lastTimestamp;
+    }
+
+    if (statistics->blocksUsed > 0) {
+        TrendLogBlock* block = TrendLogGetBlock(log, (uint16_t)(statistics->blocksUsed - 1));
+        uint8_t encoded[TREND_LOG_MAX_RECORD_BYTES];
+        uint8_t length = TrendLogEncodeRecord(log, timestamp, value, statusFlags, encoded);
+        if (block->recordCount < TREND_LOG_MAX_BLOCK_RECORDS && block->length + length <= TREND_LOG_BLOCK_DATA_BYTES) {
+            memcpy(block->data + block->length, encoded, length);
+            block->length += length;
+            block->recordCount++;
+            statistics->bytesUsed += length;
+            statistics->recordCount++;
+            statistics->totalRecords++;
+            log->lastTimestamp = timestamp;
+            log->lastValue = value;
+            log->lastStatusFlags = statusFlags;
+            return;
+        }
+        // The newest block is full, it will not change any more
+        if (log->flush != NULL) {
+            log->flush(log->flushContext, block);
+            statistics->blocksFlushed++;
+        }
+    }
+
+    if (statistics->blocksUsed == log->blockCount) {
+        const TrendLogBlock* oldest = TrendLogGetBlock(log, 0);
+        statistics->recordCount -= oldest->recordCount;
+        statistics->bytesUsed -= TREND_LOG_BLOCK_HEADER_BYTES + oldest->length;
+        log->oldestBlock = (uint16_t)((log->oldestBlock + 1) % log->blockCount);
+        statistics->blocksUsed--;
+        statistics->blocksDropped++;
+    }
+    TrendLogBlock* block = TrendLogGetBlock(log, (uint16_t)statistics->blocksUsed);
+    block->firstSequence = statistics->totalRecords + 1;
+    block->firstTimestamp = timestamp;
+    block->firstValue = value;
+    block->firstStatusFlags = statusFlags;
+    block->recordCount = 1;
+    block->length = 0;
+    block->reserved = 0;
+    statistics->blocksUsed++;
+    statistics->bytesUsed += TREND_LOG_BLOCK_HEADER_BYTES;
+    statistics->recordCount++;
+    statistics->totalRecords++;
+    log->lastTimestamp = timestamp;
+    log->lastValue = value;
+    log->lastStatusFlags = statusFlags;
+}
+
+void TrendLogClear(TrendLog* log)
+{
+    log->oldestBlock = 0;
+    log->statistics.recordCount = 0;
+    log->statistics.blocksUsed = 0;
+    log->statistics.bytesUsed = 0;
+}
+
+// Readers
+// ---------------------------------------------------------------------------
+uint32_t TrendLogPositionOfSequence(const TrendLog* log, uint32_t sequence)
+{
+    if (log->statistics.recordCount == 0) {
+        return 0;
+    }
+    uint32_t offset = sequence - TrendLogOldestSequence(log);
+    return offset < log->statistics.recordCount ? offset + 1 : 0;
+}
+
+uint32_t TrendLogCountBefore(const TrendLog* log, uint32_t timestamp, bool inclusive)
+{
+    // Last block whose first record is before the time. Records are in time order, so every
+    // record before the time is in it or in an older block.
+    uint32_t low = 0;
+    uint32_t high = log->statistics.blocksUsed;
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        uint32_t firstTimestamp = TrendLogGetBlock(log, (uint16_t)middle)->firstTimestamp;
+        if (firstTimestamp < timestamp || (inclusive && firstTimestamp == timestamp)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0) {
+        return 0;
+    }
+
+    TrendLogCursor cursor;
+    TrendLogCursorAtBlock(log, (uint16_t)(low - 1), &cursor);
+    uint32_t count = cursor.position;
+    while (TrendLogNext(log, &cursor) && (cursor.record.timestamp < timestamp || (inclusive && cursor.record.timestamp == timestamp))) {
+        count++;
+    }
+    return count;
+}
+
+bool TrendLogSeek(const TrendLog* log, uint32_t position, TrendLogCursor* cursor)
+{
+    if (position == 0 || position > log->statistics.recordCount) {
+        return false;
+    }
+    // Last block starting at or before the position
+    uint32_t offset = position - 1;
+    uint32_t oldestSequence = TrendLogOldestSequence(log);
+    uint32_t low = 0;
+    uint32_t high = log->statistics.blocksUsed;
+    while (low + 1 < high) {
+        uint32_t middle = (low + high) / 2;
+        if (TrendLogGetBlock(log, (uint16_t)middle)->firstSequence - oldestSequence <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    TrendLogCursorAtBlock(log, (uint16_t)low, cursor);
+    while (cursor->position < position) {
+        TrendLogNext(log, cursor);
+    }
+    return true;
+}
+
+bool TrendLogNext(const TrendLog* log, TrendLogCursor* cursor)
+{
+    const TrendLogBlock* block = TrendLogGetBlock(log, cursor->block);
+    if (cursor->recordInBlock + 1 >= block->recordCount) {
+        if ((uint32_t)cursor->block + 1 >= log->statistics.blocksUsed) {
+            return false;
+        }
+        TrendLogCursorAtBlock(log, (uint16_t)(cursor->block + 1), cursor);
+        return true;
+    }
+
+    uint64_t header = TrendLogGetVarint(block->data, &cursor->dataOffset);
+    TrendLogRecord* record = &cursor->record;
+    record->timestamp += (uint32_t)(header >> TREND_LOG_FLAG_BITS);
+    if (header & TREND_LOG_FLAG_VALUE_CHANGED) {
+        record->value = TrendLogApplyValueDelta(log->valueType, record->value, (uint32_t)TrendLogGetVarint(block->data, &cursor->dataOffset));
+    }
+    if (header & TREND_LOG_FLAG_STATUS_CHANGED) {
+        record->statusFlags = block->data[cursor->dataOffset++];
+    }
+    record->sequence++;
+    cursor->recordInBlock++;
+    cursor->position++;
+    return true;
+}
+
+void TrendLogGetStatistics(const TrendLog* log, TrendLogStatistics* statistics)
+{
+    *statistics = log->statistics;
+}
@@ -0,0 +1,119 @@
+/**
+ * Trend log storage
+ * --------------------------------------
+ * Keeps the history of one point in a fixed ring of blocks, so a supervisor can read back what
+ * happened while it could not reach the device (ReadRange, see ReadRange.h).
+ *
+ * Records are delta encoded. Each block starts with one record in full in its header; the records
+ * after it are stored as the difference to the record before them, in a varint header holding the
+ * time difference and two flags (value changed, status changed), followed by the value difference
+ * only if the value changed and the status flags only if they changed. An unchanged value logged
+ * at a short interval takes one byte. Unsigned and enumerated values store the zigzag encoded
+ * difference, REAL values the XOR of the bits.
+ *
+ * When the ring is full the oldest block is dropped with all its records. A block that fills up is
+ * sealed and offered to an optional flush function, which can copy it to flash. Each block's first
+ * sequence number and timestamp are in its header, so a record is found by a binary search over
+ * the blocks and decoding within one block, without decoding the log from the start. Nothing here
+ * allocates; the caller provides the blocks (RAM or PSRAM).
+ *
+ * Timestamps are seconds and never go backwards: a timestamp earlier than the previous record is
+ * stored as the previous one and counted.
+ */
+
+#ifndef TREND_LOG_H
+#define TREND_LOG_H
+
+#include <stdint.h>
+
+const uint16_t TREND_LOG_BLOCK_BYTES = 64;
+const uint16_t TREND_LOG_BLOCK_HEADER_BYTES = 16;
+const uint16_t TREND_LOG_BLOCK_DATA_BYTES = TREND_LOG_BLOCK_BYTES - TREND_LOG_BLOCK_HEADER_BYTES;
+
+enum TrendLogValueType : uint8_t {
+    TREND_LOG_VALUE_UNSIGNED,
+    TREND_LOG_VALUE_ENUMERATED,
+    TREND_LOG_VALUE_REAL // presentValue holds the bits of the float
+};
+
+struct TrendLogRecord {
+    uint32_t sequence; // 1 for the first record ever logged, see TrendLogStatistics::totalRecords
+    uint32_t timestamp; // Seconds
+    uint32_t value;
+    uint8_t statusFlags;
+};
+
+struct TrendLogBlock {
+    uint32_t firstSequence;
+    uint32_t firstTimestamp;
+    uint32_t firstValue;
+    uint8_t firstStatusFlags;
+    uint8_t recordCount;
+    uint8_t length; // Bytes of data used
+    uint8_t reserved;
+    uint8_t data[TREND_LOG_BLOCK_DATA_BYTES]; // Delta encoded records after the first
+};
+static_assert(sizeof(TrendLogBlock) == TREND_LOG_BLOCK_BYTES, "TrendLogBlock must be packed to TREND_LOG_BLOCK_BYTES");
+
+// Called with each block once it is full and will not change any more.
+typedef void (*TrendLogFlushFunction)(void* context, const TrendLogBlock* block);
+
+struct TrendLogStatistics {
+    uint32_t recordCount; // Records in the ring
+    uint32_t totalRecords; // Records ever logged, the sequence number of the newest
+    uint32_t blocksUsed;
+    uint32_t bytesUsed; // Headers and data of the blocks in use
+    uint32_t blocksDropped; // Oldest blocks dropped to make room
+    uint32_t blocksFlushed;
+    uint32_t clockSteps; // Timestamps earlier than the previous record
+};
+
+struct TrendLog {
+    TrendLogValueType valueType;
+    TrendLogBlock* blocks;
+    uint16_t blockCount;
+    uint16_t oldestBlock; // Ring position of the oldest block
+    TrendLogFlushFunction flush;
+    void* flushContext;
+
+    // Newest record, the base of the next delta
+    uint32_t lastTimestamp;
+    uint32_t lastValue;
+    uint8_t lastStatusFlags;
+
+    TrendLogStatistics statistics;
+};
+
+// Reading position, see TrendLogSeek() and TrendLogNext()
+struct TrendLogCursor {
+    uint32_t position; // 1 for the oldest record in the ring
+    uint16_t block; // Blocks from the oldest
+    uint8_t recordInBlock;
+    uint8_t dataOffset;
+    TrendLogRecord record; // Record at position
+};
+
+// Setup
+// -----------------------------
+// blocks must stay valid for the life of the log. flush may be NULL.
+void TrendLogBegin(TrendLog* log, TrendLogValueType valueType, TrendLogBlock* blocks, uint16_t blockCount, TrendLogFlushFunction flush, void* flushContext);
+
+// Writer
+// -----------------------------
+void TrendLogAppend(TrendLog* log, uint32_t timestamp, uint32_t value, uint8_t statusFlags);
+void TrendLogClear(TrendLog* log); // Drops every record, sequence numbers carry on
+
+// Readers
+// -----------------------------
+// Positions run from 1 (oldest) to statistics.recordCount (newest).
+uint32_t TrendLogPositionOfSequence(const TrendLog* log, uint32_t sequence); // 0 if not in the ring
+// Number of records with a timestamp before (or, if inclusive, at or before) the given time.
+uint32_t TrendLogCountBefore(const TrendLog* log, uint32_t timestamp, bool inclusive);
+// Places the cursor on the record at position. Returns false if there is none.
+bool TrendLogSeek(const TrendLog* log, uint32_t position, TrendLogCursor* cursor);
+// Moves the cursor to the next record. Returns false at the newest record.
+bool TrendLogNext(const TrendLog* log, TrendLogCursor* cursor);
+
+void TrendLogGetStatistics(const TrendLog* log, TrendLogStatistics* statistics);
+
+#endif // TREND_LOG_H
@@ -0,0 +1,776 @@
+/**
+ * Virtual devices
+ * --------------------------------------
+ * See VirtualDevices.h
+ */
+
+#include "VirtualDevices.h"
+
+#include <stddef.h>
+#include <string.h>
+
+const uint16_t VIRTUAL_DEVICES_REQUEST_HEADER_LENGTH = 4; // Unsegmented confirmed request APDU header
+const uint16_t VIRTUAL_DEVICES_OBJECT_DEVICE = 0xFFFE; // Object index of the device object
+const uint32_t VIRTUAL_DEVICES_NO_INDEX = 0xFFFFFFFF;
+
+// Property values that are the same for every device
+const uint32_t VIRTUAL_DEVICES_PROTOCOL_VERSION = 1;
+const uint32_t VIRTUAL_DEVICES_PROTOCOL_REVISION = 14;
+const uint32_t VIRTUAL_DEVICES_APDU_TIMEOUT_MS = 3000;
+const uint32_t VIRTUAL_DEVICES_APDU_RETRIES = 3;
+const uint8_t VIRTUAL_DEVICES_SERVICES_SUPPORTED[] = { 12, 14, 15, 26, 34 }; // ReadProperty, ReadPropertyMultiple, WriteProperty, I-Am, Who-Is
+const uint8_t VIRTUAL_DEVICES_SERVICES_SUPPORTED_BITS = 41;
+const uint8_t VIRTUAL_DEVICES_OBJECT_TYPES_SUPPORTED[] = { 0, 2, 3, 5, 8, 13, 19 };
+const uint8_t VIRTUAL_DEVICES_OBJECT_TYPES_SUPPORTED_BITS = 55;
+
+// Supported properties of each kind of object, in the order ALL returns them
+const uint32_t VIRTUAL_DEVICES_DEVICE_PROPERTIES[] = { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, BACNET_PROPERTY_IDENTIFIER_SYSTEM_STATUS, BACNET_PROPERTY_IDENTIFIER_VENDOR_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_PROTOCOL_VERSION, BACNET_PROPERTY_IDENTIFIER_PROTOCOL_REVISION, BACNET_PROPERTY_IDENTIFIER_PROTOCOL_SERVICES_SUPPORTED, BACNET_PROPERTY_IDENTIFIER_PROTOCOL_OBJECT_TYPES_SUPPORTED, BACNET_PROPERTY_IDENTIFIER_OBJECT_LIST, BACNET_PROPERTY_IDENTIFIER_MAX_APDU_LENGTH_ACCEPTED, BACNET_PROPERTY_IDENTIFIER_SEGMENTATION_SUPPORTED, BACNET_PROPERTY_IDENTIFIER_APDU_TIMEOUT, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_APDU_RETRIES, BACNET_PROPERTY_IDENTIFIER_DEVICE_ADDRESS_BINDING };
+const uint32_t VIRTUAL_DEVICES_ANALOG_PROPERTIES[] = { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS, BACNET_PROPERTY_IDENTIFIER_EVENT_STATE, BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE, BACNET_PROPERTY_IDENTIFIER_UNITS };
+const uint32_t VIRTUAL_DEVICES_BINARY_INPUT_PROPERTIES[] = { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS, BACNET_PROPERTY_IDENTIFIER_EVENT_STATE, BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE, BACNET_PROPERTY_IDENTIFIER_POLARITY };
+const uint32_t VIRTUAL_DEVICES_BINARY_VALUE_PROPERTIES[] = { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS, BACNET_PROPERTY_IDENTIFIER_EVENT_STATE, BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE };
+const uint32_t VIRTUAL_DEVICES_MULTI_STATE_PROPERTIES[] = { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS, BACNET_PROPERTY_IDENTIFIER_EVENT_STATE, BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES };
+
+enum VirtualDevicesResult : uint8_t {
+    VIRTUAL_DEVICES_OK,
+    VIRTUAL_DEVICES_ERROR, // errorClass and errorCode are set
+    VIRTUAL_DEVICES_NO_ROOM, // The response does not fit the client's max APDU
+    VIRTUAL_DEVICES_MALFORMED
+};
+
+struct VirtualDevicesError {
+    uint8_t errorClass;
+    uint8_t errorCode;
+};
+
+// Helpers
+// ---------------------------------------------------------------------------
+static uint32_t VirtualDevicesHash(uint32_t deviceInstance)
+{
+    return (deviceInstance * 2654435761u) >> 7;
+}
+
+static VirtualDevicesResult VirtualDevicesFail(VirtualDevicesError* error, uint8_t errorClass, uint8_t errorCode)
+{
+    error->errorClass = errorClass;
+    error->errorCode = errorCode;
+    return VIRTUAL_DEVICES_ERROR;
+}
+
+static bool VirtualDevicesPut(uint8_t* buffer, uint16_t* offset, uint16_t limit, uint8_t value)
+{
+    if (*offset >= limit) {
+        return false;
+    }
+    buffer[(*offset)++] = value;
+    return true;
+}
+
+// Adds the length of a value written by an encoder that returns 0 when it does not fit
+static bool VirtualDevicesAdvance(uint16_t length, uint16_t* offset)
+{
+    *offset += length;
+    return length > 0;
+}
+
+// Objects
+// ---------------------------------------------------------------------------
+static bool VirtualDevicesIsAnalog(uint16_t objectType)
+{
+    return objectType == BACNET_OBJECT_TYPE_ANALOG_INPUT || objectType == BACNET_OBJECT_TYPE_ANALOG_VALUE;
+}
+
+static bool VirtualDevicesIsBinary(uint16_t objectType)
+{
+    return objectType == BACNET_OBJECT_TYPE_BINARY_INPUT || objectType == BACNET_OBJECT_TYPE_BINARY_VALUE;
+}
+
+static bool VirtualDevicesIsMultiState(uint16_t objectType)
+{
+    return objectType == BACNET_OBJECT_TYPE_MULTI_STATE_INPUT || objectType == BACNET_OBJECT_TYPE_MULTI_STATE_VALUE;
+}
+
+// Object index in the device's table, VIRTUAL_DEVICES_OBJECT_DEVICE or VIRTUAL_DEVICE_NONE
+static uint16_t VirtualDevicesFindObject(const VirtualDevice* device, uint16_t objectType, uint32_t objectInstance)
+{
+    if (objectType == BACNET_OBJECT_TYPE_DEVICE) {
+        return objectInstance == device->deviceInstance || objectInstance == BACNET_INSTANCE_WILDCARD ? VIRTUAL_DEVICES_OBJECT_DEVICE : VIRTUAL_DEVICE_NONE;
+    }
+    for (uint16_t object = 0; object < device->objectCount; object++) {
+        if (device->objects[object].objectInstance == objectInstance && device->objects[object].objectType == objectType) {
+            return object;
+        }
+    }
+    return VIRTUAL_DEVICE_NONE;
+}
+
+static const uint32_t* VirtualDevicesGetProperties(uint16_t objectType, uint8_t* count)
+{
+    if (objectType == BACNET_OBJECT_TYPE_DEVICE) {
+        *count = (uint8_t)PropertyArrayCount(VIRTUAL_DEVICES_DEVICE_PROPERTIES);
+        return VIRTUAL_DEVICES_DEVICE_PROPERTIES;
+    }
+    if (VirtualDevicesIsAnalog(objectType)) {
+        *count = (uint8_t)PropertyArrayCount(VIRTUAL_DEVICES_ANALOG_PROPERTIES);
+        return VIRTUAL_DEVICES_ANALOG_PROPERTIES;
+    }
+    if (objectType == BACNET_OBJECT_TYPE_BINARY_INPUT) {
+        *count = (uint8_t)PropertyArrayCount(VIRTUAL_DEVICES_BINARY_INPUT_PROPERTIES);
+        return VIRTUAL_DEVICES_BINARY_INPUT_PROPERTIES;
+    }
+    if (objectType == BACNET_OBJECT_TYPE_BINARY_VALUE) {
+        *count = (uint8_t)PropertyArrayCount(VIRTUAL_DEVICES_BINARY_VALUE_PROPERTIES);
+        return VIRTUAL_DEVICES_BINARY_VALUE_PROPERTIES;
+    }
+    *count = (uint8_t)PropertyArrayCount(VIRTUAL_DEVICES_MULTI_STATE_PROPERTIES);
+    return VIRTUAL_DEVICES_MULTI_STATE_PROPERTIES;
+}
+
+static bool VirtualDevicesHasProperty(uint16_t objectType, uint32_t propertyIdentifier)
+{
+    uint8_t count;
+    const uint32_t* properties = VirtualDevicesGetProperties(objectType, &count);
+    for (uint8_t property = 0; property < count; property++) {
+        if (properties[property] == propertyIdentifier) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Values
+// ---------------------------------------------------------------------------
+static VirtualDevicesResult VirtualDevicesEncodeObjectList(const VirtualDevice* device, uint32_t arrayIndex, uint8_t* buffer, uint16_t* offset, uint16_t limit, VirtualDevicesError* error)
+{
+    uint32_t count = (uint32_t)device->objectCount + 1; // The device object comes first
+    if (arrayIndex == 0) {
+        return VirtualDevicesAdvance(BACnetEncodeUnsigned(buffer + *offset, limit - *offset, count), offset) ? VIRTUAL_DEVICES_OK : VIRTUAL_DEVICES_NO_ROOM;
+    }
+    if (arrayIndex != VIRTUAL_DEVICES_NO_INDEX && arrayIndex > count) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_INVALID_ARRAY_INDEX);
+    }
+    uint32_t first = arrayIndex == VIRTUAL_DEVICES_NO_INDEX ? 1 : arrayIndex;
+    uint32_t last = arrayIndex == VIRTUAL_DEVICES_NO_INDEX ? count : arrayIndex;
+    for (uint32_t element = first; element <= last; element++) {
+        uint16_t objectType = BACNET_OBJECT_TYPE_DEVICE;
+        uint32_t objectInstance = device->deviceInstance;
+        if (element > 1) {
+            objectType = device->objects[element - 2].objectType;
+            objectInstance = device->objects[element - 2].objectInstance;
+        }
+        if (!VirtualDevicesAdvance(BACnetEncodeObjectIdentifier(buffer + *offset, limit - *offset, objectType, objectInstance), offset)) {
+            return VIRTUAL_DEVICES_NO_ROOM;
+        }
+    }
+    return VIRTUAL_DEVICES_OK;
+}
+
+static uint16_t VirtualDevicesEncodeDeviceValue(const VirtualDevices* state, const VirtualDevice* device, uint32_t propertyIdentifier, uint8_t* buffer, uint16_t maxLength)
+{
+    switch (propertyIdentifier) {
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER:
+            return BACnetEncodeObjectIdentifier(buffer, maxLength, BACNET_OBJECT_TYPE_DEVICE, device->deviceInstance);
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME:
+            return BACnetEncodeCharacterString(buffer, maxLength, device->name, (uint32_t)strlen(device->name));
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE:
+            return BACnetEncodeEnumerated(buffer, maxLength, BACNET_OBJECT_TYPE_DEVICE);
+        case BACNET_PROPERTY_IDENTIFIER_SYSTEM_STATUS:
+            return BACnetEncodeEnumerated(buffer, maxLength, 0); // Operational
+        case BACNET_PROPERTY_IDENTIFIER_VENDOR_IDENTIFIER:
+            return BACnetEncodeUnsigned(buffer, maxLength, state->vendorIdentifier);
+        case BACNET_PROPERTY_IDENTIFIER_PROTOCOL_VERSION:
+            return BACnetEncodeUnsigned(buffer, maxLength, VIRTUAL_DEVICES_PROTOCOL_VERSION);
+        case BACNET_PROPERTY_IDENTIFIER_PROTOCOL_REVISION:
+            return BACnetEncodeUnsigned(buffer, maxLength, VIRTUAL_DEVICES_PROTOCOL_REVISION);
+        case BACNET_PROPERTY_IDENTIFIER_PROTOCOL_SERVICES_SUPPORTED:
+            return BACnetEncodeBitString(buffer, maxLength, VIRTUAL_DEVICES_SERVICES_SUPPORTED_BITS, VIRTUAL_DEVICES_SERVICES_SUPPORTED, (uint8_t)sizeof(VIRTUAL_DEVICES_SERVICES_SUPPORTED));
+        case BACNET_PROPERTY_IDENTIFIER_PROTOCOL_OBJECT_TYPES_SUPPORTED:
+            return BACnetEncodeBitString(buffer, maxLength, VIRTUAL_DEVICES_OBJECT_TYPES_SUPPORTED_BITS, VIRTUAL_DEVICES_OBJECT_TYPES_SUPPORTED, (uint8_t)sizeof(VIRTUAL_DEVICES_OBJECT_TYPES_SUPPORTED));
+        case BACNET_PROPERTY_IDENTIFIER_MAX_APDU_LENGTH_ACCEPTED:
+            return BACnetEncodeUnsigned(buffer, maxLength, VIRTUAL_DEVICES_MAX_APDU);
+        case BACNET_PROPERTY_IDENTIFIER_SEGMENTATION_SUPPORTED:
+            return BACnetEncodeEnumerated(buffer, maxLength, BACNET_SEGMENTATION_NONE);
+        case BACNET_PROPERTY_IDENTIFIER_APDU_TIMEOUT:
+            return BACnetEncodeUnsigned(buffer, maxLength, VIRTUAL_DEVICES_APDU_TIMEOUT_MS);
+        default:
+            return BACnetEncodeUnsigned(buffer, maxLength, VIRTUAL_DEVICES_APDU_RETRIES);
+    }
+}
+
+static uint16_t VirtualDevicesEncodeObjectValue(const VirtualDevice* device, uint16_t object, uint32_t propertyIdentifier, uint8_t* buffer, uint16_t maxLength)
+{
+    const VirtualObject* definition = &device->objects[object];
+    switch (propertyIdentifier) {
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER:
+            return BACnetEncodeObjectIdentifier(buffer, maxLength, definition->objectType, definition->objectInstance);
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME:
+            return BACnetEncodeCharacterString(buffer, maxLength, definition->name.value, definition->name.length);
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE:
+            return BACnetEncodeEnumerated(buffer, maxLength, definition->objectType);
+        case BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE: {
+            uint32_t value = device->presentValues[object];
+            if (VirtualDevicesIsAnalog(definition->objectType)) {
+                float real;
+                memcpy(&real, &value, sizeof(real));
+                return BACnetEncodeReal(buffer, maxLength, real);
+            }
+            return VirtualDevicesIsBinary(definition->objectType) ? BACnetEncodeEnumerated(buffer, maxLength, value) : BACnetEncodeUnsigned(buffer, maxLength, value);
+        }
+        case BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS: {
+            const uint8_t noBits[1] = { 0 };
+            return BACnetEncodeBitString(buffer, maxLength, 4, noBits, 0);
+        }
+        case BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE:
+            return BACnetEncodeBoolean(buffer, maxLength, false);
+        case BACNET_PROPERTY_IDENTIFIER_UNITS:
+            return BACnetEncodeEnumerated(buffer, maxLength, BACNET_UNITS_NO_UNITS);
+        case BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES:
+            return BACnetEncodeUnsigned(buffer, maxLength, definition->stateCount);
+        default:
+            return BACnetEncodeEnumerated(buffer, maxLength, 0); // Event state normal, polarity normal
+    }
+}
+
+// Encodes the value of a property, without tags around it
+static VirtualDevicesResult VirtualDevicesEncodeValue(const VirtualDevices* state, const VirtualDevice* device, uint16_t object, uint32_t propertyIdentifier, uint32_t arrayIndex, uint8_t* buffer, uint16_t* offset, uint16_t limit, VirtualDevicesError* error)
+{
+    uint16_t objectType = object == VIRTUAL_DEVICES_OBJECT_DEVICE ? BACNET_OBJECT_TYPE_DEVICE : device->objects[object].objectType;
+    if (!VirtualDevicesHasProperty(objectType, propertyIdentifier)) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_UNKNOWN_PROPERTY);
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_OBJECT_LIST) {
+        return VirtualDevicesEncodeObjectList(device, arrayIndex, buffer, offset, limit, error);
+    }
+    if (arrayIndex != VIRTUAL_DEVICES_NO_INDEX) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_PROPERTY_IS_NOT_AN_ARRAY);
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_DEVICE_ADDRESS_BINDING) {
+        return VIRTUAL_DEVICES_OK; // Empty list, nothing is bound
+    }
+    uint16_t length;
+    if (object == VIRTUAL_DEVICES_OBJECT_DEVICE) {
+        length = VirtualDevicesEncodeDeviceValue(state, device, propertyIdentifier, buffer + *offset, limit - *offset);
+    } else {
+        length = VirtualDevicesEncodeObjectValue(device, object, propertyIdentifier, buffer + *offset, limit - *offset);
+    }
+    return VirtualDevicesAdvance(length, offset) ? VIRTUAL_DEVICES_OK : VIRTUAL_DEVICES_NO_ROOM;
+}
+
+// Services
+// ---------------------------------------------------------------------------
+// Object [0], property [1] and optional array index [2], as at the start of ReadProperty and WriteProperty
+static bool VirtualDevicesDecodeReference(const uint8_t* apdu, uint16_t apduLength, uint16_t* offset, uint16_t* objectType, uint32_t* objectInstance, uint32_t* propertyIdentifier, uint32_t* arrayIndex)
+{
+    if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, offset, 0, objectType, objectInstance) || !BACnetDecodeContextUnsigned(apdu, apduLength, offset, 1, propertyIdentifier)) {
+        return false;
+    }
+    if (!BACnetDecodeContextUnsigned(apdu, apduLength, offset, 2, arrayIndex)) {
+        *arrayIndex = VIRTUAL_DEVICES_NO_INDEX;
+    }
+    return true;
+}
+
+// ReadProperty-ACK: object [0], property [1], array index [2] and value [3]
+static VirtualDevicesResult VirtualDevicesReadProperty(const VirtualDevices* state, const VirtualDevice* device, const uint8_t* apdu, uint16_t apduLength, uint8_t* response, uint16_t* offset, uint16_t limit, VirtualDevicesError* error)
+{
+    uint16_t requestOffset = VIRTUAL_DEVICES_REQUEST_HEADER_LENGTH;
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    uint32_t arrayIndex;
+    if (!VirtualDevicesDecodeReference(apdu, apduLength, &requestOffset, &objectType, &objectInstance, &propertyIdentifier, &arrayIndex) || requestOffset != apduLength) {
+        return VIRTUAL_DEVICES_MALFORMED;
+    }
+    uint16_t object = VirtualDevicesFindObject(device, objectType, objectInstance);
+    if (object == VIRTUAL_DEVICE_NONE) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_OBJECT, BACNET_ERROR_CODE_UNKNOWN_OBJECT);
+    }
+    if (object == VIRTUAL_DEVICES_OBJECT_DEVICE) {
+        objectInstance = device->deviceInstance;
+    }
+
+    if (!VirtualDevicesAdvance(BACnetEncodeContextObjectIdentifier(response + *offset, limit - *offset, 0, objectType, objectInstance), offset) || !VirtualDevicesAdvance(BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 1, propertyIdentifier), offset)) {
+        return VIRTUAL_DEVICES_NO_ROOM;
+    }
+    if (arrayIndex != VIRTUAL_DEVICES_NO_INDEX && !VirtualDevicesAdvance(BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 2, arrayIndex), offset)) {
+        return VIRTUAL_DEVICES_NO_ROOM;
+    }
+    if (!VirtualDevicesPut(response, offset, limit, 3 << 4 | BACNET_TAG_OPENING)) {
+        return VIRTUAL_DEVICES_NO_ROOM;
+    }
+    VirtualDevicesResult result = VirtualDevicesEncodeValue(state, device, object, propertyIdentifier, arrayIndex, response, offset, limit, error);
+    if (result != VIRTUAL_DEVICES_OK) {
+        return result;
+    }
+    return VirtualDevicesPut(response, offset, limit, 3 << 4 | BACNET_TAG_CLOSING) ? VIRTUAL_DEVICES_OK : VIRTUAL_DEVICES_NO_ROOM;
+}
+
+// One result of ReadPropertyMultiple-ACK: property [2], array index [3], then the value [4] or the error [5]
+static VirtualDevicesResult VirtualDevicesReadAccessResult(const VirtualDevices* state, const VirtualDevice* device, uint16_t object, uint32_t propertyIdentifier, uint32_t arrayIndex, uint8_t* response, uint16_t* offset, uint16_t limit)
+{
+    if (!VirtualDevicesAdvance(BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 2, propertyIdentifier), offset)) {
+        return VIRTUAL_DEVICES_NO_ROOM;
+    }
+    if (arrayIndex != VIRTUAL_DEVICES_NO_INDEX && !VirtualDevicesAdvance(BACnetEncodeContextUnsigned(response + *offset, limit - *offset, 3, arrayIndex), offset)) {
+        return VIRTUAL_DEVICES_NO_ROOM;
+    }
+    uint16_t valueStart = *offset;
+    VirtualDevicesError error = { BACNET_ERROR_CLASS_OBJECT, BACNET_ERROR_CODE_UNKNOWN_OBJECT };
+    VirtualDevicesResult result = VIRTUAL_DEVICES_ERROR;
+    if (object != VIRTUAL_DEVICE_NONE) {
+        if (!VirtualDevicesPut(response, offset, limit, 4 << 4 | BACNET_TAG_OPENING)) {
+            return VIRTUAL_DEVICES_NO_ROOM;
+        }
+        result = VirtualDevicesEncodeValue(state, device, object, propertyIdentifier, arrayIndex, response, offset, limit, &error);
+        if (result == VIRTUAL_DEVICES_OK) {
+            return VirtualDevicesPut(response, offset, limit, 4 << 4 | BACNET_TAG_CLOSING) ? VIRTUAL_DEVICES_OK : VIRTUAL_DEVICES_NO_ROOM;
+        }
+        if (result != VIRTUAL_DEVICES_ERROR) {
+            return result;
+        }
+    }
+    *offset = valueStart;
+    if (!VirtualDevicesPut(response, offset, limit, 5 << 4 | BACNET_TAG_OPENING) || !VirtualDevicesAdvance(BACnetEncodeEnumerated(response + *offset, limit - *offset, error.errorClass), offset) || !VirtualDevicesAdvance(BACnetEncodeEnumerated(response + *offset, limit - *offset, error.errorCode), offset) || !VirtualDevicesPut(response, offset, limit, 5 << 4 | BACNET_TAG_CLOSING)) {
+        return VIRTUAL_DEVICES_NO_ROOM;
+    }
+    return VIRTUAL_DEVICES_OK;
+}
+
+// ReadPropertyMultiple-ACK: for each object, object [0] and a list [1] of results. ALL and
+// REQUIRED are expanded to the supported properties, every one of which is required.
+static VirtualDevicesResult VirtualDevicesReadPropertyMultiple(const VirtualDevices* state, const VirtualDevice* device, const uint8_t* apdu, uint16_t apduLength, uint8_t* response, uint16_t* offset, uint16_t limit)
+{
+    uint16_t requestOffset = VIRTUAL_DEVICES_REQUEST_HEADER_LENGTH;
+    if (requestOffset >= apduLength) {
+        return VIRTUAL_DEVICES_MALFORMED;
+    }
+    while (requestOffset < apduLength) {
+        uint16_t objectType;
+        uint32_t objectInstance;
+        if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, &requestOffset, 0, &objectType, &objectInstance) || !BACnetDecodeTag(apdu, apduLength, &requestOffset, 1, BACNET_TAG_OPENING)) {
+            return VIRTUAL_DEVICES_MALFORMED;
+        }
+        uint16_t object = VirtualDevicesFindObject(device, objectType, objectInstance);
+        if (object == VIRTUAL_DEVICES_OBJECT_DEVICE) {
+            objectInstance = device->deviceInstance;
+        }
+        if (!VirtualDevicesAdvance(BACnetEncodeContextObjectIdentifier(response + *offset, limit - *offset, 0, objectType, objectInstance), offset) || !VirtualDevicesPut(response, offset, limit, 1 << 4 | BACNET_TAG_OPENING)) {
+            return VIRTUAL_DEVICES_NO_ROOM;
+        }
+
+        while (!BACnetDecodeTag(apdu, apduLength, &requestOffset, 1, BACNET_TAG_CLOSING)) {
+            uint32_t propertyIdentifier;
+            uint32_t arrayIndex = VIRTUAL_DEVICES_NO_INDEX;
+            if (!BACnetDecodeContextUnsigned(apdu, apduLength, &requestOffset, 0, &propertyIdentifier)) {
+                return VIRTUAL_DEVICES_MALFORMED;
+            }
+            if (!BACnetDecodeContextUnsigned(apdu, apduLength, &requestOffset, 1, &arrayIndex)) {
+                arrayIndex = VIRTUAL_DEVICES_NO_INDEX; // Optional, the closing tag [1] is not taken for it
+            }
+
+            VirtualDevicesResult result;
+            if ((propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_ALL || propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_REQUIRED) && object != VIRTUAL_DEVICE_NONE) {
+                uint8_t count;
+                const uint32_t* properties = VirtualDevicesGetProperties(object == VIRTUAL_DEVICES_OBJECT_DEVICE ? BACNET_OBJECT_TYPE_DEVICE : objectType, &count);
+                result = VIRTUAL_DEVICES_OK;
+                for (uint8_t property = 0; property < count && result == VIRTUAL_DEVICES_OK; property++) {
+                    result = VirtualDevicesReadAccessResult(state, device, object, properties[property], VIRTUAL_DEVICES_NO_INDEX, response, offset, limit);
+                }
+            } else {
+                result = VirtualDevicesReadAccessResult(state, device, object, propertyIdentifier, arrayIndex, response, offset, limit);
+            }
+            if (result != VIRTUAL_DEVICES_OK) {
+                return result;
+            }
+        }
+        if (!VirtualDevicesPut(response, offset, limit, 1 << 4 | BACNET_TAG_CLOSING)) {
+            return VIRTUAL_DEVICES_NO_ROOM;
+        }
+    }
+    return VIRTUAL_DEVICES_OK;
+}
+
+// WriteProperty of a present value: object [0], property [1], array index [2], value [3] and
+// priority [4]. Objects are not commandable, the priority is accepted and ignored.
+static VirtualDevicesResult VirtualDevicesWriteProperty(VirtualDevices* state, VirtualDevice* device, const uint8_t* apdu, uint16_t apduLength, VirtualDevicesError* error)
+{
+    uint16_t requestOffset = VIRTUAL_DEVICES_REQUEST_HEADER_LENGTH;
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+    uint32_t arrayIndex;
+    if (!VirtualDevicesDecodeReference(apdu, apduLength, &requestOffset, &objectType, &objectInstance, &propertyIdentifier, &arrayIndex) || !BACnetDecodeTag(apdu, apduLength, &requestOffset, 3, BACNET_TAG_OPENING)) {
+        return VIRTUAL_DEVICES_MALFORMED;
+    }
+    uint16_t object = VirtualDevicesFindObject(device, objectType, objectInstance);
+    if (object == VIRTUAL_DEVICE_NONE) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_OBJECT, BACNET_ERROR_CODE_UNKNOWN_OBJECT);
+    }
+    uint16_t definitionType = object == VIRTUAL_DEVICES_OBJECT_DEVICE ? BACNET_OBJECT_TYPE_DEVICE : device->objects[object].objectType;
+    if (!VirtualDevicesHasProperty(definitionType, propertyIdentifier)) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_UNKNOWN_PROPERTY);
+    }
+    if (object == VIRTUAL_DEVICES_OBJECT_DEVICE || propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE || !device->objects[object].writable) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_WRITE_ACCESS_DENIED);
+    }
+    if (arrayIndex != VIRTUAL_DEVICES_NO_INDEX) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_PROPERTY_IS_NOT_AN_ARRAY);
+    }
+
+    const VirtualObject* definition = &device->objects[object];
+    uint32_t value;
+    bool decoded;
+    if (VirtualDevicesIsAnalog(definition->objectType)) {
+        float real;
+        decoded = BACnetDecodeReal(apdu, apduLength, &requestOffset, &real);
+        memcpy(&value, &real, sizeof(value));
+    } else if (VirtualDevicesIsBinary(definition->objectType)) {
+        decoded = BACnetDecodeEnumerated(apdu, apduLength, &requestOffset, &value);
+    } else {
+        decoded = BACnetDecodeUnsigned(apdu, apduLength, &requestOffset, &value);
+    }
+    if (!decoded) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_INVALID_DATA_TYPE);
+    }
+    uint32_t priority;
+    if (!BACnetDecodeTag(apdu, apduLength, &requestOffset, 3, BACNET_TAG_CLOSING) || (requestOffset < apduLength && !BACnetDecodeContextUnsigned(apdu, apduLength, &requestOffset, 4, &priority)) || requestOffset != apduLength) {
+        return VIRTUAL_DEVICES_MALFORMED;
+    }
+    if ((VirtualDevicesIsBinary(definition->objectType) && value > 1) || (VirtualDevicesIsMultiState(definition->objectType) && (value == 0 || value > definition->stateCount))) {
+        return VirtualDevicesFail(error, BACNET_ERROR_CLASS_PROPERTY, BACNET_ERROR_CODE_VALUE_OUT_OF_RANGE);
+    }
+    device->presentValues[object] = value;
+    state->statistics.writes++;
+    return VIRTUAL_DEVICES_OK;
+}
+
+// Routing
+// ---------------------------------------------------------------------------
+// BVLC and an NPDU with the virtual network and the device's address as the source
+static void VirtualDevicesPutHeader(const VirtualDevices* state, uint16_t deviceNumber, uint8_t* response, uint16_t length, bool broadcast)
+{
+    response[0] = BVLC_TYPE_BACNET_IP;
+    response[1] = broadcast ? BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU : BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    response[2] = (uint8_t)(length >> 8);
+    response[3] = (uint8_t)length;
+    response[4] = NPDU_VERSION;
+    response[5] = NPDU_CONTROL_SOURCE_SPECIFIER;
+    response[6] = (uint8_t)(state->networkNumber >> 8);
+    response[7] = (uint8_t)state->networkNumber;
+    response[8] = VIRTUAL_DEVICE_MAC_LENGTH;
+    response[9] = (uint8_t)(deviceNumber >> 8);
+    response[10] = (uint8_t)deviceNumber;
+}
+
+static void VirtualDevicesHandleConfirmed(VirtualDevices* state, uint16_t deviceNumber, const uint8_t* message, const BACnetFrame* frame, const uint8_t* sourceAddress)
+{
+    VirtualDevice* device = &state->devices[deviceNumber - 1];
+    const uint8_t* apdu = message + frame->apduOffset;
+    state->statistics.requests++;
+
+    // The client decides how large a response it accepts
+    uint16_t limit = VIRTUAL_DEVICES_HEADER_LENGTH + BACnetMaxAPDUAccepted(apdu[1]);
+    if (limit > VIRTUAL_DEVICES_RESPONSE_MAX_LENGTH) {
+        limit = VIRTUAL_DEVICES_RESPONSE_MAX_LENGTH;
+    }
+    uint8_t* response = state->response;
+    uint16_t offset = VIRTUAL_DEVICES_HEADER_LENGTH;
+    response[offset++] = APDU_TYPE_COMPLEX_ACK;
+    response[offset++] = frame->invokeId;
+    response[offset++] = frame->serviceChoice;
+    VirtualDevicesError error = { 0, 0 };
+    VirtualDevicesResult result;
+    if ((apdu[0] & APDU_FLAG_SEGMENTED) || frame->apduLength < VIRTUAL_DEVICES_REQUEST_HEADER_LENGTH) {
+        result = VIRTUAL_DEVICES_NO_ROOM;
+    } else if (frame->serviceChoice == BACNET_SERVICE_READ_PROPERTY) {
+        result = VirtualDevicesReadProperty(state, device, apdu, frame->apduLength, response, &offset, limit, &error);
+    } else if (frame->serviceChoice == BACNET_SERVICE_READ_PROPERTY_MULTIPLE) {
+        result = VirtualDevicesReadPropertyMultiple(state, device, apdu, frame->apduLength, response, &offset, limit);
+    } else if (frame->serviceChoice == BACNET_SERVICE_WRITE_PROPERTY) {
+        result = VirtualDevicesWriteProperty(state, device, apdu, frame->apduLength, &error);
+        if (result == VIRTUAL_DEVICES_OK) {
+            offset = VIRTUAL_DEVICES_HEADER_LENGTH;
+            response[offset++] = APDU_TYPE_SIMPLE_ACK;
+            response[offset++] = frame->invokeId;
+            response[offset++] = frame->serviceChoice;
+        }
+    } else {
+        error.errorCode = BACNET_REJECT_REASON_UNRECOGNIZED_SERVICE;
+        result = VIRTUAL_DEVICES_MALFORMED;
+    }
+
+    if (result != VIRTUAL_DEVICES_OK) {
+        state->statistics.errors++;
+        offset = VIRTUAL_DEVICES_HEADER_LENGTH;
+        if (result == VIRTUAL_DEVICES_ERROR) {
+            response[offset++] = APDU_TYPE_ERROR;
+            response[offset++] = frame->invokeId;
+            response[offset++] = frame->serviceChoice;
+            offset += BACnetEncodeEnumerated(response + offset, 5, error.errorClass);
+            offset += BACnetEncodeEnumerated(response + offset, 5, error.errorCode);
+        } else if (result == VIRTUAL_DEVICES_NO_ROOM) {
+            response[offset++] = APDU_TYPE_ABORT | APDU_FLAG_SERVER;
+            response[offset++] = frame->invokeId;
+            response[offset++] = BACNET_ABORT_REASON_SEGMENTATION_NOT_SUPPORTED;
+        } else {
+            response[offset++] = APDU_TYPE_REJECT;
+            response[offset++] = frame->invokeId;
+            response[offset++] = error.errorCode != 0 ? error.errorCode : BACNET_REJECT_REASON_INVALID_TAG;
+        }
+    }
+    VirtualDevicesPutHeader(state, deviceNumber, response, offset, false);
+    state->send(state->sendContext, response, offset, sourceAddress, false);
+}
+
+// I-Am: device, max APDU, segmentation and vendor, broadcast with the device's address as the
+// source. Encoded once when the device is added and kept by its Discovery state.
+static bool VirtualDevicesCacheIAm(VirtualDevices* state, uint16_t deviceNumber)
+{
+    uint8_t* response = state->response;
+    uint16_t offset = VIRTUAL_DEVICES_HEADER_LENGTH;
+    response[offset++] = APDU_TYPE_UNCONFIRMED_REQUEST;
+    response[offset++] = BACNET_UNCONFIRMED_SERVICE_I_AM;
+    offset += BACnetEncodeObjectIdentifier(response + offset, 5, BACNET_OBJECT_TYPE_DEVICE, state->devices[deviceNumber - 1].deviceInstance);
+    offset += BACnetEncodeUnsigned(response + offset, 5, VIRTUAL_DEVICES_MAX_APDU);
+    offset += BACnetEncodeEnumerated(response + offset, 5, BACNET_SEGMENTATION_NONE);
+    offset += BACnetEncodeUnsigned(response + offset, 5, state->vendorIdentifier);
+    VirtualDevicesPutHeader(state, deviceNumber, response, offset, true);
+    return DiscoveryCacheIAm(&state->discovery[deviceNumber - 1], response, offset);
+}
+
+static void VirtualDevicesScheduleIAm(VirtualDevices* state, uint16_t deviceNumber, const uint8_t* sourceAddress, bool broadcast, uint32_t nowMs)
+{
+    if (DiscoveryScheduleReply(&state->discovery[deviceNumber - 1], sourceAddress, broadcast, nowMs)) {
+        state->replyPending = true;
+    } else {
+        state->statistics.whoIsRateLimited++;
+    }
+}
+
+// Who-Is with an optional device range: low [0] and high [1]
+static void VirtualDevicesHandleWhoIs(VirtualDevices* state, const uint8_t* message, const BACnetFrame* frame, const uint8_t* sourceAddress, uint32_t nowMs)
+{
+    state->statistics.whoIsReceived++;
+    const uint8_t* apdu = message + frame->apduOffset;
+    uint16_t offset = 2;
+    uint32_t low = 0;
+    uint32_t high = BACNET_MAX_INSTANCE;
+    if (offset < frame->apduLength && (!BACnetDecodeContextUnsigned(apdu, frame->apduLength, &offset, 0, &low) || !BACnetDecodeContextUnsigned(apdu, frame->apduLength, &offset, 1, &high))) {
+        state->statistics.dropped++;
+        return;
+    }
+    if (low > high) {
+        return;
+    }
+    // A narrow range is looked up instance by instance, a wide one by walking the devices
+    if (high - low < state->deviceCount) {
+        for (uint32_t deviceInstance = low; deviceInstance <= high; deviceInstance++) {
+            const VirtualDevice* device = VirtualDevicesFind(state, deviceInstance);
+            if (device != NULL) {
+                VirtualDevicesScheduleIAm(state, (uint16_t)(device - state->devices + 1), sourceAddress, frame->broadcast, nowMs);
+            }
+        }
+        return;
+    }
+    for (uint16_t device = 0; device < state->deviceCount; device++) {
+        if (state->devices[device].deviceInstance >= low && state->devices[device].deviceInstance <= high) {
+            VirtualDevicesScheduleIAm(state, (uint16_t)(device + 1), sourceAddress, frame->broadcast, nowMs);
+        }
+    }
+}
+
+// Network layer messages. Only Who-Is-Router-To-Network is answered. Returns true if it was one.
+static bool VirtualDevicesHandleNetworkMessage(VirtualDevices* state, const uint8_t* message, uint16_t length)
+{
+    if (length < 4 || message[0] != BVLC_TYPE_BACNET_IP) {
+        return false;
+    }
+    uint16_t offset = 4;
+    if (message[1] == BVLC_FUNCTION_FORWARDED_NPDU) {
+        offset += 6;
+    } else if (message[1] != BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU && message[1] != BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU) {
+        return false;
+    }
+    if (offset + 3 > length || message[offset] != NPDU_VERSION || !(message[offset + 1] & NPDU_CONTROL_NETWORK_MESSAGE)) {
+        return false;
+    }
+    uint8_t control = message[offset + 1];
+    offset += 2;
+    if (control & NPDU_CONTROL_DESTINATION_SPECIFIER) {
+        if (offset + 3 > length || (uint16_t)(message[offset] << 8 | message[offset + 1]) != BACNET_NETWORK_GLOBAL_BROADCAST) {
+            return false;
+        }
+        offset += 3 + message[offset + 2];
+    }
+    if (control & NPDU_CONTROL_SOURCE_SPECIFIER) {
+        if (offset + 3 > length) {
+            return false;
+        }
+        offset += 3 + message[offset + 2];
+    }
+    if (control & NPDU_CONTROL_DESTINATION_SPECIFIER) {
+        offset += 1; // Hop count
+    }
+    if (offset >= length || message[offset] != BACNET_NETWORK_MESSAGE_WHO_IS_ROUTER_TO_NETWORK) {
+        return false;
+    }
+    // Without a network number the question is for every network reachable through this router
+    if (offset + 3 <= length && (uint16_t)(message[offset + 1] << 8 | message[offset + 2]) != state->networkNumber) {
+        return true;
+    }
+    state->statistics.routerQueries++;
+    VirtualDevicesAnnounce(state);
+    return true;
+}
+
+// Setup
+// ---------------------------------------------------------------------------
+void VirtualDevicesBegin(VirtualDevices* state, uint16_t networkNumber, uint16_t vendorIdentifier, VirtualDevicesSendFunction send, void* sendContext)
+{
+    memset(state, 0, sizeof(*state));
+    state->networkNumber = networkNumber;
+    state->vendorIdentifier = vendorIdentifier;
+    state->send = send;
+    state->sendContext = sendContext;
+    for (uint32_t slot = 0; slot < VIRTUAL_DEVICES_INDEX_SIZE; slot++) {
+        state->index[slot] = VIRTUAL_DEVICE_NONE;
+    }
+}
+
+uint16_t VirtualDevicesAdd(VirtualDevices* state, uint32_t deviceInstance, const char* name, const VirtualObject* objects, uint16_t objectCount, uint32_t* presentValues)
+{
+    if (state->deviceCount >= VIRTUAL_DEVICES_CAPACITY || deviceInstance > BACNET_MAX_INSTANCE) {
+        return VIRTUAL_DEVICE_NONE;
+    }
+    uint32_t slot = VirtualDevicesHash(deviceInstance) & (VIRTUAL_DEVICES_INDEX_SIZE - 1);
+    while (state->index[slot] != VIRTUAL_DEVICE_NONE) {
+        if (state->devices[state->index[slot]].deviceInstance == deviceInstance) {
+            return VIRTUAL_DEVICE_NONE;
+        }
+        slot = (slot + 1) & (VIRTUAL_DEVICES_INDEX_SIZE - 1);
+    }
+
+    uint16_t device = state->deviceCount;
+    state->index[slot] = device;
+    state->devices[device].deviceInstance = deviceInstance;
+    state->devices[device].name = name;
+    state->devices[device].objects = objects;
+    state->devices[device].objectCount = objectCount;
+    state->devices[device].presentValues = presentValues;
+    state->deviceCount++;
+    DiscoveryBegin(&state->discovery[device], deviceInstance);
+    if (!VirtualDevicesCacheIAm(state, (uint16_t)(device + 1))) {
+        state->index[slot] = VIRTUAL_DEVICE_NONE;
+        state->deviceCount--;
+        return VIRTUAL_DEVICE_NONE;
+    }
+    return (uint16_t)(device + 1);
+}
+
+// Lookup
+// ---------------------------------------------------------------------------
+const VirtualDevice* VirtualDevicesFind(const VirtualDevices* state, uint32_t deviceInstance)
+{
+    uint32_t slot = VirtualDevicesHash(deviceInstance) & (VIRTUAL_DEVICES_INDEX_SIZE - 1);
+    while (state->index[slot] != VIRTUAL_DEVICE_NONE) {
+        const VirtualDevice* device = &state->devices[state->index[slot]];
+        if (device->deviceInstance == deviceInstance) {
+            return device;
+        }
+        slot = (slot + 1) & (VIRTUAL_DEVICES_INDEX_SIZE - 1);
+    }
+    return NULL;
+}
+
+const VirtualDevice* VirtualDevicesGet(const VirtualDevices* state, uint16_t deviceNumber)
+{
+    return deviceNumber >= 1 && deviceNumber <= state->deviceCount ? &state->devices[deviceNumber - 1] : NULL;
+}
+
+// Network
+// ---------------------------------------------------------------------------
+bool VirtualDevicesHandleMessage(VirtualDevices* state, const uint8_t* message, uint16_t length, const uint8_t* sourceAddress, uint32_t nowMs)
+{
+    if (state->deviceCount == 0) {
+        return false;
+    }
+    BACnetFrame frame;
+    if (!BACnetFrameParse(message, length, &frame)) {
+        return VirtualDevicesHandleNetworkMessage(state, message, length);
+    }
+    if (!frame.hasDestinationNetwork) {
+        return false;
+    }
+    bool globalBroadcast = frame.destinationNetwork == BACNET_NETWORK_GLOBAL_BROADCAST;
+    if (!globalBroadcast && frame.destinationNetwork != state->networkNumber) {
+        return false;
+    }
+
+    // Replies to a requester behind another router would have to be routed back. Not supported.
+    if (frame.hasSourceNetwork) {
+        state->statistics.dropped++;
+        return !globalBroadcast;
+    }
+    if (frame.apduType == APDU_TYPE_UNCONFIRMED_REQUEST && frame.serviceChoice == BACNET_UNCONFIRMED_SERVICE_WHO_IS) {
+        if (globalBroadcast || frame.destinationAddressLength == 0) {
+            VirtualDevicesHandleWhoIs(state, message, &frame, sourceAddress, nowMs);
+        }
+        return !globalBroadcast;
+    }
+    if (globalBroadcast) {
+        return false;
+    }
+    if (frame.apduType != APDU_TYPE_CONFIRMED_REQUEST) {
+        return true; // Nothing else is answered on the virtual network
+    }
+    if (frame.destinationAddressLength != VIRTUAL_DEVICE_MAC_LENGTH) {
+        state->statistics.dropped++;
+        return true;
+    }
+    uint16_t deviceNumber = (uint16_t)(message[frame.destinationAddressOffset] << 8 | message[frame.destinationAddressOffset + 1]);
+    if (VirtualDevicesGet(state, deviceNumber) == NULL) {
+        state->statistics.unknownDestination++;
+        return true;
+    }
+    VirtualDevicesHandleConfirmed(state, deviceNumber, message, &frame, sourceAddress);
+    return true;
+}
+
+bool VirtualDevicesPoll(VirtualDevices* state, uint32_t nowMs, uint32_t* nextDueMs)
+{
+    if (!state->replyPending) {
+        return false;
+    }
+    state->replyPending = false;
+    for (uint16_t device = 0; device < state->deviceCount; device++) {
+        DiscoveryState* discovery = &state->discovery[device];
+        const uint8_t* message;
+        uint16_t length;
+        if (DiscoveryPoll(discovery, nowMs, &message, &length)) {
+            state->send(state->sendContext, message, length, NULL, true);
+            state->statistics.iAmSent++;
+        } else if (discovery->replyPending) {
+            if (!state->replyPending || (int32_t)(discovery->replyDueMs - *nextDueMs) < 0) {
+                *nextDueMs = discovery->replyDueMs;
+            }
+            state->replyPending = true;
+        }
+    }
+    return state->replyPending;
+}
+
+void VirtualDevicesAnnounce(VirtualDevices* state)
+{
+    uint8_t* response = state->response;
+    uint16_t offset = 0;
+    response[offset++] = BVLC_TYPE_BACNET_IP;
+    response[offset++] = BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU;
+    offset += 2; // Filled in below
+    response[offset++] = NPDU_VERSION;
+    response[offset++] = NPDU_CONTROL_NETWORK_MESSAGE;
+    response[offset++] = BACNET_NETWORK_MESSAGE_I_AM_ROUTER_TO_NETWORK;
+    response[offset++] = (uint8_t)(state->networkNumber >> 8);
+    response[offset++] = (uint8_t)state->networkNumber;
+    response[2] = (uint8_t)(offset >> 8);
+    response[3] = (uint8_t)offset;
+    state->send(state->sendContext, response, offset, NULL, true);
+}
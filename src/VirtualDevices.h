@@ -0,0 +1,131 @@
+/**
+ * Virtual devices
+ * --------------------------------------
+ * Hosts BACnet devices on a virtual network behind this device's BACnet/IP port, the way a gateway
+ * presents the controllers it fronts. This device is the router to the virtual network: it answers
+ * Who-Is-Router-To-Network, and requests addressed to the virtual network (DNET) are answered here
+ * for the device whose virtual MAC address is the DADR, with the network and address as the source
+ * (SNET/SADR) of the reply. The CAS BACnet stack is not involved; it keeps serving this device on
+ * the local network.
+ *
+ * Each device has its own object table (VirtualObject) and present values. A device's MAC address
+ * is its number (the order it was added, from 1) in two bytes, so a routed request finds its device
+ * by index. A device instance finds its device through an open addressing index, so the cost of
+ * answering does not grow with the number of devices.
+ *
+ * Answered are Who-Is (global broadcast or broadcast on the virtual network), ReadProperty and
+ * ReadPropertyMultiple of the supported properties (including ALL and REQUIRED) and WriteProperty
+ * of present values. Other confirmed services are rejected, responses larger than the client
+ * accepts are aborted (no segmentation). Requests that already came through another router (SNET)
+ * are dropped and counted.
+ *
+ * I-Am replies go through a Discovery state per device (see Discovery.h): each device's reply to a
+ * broadcast Who-Is is delayed by the jitter of its own instance, and a source asking again within
+ * DISCOVERY_RATE_LIMIT_MS is not answered, so a Who-Is storm does not become a burst of one I-Am
+ * per device. VirtualDevicesPoll() sends the replies that are due. This takes about 170 bytes of
+ * RAM per device.
+ */
+
+#ifndef VIRTUAL_DEVICES_H
+#define VIRTUAL_DEVICES_H
+
+#include "BACnetFrame.h"
+#include "Discovery.h"
+#include "PropertyRegistry.h"
+
+#include <stdint.h>
+
+// Set with -D VIRTUAL_DEVICES_MAX_DEVICES=n
+#ifndef VIRTUAL_DEVICES_MAX_DEVICES
+#define VIRTUAL_DEVICES_MAX_DEVICES 64
+#endif
+const uint16_t VIRTUAL_DEVICES_CAPACITY = VIRTUAL_DEVICES_MAX_DEVICES;
+const uint16_t VIRTUAL_DEVICE_NONE = 0xFFFF;
+const uint8_t VIRTUAL_DEVICE_MAC_LENGTH = 2;
+const uint16_t VIRTUAL_DEVICES_HEADER_LENGTH = 11; // BVLC + NPDU with SNET and a 2 byte SADR
+const uint16_t VIRTUAL_DEVICES_MAX_APDU = 1476; // Largest APDU on BACnet/IP
+const uint16_t VIRTUAL_DEVICES_RESPONSE_MAX_LENGTH = VIRTUAL_DEVICES_HEADER_LENGTH + VIRTUAL_DEVICES_MAX_APDU;
+static_assert(VIRTUAL_DEVICES_MAX_DEVICES > 0 && VIRTUAL_DEVICES_MAX_DEVICES < VIRTUAL_DEVICE_NONE, "VIRTUAL_DEVICES_MAX_DEVICES out of range");
+
+// Device instance index: open addressing, a power of two at least twice the capacity.
+constexpr uint32_t VirtualDevicesIndexSize(uint32_t minimum, uint32_t size = 1)
+{
+    return size >= minimum ? size : VirtualDevicesIndexSize(minimum, size << 1);
+}
+const uint32_t VIRTUAL_DEVICES_INDEX_SIZE = VirtualDevicesIndexSize(2 * VIRTUAL_DEVICES_CAPACITY);
+
+// An object of a virtual device. The present value is an unsigned (Multi-state), an enumerated
+// (Binary) or the bits of a REAL (Analog), depending on the object type.
+struct VirtualObject {
+    uint16_t objectType; // Analog, Binary or Multi-state Input or Value
+    uint32_t objectInstance;
+    PropertyString name;
+    uint32_t stateCount; // Number_Of_States of Multi-state objects
+    bool writable; // Present_Value can be written
+};
+
+struct VirtualDevice {
+    uint32_t deviceInstance;
+    const char* name; // Owned by the caller
+    const VirtualObject* objects;
+    uint16_t objectCount;
+    uint32_t* presentValues; // One per object, owned by the caller
+};
+
+// Sends a reply. address is the 6 byte B/IP address of the requester, ignored for broadcasts.
+typedef void (*VirtualDevicesSendFunction)(void* context, const uint8_t* message, uint16_t length, const uint8_t* address, bool broadcast);
+
+struct VirtualDevicesStatistics {
+    uint32_t requests; // Confirmed requests for a device here
+    uint32_t errors; // Answered with Error, Reject or Abort
+    uint32_t writes;
+    uint32_t whoIsReceived;
+    uint32_t whoIsRateLimited; // I-Am replies not sent because the source asked again too soon
+    uint32_t iAmSent;
+    uint32_t routerQueries; // Who-Is-Router-To-Network answered
+    uint32_t unknownDestination; // Requests for a MAC address without a device
+    uint32_t dropped; // Routed from another network, malformed or too large to send
+};
+
+struct VirtualDevices {
+    uint16_t networkNumber;
+    uint16_t vendorIdentifier;
+    VirtualDevicesSendFunction send;
+    void* sendContext;
+
+    VirtualDevice devices[VIRTUAL_DEVICES_CAPACITY];
+    uint16_t deviceCount;
+    uint16_t index[VIRTUAL_DEVICES_INDEX_SIZE]; // Device number - 1 by device instance, VIRTUAL_DEVICE_NONE when free
+    DiscoveryState discovery[VIRTUAL_DEVICES_CAPACITY]; // I-Am replies, by device number - 1
+    bool replyPending; // Some device has an I-Am to send
+    uint8_t response[VIRTUAL_DEVICES_RESPONSE_MAX_LENGTH];
+
+    VirtualDevicesStatistics statistics;
+};
+
+// Setup
+// -----------------------------
+void VirtualDevicesBegin(VirtualDevices* state, uint16_t networkNumber, uint16_t vendorIdentifier, VirtualDevicesSendFunction send, void* sendContext);
+// Returns the device number (its MAC address, from 1), or VIRTUAL_DEVICE_NONE if the instance is
+// taken, out of range, or there is no room.
+uint16_t VirtualDevicesAdd(VirtualDevices* state, uint32_t deviceInstance, const char* name, const VirtualObject* objects, uint16_t objectCount, uint32_t* presentValues);
+
+// Lookup
+// -----------------------------
+const VirtualDevice* VirtualDevicesFind(const VirtualDevices* state, uint32_t deviceInstance); // NULL if not hosted here
+const VirtualDevice* VirtualDevicesGet(const VirtualDevices* state, uint16_t deviceNumber); // NULL if out of range
+
+// Network
+// -----------------------------
+// Offer a received datagram. Replies are sent through the send function, I-Am replies once they are
+// due (VirtualDevicesPoll()). Returns true if the datagram was for the virtual network and must not
+// be passed on; a global Who-Is is answered for the virtual devices and still returns false, so
+// this device answers it as well.
+bool VirtualDevicesHandleMessage(VirtualDevices* state, const uint8_t* message, uint16_t length, const uint8_t* sourceAddress, uint32_t nowMs);
+// Broadcasts the I-Am replies that are due. Returns true if some are still pending, with the time
+// the next one is due in *nextDueMs.
+bool VirtualDevicesPoll(VirtualDevices* state, uint32_t nowMs, uint32_t* nextDueMs);
+// Broadcasts I-Am-Router-To-Network, done when the link comes up.
+void VirtualDevicesAnnounce(VirtualDevices* state);
+
+#endif // VIRTUAL_DEVICES_H
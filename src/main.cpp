@@ -16,9 +16,21 @@
  * Last updated: May 8, 2019 
  */
 
+#ifdef ARDUINO
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiUdp.h>
+#include <esp_partition.h>
+#include <esp_pm.h>
+#else
+// Host-native build (PlatformIO "native" environment).
+#include "NativeArduino.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#include <atomic>
 
 // Missing file
 // This file is part of the CAS BACnet stack and is not included in this repo
@@ -27,6 +39,24 @@
 #include <CASBACnetStackAdapter.h>
 #include <CIBuildSettings.h>
 
+#include "BACnetFrame.h"
+#include "Cov.h"
+#include "Discovery.h"
+#include "EventLoop.h"
+#include "Logging.h"
+#include "MemoryTelemetry.h"
+#include "Network.h"
+#include "OutputDriver.h"
+#include "PointList.h"
+#include "PointStore.h"
+#include "PropertyRegistry.h"
+#include "ReadRange.h"
+#include "ResponseCache.h"
+#include "ServiceMetrics.h"
+#include "Transport.h"
+#include "TrendLog.h"
+#include "VirtualDevices.h"
+
 // Application Version
 // -----------------------------
 const uint32_t APPLICATION_VERSION_MAJOR = 0;
@@ -39,33 +69,83 @@ const uint32_t APPLICATION_VERSION_PATCH = 2;
 const char* APPLICATION_WIFI_SSID = "---YOUR SSID---";
 const char* APPLICATION_WIFI_PASSWORD = "--YOUR PASSWORD---";
 
+// Static IP address, saved to NVS at startup so the connect skips DHCP. Give the addresses as
+// comma separated bytes, e.g. -D APPLICATION_STATIC_IP=192,168,1,50 -D APPLICATION_STATIC_GATEWAY=192,168,1,1
+// Without APPLICATION_STATIC_IP the address saved in NVS, if any, is kept.
+#ifdef APPLICATION_STATIC_IP
+#ifndef APPLICATION_STATIC_GATEWAY
+#error "APPLICATION_STATIC_IP needs APPLICATION_STATIC_GATEWAY"
+#endif
+#ifndef APPLICATION_STATIC_SUBNET_MASK
+#define APPLICATION_STATIC_SUBNET_MASK 255, 255, 255, 0
+#endif
+#endif
+
 const uint32_t APPLICATION_BACNET_DEVICE_INSTANCE = 389001;
 const uint32_t APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE = 1;
-const char* APPLICATION_BACNET_OBJECT_DEVICE_OBJECT_NAME = "ESP32 BACnet Example Server";
-const char* APPLICATION_BACNET_OBJECT_MSV_LED_OBJECT_NAME = "LED State";
-const char* APPLICATION_BACNET_OBJECT_MSV_LED_STATE_TEXT[] = { "Off", "On", "Blink" };
+const char APPLICATION_BACNET_OBJECT_DEVICE_OBJECT_NAME[] = "ESP32 BACnet Example Server";
+const char APPLICATION_BACNET_OBJECT_MSV_LED_OBJECT_NAME[] = "LED State";
+constexpr PropertyString APPLICATION_BACNET_OBJECT_MSV_LED_STATE_TEXT[] = { MakePropertyString("Off"), MakePropertyString("On"), MakePropertyString("Blink") };
+constexpr PropertyString APPLICATION_BACNET_OBJECT_MSV_BENCHMARK_STATE_TEXT[] = { MakePropertyString("Off"), MakePropertyString("On"), MakePropertyString("Auto") };
+const char APPLICATION_BACNET_OBJECT_AV_FREE_HEAP_OBJECT_NAME[] = "Free heap (bytes)";
+const char APPLICATION_BACNET_OBJECT_AV_MINIMUM_FREE_HEAP_OBJECT_NAME[] = "Minimum free heap (bytes)";
+const char APPLICATION_BACNET_OBJECT_AV_LARGEST_FREE_BLOCK_OBJECT_NAME[] = "Largest free heap block (bytes)";
+const char APPLICATION_BACNET_OBJECT_AV_BACNET_STACK_MEMORY_OBJECT_NAME[] = "BACnet stack memory (bytes)";
+const char APPLICATION_BACNET_OBJECT_AV_TRANSPORT_MEMORY_OBJECT_NAME[] = "Transport buffer memory (bytes)";
+const char APPLICATION_BACNET_OBJECT_AV_LOGGING_MEMORY_OBJECT_NAME[] = "Logging buffer memory (bytes)";
+const char APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_OBJECT_NAME[] = "Memory alarm";
+const char APPLICATION_BACNET_OBJECT_AV_READ_PROPERTY_LATENCY_OBJECT_NAME[] = "ReadProperty p99 latency (us)";
+const char APPLICATION_BACNET_OBJECT_AV_READ_PROPERTY_MULTIPLE_LATENCY_OBJECT_NAME[] = "ReadPropertyMultiple p99 latency (us)";
+const char APPLICATION_BACNET_OBJECT_AV_WRITE_PROPERTY_LATENCY_OBJECT_NAME[] = "WriteProperty p99 latency (us)";
+const char APPLICATION_BACNET_OBJECT_AV_SUBSCRIBE_COV_LATENCY_OBJECT_NAME[] = "SubscribeCOV p99 latency (us)";
+const uint32_t APPLICATION_BACNET_OBJECT_TL_LED_INSTANCE = 1;
+const char APPLICATION_BACNET_OBJECT_TL_LED_OBJECT_NAME[] = "LED State log";
+const uint16_t APPLICATION_BACNET_VENDOR_IDENTIFIER = 389; // Chipkin Automation Systems
 const uint16_t APPLICATION_BACNET_UDP_PORT = 47808;
 const uint32_t APPLICATION_LED_PIN = LED_BUILTIN;
 const uint32_t APPLICATION_SERIAL_BAUD_RATE = 115200;
 const long APPLICATION_LED_BLINK_RATE_MS = 500; // interval at which to blink (milliseconds)
 
+// Threaded mode
+// -----------------------------
+// When enabled (-D APPLICATION_THREADED_MODE=1) the work done by loop() is split into a pipeline:
+// a network task on core 0 fills the receive ring, the CAS BACnet stack runs in its own task on
+// core 1. The outputs are driven by the output timer in both modes, see OutputDriver.h.
+#ifndef APPLICATION_THREADED_MODE
+#define APPLICATION_THREADED_MODE 0
+#endif
+#if APPLICATION_THREADED_MODE
+const uint32_t APPLICATION_TASK_STACK_SIZE = 8192;
+const uint32_t APPLICATION_NETWORK_TASK_PRIORITY = 3;
+const uint32_t APPLICATION_BACNET_TASK_PRIORITY = 2;
+const uint32_t APPLICATION_NETWORK_TASK_WAIT_MS = 100;
+const uint32_t APPLICATION_NETWORK_TASK_LINK_WAIT_MS = 10; // Poll interval until the UDP port is open
+const uint32_t APPLICATION_BACNET_TASK_IDLE_MS = 10; // Longest the stack goes without fpLoop() when idle
+#endif
+
+// Event-driven mode
+// -----------------------------
+// When enabled (-D APPLICATION_EVENT_DRIVEN_MODE=1) loop() does not spin. After each scan it blocks on
+// the UDP socket until a datagram arrives or the next deadline (see EventLoop.h), and the ESP32
+// enters light sleep while it waits. Threaded mode already blocks between packets and is unchanged.
+#ifndef APPLICATION_EVENT_DRIVEN_MODE
+#define APPLICATION_EVENT_DRIVEN_MODE 0
+#endif
+#if APPLICATION_EVENT_DRIVEN_MODE && APPLICATION_THREADED_MODE
+#error "APPLICATION_EVENT_DRIVEN_MODE applies to loop(), it can not be combined with APPLICATION_THREADED_MODE"
+#endif
+#if APPLICATION_EVENT_DRIVEN_MODE
+const uint32_t APPLICATION_EVENT_STACK_TIMER_MS = 50; // Longest the stack goes without fpLoop() when idle
+#ifdef ARDUINO
+const int APPLICATION_EVENT_MAX_CPU_FREQUENCY_MHZ = 240;
+const int APPLICATION_EVENT_MIN_CPU_FREQUENCY_MHZ = 80; // Lowest frequency WiFi runs at
+#endif
+#endif
+
 // BACnet constants
 // -----------------------------
-// This is a sub list of BACnet constants. A full list can be found in the documentation
-const uint16_t BACNET_SERVICE_READ_PROPERTY_MULTIPLE = 14;
-const uint16_t BACNET_SERVICE_WRITE_PROPERTY = 15;
-const uint16_t BACNET_OBJECT_TYPE_DEVICE = 8;
-const uint16_t BACNET_OBJECT_TYPE_MULTI_STATE_VALUE = 19;
-const uint16_t BACNET_NETWORK_TYPE_IP = 0;
-const uint32_t BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES = 74;
-const uint32_t BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME = 77;
-const uint32_t BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE = 85;
-const uint32_t BACNET_PROPERTY_IDENTIFIER_STATE_TEXT = 110;
-const uint32_t BACNET_ERROR_CODE_VALUE_OUT_OF_RANGE = 37;
-
-// Wifi
-// create UDP instance
-WiFiUDP gUDP;
+// The protocol constants are in BACnetFrame.h, shared with the fast paths
+const uint16_t BACNET_NETWORK_TYPE_IP = 0; // CAS BACnet stack network type
 
 // LED
 // -----------------------------
@@ -73,84 +153,378 @@ WiFiUDP gUDP;
 const uint16_t LED_MODE_OFF = 1;
 const uint16_t LED_MODE_ON = 2;
 const uint16_t LED_MODE_BLINK = 3;
-uint32_t gLEDMode = LED_MODE_BLINK;
-const uint16_t LED_MODE_STATE_COUNT = LED_MODE_BLINK;
+// The LED mode is the present value of the MSV, kept in the point store. Changed with WriteLEDMode().
+uint16_t gLEDModePoint = POINT_INVALID;
+// Output mode for each LED mode, indexed by the present value of the MSV
+constexpr OutputMode APPLICATION_LED_OUTPUT_MODES[] = { OUTPUT_MODE_OFF, OUTPUT_MODE_OFF, OUTPUT_MODE_ON, OUTPUT_MODE_BLINK };
+
+#if APPLICATION_THREADED_MODE
+// Wakes a task that is waiting in WaitForTaskNotify(). FreeRTOS task notifications on the ESP32; the
+// host build stands in a condition variable with the same sticky, binary semantics.
+#ifdef ARDUINO
+typedef TaskHandle_t ApplicationTask;
+#else
+struct ApplicationTask {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool notified;
+};
+#endif
+ApplicationTask gBACnetTask;
+ApplicationTask gNetworkTask;
+// Set by the network task while it waits for the BACnet task to free a slot in the receive ring
+std::atomic<bool> gNetworkTaskWaitingForSlot(false);
+#endif
+
+// Memory telemetry
+// -----------------------------
+// Read-only Analog Values with the latest memory sample, and a Binary Value with the memory alarm.
+const unsigned long APPLICATION_MEMORY_SAMPLE_INTERVAL_MS = 1000;
+enum MemoryTelemetryValue {
+    MEMORY_VALUE_FREE_HEAP,
+    MEMORY_VALUE_MINIMUM_FREE_HEAP,
+    MEMORY_VALUE_LARGEST_FREE_BLOCK,
+    MEMORY_VALUE_BACNET_STACK,
+    MEMORY_VALUE_TRANSPORT,
+    MEMORY_VALUE_LOGGING,
+    MEMORY_VALUE_COUNT
+};
+const uint32_t APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE = 1; // Instances follow MemoryTelemetryValue
+const uint32_t APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_INSTANCE = 1;
+uint16_t gMemoryValuePoints[MEMORY_VALUE_COUNT];
+uint16_t gMemoryAlarmPoint = POINT_INVALID;
+MemoryStatistics gMemoryStatistics;
+
+// Service metrics
+// -----------------------------
+// Read-only Analog Values with the p99 response time of the main services. The Description of each
+// holds the full histogram, see ServiceMetrics.h.
+const unsigned long APPLICATION_SERVICE_METRICS_UPDATE_INTERVAL_MS = 1000;
+const uint16_t APPLICATION_SERVICE_METRICS_SERVICES[] = { BACNET_SERVICE_READ_PROPERTY, BACNET_SERVICE_READ_PROPERTY_MULTIPLE, BACNET_SERVICE_WRITE_PROPERTY, BACNET_SERVICE_SUBSCRIBE_COV };
+const uint32_t APPLICATION_SERVICE_METRICS_SERVICE_COUNT = PropertyArrayCount(APPLICATION_SERVICE_METRICS_SERVICES);
+const uint32_t APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE = 101; // Instances follow APPLICATION_SERVICE_METRICS_SERVICES
+uint16_t gServiceLatencyPoints[APPLICATION_SERVICE_METRICS_SERVICE_COUNT];
+
+// Discovery
+// -----------------------------
+// Who-Is is answered from a cached I-Am frame, see Discovery.h
+DiscoveryState gDiscovery;
+
+// Event loop
+// -----------------------------
+// Due times registered by the scan, used to sleep between scans in event-driven mode.
+EventLoopState gEventLoop;
+
+// Response cache
+// -----------------------------
+// ReadProperty and ReadPropertyMultiple of the static properties and present values are answered
+// from pre-encoded values without waking the stack, see ResponseCache.h. Build with
+// -D APPLICATION_RESPONSE_CACHE=0 to leave every request to the stack.
+#ifndef APPLICATION_RESPONSE_CACHE
+#define APPLICATION_RESPONSE_CACHE 1
+#endif
+#if APPLICATION_RESPONSE_CACHE
+ResponseCache gResponseCache;
+uint8_t gResponseCacheBuffer[PACKET_MAX_LENGTH];
+const uint32_t APPLICATION_RESPONSE_CACHE_MAX_STRING_LENGTH = 128; // Longer strings are left to the stack
+#endif
+
+// Trend logs
+// -----------------------------
+// Trend Log objects that sample a point every APPLICATION_TREND_LOG_INTERVAL_MS into a delta encoded
+// ring of blocks (see TrendLog.h). ReadRange of their Log_Buffer is answered without waking the
+// stack, see ReadRange.h. The blocks are in PSRAM on boards that have it.
+//
+// Build with -D APPLICATION_TREND_LOG_FLASH=1 to also copy every full block to the "trendlog" data
+// partition, which must be added to the partition table. The partition is split evenly between the
+// logs and each slice is written as a ring.
+#ifndef APPLICATION_TREND_LOG_BLOCKS
+#define APPLICATION_TREND_LOG_BLOCKS 64 // Per log, TREND_LOG_BLOCK_BYTES each
+#endif
+#ifndef APPLICATION_TREND_LOG_FLASH
+#define APPLICATION_TREND_LOG_FLASH 0
+#endif
+// Wall clock, UTC seconds since 1970, set by SNTP once the link is up. It is given to the stack
+// and stamps the trend log records; until it is set the trend logs are not sampled.
+#ifndef APPLICATION_NTP_SERVER
+#define APPLICATION_NTP_SERVER "pool.ntp.org"
+#endif
+const time_t APPLICATION_CLOCK_SET_AFTER = 1577836800; // 2020-01-01, earlier means SNTP has not answered yet
+#if APPLICATION_TREND_LOG_FLASH && !defined(ARDUINO)
+#error "APPLICATION_TREND_LOG_FLASH needs the ESP32 flash partition API"
+#endif
+struct TrendLogChannel {
+    uint32_t objectInstance; // Trend Log instance
+    uint16_t pointObjectType; // Logged point
+    uint32_t pointObjectInstance;
+    TrendLogValueType valueType;
+};
+const unsigned long APPLICATION_TREND_LOG_INTERVAL_MS = 10000;
+uint32_t gTrendLogSamplesSkipped = 0; // Samples not logged because the clock was not set yet
+constexpr TrendLogChannel APPLICATION_TREND_LOGS[] = {
+    { APPLICATION_BACNET_OBJECT_TL_LED_INSTANCE, BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE, TREND_LOG_VALUE_UNSIGNED },
+};
+const uint32_t APPLICATION_TREND_LOG_COUNT = PropertyArrayCount(APPLICATION_TREND_LOGS);
+TrendLog gTrendLogs[APPLICATION_TREND_LOG_COUNT];
+uint16_t gTrendLogPoints[APPLICATION_TREND_LOG_COUNT];
+#if defined(ARDUINO) && defined(BOARD_HAS_PSRAM)
+TrendLogBlock* gTrendLogBlocks = NULL; // APPLICATION_TREND_LOG_BLOCKS per log, allocated by AddTrendLogObjects()
+#else
+TrendLogBlock gTrendLogBlocks[APPLICATION_TREND_LOG_COUNT * APPLICATION_TREND_LOG_BLOCKS];
+#endif
+ReadRangeLog gReadRangeLogs[APPLICATION_TREND_LOG_COUNT];
+ReadRangeState gReadRange;
+#if APPLICATION_RESPONSE_CACHE
+uint8_t* const gReadRangeBuffer = gResponseCacheBuffer; // Both answer from the receive callback, one request at a time
+#else
+uint8_t gReadRangeBuffer[PACKET_MAX_LENGTH];
+#endif
+#if APPLICATION_TREND_LOG_FLASH
+const char APPLICATION_TREND_LOG_PARTITION_LABEL[] = "trendlog";
+// Slice of the partition that one log's full blocks are copied to
+struct TrendLogArchive {
+    const esp_partition_t* partition;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t next; // Offset in the slice of the next block
+    uint32_t writeErrors;
+};
+TrendLogArchive gTrendLogArchives[APPLICATION_TREND_LOG_COUNT];
+#endif
+
+// Virtual devices
+// -----------------------------
+// Build with -D APPLICATION_VIRTUAL_DEVICES=n to host n BACnet devices on the virtual network
+// APPLICATION_VIRTUAL_NETWORK_NUMBER behind this device's UDP port, the way a gateway presents the
+// controllers it fronts (see VirtualDevices.h). Every virtual device has the objects of
+// APPLICATION_VIRTUAL_OBJECTS with its own present values, and device instances from
+// APPLICATION_VIRTUAL_DEVICE_FIRST_INSTANCE. This device answers as the router to that network.
+#ifndef APPLICATION_VIRTUAL_DEVICES
+#define APPLICATION_VIRTUAL_DEVICES 0
+#endif
+#if APPLICATION_VIRTUAL_DEVICES > 0
+static_assert(APPLICATION_VIRTUAL_DEVICES <= VIRTUAL_DEVICES_MAX_DEVICES, "Raise VIRTUAL_DEVICES_MAX_DEVICES to host APPLICATION_VIRTUAL_DEVICES devices");
+const uint16_t APPLICATION_VIRTUAL_NETWORK_NUMBER = 1000;
+const uint32_t APPLICATION_VIRTUAL_DEVICE_FIRST_INSTANCE = 389100;
+const uint32_t APPLICATION_VIRTUAL_DEVICE_NAME_LENGTH = 32;
+constexpr VirtualObject APPLICATION_VIRTUAL_OBJECTS[] = {
+    { BACNET_OBJECT_TYPE_ANALOG_VALUE, 1, MakePropertyString("Temperature"), 0, true },
+    { BACNET_OBJECT_TYPE_BINARY_VALUE, 1, MakePropertyString("Run status"), 0, true },
+    { BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, 1, MakePropertyString("Mode"), 3, true },
+};
+const uint16_t APPLICATION_VIRTUAL_OBJECT_COUNT = PropertyArrayCount(APPLICATION_VIRTUAL_OBJECTS);
+VirtualDevices gVirtualDevices;
+char gVirtualDeviceNames[APPLICATION_VIRTUAL_DEVICES][APPLICATION_VIRTUAL_DEVICE_NAME_LENGTH];
+uint32_t gVirtualDeviceValues[APPLICATION_VIRTUAL_DEVICES][APPLICATION_VIRTUAL_OBJECT_COUNT];
+#endif
+
+// Bring-up
+// -----------------------------
+// The device and its objects are created at power on. WiFi comes up in the background (see
+// Network.h), the UDP port is opened and the device announced as soon as the link is up.
+NetworkState gNetwork;
+// Milliseconds since boot at which each step finished, 0 until then
+struct BringUpTimes {
+    unsigned long objectsReadyMs;
+    unsigned long linkUpMs;
+    unsigned long announcedMs;
+    unsigned long firstReadPropertyMs; // First ReadProperty answered
+};
+BringUpTimes gBringUp;
+
+// Point list
+// -----------------------------
+// The application's objects, see PointList.h. Everything else about a point (its name, states,
+// initial value and whether it can be written or subscribed to) is declared here.
+//
+// Build with -D APPLICATION_BENCHMARK_POINTS=n to add n extra points, split between Analog, Binary
+// and Multi-state Values, for measuring how the device scales. POINT_STORE_MAX_POINTS must be
+// raised to match.
+#ifndef APPLICATION_BENCHMARK_POINTS
+#define APPLICATION_BENCHMARK_POINTS 0
+#endif
+const uint32_t APPLICATION_BACNET_OBJECT_BENCHMARK_FIRST_INSTANCE = 1001;
+
+constexpr PointGroup APPLICATION_POINT_LIST[] = {
+    PointGroupStates(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE, 1, MakePropertyString(APPLICATION_BACNET_OBJECT_MSV_LED_OBJECT_NAME), POINT_FLAG_WRITABLE | POINT_FLAG_SUBSCRIBABLE, LED_MODE_BLINK, APPLICATION_BACNET_OBJECT_MSV_LED_STATE_TEXT),
+#if APPLICATION_BENCHMARK_POINTS > 0
+    PointGroupReal(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_BENCHMARK_FIRST_INSTANCE, APPLICATION_BENCHMARK_POINTS / 3, MakePropertyString("Benchmark AV "), POINT_FLAG_WRITABLE | POINT_FLAG_SUBSCRIBABLE, 0.0f),
+    PointGroupBinary(BACNET_OBJECT_TYPE_BINARY_VALUE, APPLICATION_BACNET_OBJECT_BENCHMARK_FIRST_INSTANCE, APPLICATION_BENCHMARK_POINTS / 3, MakePropertyString("Benchmark BV "), POINT_FLAG_WRITABLE | POINT_FLAG_SUBSCRIBABLE, 0),
+    PointGroupStates(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, APPLICATION_BACNET_OBJECT_BENCHMARK_FIRST_INSTANCE, APPLICATION_BENCHMARK_POINTS - 2 * (APPLICATION_BENCHMARK_POINTS / 3), MakePropertyString("Benchmark MSV "), POINT_FLAG_WRITABLE | POINT_FLAG_SUBSCRIBABLE, 1, APPLICATION_BACNET_OBJECT_MSV_BENCHMARK_STATE_TEXT),
+#endif
+};
+const uint16_t APPLICATION_POINT_LIST_GROUP_COUNT = PropertyArrayCount(APPLICATION_POINT_LIST);
+const uint32_t APPLICATION_POINT_LIST_COUNT = PointListCount(APPLICATION_POINT_LIST);
+static_assert(APPLICATION_POINT_LIST_COUNT + MEMORY_VALUE_COUNT + 1 + APPLICATION_SERVICE_METRICS_SERVICE_COUNT <= POINT_STORE_CAPACITY, "The point list does not fit the point store, raise POINT_STORE_MAX_POINTS");
+
+// Property registry
+// -----------------------------
+// Properties of the objects that are not in the point list (the device and the telemetry objects).
+// Point list objects are served from the point list and the point store. Constant values have their
+// lengths computed at compile time, live values are read and written through the getter/setter slots.
+bool WriteLEDMode(const uint32_t value);
 
-// LED State
-uint16_t gLEDState = LOW;
+constexpr PropertyEntry APPLICATION_PROPERTY_TABLE[] = {
+    PropertyCharString(BACNET_OBJECT_TYPE_DEVICE, APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_DEVICE_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE + MEMORY_VALUE_FREE_HEAP, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_FREE_HEAP_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE + MEMORY_VALUE_MINIMUM_FREE_HEAP, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_MINIMUM_FREE_HEAP_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE + MEMORY_VALUE_LARGEST_FREE_BLOCK, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_LARGEST_FREE_BLOCK_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE + MEMORY_VALUE_BACNET_STACK, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_BACNET_STACK_MEMORY_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE + MEMORY_VALUE_TRANSPORT, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_TRANSPORT_MEMORY_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE + MEMORY_VALUE_LOGGING, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_LOGGING_MEMORY_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_BINARY_VALUE, APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_INSTANCE, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE + 0, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_READ_PROPERTY_LATENCY_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE + 1, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_READ_PROPERTY_MULTIPLE_LATENCY_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE + 2, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_WRITE_PROPERTY_LATENCY_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_ANALOG_VALUE, APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE + 3, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_AV_SUBSCRIBE_COV_LATENCY_OBJECT_NAME)),
+    PropertyCharString(BACNET_OBJECT_TYPE_TREND_LOG, APPLICATION_BACNET_OBJECT_TL_LED_INSTANCE, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString(APPLICATION_BACNET_OBJECT_TL_LED_OBJECT_NAME)),
+    PropertyUIntConstant(BACNET_OBJECT_TYPE_TREND_LOG, APPLICATION_BACNET_OBJECT_TL_LED_INSTANCE, BACNET_PROPERTY_IDENTIFIER_LOG_INTERVAL, APPLICATION_TREND_LOG_INTERVAL_MS / 10), // Hundredths of a second
+};
+const uint16_t APPLICATION_PROPERTY_TABLE_COUNT = PropertyArrayCount(APPLICATION_PROPERTY_TABLE);
+uint16_t gPropertyRegistryIndex[PropertyRegistryIndexSize(APPLICATION_PROPERTY_TABLE_COUNT)];
+PropertyRegistry gPropertyRegistry;
+
+// Callback routing
+// -----------------------------
+// The stack calls the same property callbacks for every device it hosts. Each device registers its
+// handlers with RegisterCallbackDevice() and the callbacks find them by device instance through an
+// open addressing index. A NULL handler means the device has no properties of that type.
+struct CallbackDeviceHandlers {
+    bool (*getCharString)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, uint32_t maxElementCount, uint8_t* encodingType, bool useArrayIndex, uint32_t propertyArrayIndex);
+    bool (*getUInt)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex);
+    bool (*getReal)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float* value, bool useArrayIndex, uint32_t propertyArrayIndex);
+    bool (*getEnumerated)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex);
+    bool (*setUInt)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode);
+    bool (*setReal)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode);
+    bool (*setEnumerated)(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode);
+};
+
+struct CallbackDevice {
+    uint32_t deviceInstance;
+    const CallbackDeviceHandlers* handlers;
+};
+
+const uint8_t APPLICATION_CALLBACK_DEVICE_CAPACITY = 4; // Devices added to the stack, virtual devices are answered before it
+const uint8_t APPLICATION_CALLBACK_DEVICE_INDEX_SIZE = 8; // Power of two, at least twice the capacity
+const uint8_t APPLICATION_CALLBACK_DEVICE_NONE = 0xFF;
+static_assert((APPLICATION_CALLBACK_DEVICE_INDEX_SIZE & (APPLICATION_CALLBACK_DEVICE_INDEX_SIZE - 1)) == 0 && APPLICATION_CALLBACK_DEVICE_INDEX_SIZE >= 2 * APPLICATION_CALLBACK_DEVICE_CAPACITY, "APPLICATION_CALLBACK_DEVICE_INDEX_SIZE must be a power of two at least twice the capacity");
+CallbackDevice gCallbackDevices[APPLICATION_CALLBACK_DEVICE_CAPACITY];
+uint8_t gCallbackDeviceCount = 0;
+uint8_t gCallbackDeviceIndex[APPLICATION_CALLBACK_DEVICE_INDEX_SIZE]; // Slot in gCallbackDevices by device instance
+
+bool RegisterCallbackDevice(uint32_t deviceInstance, const CallbackDeviceHandlers* handlers);
+const CallbackDeviceHandlers* FindCallbackDevice(uint32_t deviceInstance);
 
 // Callback functions
 // -----------------------------
+uint32_t gReceivedTooLarge = 0; // Datagrams dropped because they do not fit the stack's buffer
 uint16_t CallbackReceiveMessage(uint8_t* message, const uint16_t maxMessageLength, uint8_t* receivedConnectionString, const uint8_t maxConnectionStringLength, uint8_t* receivedConnectionStringLength, uint8_t* networkType);
 uint16_t CallbackSendMessage(const uint8_t* message, const uint16_t messageLength, const uint8_t* connectionString, const uint8_t connectionStringLength, const uint8_t networkType, bool broadcast);
 time_t CallbackGetSystemTime();
+bool IsClockSet();
 bool CallbackGetPropertyCharString(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, const uint32_t maxElementCount, uint8_t* encodingType, const bool useArrayIndex, const uint32_t propertyArrayIndex);
 bool CallbackGetPropertyUInt(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex);
+bool CallbackGetPropertyReal(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float* value, bool useArrayIndex, uint32_t propertyArrayIndex);
+bool CallbackGetPropertyEnumerated(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex);
 bool CallbackSetPropertyUInt(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const uint32_t value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode);
+bool CallbackSetPropertyReal(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const float value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode);
+bool CallbackSetPropertyEnumerated(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const uint32_t value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode);
 
 // Helpers
 // -----------------------------
-bool GetBroadcastAddress(uint8_t* broadcastAddress, size_t maxbroadcastAddressSize);
+void UpdateBroadcastAddress();
+#ifdef ARDUINO
+void WiFiEventHandler(WiFiEvent_t event);
+#endif
+void ServiceNetwork(unsigned long currentMillis);
+bool AnnounceDevice();
+uint32_t PackIPAddress(const uint8_t* ipAddress);
+void ReportStatus(unsigned long currentMillis);
+void ReadLocalInput();
+bool ProcessChanges();
+bool AddPointListObjects();
+bool SetPointListValue(const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const uint32_t value, const bool useArrayIndex, unsigned int* errorCode);
+bool GetPropertyCharString(const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, const uint32_t maxElementCount, const bool useArrayIndex, const uint32_t propertyArrayIndex);
+bool GetPropertyUInt(const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, uint32_t* value, const bool useArrayIndex, const uint32_t propertyArrayIndex);
+bool LocalGetPropertyCharString(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, uint32_t maxElementCount, uint8_t* encodingType, bool useArrayIndex, uint32_t propertyArrayIndex);
+bool LocalGetPropertyReal(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float* value, bool useArrayIndex, uint32_t propertyArrayIndex);
+bool LocalGetPropertyEnumerated(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex);
+bool LocalSetPropertyUInt(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode);
+bool LocalSetPropertyReal(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode);
+bool LocalSetPropertyEnumerated(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode);
+void RecordUnicastResponse(const BACnetFrame* frame, const uint8_t* connectionString);
+#if APPLICATION_RESPONSE_CACHE
+void BuildResponseCache();
+void CacheStaticProperties(uint16_t objectType, uint32_t objectInstance);
+bool EncodeCharStringProperty(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t* buffer, uint16_t maxLength, uint16_t* length);
+uint16_t EncodeVolatileProperty(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint8_t* buffer, uint16_t maxLength);
+#endif
+bool AddMemoryTelemetryObjects();
+void UpdateMemoryTelemetry(unsigned long currentMillis);
+bool AddServiceMetricsObjects();
+void UpdateServiceMetricsObjects(unsigned long currentMillis);
+void SendDiscoveryReplies(unsigned long currentMillis);
+bool AddTrendLogObjects();
+void UpdateTrendLogs(unsigned long currentMillis);
+#if APPLICATION_VIRTUAL_DEVICES > 0
+bool AddVirtualDevices();
+void SendVirtualDeviceMessage(void* context, const uint8_t* message, uint16_t length, const uint8_t* address, bool broadcast);
+#endif
+#if APPLICATION_TREND_LOG_FLASH
+bool BeginTrendLogArchives();
+void ArchiveTrendLogBlock(void* context, const TrendLogBlock* block);
+#endif
+#if APPLICATION_THREADED_MODE
+bool StartTasks();
+void NotifyTask(ApplicationTask* task);
+void WaitForTaskNotify(ApplicationTask* task, uint32_t timeoutMs);
+#endif
+#if APPLICATION_EVENT_DRIVEN_MODE
+void EnableLightSleep();
+void WaitForWork(bool changed);
+#endif
 
 void setup()
 {
     // Hardware setup
     // ==========================================
-    // Set the digital pin as output:
-    pinMode(APPLICATION_LED_PIN, OUTPUT);
     Serial.begin(APPLICATION_SERIAL_BAUD_RATE);
-    delay(3000); // Let the Serial port connect, and give us some time to reprogram if needed.
-
-    Serial.print("FYI: ESP32 CAS BACnet Stack example version: ");
-    Serial.print(APPLICATION_VERSION_MAJOR);
-    Serial.print(".");
-    Serial.print(APPLICATION_VERSION_MINOR);
-    Serial.print(".");
-    Serial.println(APPLICATION_VERSION_PATCH);
-    Serial.print(".");
-    Serial.println(CI_PIPELINE_IID);
+
+    // Start the deferred logging task before anything on the hot path can write records.
+    if (!LogBegin()) {
+        LOG_ERROR("Could not start the logging task");
+    }
+
+    LOG_FYI("ESP32 CAS BACnet Stack example version: %u.%u.%u.%u", APPLICATION_VERSION_MAJOR, APPLICATION_VERSION_MINOR, APPLICATION_VERSION_PATCH, CI_PIPELINE_IID);
     uint64_t chipid = ESP.getEfuseMac(); // The chip ID is essentially its MAC address(length: 6 bytes).
-    Serial.printf("FYI: ESP32 Chip ID: %04X, (%08X)\n", (uint16_t)(chipid >> 32), (uint32_t)chipid);
+    LOG_FYI("ESP32 Chip ID: %04X, (%08X)", (uint16_t)(chipid >> 32), (uint32_t)chipid);
 
-    // WiFi connection
+    // Set up the property registry
     // ==========================================
-    Serial.println("FYI: Connecting to wifi...");
-    WiFi.begin(APPLICATION_WIFI_SSID, APPLICATION_WIFI_PASSWORD);
-
-    // Wait for connection
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        Serial.print(".");
-    }
-    Serial.println("");
-    Serial.print("FYI: Connected to ");
-    Serial.println(APPLICATION_WIFI_SSID);
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    Serial.print("Subnet mask: ");
-    Serial.println(WiFi.subnetMask());
-
-    // Set up UDP port.
-    // Connect the UDP resource to the BACnet Port
-    Serial.printf("FYI: Connecting UDP resource to port=[%u]\n", APPLICATION_BACNET_UDP_PORT);
-    gUDP.begin(APPLICATION_BACNET_UDP_PORT);
-    Serial.println("FYI: Connected to UDP port.");
+    if (!PropertyRegistryBegin(&gPropertyRegistry, APPLICATION_PROPERTY_TABLE, APPLICATION_PROPERTY_TABLE_COUNT, gPropertyRegistryIndex, PropertyArrayCount(gPropertyRegistryIndex))) {
+        LOG_ERROR("Could not build the property registry index");
+        return;
+    }
 
     // Set up the CAS BACnet stack.
     // ==========================================
+    // The heap used while adding the device and its objects is reported as the BACnet stack's memory.
+    uint32_t freeHeapBeforeStack = MemoryGetFreeHeap();
     LoadBACnetFunctions();
-    Serial.print("FYI: CAS BACnet Stack version: ");
-    Serial.print(fpGetAPIMajorVersion());
-    Serial.print(".");
-    Serial.print(fpGetAPIMinorVersion());
-    Serial.print(".");
-    Serial.println(fpGetAPIPatchVersion());
-    Serial.print(".");
-    Serial.println(fpGetAPIBuildVersion());
+    LOG_FYI("CAS BACnet Stack version: %u.%u.%u.%u", fpGetAPIMajorVersion(), fpGetAPIMinorVersion(), fpGetAPIPatchVersion(), fpGetAPIBuildVersion());
+
+    // Point changes are reported to the stack once per scan, see Cov.h
+    CovBegin(fpValueUpdated, APPLICATION_BACNET_DEVICE_INSTANCE);
 
     // Set up CallBack functions
     // ------------------------------------------
     // There are many call back functions that we could implement. These are the minimum required for the demo.
+    // The property callbacks are routed to the handlers registered for the device instance.
+    static const CallbackDeviceHandlers localDeviceHandlers = { LocalGetPropertyCharString, GetPropertyUInt, LocalGetPropertyReal, LocalGetPropertyEnumerated, LocalSetPropertyUInt, LocalSetPropertyReal, LocalSetPropertyEnumerated };
+    if (!RegisterCallbackDevice(APPLICATION_BACNET_DEVICE_INSTANCE, &localDeviceHandlers)) {
+        LOG_ERROR("Could not register the callbacks of Device %u", APPLICATION_BACNET_DEVICE_INSTANCE);
+        return;
+    }
 
     // Message Callback Functions
     fpRegisterCallbackReceiveMessage(CallbackReceiveMessage);
@@ -162,130 +536,915 @@ void setup()
     // Get Property Callback Functions
     fpRegisterCallbackGetPropertyCharacterString(CallbackGetPropertyCharString);
     fpRegisterCallbackGetPropertyUnsignedInteger(CallbackGetPropertyUInt);
+    fpRegisterCallbackGetPropertyReal(CallbackGetPropertyReal);
+    fpRegisterCallbackGetPropertyEnumerated(CallbackGetPropertyEnumerated);
 
     // Set Property Callback Functions
     fpRegisterCallbackSetPropertyUnsignedInteger(CallbackSetPropertyUInt);
+    fpRegisterCallbackSetPropertyReal(CallbackSetPropertyReal);
+    fpRegisterCallbackSetPropertyEnumerated(CallbackSetPropertyEnumerated);
 
     // Set up the BACnet device
     // ------------------------------------------
     if (!fpAddDevice(APPLICATION_BACNET_DEVICE_INSTANCE)) {
-        Serial.printf("Error: Could not add device. Device instanse=%u\n", APPLICATION_BACNET_DEVICE_INSTANCE);
+        LOG_ERROR("Could not add device. Device instanse=%u", APPLICATION_BACNET_DEVICE_INSTANCE);
         return;
     }
-    Serial.printf("FYI: BACnet device created: Device instanse=%u\n", APPLICATION_BACNET_DEVICE_INSTANCE);
+    LOG_FYI("BACnet device created: Device instanse=%u", APPLICATION_BACNET_DEVICE_INSTANCE);
 
     // By default the write service is not enabled. We have to enable it to allow users to write to points.
     if (!fpSetServiceEnabled(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_SERVICE_WRITE_PROPERTY, true)) {
-        Serial.printf("Error: Failed to enabled the WriteProperty service=[%u] for Device %u\n", BACNET_SERVICE_WRITE_PROPERTY, APPLICATION_BACNET_DEVICE_INSTANCE);
+        LOG_ERROR("Failed to enabled the WriteProperty service=[%u] for Device %u", BACNET_SERVICE_WRITE_PROPERTY, APPLICATION_BACNET_DEVICE_INSTANCE);
         return;
     }
-    Serial.printf("FYI: Enabled WriteProperty for Device %u\n", APPLICATION_BACNET_DEVICE_INSTANCE);
+    LOG_FYI("Enabled WriteProperty for Device %u", APPLICATION_BACNET_DEVICE_INSTANCE);
 
     // Read Property Multiple service is a nice to have, not required for a BACnet server to work but it does make polling the device easier.
     if (!fpSetServiceEnabled(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_SERVICE_READ_PROPERTY_MULTIPLE, true)) {
-        Serial.printf("Error: Failed to enabled the Read Property Multiple service=[%u] for Device %u\n", BACNET_SERVICE_READ_PROPERTY_MULTIPLE, APPLICATION_BACNET_DEVICE_INSTANCE);
+        LOG_ERROR("Failed to enabled the Read Property Multiple service=[%u] for Device %u", BACNET_SERVICE_READ_PROPERTY_MULTIPLE, APPLICATION_BACNET_DEVICE_INSTANCE);
         return;
     }
-    Serial.printf("FYI: Enabled Read Property Multiple for Device %u\n", BACNET_SERVICE_READ_PROPERTY_MULTIPLE);
+    LOG_FYI("Enabled Read Property Multiple for Device %u", BACNET_SERVICE_READ_PROPERTY_MULTIPLE);
+
+    // SubscribeCOV lets clients be notified of changes instead of polling the points.
+    if (!fpSetServiceEnabled(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_SERVICE_SUBSCRIBE_COV, true)) {
+        LOG_ERROR("Failed to enabled the SubscribeCOV service=[%u] for Device %u", BACNET_SERVICE_SUBSCRIBE_COV, APPLICATION_BACNET_DEVICE_INSTANCE);
+        return;
+    }
+    LOG_FYI("Enabled SubscribeCOV for Device %u", APPLICATION_BACNET_DEVICE_INSTANCE);
 
     // Add Objects
-    if (!fpAddObject(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE)) {
-        Serial.printf("Error: Failed to add multi-state-output (%u) to Device (%u)\n", APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE, APPLICATION_BACNET_DEVICE_INSTANCE);
+    if (!AddPointListObjects()) {
         return;
     }
-    fpSetPropertyWritable(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, true);
-    fpSetPropertyEnabled(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, true);
+    gLEDModePoint = PointStoreFind(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE);
 
-    Serial.printf("FYI: Added multi-state-output (%u) to Device (%u)\n", APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE, APPLICATION_BACNET_DEVICE_INSTANCE);
+    // Outputs
+    if (!OutputDriverBegin()) {
+        LOG_ERROR("Could not start the output timer");
+        return;
+    }
+    if (OutputDriverAdd(gLEDModePoint, APPLICATION_LED_PIN, 2 * APPLICATION_LED_BLINK_RATE_MS, APPLICATION_LED_OUTPUT_MODES, sizeof(APPLICATION_LED_OUTPUT_MODES) / sizeof(APPLICATION_LED_OUTPUT_MODES[0])) == OUTPUT_INVALID) {
+        LOG_ERROR("Could not add the LED output on pin %u", APPLICATION_LED_PIN);
+        return;
+    }
+    LOG_FYI("LED output on pin %u driven by the output timer", APPLICATION_LED_PIN);
 
-    // Send a IAm Message to announse to the network that a new BACnet device has started.
-    uint8_t connectionString[6];
-    if (!GetBroadcastAddress(connectionString, 6)) {
-        Serial.println("Error: Could not get the broadcast IP address");
+    if (!AddMemoryTelemetryObjects()) {
         return;
     }
-    connectionString[4] = APPLICATION_BACNET_UDP_PORT / 256;
-    connectionString[5] = APPLICATION_BACNET_UDP_PORT % 256;
-    if (!fpSendIAm(APPLICATION_BACNET_DEVICE_INSTANCE, connectionString, 6, BACNET_NETWORK_TYPE_IP, true, 65535, NULL, 0)) {
-        Serial.printf("Error: Unable to send IAm for Device %u", APPLICATION_BACNET_DEVICE_INSTANCE);
+    if (!AddServiceMetricsObjects()) {
+        return;
+    }
+    if (!AddTrendLogObjects()) {
         return;
     }
-    Serial.println("FYI: Sent broadcast IAm message");
+#if APPLICATION_VIRTUAL_DEVICES > 0
+    if (!AddVirtualDevices()) {
+        return;
+    }
+#endif
+    uint32_t freeHeapAfterStack = MemoryGetFreeHeap();
+    MemorySetSubsystemBytes(MEMORY_SUBSYSTEM_BACNET_STACK, freeHeapBeforeStack > freeHeapAfterStack ? freeHeapBeforeStack - freeHeapAfterStack : 0);
+    MemorySetSubsystemBytes(MEMORY_SUBSYSTEM_TRANSPORT, TRANSPORT_RECEIVE_RING_CAPACITY * sizeof(PacketSlot));
+    MemorySetSubsystemBytes(MEMORY_SUBSYSTEM_LOGGING, LOG_RECORD_CAPACITY * sizeof(LogRecord));
+    UpdateMemoryTelemetry(millis());
+    DiscoveryBegin(&gDiscovery, APPLICATION_BACNET_DEVICE_INSTANCE);
+#if APPLICATION_RESPONSE_CACHE
+    BuildResponseCache();
+#endif
+    gBringUp.objectsReadyMs = millis();
+    LOG_FYI("Bring-up: device and objects ready %lu ms after boot", gBringUp.objectsReadyMs);
+
+    // WiFi connection
+    // ==========================================
+    // Continues in the background, see ServiceNetwork()
+#ifdef ARDUINO
+    // The link can get a new address without going down (DHCP renewal, a static address cleared with
+    // 'n'). Refresh the cached broadcast address whenever it does.
+    WiFi.onEvent(WiFiEventHandler);
+#endif
+#ifdef APPLICATION_STATIC_IP
+    NetworkSaveStaticIP(&gNetwork, (uint32_t)IPAddress(APPLICATION_STATIC_IP), (uint32_t)IPAddress(APPLICATION_STATIC_GATEWAY), (uint32_t)IPAddress(APPLICATION_STATIC_SUBNET_MASK));
+#endif
+    LOG_FYI("Connecting to wifi %s...", APPLICATION_WIFI_SSID);
+    NetworkBegin(&gNetwork, APPLICATION_WIFI_SSID, APPLICATION_WIFI_PASSWORD, (uint32_t)millis());
+    if (gNetwork.usingCache) {
+        LOG_FYI("Connecting to the cached access point on channel %u", gNetwork.channel);
+    }
+    if (gNetwork.staticIP != 0) {
+        IPAddress staticIP(gNetwork.staticIP);
+        LOG_FYI("Using the static IP address %u.%u.%u.%u", staticIP[0], staticIP[1], staticIP[2], staticIP[3]);
+    }
+
+#if APPLICATION_THREADED_MODE
+    if (!StartTasks()) {
+        LOG_ERROR("Could not start the network and BACnet tasks");
+        return;
+    }
+    LOG_FYI("Started threaded mode");
+#endif
+#if APPLICATION_EVENT_DRIVEN_MODE
+    EventLoopBegin(&gEventLoop, APPLICATION_EVENT_STACK_TIMER_MS, micros());
+#ifdef ARDUINO
+    EnableLightSleep();
+#endif
+    LOG_FYI("Started event-driven mode, the stack's timers are serviced every %u ms when idle", APPLICATION_EVENT_STACK_TIMER_MS);
+#endif
 }
 
 void loop()
 {
+#if APPLICATION_THREADED_MODE
+    // The network and BACnet tasks do all the work. The Arduino loop task is not needed.
+#ifdef ARDUINO
+    vTaskDelete(NULL);
+#else
+    delay(1000);
+#endif
+#else
     fpLoop();
+    ReadLocalInput();
     unsigned long currentMillis = millis();
+    ServiceNetwork(currentMillis);
+    UpdateMemoryTelemetry(currentMillis);
+    UpdateServiceMetricsObjects(currentMillis);
+    UpdateTrendLogs(currentMillis);
+    SendDiscoveryReplies(currentMillis);
+    bool changed = ProcessChanges();
+    ReportStatus(currentMillis);
+#if APPLICATION_EVENT_DRIVEN_MODE
+    WaitForWork(changed);
+#else
+    (void)changed;
+#endif
+#endif
+}
 
+// Prints heap and transport statistics every 30 seconds
+void ReportStatus(unsigned long currentMillis)
+{
     static unsigned long lastMemoryCheck = 0;
+    EventLoopWakeBy(&gEventLoop, lastMemoryCheck + 1);
     if (lastMemoryCheck < currentMillis) {
         lastMemoryCheck = currentMillis + 30000;
-        Serial.print("FYI: FreeHeap: ");
-        Serial.print(ESP.getFreeHeap());
-        Serial.print(" / ");
-        Serial.print(ESP.getHeapSize());
-        Serial.print(" (");
-        Serial.print(((float)ESP.getFreeHeap() / (float)ESP.getHeapSize()) * 100.0f);
-        Serial.println(" %)");
+        LOG_FYI("FreeHeap: %u / %u (%.2f %%), minimum %u, largest block %u%s", gMemoryStatistics.freeHeap, gMemoryStatistics.heapSize, gMemoryStatistics.heapSize > 0 ? ((float)gMemoryStatistics.freeHeap / (float)gMemoryStatistics.heapSize) * 100.0f : 0.0f, gMemoryStatistics.minimumFreeHeap, gMemoryStatistics.largestFreeBlock, gMemoryStatistics.alarm ? " (ALARM)" : "");
+        LOG_FYI("Memory: BACnet stack %u, transport buffers %u, logging %u bytes", gMemoryStatistics.subsystemBytes[MEMORY_SUBSYSTEM_BACNET_STACK], gMemoryStatistics.subsystemBytes[MEMORY_SUBSYSTEM_TRANSPORT], gMemoryStatistics.subsystemBytes[MEMORY_SUBSYSTEM_LOGGING]);
+        LOG_FYI("Log records: %u written, %u dropped", LogGetWrittenCount(), LogGetDroppedCount());
+        TransportStatistics transportStatistics;
+        TransportGetStatistics(&transportStatistics);
+        LOG_FYI("UDP: %u received, %u sent (%u broadcast), %u send errors, receive ring depth %u (high water mark %u, full %u times), %u dropped by the socket, largest batch %u, %u too large for the stack", transportStatistics.packetsReceived, transportStatistics.packetsSent, transportStatistics.broadcastsSent, transportStatistics.sendErrors, transportStatistics.receiveRingDepth, transportStatistics.receiveRingHighWaterMark, transportStatistics.receiveRingFullStops, transportStatistics.receiveSocketDrops, transportStatistics.receiveLargestBatch, gReceivedTooLarge);
+        LOG_FYI("UDP send path: %.2f us average, %u us max", transportStatistics.packetsSent > 0 ? (float)transportStatistics.sendTimeTotalUs / (float)transportStatistics.packetsSent : 0.0f, transportStatistics.sendTimeMaxUs);
+        PointStoreStatistics pointStoreStatistics;
+        PointStoreGetStatistics(&pointStoreStatistics);
+        LOG_FYI("Points: %u points, %u writes, %u changes (%u coalesced), %u snapshot retries", pointStoreStatistics.pointCount, pointStoreStatistics.writes, pointStoreStatistics.changes, pointStoreStatistics.coalesced, pointStoreStatistics.readRetries);
+        CovStatistics covStatistics;
+        CovGetStatistics(&covStatistics);
+        LOG_FYI("COV: %u subscribable points, %u value updates", covStatistics.pointCount, covStatistics.notificationsFlushed);
+        const NetworkStatistics& networkStatistics = gNetwork.statistics;
+        LOG_FYI("Network: %s, %u connects (%u to the cached access point, %u fell back to a scan), %u link losses, last connect took %u ms", NetworkIsConnected(&gNetwork) ? "connected" : "connecting", networkStatistics.connectAttempts, networkStatistics.cachedConnectAttempts, networkStatistics.cachedConnectFailures, networkStatistics.linkLosses, networkStatistics.lastConnectMs);
+        const DiscoveryStatistics& discoveryStatistics = gDiscovery.statistics;
+        LOG_FYI("Who-Is: %u received, %u not matching, %u rate limited, %u coalesced, %u passed to the stack, %u IAm sent", discoveryStatistics.whoIsReceived, discoveryStatistics.whoIsNotMatching, discoveryStatistics.whoIsRateLimited, discoveryStatistics.whoIsCoalesced, discoveryStatistics.whoIsForwarded, discoveryStatistics.iAmSent);
+#if APPLICATION_RESPONSE_CACHE
+        const ResponseCacheStatistics& responseCacheStatistics = gResponseCache.statistics;
+        LOG_FYI("Response cache: %u values (%u bytes, %u did not fit), %u requests answered, %u passed to the stack, %u invalidations, %u property lists learned", responseCacheStatistics.entries, responseCacheStatistics.arenaBytes, responseCacheStatistics.rejected, responseCacheStatistics.hits, responseCacheStatistics.misses, responseCacheStatistics.invalidations, responseCacheStatistics.listsLearned);
+#endif
+#if APPLICATION_EVENT_DRIVEN_MODE
+        const EventLoopStatistics& eventLoopStatistics = gEventLoop.statistics;
+        LOG_FYI("Event loop: %.1f %% idle, %u scans (%u with work queued), woken %u times by a packet and %u by a deadline, wake latency p50 <%u us, p99 <%u us, max %u us", EventLoopTakeIdlePercent(&gEventLoop, micros()), eventLoopStatistics.scans, eventLoopStatistics.busyScans, eventLoopStatistics.packetWakes, eventLoopStatistics.deadlineWakes, HistogramPercentileUs(&eventLoopStatistics.late, 50), HistogramPercentileUs(&eventLoopStatistics.late, 99), eventLoopStatistics.late.maxUs);
+#endif
+        time_t now = CallbackGetSystemTime();
+        LOG_FYI("Clock: %s (%lu UTC), %u trend log samples skipped before it was set", IsClockSet() ? "set" : "waiting for SNTP", (unsigned long)now, gTrendLogSamplesSkipped);
+        for (uint32_t offset = 0; offset < APPLICATION_TREND_LOG_COUNT; offset++) {
+            TrendLogStatistics trendLogStatistics;
+            TrendLogGetStatistics(&gTrendLogs[offset], &trendLogStatistics);
+            LOG_FYI("Trend log %u: %u records in %u bytes (%.2f bytes per record), %u logged, %u blocks dropped, %u flushed, %u clock steps", APPLICATION_TREND_LOGS[offset].objectInstance, trendLogStatistics.recordCount, trendLogStatistics.bytesUsed, trendLogStatistics.recordCount > 0 ? (float)trendLogStatistics.bytesUsed / (float)trendLogStatistics.recordCount : 0.0f, trendLogStatistics.totalRecords, trendLogStatistics.blocksDropped, trendLogStatistics.blocksFlushed, trendLogStatistics.clockSteps);
+#if APPLICATION_TREND_LOG_FLASH
+            LOG_FYI("Trend log %u flash: next block at %u of %u bytes, %u write errors", APPLICATION_TREND_LOGS[offset].objectInstance, gTrendLogArchives[offset].next, gTrendLogArchives[offset].size, gTrendLogArchives[offset].writeErrors);
+#endif
+        }
+        const ReadRangeStatistics& readRangeStatistics = gReadRange.statistics;
+        LOG_FYI("ReadRange: %u requests answered (%u records, %u truncated), %u passed to the stack", readRangeStatistics.answered, readRangeStatistics.recordsSent, readRangeStatistics.truncated, readRangeStatistics.passed);
+#if APPLICATION_VIRTUAL_DEVICES > 0
+        const VirtualDevicesStatistics& virtualDevicesStatistics = gVirtualDevices.statistics;
+        LOG_FYI("Virtual devices: %u on network %u, %u requests (%u errors, %u writes), %u Who-Is, %u rate limited, %u IAm sent, %u router queries, %u for unknown devices, %u dropped", gVirtualDevices.deviceCount, gVirtualDevices.networkNumber, virtualDevicesStatistics.requests, virtualDevicesStatistics.errors, virtualDevicesStatistics.writes, virtualDevicesStatistics.whoIsReceived, virtualDevicesStatistics.whoIsRateLimited, virtualDevicesStatistics.iAmSent, virtualDevicesStatistics.routerQueries, virtualDevicesStatistics.unknownDestination, virtualDevicesStatistics.dropped);
+#endif
+        OutputStatistics outputStatistics;
+        OutputDriverGetStatistics(&outputStatistics);
+        LOG_FYI("Outputs: %u channels, %u mode changes, %u timed edges, jitter p50 <%u us, p99 <%u us, max %u us, %u restarts", outputStatistics.channelCount, outputStatistics.modeChanges, outputStatistics.edges, HistogramPercentileUs(&outputStatistics.jitter, 50), HistogramPercentileUs(&outputStatistics.jitter, 99), outputStatistics.jitter.maxUs, outputStatistics.restarts);
     }
+}
 
-    switch (gLEDMode) {
-        default:
-        case LED_MODE_OFF:
-            if (gLEDState != LOW) {
-                gLEDState = LOW;
-                digitalWrite(APPLICATION_LED_PIN, gLEDState);
+// Serial console commands
+// - '1' off, '2' on, '3' blink: local override of the LED mode
+// - 'm': dump the per-service request metrics
+// - 'n': forget the cached access point and static IP address, and go back to DHCP
+void ReadLocalInput()
+{
+    while (Serial.available() > 0) {
+        int input = Serial.read();
+        if (input >= '0' + LED_MODE_OFF && input <= '0' + LED_MODE_BLINK) {
+            WriteLEDMode((uint32_t)(input - '0'));
+            LOG_FYI("LED mode set to %d from the serial console", input - '0');
+        } else if (input == 'm') {
+            ServiceMetricsDump();
+        } else if (input == 'n') {
+            NetworkClearSettings(&gNetwork);
+            LOG_FYI("Cleared the network settings, back to DHCP; the next connect scans for the access point");
+        }
+    }
+}
+
+// Adds every object in the point list to the device and the point store, and reports how long it
+// took, the point store's RAM per point and, on the device, how much heap the stack used per object.
+bool AddPointListObjects()
+{
+    unsigned long startUs = micros();
+#ifdef ARDUINO
+    uint32_t freeHeapBefore = MemoryGetFreeHeap();
+#endif
+
+    for (uint16_t groupOffset = 0; groupOffset < APPLICATION_POINT_LIST_GROUP_COUNT; groupOffset++) {
+        const PointGroup* group = &APPLICATION_POINT_LIST[groupOffset];
+        uint32_t initialValue = group->initialValue;
+        if (group->real) {
+            memcpy(&initialValue, &group->initialReal, sizeof(initialValue));
+        }
+        for (uint32_t objectInstance = group->firstInstance; objectInstance - group->firstInstance < group->count; objectInstance++) {
+            if (!fpAddObject(APPLICATION_BACNET_DEVICE_INSTANCE, group->objectType, objectInstance)) {
+                LOG_ERROR("Failed to add object (%u, %u) to Device (%u)", group->objectType, objectInstance, APPLICATION_BACNET_DEVICE_INSTANCE);
+                return false;
             }
-            break;
-        case LED_MODE_ON:
-            if (gLEDState != HIGH) {
-                gLEDState = HIGH;
-                digitalWrite(APPLICATION_LED_PIN, gLEDState);
+            if (group->flags & POINT_FLAG_WRITABLE) {
+                fpSetPropertyWritable(APPLICATION_BACNET_DEVICE_INSTANCE, group->objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, true);
             }
-            break;
-        case LED_MODE_BLINK:
-            // check to see if it's time to blink the LED; that is, if the difference
-            // between the current time and last time you blinked the LED is bigger than
-            // the interval at which you want to blink the LED.
-            static long lastBlink = 0;
-            if (currentMillis - lastBlink >= APPLICATION_LED_BLINK_RATE_MS) {
-                // save the last time you blinked the LED
-                lastBlink = currentMillis;
-
-                // if the LED is off turn it on and vice-versa:
-                if (gLEDState == LOW) {
-                    gLEDState = HIGH;
-                    Serial.print("+");
-                } else {
-                    gLEDState = LOW;
-                    Serial.print("-");
-                }
+            if (group->stateText != NULL) {
+                fpSetPropertyEnabled(APPLICATION_BACNET_DEVICE_INSTANCE, group->objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, true);
+            }
+            uint16_t point = PointStoreAdd(group->objectType, objectInstance, initialValue);
+            if (point == POINT_INVALID) {
+                LOG_ERROR("Point store is full, could not add object (%u, %u)", group->objectType, objectInstance);
+                return false;
+            }
+            if (group->flags & POINT_FLAG_SUBSCRIBABLE) {
+                fpSetPropertySubscribable(APPLICATION_BACNET_DEVICE_INSTANCE, group->objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, true);
+                CovSetSubscribable(point);
+            }
+        }
+    }
+
+    unsigned long elapsedUs = micros() - startUs;
+    LOG_FYI("Added %u objects from the point list to Device (%u) in %lu us (%.2f us per object)", APPLICATION_POINT_LIST_COUNT, APPLICATION_BACNET_DEVICE_INSTANCE, elapsedUs, (float)elapsedUs / (float)APPLICATION_POINT_LIST_COUNT);
+    LOG_FYI("Point store RAM: %u bytes for %u points with the index, %.1f bytes per point", PointStoreGetMemoryBytes(), POINT_STORE_CAPACITY, (float)PointStoreGetMemoryBytes() / (float)POINT_STORE_CAPACITY);
+#ifdef ARDUINO
+    // The host shim has no heap to measure
+    uint32_t freeHeapAfter = MemoryGetFreeHeap();
+    uint32_t heapUsed = freeHeapBefore > freeHeapAfter ? freeHeapBefore - freeHeapAfter : 0;
+    LOG_FYI("BACnet stack RAM: %.1f bytes of heap per object", (float)heapUsed / (float)APPLICATION_POINT_LIST_COUNT);
+#endif
+    return true;
+}
+
+// Adds the memory telemetry objects to the device and the point store
+bool AddMemoryTelemetryObjects()
+{
+    for (uint32_t offset = 0; offset < MEMORY_VALUE_COUNT; offset++) {
+        uint32_t objectInstance = APPLICATION_BACNET_OBJECT_AV_MEMORY_FIRST_INSTANCE + offset;
+        if (!fpAddObject(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_ANALOG_VALUE, objectInstance)) {
+            LOG_ERROR("Failed to add analog-value (%u) to Device (%u)", objectInstance, APPLICATION_BACNET_DEVICE_INSTANCE);
+            return false;
+        }
+        gMemoryValuePoints[offset] = PointStoreAdd(BACNET_OBJECT_TYPE_ANALOG_VALUE, objectInstance, 0);
+        if (gMemoryValuePoints[offset] == POINT_INVALID) {
+            LOG_ERROR("Point store is full, could not add analog-value (%u)", objectInstance);
+            return false;
+        }
+    }
+
+    if (!fpAddObject(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_BINARY_VALUE, APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_INSTANCE)) {
+        LOG_ERROR("Failed to add binary-value (%u) to Device (%u)", APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_INSTANCE, APPLICATION_BACNET_DEVICE_INSTANCE);
+        return false;
+    }
+    fpSetPropertySubscribable(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_BINARY_VALUE, APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_INSTANCE, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, true);
+    gMemoryAlarmPoint = PointStoreAdd(BACNET_OBJECT_TYPE_BINARY_VALUE, APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_INSTANCE, 0);
+    if (gMemoryAlarmPoint == POINT_INVALID) {
+        LOG_ERROR("Point store is full, could not add binary-value (%u)", APPLICATION_BACNET_OBJECT_BV_MEMORY_ALARM_INSTANCE);
+        return false;
+    }
+    CovSetSubscribable(gMemoryAlarmPoint);
+
+    LOG_FYI("Added %u memory telemetry analog-values and the memory alarm binary-value to Device (%u)", MEMORY_VALUE_COUNT, APPLICATION_BACNET_DEVICE_INSTANCE);
+    return true;
+}
+
+// Samples the heap and writes the memory telemetry objects, once per APPLICATION_MEMORY_SAMPLE_INTERVAL_MS
+void UpdateMemoryTelemetry(unsigned long currentMillis)
+{
+    static unsigned long nextSample = 0;
+    if (currentMillis < nextSample) {
+        EventLoopWakeBy(&gEventLoop, nextSample);
+        return;
+    }
+    nextSample = currentMillis + APPLICATION_MEMORY_SAMPLE_INTERVAL_MS;
+    EventLoopWakeBy(&gEventLoop, nextSample);
+
+    if (MemorySample(&gMemoryStatistics)) {
+        if (gMemoryStatistics.alarm) {
+            LOG_ERROR("Memory alarm: free heap %u, largest free block %u", gMemoryStatistics.freeHeap, gMemoryStatistics.largestFreeBlock);
+        } else {
+            LOG_FYI("Memory alarm cleared: free heap %u, largest free block %u", gMemoryStatistics.freeHeap, gMemoryStatistics.largestFreeBlock);
+        }
+    }
+    if (gMemoryAlarmPoint == POINT_INVALID) {
+        return; // The telemetry objects were not added
+    }
+
+    PointStoreWriteReal(gMemoryValuePoints[MEMORY_VALUE_FREE_HEAP], (float)gMemoryStatistics.freeHeap);
+    PointStoreWriteReal(gMemoryValuePoints[MEMORY_VALUE_MINIMUM_FREE_HEAP], (float)gMemoryStatistics.minimumFreeHeap);
+    PointStoreWriteReal(gMemoryValuePoints[MEMORY_VALUE_LARGEST_FREE_BLOCK], (float)gMemoryStatistics.largestFreeBlock);
+    PointStoreWriteReal(gMemoryValuePoints[MEMORY_VALUE_BACNET_STACK], (float)gMemoryStatistics.subsystemBytes[MEMORY_SUBSYSTEM_BACNET_STACK]);
+    PointStoreWriteReal(gMemoryValuePoints[MEMORY_VALUE_TRANSPORT], (float)gMemoryStatistics.subsystemBytes[MEMORY_SUBSYSTEM_TRANSPORT]);
+    PointStoreWriteReal(gMemoryValuePoints[MEMORY_VALUE_LOGGING], (float)gMemoryStatistics.subsystemBytes[MEMORY_SUBSYSTEM_LOGGING]);
+
+    // The alarm is the Binary Value's present value only. Status_Flags are answered by the stack, so
+    // setting IN_ALARM in the point store would show in the trend logs but never on the objects.
+    PointStoreWrite(gMemoryAlarmPoint, gMemoryStatistics.alarm ? 1 : 0);
+}
+
+// Adds the service latency objects to the device and the point store
+bool AddServiceMetricsObjects()
+{
+    for (uint32_t offset = 0; offset < APPLICATION_SERVICE_METRICS_SERVICE_COUNT; offset++) {
+        uint32_t objectInstance = APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE + offset;
+        if (!fpAddObject(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_ANALOG_VALUE, objectInstance)) {
+            LOG_ERROR("Failed to add analog-value (%u) to Device (%u)", objectInstance, APPLICATION_BACNET_DEVICE_INSTANCE);
+            return false;
+        }
+        fpSetPropertyEnabled(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_ANALOG_VALUE, objectInstance, BACNET_PROPERTY_IDENTIFIER_DESCRIPTION, true);
+        gServiceLatencyPoints[offset] = PointStoreAdd(BACNET_OBJECT_TYPE_ANALOG_VALUE, objectInstance, 0);
+        if (gServiceLatencyPoints[offset] == POINT_INVALID) {
+            LOG_ERROR("Point store is full, could not add analog-value (%u)", objectInstance);
+            return false;
+        }
+    }
+    LOG_FYI("Added %u service latency analog-values to Device (%u)", APPLICATION_SERVICE_METRICS_SERVICE_COUNT, APPLICATION_BACNET_DEVICE_INSTANCE);
+    return true;
+}
+
+// Writes the p99 latency of each service to its object, once per APPLICATION_SERVICE_METRICS_UPDATE_INTERVAL_MS
+void UpdateServiceMetricsObjects(unsigned long currentMillis)
+{
+    static unsigned long nextUpdate = 0;
+    if (currentMillis < nextUpdate) {
+        EventLoopWakeBy(&gEventLoop, nextUpdate);
+        return;
+    }
+    nextUpdate = currentMillis + APPLICATION_SERVICE_METRICS_UPDATE_INTERVAL_MS;
+    EventLoopWakeBy(&gEventLoop, nextUpdate);
+
+    for (uint32_t offset = 0; offset < APPLICATION_SERVICE_METRICS_SERVICE_COUNT; offset++) {
+        const ServiceMetrics* metrics = ServiceMetricsGet((uint8_t)APPLICATION_SERVICE_METRICS_SERVICES[offset]);
+        PointStoreWriteReal(gServiceLatencyPoints[offset], (float)HistogramPercentileUs(&metrics->latency, 99));
+    }
+}
+
+// Adds the trend log objects to the device and starts their logs. ReadRange of the logs is answered
+// in CallbackReceiveMessage().
+bool AddTrendLogObjects()
+{
+#if defined(ARDUINO) && defined(BOARD_HAS_PSRAM)
+    gTrendLogBlocks = (TrendLogBlock*)ps_malloc(APPLICATION_TREND_LOG_COUNT * APPLICATION_TREND_LOG_BLOCKS * sizeof(TrendLogBlock));
+    if (gTrendLogBlocks == NULL) {
+        LOG_ERROR("Could not allocate %u trend log blocks in PSRAM", APPLICATION_TREND_LOG_COUNT * APPLICATION_TREND_LOG_BLOCKS);
+        return false;
+    }
+#endif
+#if APPLICATION_TREND_LOG_FLASH
+    bool archived = BeginTrendLogArchives();
+#endif
+    for (uint32_t offset = 0; offset < APPLICATION_TREND_LOG_COUNT; offset++) {
+        const TrendLogChannel* channel = &APPLICATION_TREND_LOGS[offset];
+        if (!fpAddObject(APPLICATION_BACNET_DEVICE_INSTANCE, BACNET_OBJECT_TYPE_TREND_LOG, channel->objectInstance)) {
+            LOG_ERROR("Failed to add trend-log (%u) to Device (%u)", channel->objectInstance, APPLICATION_BACNET_DEVICE_INSTANCE);
+            return false;
+        }
+        gTrendLogPoints[offset] = PointStoreFind(channel->pointObjectType, channel->pointObjectInstance);
+        if (gTrendLogPoints[offset] == POINT_INVALID) {
+            LOG_ERROR("Trend-log (%u) logs object (%u, %u), which is not in the point store", channel->objectInstance, channel->pointObjectType, channel->pointObjectInstance);
+            return false;
+        }
+        TrendLogFlushFunction flush = NULL;
+        void* flushContext = NULL;
+#if APPLICATION_TREND_LOG_FLASH
+        if (archived) {
+            flush = ArchiveTrendLogBlock;
+            flushContext = &gTrendLogArchives[offset];
+        }
+#endif
+        TrendLogBegin(&gTrendLogs[offset], channel->valueType, &gTrendLogBlocks[offset * APPLICATION_TREND_LOG_BLOCKS], APPLICATION_TREND_LOG_BLOCKS, flush, flushContext);
+        gReadRangeLogs[offset].objectInstance = channel->objectInstance;
+        gReadRangeLogs[offset].log = &gTrendLogs[offset];
+    }
+    ReadRangeBegin(&gReadRange, gReadRangeLogs, APPLICATION_TREND_LOG_COUNT);
+    LOG_FYI("Added %u trend-logs to Device (%u), %u bytes of log blocks each", APPLICATION_TREND_LOG_COUNT, APPLICATION_BACNET_DEVICE_INSTANCE, APPLICATION_TREND_LOG_BLOCKS * TREND_LOG_BLOCK_BYTES);
+    return true;
+}
+
+#if APPLICATION_VIRTUAL_DEVICES > 0
+// Adds the virtual devices, each with its own copy of the object table's present values
+bool AddVirtualDevices()
+{
+    VirtualDevicesBegin(&gVirtualDevices, APPLICATION_VIRTUAL_NETWORK_NUMBER, APPLICATION_BACNET_VENDOR_IDENTIFIER, SendVirtualDeviceMessage, NULL);
+    for (uint32_t device = 0; device < APPLICATION_VIRTUAL_DEVICES; device++) {
+        for (uint16_t object = 0; object < APPLICATION_VIRTUAL_OBJECT_COUNT; object++) {
+            // 0.0 for Analog Values, inactive for Binary Values, the first state for Multi-state Values
+            gVirtualDeviceValues[device][object] = APPLICATION_VIRTUAL_OBJECTS[object].objectType == BACNET_OBJECT_TYPE_MULTI_STATE_VALUE ? 1 : 0;
+        }
+        uint32_t deviceInstance = APPLICATION_VIRTUAL_DEVICE_FIRST_INSTANCE + device;
+        snprintf(gVirtualDeviceNames[device], APPLICATION_VIRTUAL_DEVICE_NAME_LENGTH, "ESP32 virtual device %u", device + 1);
+        if (VirtualDevicesAdd(&gVirtualDevices, deviceInstance, gVirtualDeviceNames[device], APPLICATION_VIRTUAL_OBJECTS, APPLICATION_VIRTUAL_OBJECT_COUNT, gVirtualDeviceValues[device]) == VIRTUAL_DEVICE_NONE) {
+            LOG_ERROR("Could not add virtual device (%u)", deviceInstance);
+            return false;
+        }
+    }
+    LOG_FYI("Added %u virtual devices (%u to %u) with %u objects each on network %u", APPLICATION_VIRTUAL_DEVICES, APPLICATION_VIRTUAL_DEVICE_FIRST_INSTANCE, APPLICATION_VIRTUAL_DEVICE_FIRST_INSTANCE + APPLICATION_VIRTUAL_DEVICES - 1, APPLICATION_VIRTUAL_OBJECT_COUNT, APPLICATION_VIRTUAL_NETWORK_NUMBER);
+    return true;
+}
+
+// Sends a reply of the virtual devices. Unicast replies are recorded like the stack's.
+void SendVirtualDeviceMessage(void* context, const uint8_t* message, uint16_t length, const uint8_t* address, bool broadcast)
+{
+    (void)context;
+    uint8_t connectionString[PACKET_ADDRESS_LENGTH];
+    if (broadcast) {
+        if (!TransportGetBroadcastConnectionString(connectionString)) {
+            return; // No network yet
+        }
+        address = connectionString;
+    }
+    if (TransportSend(message, length, address, broadcast) != length) {
+        LOG_ERROR("Failed to send virtual device message with %u bytes", length);
+        return;
+    }
+    BACnetFrame frame;
+    if (!broadcast && BACnetFrameParse(message, length, &frame)) {
+        RecordUnicastResponse(&frame, address);
+    }
+}
+#endif
+
+// Logs the present value and status flags of each logged point, once per APPLICATION_TREND_LOG_INTERVAL_MS
+void UpdateTrendLogs(unsigned long currentMillis)
+{
+    static unsigned long nextSample = 0;
+    if (currentMillis < nextSample) {
+        EventLoopWakeBy(&gEventLoop, nextSample);
+        return;
+    }
+    nextSample = currentMillis + APPLICATION_TREND_LOG_INTERVAL_MS;
+    EventLoopWakeBy(&gEventLoop, nextSample);
+
+    if (!IsClockSet()) {
+        gTrendLogSamplesSkipped++;
+        return;
+    }
+    uint32_t timestamp = (uint32_t)CallbackGetSystemTime();
+    for (uint32_t offset = 0; offset < APPLICATION_TREND_LOG_COUNT; offset++) {
+        PointSnapshot snapshot;
+        if (PointStoreRead(gTrendLogPoints[offset], &snapshot)) {
+            TrendLogAppend(&gTrendLogs[offset], timestamp, snapshot.presentValue, snapshot.statusFlags);
+        }
+    }
+}
+
+#if APPLICATION_TREND_LOG_FLASH
+// Splits the trend log partition between the logs, in whole sectors. Returns false if there is no
+// partition or it is too small, the logs are then kept in RAM only.
+bool BeginTrendLogArchives()
+{
+    const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, APPLICATION_TREND_LOG_PARTITION_LABEL);
+    if (partition == NULL) {
+        LOG_ERROR("No \"%s\" partition, the trend logs are not copied to flash", APPLICATION_TREND_LOG_PARTITION_LABEL);
+        return false;
+    }
+    uint32_t sliceSize = partition->size / APPLICATION_TREND_LOG_COUNT / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    if (sliceSize == 0) {
+        LOG_ERROR("The \"%s\" partition is too small for %u trend logs", APPLICATION_TREND_LOG_PARTITION_LABEL, APPLICATION_TREND_LOG_COUNT);
+        return false;
+    }
+    for (uint32_t offset = 0; offset < APPLICATION_TREND_LOG_COUNT; offset++) {
+        TrendLogArchive* archive = &gTrendLogArchives[offset];
+        archive->partition = partition;
+        archive->offset = offset * sliceSize;
+        archive->size = sliceSize;
+        archive->next = 0;
+        archive->writeErrors = 0;
+    }
+    LOG_FYI("Trend log blocks are copied to flash, %u bytes per log", sliceSize);
+    return true;
+}
+
+// Flush function of the trend logs. Each sector is erased when the ring reaches it, so the oldest
+// sector of blocks is lost at a time.
+void ArchiveTrendLogBlock(void* context, const TrendLogBlock* block)
+{
+    TrendLogArchive* archive = (TrendLogArchive*)context;
+    uint32_t address = archive->offset + archive->next;
+    if ((archive->next % SPI_FLASH_SEC_SIZE == 0 && esp_partition_erase_range(archive->partition, address, SPI_FLASH_SEC_SIZE) != ESP_OK) || esp_partition_write(archive->partition, address, block, sizeof(*block)) != ESP_OK) {
+        archive->writeErrors++;
+    }
+    archive->next = (archive->next + sizeof(*block)) % archive->size;
+}
+#endif
+
+#if APPLICATION_RESPONSE_CACHE
+// Encodes the static properties of the device and of every object in the point store into the
+// response cache, and reports how long it took and how much RAM it uses. The ALL and REQUIRED
+// lists of the point store objects are learned from the stack's first answer.
+void BuildResponseCache()
+{
+    unsigned long startUs = micros();
+    ResponseCacheBegin(&gResponseCache, EncodeVolatileProperty);
+
+    CacheStaticProperties(BACNET_OBJECT_TYPE_DEVICE, APPLICATION_BACNET_DEVICE_INSTANCE);
+    uint16_t pointCount = PointStoreCount();
+    for (uint16_t point = 0; point < pointCount; point++) {
+        uint16_t objectType;
+        uint32_t objectInstance;
+        PointStoreGetObject(point, &objectType, &objectInstance);
+        CacheStaticProperties(objectType, objectInstance);
+        ResponseCacheLearnPropertyLists(&gResponseCache, objectType, objectInstance);
+    }
+
+    const ResponseCacheStatistics& statistics = gResponseCache.statistics;
+    LOG_FYI("Response cache: %u values from %u objects in %lu us, %u of %u bytes used, %u values did not fit", statistics.entries, pointCount + 1, micros() - startUs, statistics.arenaBytes, RESPONSE_CACHE_ARENA_BYTES, statistics.rejected);
+}
+
+// Object_Identifier, Object_Type and Object_Name of every object, and Number_Of_States and
+// State_Text of Multi-state objects. The values come from the same getters the stack's callbacks
+// use, so the cached response is the one the stack would have sent.
+void CacheStaticProperties(uint16_t objectType, uint32_t objectInstance)
+{
+    uint8_t* buffer = gResponseCacheBuffer;
+    const uint16_t maxLength = sizeof(gResponseCacheBuffer);
+    uint16_t length = BACnetEncodeObjectIdentifier(buffer, maxLength, objectType, objectInstance);
+    ResponseCacheAdd(&gResponseCache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, RESPONSE_CACHE_NO_INDEX, buffer, length);
+    length = BACnetEncodeEnumerated(buffer, maxLength, objectType);
+    ResponseCacheAdd(&gResponseCache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, RESPONSE_CACHE_NO_INDEX, buffer, length);
+    length = 0;
+    if (EncodeCharStringProperty(objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, false, 0, buffer, maxLength, &length)) {
+        ResponseCacheAdd(&gResponseCache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, RESPONSE_CACHE_NO_INDEX, buffer, length);
+    }
+
+    uint32_t stateCount;
+    if (!GetPropertyUInt(objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES, &stateCount, false, 0)) {
+        return;
+    }
+    length = BACnetEncodeUnsigned(buffer, maxLength, stateCount);
+    ResponseCacheAdd(&gResponseCache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES, RESPONSE_CACHE_NO_INDEX, buffer, length);
+    ResponseCacheAdd(&gResponseCache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, 0, buffer, length);
+
+    // Each state text, then the whole array
+    for (uint32_t state = 1; state <= stateCount; state++) {
+        length = 0;
+        if (!EncodeCharStringProperty(objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, true, state, buffer, maxLength, &length)) {
+            return;
+        }
+        ResponseCacheAdd(&gResponseCache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, state, buffer, length);
+    }
+    length = 0;
+    for (uint32_t state = 1; state <= stateCount; state++) {
+        if (!EncodeCharStringProperty(objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, true, state, buffer, maxLength, &length)) {
+            return;
+        }
+    }
+    ResponseCacheAdd(&gResponseCache, objectType, objectInstance, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, RESPONSE_CACHE_NO_INDEX, buffer, length);
+}
+
+// Appends a character string property to buffer at *length. Returns false if the getter does not
+// know it or it is too long to cache.
+bool EncodeCharStringProperty(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t* buffer, uint16_t maxLength, uint16_t* length)
+{
+    char value[APPLICATION_RESPONSE_CACHE_MAX_STRING_LENGTH];
+    uint32_t valueLength = 0;
+    if (!GetPropertyCharString(objectType, objectInstance, propertyIdentifier, value, &valueLength, sizeof(value), useArrayIndex, propertyArrayIndex) || valueLength >= sizeof(value)) {
+        return false;
+    }
+    uint16_t encodedLength = BACnetEncodeCharacterString(buffer + *length, maxLength - *length, value, valueLength);
+    *length += encodedLength;
+    return encodedLength > 0;
+}
+
+// Present values, encoded from the point store when a cached request asks for them, and the live
+// description of the service latency objects
+uint16_t EncodeVolatileProperty(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint8_t* buffer, uint16_t maxLength)
+{
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_DESCRIPTION) {
+        char value[256]; // ServiceMetricsFormat() writes at most 255 characters
+        uint32_t valueLength = 0;
+        if (objectType != BACNET_OBJECT_TYPE_ANALOG_VALUE || !GetPropertyCharString(objectType, objectInstance, propertyIdentifier, value, &valueLength, sizeof(value), false, 0)) {
+            return 0;
+        }
+        return BACnetEncodeCharacterString(buffer, maxLength, value, valueLength);
+    }
+    if (propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE) {
+        return 0;
+    }
+    uint16_t point = PointStoreFind(objectType, objectInstance);
+    if (point == POINT_INVALID) {
+        return 0;
+    }
+    switch (objectType) {
+        case BACNET_OBJECT_TYPE_ANALOG_VALUE:
+            return BACnetEncodeReal(buffer, maxLength, PointStoreGetReal(point));
+        case BACNET_OBJECT_TYPE_BINARY_VALUE:
+            return BACnetEncodeEnumerated(buffer, maxLength, PointStoreGetUnsigned(point));
+        case BACNET_OBJECT_TYPE_MULTI_STATE_VALUE:
+            return BACnetEncodeUnsigned(buffer, maxLength, PointStoreGetUnsigned(point));
+        default:
+            return 0;
+    }
+}
+#endif
+
+// Broadcasts the cached I-Am once its jitter delay has passed, and those of the virtual devices
+void SendDiscoveryReplies(unsigned long currentMillis)
+{
+#if APPLICATION_VIRTUAL_DEVICES > 0
+    uint32_t virtualDueMs;
+    if (VirtualDevicesPoll(&gVirtualDevices, (uint32_t)currentMillis, &virtualDueMs)) {
+        EventLoopWakeBy(&gEventLoop, virtualDueMs);
+    }
+#endif
+    const uint8_t* message;
+    uint16_t length;
+    if (!DiscoveryPoll(&gDiscovery, (uint32_t)currentMillis, &message, &length)) {
+        if (gDiscovery.replyPending) {
+            EventLoopWakeBy(&gEventLoop, gDiscovery.replyDueMs);
+        }
+        return;
+    }
+    uint8_t connectionString[6];
+    if (!TransportGetBroadcastConnectionString(connectionString) || TransportSend(message, length, connectionString, true) != length) {
+        LOG_ERROR("Failed to send IAm message");
+    }
+}
+
+// Hands the points changed during this scan to everything that reacts to changes. Runs once per
+// scan on the point store's writer task. Returns true if any point changed.
+bool ProcessChanges()
+{
+    PointChangeSet changes;
+    if (PointStoreTakeChanges(&changes) == 0) {
+        return false;
+    }
+    CovFlush(&changes);
+    OutputDriverApplyChanges(&changes);
+    return true;
+}
+
+#if APPLICATION_EVENT_DRIVEN_MODE
+// Event-driven mode
+// ---------------------------------------------------------------------------
+#ifdef ARDUINO
+// Lets the CPU scale its frequency and enter light sleep whenever every task is blocked. The WiFi
+// modem sleeps between beacons and wakes the CPU for incoming packets. Needs an ESP-IDF built with
+// CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE; without them the CPU only idles.
+void EnableLightSleep()
+{
+    WiFi.setSleep(true);
+    esp_pm_config_esp32_t config = {};
+    config.max_freq_mhz = APPLICATION_EVENT_MAX_CPU_FREQUENCY_MHZ;
+    config.min_freq_mhz = APPLICATION_EVENT_MIN_CPU_FREQUENCY_MHZ;
+    config.light_sleep_enable = true;
+    esp_err_t result = esp_pm_configure(&config);
+    if (result != ESP_OK) {
+        LOG_ERROR("Light sleep is not available (error %d), the CPU idles between scans instead", result);
+        return;
+    }
+    LOG_FYI("Light sleep enabled, %u to %u MHz", APPLICATION_EVENT_MIN_CPU_FREQUENCY_MHZ, APPLICATION_EVENT_MAX_CPU_FREQUENCY_MHZ);
+}
+#endif
 
-                // set the LED with the ledState of the variable:
-                digitalWrite(APPLICATION_LED_PIN, gLEDState);
+// Blocks until a datagram arrives or the next deadline registered during the scan. Does not wait if
+// work is already queued: a received packet not handed to the stack yet, or point changes whose COV
+// notifications the stack sends on its next run.
+void WaitForWork(bool changed)
+{
+    uint32_t timeoutMs = EventLoopTakeTimeoutMs(&gEventLoop, (uint32_t)millis());
+    if (changed || TransportPeekReceived() != NULL || timeoutMs == 0) {
+        EventLoopRecordBusy(&gEventLoop);
+        return;
+    }
+    uint32_t startUs = micros();
+    bool readable = false;
+    if (TransportIsOpen()) {
+        readable = TransportWaitReadable(timeoutMs);
+    } else {
+        // No socket until the link is up, the network is polled at the stack's timer interval
+        delay(timeoutMs);
+    }
+    EventLoopRecordWait(&gEventLoop, startUs, micros(), timeoutMs, readable);
+}
+#endif
+
+#if APPLICATION_THREADED_MODE
+// Threaded mode
+// ---------------------------------------------------------------------------
+// Network task: waits on the socket and drains every datagram into the receive ring, then wakes the
+// BACnet task. It is the only producer of the receive ring.
+void NetworkTask(void* parameters)
+{
+    (void)parameters;
+    for (;;) {
+        if (!TransportIsOpen()) {
+            // The BACnet task opens the port once the link is up
+            delay(APPLICATION_NETWORK_TASK_LINK_WAIT_MS);
+            continue;
+        }
+        if (!TransportWaitReadable(APPLICATION_NETWORK_TASK_WAIT_MS)) {
+            continue;
+        }
+        if (TransportReceivePending() > 0) {
+            NotifyTask(&gBACnetTask);
+        } else if (TransportReceiveRingFull()) {
+            // The socket stays readable while the ring is full, sleep until the BACnet task frees a
+            // slot. The ring is checked again after raising the flag so a slot freed in between is
+            // not missed; the timeout bounds the wait if it is anyway.
+            gNetworkTaskWaitingForSlot.store(true);
+            if (TransportReceiveRingFull()) {
+                WaitForTaskNotify(&gNetworkTask, APPLICATION_NETWORK_TASK_WAIT_MS);
             }
-            break;
+            gNetworkTaskWaitingForSlot.store(false);
+        }
+    }
+}
+
+// BACnet task: runs the CAS BACnet stack and is the only writer of the point store. It is the only
+// consumer of the receive ring. Replies are sent straight from this task; lwIP allows one task
+// to send on a socket while another receives on it.
+void BACnetTask(void* parameters)
+{
+    (void)parameters;
+    for (;;) {
+        fpLoop();
+        if (gNetworkTaskWaitingForSlot.exchange(false)) {
+            NotifyTask(&gNetworkTask); // fpLoop() consumed a packet, so the ring has room again
+        }
+        ReadLocalInput();
+        unsigned long currentMillis = millis();
+        ServiceNetwork(currentMillis);
+        UpdateMemoryTelemetry(currentMillis);
+        UpdateServiceMetricsObjects(currentMillis);
+        UpdateTrendLogs(currentMillis);
+        SendDiscoveryReplies(currentMillis);
+        ProcessChanges();
+        ReportStatus(currentMillis);
+
+        if (TransportPeekReceived() == NULL) {
+            // Nothing queued, sleep until the network task has a packet or the stack's timers need servicing.
+            WaitForTaskNotify(&gBACnetTask, APPLICATION_BACNET_TASK_IDLE_MS);
+        }
+    }
+}
+
+void NotifyTask(ApplicationTask* task)
+{
+#ifdef ARDUINO
+    xTaskNotifyGive(*task);
+#else
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notified = true;
     }
+    task->condition.notify_one();
+#endif
 }
 
+// Must be called from the task itself. Returns at once if the task was notified since the last wait.
+void WaitForTaskNotify(ApplicationTask* task, uint32_t timeoutMs)
+{
+#ifdef ARDUINO
+    (void)task;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+#else
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [task] { return task->notified; });
+    task->notified = false;
+#endif
+}
+
+bool StartTasks()
+{
+#ifdef ARDUINO
+    if (xTaskCreatePinnedToCore(BACnetTask, "bacnet", APPLICATION_TASK_STACK_SIZE, NULL, APPLICATION_BACNET_TASK_PRIORITY, &gBACnetTask, 1) != pdPASS) {
+        return false;
+    }
+    if (xTaskCreatePinnedToCore(NetworkTask, "network", APPLICATION_TASK_STACK_SIZE, NULL, APPLICATION_NETWORK_TASK_PRIORITY, &gNetworkTask, 0) != pdPASS) {
+        return false;
+    }
+#else
+    std::thread(BACnetTask, (void*)NULL).detach();
+    std::thread(NetworkTask, (void*)NULL).detach();
+#endif
+    return true;
+}
+#endif // APPLICATION_THREADED_MODE
+
 // Helper
 // ---------------------------------------------------------------------------
-bool GetBroadcastAddress(uint8_t* broadcastAddress, size_t maxbroadcastAddressSize)
+void UpdateBroadcastAddress()
 {
-    if (broadcastAddress == NULL || maxbroadcastAddressSize < 4) {
-        return false; // Not enugh space.
-    }
     IPAddress localIP = WiFi.localIP();
     IPAddress subnetMask = WiFi.subnetMask();
+    uint8_t localIPAddress[4] = { localIP[0], localIP[1], localIP[2], localIP[3] };
+    uint8_t subnetMaskAddress[4] = { subnetMask[0], subnetMask[1], subnetMask[2], subnetMask[3] };
+    TransportSetBroadcastAddress(localIPAddress, subnetMaskAddress);
+}
 
-    broadcastAddress[0] = localIP[0] | ~subnetMask[0];
-    broadcastAddress[1] = localIP[1] | ~subnetMask[1];
-    broadcastAddress[2] = localIP[2] | ~subnetMask[2];
-    broadcastAddress[3] = localIP[3] | ~subnetMask[3];
+#ifdef ARDUINO
+// Runs in the WiFi event task. The transport's broadcast address is atomic, so it can be set from here.
+void WiFiEventHandler(WiFiEvent_t event)
+{
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 2
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+#else
+    if (event == SYSTEM_EVENT_STA_GOT_IP) {
+#endif
+        UpdateBroadcastAddress();
+    }
+}
+#endif
+
+// Advances the WiFi bring-up. When the link comes up the broadcast address is refreshed, the UDP
+// port opened (once, it stays bound across reconnects) and the device announced.
+void ServiceNetwork(unsigned long currentMillis)
+{
+    switch (NetworkPoll(&gNetwork, (uint32_t)currentMillis)) {
+        case NETWORK_EVENT_LINK_UP: {
+            IPAddress localIP = WiFi.localIP();
+            LOG_FYI("Connected to %s in %u ms, IP address: %u.%u.%u.%u", APPLICATION_WIFI_SSID, gNetwork.statistics.lastConnectMs, localIP[0], localIP[1], localIP[2], localIP[3]);
+            if (gBringUp.linkUpMs == 0) {
+                gBringUp.linkUpMs = currentMillis;
+            }
+            UpdateBroadcastAddress();
+#ifdef ARDUINO
+            static bool clockStarted = false;
+            if (!clockStarted) {
+                configTime(0, 0, APPLICATION_NTP_SERVER); // UTC; SNTP keeps the clock set from here on
+                clockStarted = true;
+            }
+#endif
+
+            if (!TransportIsOpen()) {
+                if (!TransportBegin(APPLICATION_BACNET_UDP_PORT)) {
+                    LOG_ERROR("Could not open UDP port=[%u]", APPLICATION_BACNET_UDP_PORT);
+                    return;
+                }
+                LOG_FYI("Connected to UDP port=[%u]", APPLICATION_BACNET_UDP_PORT);
+            }
+            if (AnnounceDevice() && gBringUp.announcedMs == 0) {
+                gBringUp.announcedMs = millis();
+            }
+#if APPLICATION_VIRTUAL_DEVICES > 0
+            VirtualDevicesAnnounce(&gVirtualDevices);
+#endif
+            break;
+        }
+        case NETWORK_EVENT_LINK_DOWN:
+            LOG_ERROR("Lost the connection to %s, reconnecting", APPLICATION_WIFI_SSID);
+            break;
+        default:
+            break;
+    }
+}
+
+// Send a IAm Message to announse to the network that this BACnet device has started.
+// The send callback caches the encoded frame, later Who-Is are answered from the cache.
+bool AnnounceDevice()
+{
+    uint8_t connectionString[6];
+    if (!TransportGetBroadcastConnectionString(connectionString)) {
+        LOG_ERROR("Could not get the broadcast IP address");
+        return false;
+    }
+    if (!fpSendIAm(APPLICATION_BACNET_DEVICE_INSTANCE, connectionString, 6, BACNET_NETWORK_TYPE_IP, true, 65535, NULL, 0)) {
+        LOG_ERROR("Unable to send IAm for Device %u", APPLICATION_BACNET_DEVICE_INSTANCE);
+        return false;
+    }
+    LOG_FYI("Sent broadcast IAm message");
+    if (!DiscoveryHasIAm(&gDiscovery)) {
+        LOG_ERROR("Could not cache the IAm message, Who-Is will be answered by the stack");
+    }
     return true;
 }
 
+// Packs a 4 byte IP address into a uint32_t (big endian) for the binary log records
+uint32_t PackIPAddress(const uint8_t* ipAddress)
+{
+    return ((uint32_t)ipAddress[0] << 24) | ((uint32_t)ipAddress[1] << 16) | ((uint32_t)ipAddress[2] << 8) | (uint32_t)ipAddress[3];
+}
+
 // Callback used by the BACnet Stack to check if there is a message to process
 // ---------------------------------------------------------------------------
 
@@ -293,168 +1452,458 @@ uint16_t CallbackReceiveMessage(uint8_t* message, const uint16_t maxMessageLengt
 {
     // Check parameters
     if (message == NULL || maxMessageLength == 0) {
-        Serial.println("Error: Invalid input buffer");
+        LOG_ERROR("Invalid input buffer");
         return 0;
     }
     if (receivedConnectionString == NULL || maxConnectionStringLength == 0) {
-        Serial.println("Error: Invalid connection string buffer");
+        LOG_ERROR("Invalid connection string buffer");
         return 0;
     }
     if (maxConnectionStringLength < 6) {
-        Serial.println("Error: Not enough space for a UDP connection string");
+        LOG_ERROR("Not enough space for a UDP connection string");
         return 0;
     }
 
-    // processing incoming packet, must be called before reading the buffer
-    gUDP.parsePacket();
+    // Move every datagram waiting on the socket into the receive ring, then hand the oldest one to the stack.
+    // In threaded mode the network task fills the ring.
+#if !APPLICATION_THREADED_MODE
+    TransportReceivePending();
+#endif
+    const PacketSlot* packet;
+    BACnetFrame frame;
+    bool parsed;
+    for (;;) {
+        packet = TransportPeekReceived();
+        if (packet == NULL) {
+            return 0;
+        }
+        if (packet->length > maxMessageLength) {
+            // Per packet, so a record for the drain task rather than a blocking print
+            gReceivedTooLarge++;
+            LOG_EVENT(LOG_EVENT_RECEIVE_TOO_LARGE, packet->length, PackIPAddress(packet->address), packet->address[4] * 256 + packet->address[5], maxMessageLength, 0);
+            TransportReleaseReceived();
+            return 0;
+        }
 
-    int32_t bytesRead = gUDP.read(message, maxMessageLength);
-    if (bytesRead <= 0) {
-        return 0;
+        parsed = BACnetFrameParse(packet->data, packet->length, &frame);
+#if APPLICATION_VIRTUAL_DEVICES > 0
+        // Requests routed to the virtual network are answered for the virtual devices
+        if (parsed && frame.hasDestinationNetwork && frame.destinationNetwork == APPLICATION_VIRTUAL_NETWORK_NUMBER) {
+            ServiceMetricsRecordRequest(&frame, packet->address, packet->timestamp);
+        }
+        if (VirtualDevicesHandleMessage(&gVirtualDevices, packet->data, packet->length, packet->address, (uint32_t)millis())) {
+            TransportReleaseReceived();
+            continue;
+        }
+#endif
+        // Who-Is is answered here without waking the stack
+        if (parsed && DiscoveryHandleWhoIs(&gDiscovery, packet->data, &frame, packet->address, (uint32_t)millis())) {
+            TransportReleaseReceived();
+            continue;
+        }
+#if APPLICATION_RESPONSE_CACHE
+        // So are reads of cached properties
+        if (parsed) {
+            uint16_t responseLength = ResponseCacheHandleRequest(&gResponseCache, packet->data, &frame, gResponseCacheBuffer, sizeof(gResponseCacheBuffer));
+            if (responseLength > 0) {
+                ServiceMetricsRecordRequest(&frame, packet->address, packet->timestamp);
+                BACnetFrame responseFrame;
+                if (TransportSend(gResponseCacheBuffer, responseLength, packet->address, false) == responseLength && BACnetFrameParse(gResponseCacheBuffer, responseLength, &responseFrame)) {
+                    RecordUnicastResponse(&responseFrame, packet->address);
+                }
+                TransportReleaseReceived();
+                continue;
+            }
+            ResponseCacheObserveRequest(&gResponseCache, packet->data, &frame, packet->address);
+        }
+#endif
+        // And ReadRange of the trend logs
+        if (parsed) {
+            uint16_t responseLength = ReadRangeHandleRequest(&gReadRange, packet->data, &frame, gReadRangeBuffer, PACKET_MAX_LENGTH);
+            if (responseLength > 0) {
+                ServiceMetricsRecordRequest(&frame, packet->address, packet->timestamp);
+                BACnetFrame responseFrame;
+                if (TransportSend(gReadRangeBuffer, responseLength, packet->address, false) == responseLength && BACnetFrameParse(gReadRangeBuffer, responseLength, &responseFrame)) {
+                    RecordUnicastResponse(&responseFrame, packet->address);
+                }
+                TransportReleaseReceived();
+                continue;
+            }
+        }
+        break;
     }
 
     // We got a message.
-    IPAddress remoteIP = gUDP.remoteIP();
-    receivedConnectionString[0] = remoteIP[0];
-    receivedConnectionString[1] = remoteIP[1];
-    receivedConnectionString[2] = remoteIP[2];
-    receivedConnectionString[3] = remoteIP[3];
-
-    uint16_t remotePort = gUDP.remotePort();
-    receivedConnectionString[4] = remotePort / 256;
-    receivedConnectionString[5] = remotePort % 256;
-
-    *receivedConnectionStringLength = 6;
+    uint16_t bytesRead = packet->length;
+    memcpy(message, packet->data, bytesRead);
+    memcpy(receivedConnectionString, packet->address, PACKET_ADDRESS_LENGTH);
+    *receivedConnectionStringLength = PACKET_ADDRESS_LENGTH;
     *networkType = BACNET_NETWORK_TYPE_IP;
+    if (parsed) {
+        ServiceMetricsRecordRequest(&frame, receivedConnectionString, packet->timestamp);
+    }
+    TransportReleaseReceived();
 
-    Serial.printf("FYI: Recived message with %u bytes from %u.%u.%u.%u:%u\n", bytesRead, receivedConnectionString[0], receivedConnectionString[1], receivedConnectionString[2], receivedConnectionString[3], remotePort);
+    LOG_EVENT(LOG_EVENT_PACKET_RECEIVED, bytesRead, PackIPAddress(receivedConnectionString), receivedConnectionString[4] * 256 + receivedConnectionString[5], 0, 0);
     // Serial.printf("Message first 10 bytes: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X \n", message[0], message[1], message[2], message[3], message[4], message[5], message[6], message[7], message[8], message[9]);
     return bytesRead;
 }
 uint16_t CallbackSendMessage(const uint8_t* message, const uint16_t messageLength, const uint8_t* connectionString, const uint8_t connectionStringLength, const uint8_t networkType, bool broadcast)
 {
     if (message == NULL || messageLength == 0) {
-        Serial.println("FYI: Nothing to send");
+        LOG_FYI("Nothing to send");
         return 0;
     }
     if (connectionString == NULL || connectionStringLength == 0) {
-        Serial.println("FYI: No connection string");
+        LOG_FYI("No connection string");
+        return 0;
+    }
+    if (connectionStringLength < 6) {
+        LOG_ERROR("Connection string is too short for a UDP address");
         return 0;
     }
 
     // Verify Network Type
     if (networkType != BACNET_NETWORK_TYPE_IP) {
-        Serial.println("FYI: Message for different network");
+        LOG_FYI("Message for different network");
         return 0;
     }
 
-    // Prepare the IP Address
-    char destiationIPAddressAsString[32];
-    if (broadcast) {
-        uint8_t broadcastIPAddress[4];
-        if (!GetBroadcastAddress(broadcastIPAddress, 4)) {
-            Serial.println("Error: Could not get the broadcast iIP address");
-            return 0;
+    // Send. Broadcasts go to the cached broadcast address.
+    // A congested link fails every send, so failures are counted in sendErrors and logged as a
+    // record for the drain task rather than printed here
+    if (TransportSend(message, messageLength, connectionString, broadcast) != messageLength) {
+        LOG_EVENT(LOG_EVENT_SEND_FAILED, messageLength, PackIPAddress(connectionString), connectionString[4] * 256 + connectionString[5], broadcast, 0);
+        return 0;
+    }
+    BACnetFrame frame;
+    if (BACnetFrameParse(message, messageLength, &frame)) {
+        if (!broadcast) {
+            RecordUnicastResponse(&frame, connectionString);
+#if APPLICATION_RESPONSE_CACHE
+            ResponseCacheObserveResponse(&gResponseCache, message, &frame, connectionString, gResponseCacheBuffer, sizeof(gResponseCacheBuffer));
+#endif
+        } else if (!DiscoveryHasIAm(&gDiscovery)) {
+            DiscoveryCacheIAm(&gDiscovery, message, messageLength);
         }
-        snprintf(destiationIPAddressAsString, 32, "%u.%u.%u.%u", broadcastIPAddress[0], broadcastIPAddress[1], broadcastIPAddress[2], broadcastIPAddress[3]);
-    } else {
-        snprintf(destiationIPAddressAsString, 32, "%u.%u.%u.%u", connectionString[0], connectionString[1], connectionString[2], connectionString[3]);
     }
 
-    // Get the port
-    uint16_t udpPort = 0;
-    udpPort += connectionString[4] * 256;
-    udpPort += connectionString[5];
-
-    // Send
-    gUDP.beginPacket(destiationIPAddressAsString, udpPort);
-    gUDP.write(message, messageLength);
-    gUDP.endPacket();
-
-    Serial.printf("FYI: Sent message with %u bytes to %s:%u\n", messageLength, destiationIPAddressAsString, udpPort);
+#if LOG_LEVEL >= LOG_LEVEL_FYI
+    uint8_t destinationIPAddress[4];
+    if (!broadcast || !TransportGetBroadcastAddress(destinationIPAddress)) {
+        memcpy(destinationIPAddress, connectionString, 4);
+    }
+    LOG_EVENT(LOG_EVENT_PACKET_SENT, messageLength, PackIPAddress(destinationIPAddress), connectionString[4] * 256 + connectionString[5], broadcast, 0);
+#endif
     // Serial.printf("Message first 10 bytes: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X \n", message[0], message[1], message[2], message[3], message[4], message[5], message[6], message[7], message[8], message[9]);
     return messageLength;
 }
+// Records the response time of a reply sent by the stack or by the response cache
+void RecordUnicastResponse(const BACnetFrame* frame, const uint8_t* connectionString)
+{
+    ServiceMetricsRecordResponse(frame, connectionString);
+    if (gBringUp.firstReadPropertyMs == 0 && frame->apduType == APDU_TYPE_COMPLEX_ACK && frame->serviceChoice == BACNET_SERVICE_READ_PROPERTY) {
+        gBringUp.firstReadPropertyMs = millis();
+        LOG_FYI("Bring-up: first ReadProperty answered %lu ms after boot (objects ready %lu ms, link up %lu ms, IAm sent %lu ms)", gBringUp.firstReadPropertyMs, gBringUp.objectsReadyMs, gBringUp.linkUpMs, gBringUp.announcedMs);
+    }
+}
 time_t CallbackGetSystemTime()
 {
-    return millis() / 1000;
+    return time(NULL);
+}
+bool IsClockSet()
+{
+    return CallbackGetSystemTime() >= APPLICATION_CLOCK_SET_AFTER;
 }
 bool CallbackGetPropertyCharString(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, const uint32_t maxElementCount, uint8_t* encodingType, const bool useArrayIndex, const uint32_t propertyArrayIndex)
 {
-    Serial.printf("FYI: CallbackGetPropertyCharString deviceInstance=%d, objectType=%d, objectInstance=%d, propertyIdentifier=%d\n", deviceInstance, objectType, objectInstance, propertyIdentifier);
+    LOG_EVENT(LOG_EVENT_GET_PROPERTY_CHAR_STRING, objectType, deviceInstance, objectInstance, propertyIdentifier, 0);
 
-    if (deviceInstance != APPLICATION_BACNET_DEVICE_INSTANCE) {
+    const CallbackDeviceHandlers* handlers = FindCallbackDevice(deviceInstance);
+    if (handlers == NULL || handlers->getCharString == NULL) {
         return false;
     }
+    return handlers->getCharString(objectType, objectInstance, propertyIdentifier, value, valueElementCount, maxElementCount, encodingType, useArrayIndex, propertyArrayIndex);
+}
 
-    if (objectType == BACNET_OBJECT_TYPE_MULTI_STATE_VALUE && objectInstance == APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE) {
-        if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME && useArrayIndex == false) {
-            size_t objectNameStringLength = strlen(APPLICATION_BACNET_OBJECT_MSV_LED_OBJECT_NAME);
-            if (objectNameStringLength <= maxElementCount) {
-                memcpy(value, APPLICATION_BACNET_OBJECT_MSV_LED_OBJECT_NAME, objectNameStringLength);
-                *valueElementCount = objectNameStringLength;
-                return true;
-            }
-        } else if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_STATE_TEXT && useArrayIndex == true) {
-            if (propertyArrayIndex > LED_MODE_STATE_COUNT || propertyArrayIndex <= 0) {
-                return false; // Invalid range
-            }
+bool CallbackGetPropertyUInt(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    LOG_EVENT(LOG_EVENT_GET_PROPERTY_UINT, objectType, deviceInstance, objectInstance, propertyIdentifier, 0);
 
-            size_t objectNameStringLength = strlen(APPLICATION_BACNET_OBJECT_MSV_LED_STATE_TEXT[propertyArrayIndex - 1]);
-            if (objectNameStringLength <= maxElementCount) {
-                memcpy(value, APPLICATION_BACNET_OBJECT_MSV_LED_STATE_TEXT[propertyArrayIndex - 1], objectNameStringLength);
-                *valueElementCount = objectNameStringLength;
-                return true;
-            }
+    const CallbackDeviceHandlers* handlers = FindCallbackDevice(deviceInstance);
+    if (handlers == NULL || handlers->getUInt == NULL) {
+        return false;
+    }
+    return handlers->getUInt(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, propertyArrayIndex);
+}
+
+bool CallbackGetPropertyReal(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float* value, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    LOG_EVENT(LOG_EVENT_GET_PROPERTY_REAL, objectType, deviceInstance, objectInstance, propertyIdentifier, 0);
+
+    const CallbackDeviceHandlers* handlers = FindCallbackDevice(deviceInstance);
+    if (handlers == NULL || handlers->getReal == NULL) {
+        return false;
+    }
+    return handlers->getReal(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, propertyArrayIndex);
+}
+
+bool CallbackGetPropertyEnumerated(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    LOG_EVENT(LOG_EVENT_GET_PROPERTY_ENUMERATED, objectType, deviceInstance, objectInstance, propertyIdentifier, 0);
+
+    const CallbackDeviceHandlers* handlers = FindCallbackDevice(deviceInstance);
+    if (handlers == NULL || handlers->getEnumerated == NULL) {
+        return false;
+    }
+    return handlers->getEnumerated(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, propertyArrayIndex);
+}
+
+bool CallbackSetPropertyUInt(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const uint32_t value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode)
+{
+    LOG_EVENT(LOG_EVENT_SET_PROPERTY_UINT, objectType, deviceInstance, objectInstance, propertyIdentifier, value);
+
+    const CallbackDeviceHandlers* handlers = FindCallbackDevice(deviceInstance);
+    if (handlers == NULL || handlers->setUInt == NULL) {
+        return false;
+    }
+    return handlers->setUInt(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, propertyArrayIndex, priority, errorCode);
+}
+
+bool CallbackSetPropertyReal(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const float value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode)
+{
+    const CallbackDeviceHandlers* handlers = FindCallbackDevice(deviceInstance);
+    if (handlers == NULL || handlers->setReal == NULL) {
+        return false;
+    }
+    return handlers->setReal(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, propertyArrayIndex, priority, errorCode);
+}
+
+bool CallbackSetPropertyEnumerated(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const uint32_t value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode)
+{
+    const CallbackDeviceHandlers* handlers = FindCallbackDevice(deviceInstance);
+    if (handlers == NULL || handlers->setEnumerated == NULL) {
+        return false;
+    }
+    return handlers->setEnumerated(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, propertyArrayIndex, priority, errorCode);
+}
+
+// Callback routing
+// ---------------------------------------------------------------------------
+uint32_t CallbackDeviceHash(uint32_t deviceInstance)
+{
+    return (deviceInstance * 2654435761u) >> 7;
+}
+
+bool RegisterCallbackDevice(uint32_t deviceInstance, const CallbackDeviceHandlers* handlers)
+{
+    if (gCallbackDeviceCount == 0) {
+        memset(gCallbackDeviceIndex, APPLICATION_CALLBACK_DEVICE_NONE, sizeof(gCallbackDeviceIndex));
+    }
+    if (gCallbackDeviceCount >= APPLICATION_CALLBACK_DEVICE_CAPACITY) {
+        return false;
+    }
+    uint32_t slot = CallbackDeviceHash(deviceInstance) & (APPLICATION_CALLBACK_DEVICE_INDEX_SIZE - 1);
+    while (gCallbackDeviceIndex[slot] != APPLICATION_CALLBACK_DEVICE_NONE) {
+        if (gCallbackDevices[gCallbackDeviceIndex[slot]].deviceInstance == deviceInstance) {
+            return false;
         }
-    } else if (objectType == BACNET_OBJECT_TYPE_DEVICE && objectInstance == APPLICATION_BACNET_DEVICE_INSTANCE && propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME && useArrayIndex == false) {
-        size_t objectNameStringLength = strlen(APPLICATION_BACNET_OBJECT_DEVICE_OBJECT_NAME);
-        if (objectNameStringLength <= maxElementCount) {
-            memcpy(value, APPLICATION_BACNET_OBJECT_DEVICE_OBJECT_NAME, objectNameStringLength);
-            *valueElementCount = objectNameStringLength;
-            return true;
+        slot = (slot + 1) & (APPLICATION_CALLBACK_DEVICE_INDEX_SIZE - 1);
+    }
+    gCallbackDevices[gCallbackDeviceCount].deviceInstance = deviceInstance;
+    gCallbackDevices[gCallbackDeviceCount].handlers = handlers;
+    gCallbackDeviceIndex[slot] = gCallbackDeviceCount;
+    gCallbackDeviceCount++;
+    return true;
+}
+
+const CallbackDeviceHandlers* FindCallbackDevice(uint32_t deviceInstance)
+{
+    if (gCallbackDeviceCount == 0) {
+        return NULL;
+    }
+    uint32_t slot = CallbackDeviceHash(deviceInstance) & (APPLICATION_CALLBACK_DEVICE_INDEX_SIZE - 1);
+    while (gCallbackDeviceIndex[slot] != APPLICATION_CALLBACK_DEVICE_NONE) {
+        const CallbackDevice* device = &gCallbackDevices[gCallbackDeviceIndex[slot]];
+        if (device->deviceInstance == deviceInstance) {
+            return device->handlers;
         }
+        slot = (slot + 1) & (APPLICATION_CALLBACK_DEVICE_INDEX_SIZE - 1);
     }
+    return NULL;
+}
 
-    return false;
+// Local device handlers
+// ---------------------------------------------------------------------------
+// The callbacks of APPLICATION_BACNET_DEVICE_INSTANCE, registered in setup()
+bool LocalGetPropertyCharString(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, uint32_t maxElementCount, uint8_t* encodingType, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    (void)encodingType;
+    return GetPropertyCharString(objectType, objectInstance, propertyIdentifier, value, valueElementCount, maxElementCount, useArrayIndex, propertyArrayIndex);
 }
 
-bool CallbackGetPropertyUInt(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex)
+// Present values of the Analog Values, served from the point store
+bool LocalGetPropertyReal(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float* value, bool useArrayIndex, uint32_t propertyArrayIndex)
 {
-    Serial.printf("FYI: CallbackGetPropertyUInt deviceInstance=%d, objectType=%d, objectInstance=%d, propertyIdentifier=%d\n", deviceInstance, objectType, objectInstance, propertyIdentifier);
+    (void)propertyArrayIndex;
+    if (objectType != BACNET_OBJECT_TYPE_ANALOG_VALUE || propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE || useArrayIndex) {
+        return false;
+    }
+    uint16_t point = PointStoreFind(objectType, objectInstance);
+    if (point == POINT_INVALID) {
+        return false;
+    }
+    *value = PointStoreGetReal(point);
+    return true;
+}
 
-    if (deviceInstance == APPLICATION_BACNET_DEVICE_INSTANCE && objectType == BACNET_OBJECT_TYPE_MULTI_STATE_VALUE && objectInstance == APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE) {
-        if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE && useArrayIndex == false) {
-            *value = gLEDMode;
-            return true;
-        } else if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES && useArrayIndex == false) {
-            *value = LED_MODE_STATE_COUNT;
-            return true;
-        } else if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_STATE_TEXT && useArrayIndex == true && propertyArrayIndex == 0) {
-            *value = LED_MODE_STATE_COUNT;
-            return true;
-        }
+// Present values of the Binary Values, served from the point store
+bool LocalGetPropertyEnumerated(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    (void)propertyArrayIndex;
+    if (objectType != BACNET_OBJECT_TYPE_BINARY_VALUE || propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE || useArrayIndex) {
+        return false;
+    }
+    uint16_t point = PointStoreFind(objectType, objectInstance);
+    if (point == POINT_INVALID) {
+        return false;
     }
+    *value = PointStoreGetUnsigned(point);
+    return true;
+}
 
-    return false;
+bool LocalSetPropertyUInt(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode)
+{
+    const PropertyEntry* entry = PropertyRegistryFind(&gPropertyRegistry, objectType, objectInstance, propertyIdentifier);
+    if (entry != NULL) {
+        return PropertyRegistrySetUInt(entry, value, useArrayIndex, propertyArrayIndex, priority, errorCode);
+    }
+    return SetPointListValue(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, errorCode);
 }
-bool CallbackSetPropertyUInt(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const uint32_t value, const bool useArrayIndex, const uint32_t propertyArrayIndex, const uint8_t priority, unsigned int* errorCode)
+
+bool LocalSetPropertyReal(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, float value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode)
 {
-    Serial.printf("FYI: CallbackSetPropertyUInt deviceInstance=%d, objectType=%d, objectInstance=%d, propertyIdentifier=%d, value=%d\n", deviceInstance, objectType, objectInstance, propertyIdentifier, value);
+    (void)propertyArrayIndex;
+    (void)priority;
+    uint32_t rawValue;
+    memcpy(&rawValue, &value, sizeof(rawValue));
+    return SetPointListValue(objectType, objectInstance, propertyIdentifier, rawValue, useArrayIndex, errorCode);
+}
 
-    if (deviceInstance == APPLICATION_BACNET_DEVICE_INSTANCE && objectType == BACNET_OBJECT_TYPE_MULTI_STATE_VALUE && objectInstance == APPLICATION_BACNET_OBJECT_MSV_LED_INSTANCE && propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE && useArrayIndex == false) {
-        switch (value) {
-            case LED_MODE_OFF:
-            case LED_MODE_ON:
-            case LED_MODE_BLINK:
-                gLEDMode = value;
+bool LocalSetPropertyEnumerated(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t value, bool useArrayIndex, uint32_t propertyArrayIndex, uint8_t priority, unsigned int* errorCode)
+{
+    (void)propertyArrayIndex;
+    (void)priority;
+    return SetPointListValue(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, errorCode);
+}
+
+// Property getters and setters
+// ---------------------------------------------------------------------------
+// Character string properties, shared by the stack's callback and the response cache
+bool GetPropertyCharString(const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, const uint32_t maxElementCount, const bool useArrayIndex, const uint32_t propertyArrayIndex)
+{
+    // The description of the service latency objects is the live histogram
+    if (objectType == BACNET_OBJECT_TYPE_ANALOG_VALUE && propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_DESCRIPTION && !useArrayIndex && objectInstance >= APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE && objectInstance < APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE + APPLICATION_SERVICE_METRICS_SERVICE_COUNT) {
+        const ServiceMetrics* metrics = ServiceMetricsGet((uint8_t)APPLICATION_SERVICE_METRICS_SERVICES[objectInstance - APPLICATION_BACNET_OBJECT_AV_SERVICE_LATENCY_FIRST_INSTANCE]);
+        *valueElementCount = ServiceMetricsFormat(metrics, value, maxElementCount);
+        return true;
+    }
+
+    const PropertyEntry* entry = PropertyRegistryFind(&gPropertyRegistry, objectType, objectInstance, propertyIdentifier);
+    if (entry != NULL) {
+        return PropertyRegistryGetCharString(entry, value, valueElementCount, maxElementCount, useArrayIndex, propertyArrayIndex);
+    }
+
+    // Point list objects
+    const PointGroup* group = PointListFind(APPLICATION_POINT_LIST, APPLICATION_POINT_LIST_GROUP_COUNT, objectType, objectInstance);
+    if (group == NULL) {
+        return false;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME && !useArrayIndex) {
+        *valueElementCount = PointListFormatName(group, objectInstance, value, maxElementCount);
+        return true;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_STATE_TEXT && group->stateText != NULL) {
+        PropertyEntry stateText = PropertyCharStringArray(objectType, objectInstance, propertyIdentifier, group->stateText, group->stateCount);
+        return PropertyRegistryGetCharString(&stateText, value, valueElementCount, maxElementCount, useArrayIndex, propertyArrayIndex);
+    }
+    return false;
+}
+
+// Unsigned properties, shared by the stack's callback and the response cache
+bool GetPropertyUInt(const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, uint32_t* value, const bool useArrayIndex, const uint32_t propertyArrayIndex)
+{
+    // The record counts of the trend logs are live
+    if (objectType == BACNET_OBJECT_TYPE_TREND_LOG && !useArrayIndex && (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_RECORD_COUNT || propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_TOTAL_RECORD_COUNT)) {
+        for (uint32_t offset = 0; offset < APPLICATION_TREND_LOG_COUNT; offset++) {
+            if (APPLICATION_TREND_LOGS[offset].objectInstance == objectInstance) {
+                const TrendLogStatistics& statistics = gTrendLogs[offset].statistics;
+                *value = propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_RECORD_COUNT ? statistics.recordCount : statistics.totalRecords;
                 return true;
-            default:
-                // Out of range
-                *errorCode = BACNET_ERROR_CODE_VALUE_OUT_OF_RANGE;
-                return false;
+            }
         }
+        return false;
+    }
+
+    const PropertyEntry* entry = PropertyRegistryFind(&gPropertyRegistry, objectType, objectInstance, propertyIdentifier);
+    if (entry != NULL) {
+        return PropertyRegistryGetUInt(entry, value, useArrayIndex, propertyArrayIndex);
     }
 
+    // Point list objects with states
+    const PointGroup* group = PointListFind(APPLICATION_POINT_LIST, APPLICATION_POINT_LIST_GROUP_COUNT, objectType, objectInstance);
+    if (group == NULL || group->stateText == NULL) {
+        return false;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_STATE_TEXT && useArrayIndex && propertyArrayIndex == 0) {
+        *value = group->stateCount; // Size of the array
+        return true;
+    }
+    if (useArrayIndex) {
+        return false;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES) {
+        *value = group->stateCount;
+        return true;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE) {
+        *value = PointStoreGetUnsigned(PointStoreFind(objectType, objectInstance));
+        return true;
+    }
     return false;
-}
\ No newline at end of file
+}
+
+// Writes the present value of a point list object. value is the raw point store value: the bits of
+// the float for REAL objects, the state for Multi-state objects and 0 or 1 for Binary objects.
+bool SetPointListValue(const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, const uint32_t value, const bool useArrayIndex, unsigned int* errorCode)
+{
+    if (propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE || useArrayIndex) {
+        return false;
+    }
+    const PointGroup* group = PointListFind(APPLICATION_POINT_LIST, APPLICATION_POINT_LIST_GROUP_COUNT, objectType, objectInstance);
+    if (group == NULL) {
+        return false;
+    }
+    if (!(group->flags & POINT_FLAG_WRITABLE)) {
+        *errorCode = BACNET_ERROR_CODE_WRITE_ACCESS_DENIED;
+        return false;
+    }
+    if (!group->real) {
+        uint32_t maximum = group->stateText != NULL ? group->stateCount : 1;
+        uint32_t minimum = group->stateText != NULL ? 1 : 0;
+        if (value < minimum || value > maximum) {
+            *errorCode = BACNET_ERROR_CODE_VALUE_OUT_OF_RANGE;
+            return false;
+        }
+    }
+    PointStoreWrite(PointStoreFind(objectType, objectInstance), value);
+    return true;
+}
+
+// Writes a new LED mode to the point store. The value must already be validated. Must be called
+// from the point store's writer task.
+bool WriteLEDMode(const uint32_t value)
+{
+    PointStoreWrite(gLEDModePoint, value);
+    return true;
+}
@@ -0,0 +1,45 @@
+/**
+ * Benchmark helpers
+ * --------------------------------------
+ * The timer and the run loop shared by the host benchmarks in tools/. Each benchmark includes this
+ * header as "../Benchmark.h"; there is nothing to build or link.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <stdint.h>
+#include <time.h>
+
+const uint32_t BENCHMARK_MAX_RUNS = 99; // Largest --runs a benchmark accepts
+
+// Monotonic time in ns
+inline double BenchmarkNowNs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+// Calls measureOnce() once untimed to warm the caches, then runs times, and returns the median of
+// the timed runs. measureOnce() returns the time of one run in ns, or 0 if the run failed; a failed
+// run, or runs outside 1 to BENCHMARK_MAX_RUNS, makes the result 0.
+template <typename MeasureOnceFunction>
+double BenchmarkMedian(uint32_t runs, MeasureOnceFunction measureOnce)
+{
+    if (runs == 0 || runs > BENCHMARK_MAX_RUNS || measureOnce() == 0) {
+        return 0;
+    }
+    double runNs[BENCHMARK_MAX_RUNS];
+    for (uint32_t run = 0; run < runs; run++) {
+        runNs[run] = measureOnce();
+        if (runNs[run] == 0) {
+            return 0;
+        }
+    }
+    std::sort(runNs, runNs + runs);
+    return runNs[runs / 2];
+}
+
+#endif // BENCHMARK_H
@@ -0,0 +1,712 @@
+/**
+ * Response cache benchmark
+ * --------------------------------------
+ * Measures the CPU time to answer ReadProperty and ReadPropertyMultiple requests for Multi-state
+ * Value objects from the response cache (src/ResponseCache.cpp), against a model of the path the
+ * same requests take through the CAS BACnet stack.
+ *
+ * The stack is only available as a library, so the model does the work any answer from it has to
+ * do and nothing more: the receive callback's copy of the datagram, decoding the request into a
+ * list of object and property references, finding each object and checking that each property is
+ * supported (ALL and REQUIRED are expanded from the object type's property table), asking the
+ * application for each value through a callback, encoding the values, and copying the answer
+ * behind its BVLC and NPDU header. The callbacks go through the same getters as src/main.cpp: the
+ * property registry, the point list and the point store. The stack also allocates, keeps its
+ * objects in generic containers and dispatches through more layers, so its cost on the device is
+ * higher than the model's and the speedups printed here are the least to expect.
+ *
+ * The cache is filled the way main.cpp fills it and learns ALL and REQUIRED from the model's
+ * answers. Every answer from the cache is checked against the model's, byte for byte, before it
+ * is timed. Both paths include parsing the frame.
+ *
+ * Each measurement is run once untimed to warm the caches, then --runs times; the median is printed.
+ *
+ * Build:  pio run -e cachebench
+ * Usage:  .pio/build/cachebench/program [options]
+ *   --objects <n>       Spread the requests over this many objects (default 8)
+ *   --iterations <n>    Requests per measurement (default 200000)
+ *   --runs <n>          Timed runs per measurement (default 5)
+ *   --min-speedup <x>   Exit with an error if a ReadPropertyMultiple is not at least x times
+ *                       faster from the cache
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BACnetFrame.h"
+#include "PointList.h"
+#include "PointStore.h"
+#include "PropertyRegistry.h"
+#include "ResponseCache.h"
+
+#include "../Benchmark.h"
+
+const uint32_t DEVICE_INSTANCE = 389001;
+const uint32_t FIRST_INSTANCE = 1001;
+const uint8_t MAX_APDU_1476 = 0x05;
+const uint16_t RESPONSE_MAX_LENGTH = 1500; // One Ethernet frame
+const uint16_t RESPONSE_HEADER_LENGTH = 6; // BVLC + NPDU of a local unicast response
+const uint8_t CLIENT_ADDRESS[RESPONSE_CACHE_ADDRESS_LENGTH] = { 127, 0, 0, 1, 0xBA, 0xC0 };
+const uint32_t MAX_OBJECTS = 14; // What the default cache holds with the property lists learned
+
+struct BenchmarkSettings {
+    uint32_t objects;
+    uint32_t iterations;
+    uint32_t runs;
+    float minSpeedup;
+};
+
+struct BenchmarkRequest {
+    const char* name;
+    uint8_t service;
+    const uint32_t* properties;
+    uint8_t propertyCount;
+};
+const uint32_t REQUEST_PRESENT_VALUE[] = { BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE };
+const uint32_t REQUEST_POLL[] = { BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT }; // loadgen --service rpm
+const uint32_t REQUEST_FULL_OBJECT[] = { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT };
+const uint32_t REQUEST_ALL[] = { BACNET_PROPERTY_IDENTIFIER_ALL }; // loadgen --service rpm-all
+const uint32_t REQUEST_REQUIRED[] = { BACNET_PROPERTY_IDENTIFIER_REQUIRED };
+const BenchmarkRequest BENCHMARK_REQUESTS[] = {
+    { "ReadProperty Present_Value", BACNET_SERVICE_READ_PROPERTY, REQUEST_PRESENT_VALUE, 1 },
+    { "ReadProperty Object_Name", BACNET_SERVICE_READ_PROPERTY, REQUEST_POLL + 1, 1 },
+    { "RPM poll (loadgen rpm)", BACNET_SERVICE_READ_PROPERTY_MULTIPLE, REQUEST_POLL, 4 },
+    { "RPM full object", BACNET_SERVICE_READ_PROPERTY_MULTIPLE, REQUEST_FULL_OBJECT, 6 },
+    { "RPM ALL (loadgen rpm-all)", BACNET_SERVICE_READ_PROPERTY_MULTIPLE, REQUEST_ALL, 1 },
+    { "RPM REQUIRED", BACNET_SERVICE_READ_PROPERTY_MULTIPLE, REQUEST_REQUIRED, 1 },
+};
+const uint32_t BENCHMARK_REQUEST_COUNT = sizeof(BENCHMARK_REQUESTS) / sizeof(BENCHMARK_REQUESTS[0]);
+
+// Application
+// ---------------------------------------------------------------------------
+// The benchmark objects are one point list group, looked up behind a property registry of the
+// device's own properties as in main.cpp.
+constexpr PropertyString STATE_TEXT[] = { MakePropertyString("Off"), MakePropertyString("On"), MakePropertyString("Auto") };
+constexpr PropertyEntry PROPERTY_TABLE[] = {
+    PropertyCharString(BACNET_OBJECT_TYPE_DEVICE, DEVICE_INSTANCE, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString("ESP32 BACnet Example Server")),
+    PropertyCharString(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, 1, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, MakePropertyString("LED State")),
+    PropertyCharStringArray(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, 1, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, STATE_TEXT, PropertyArrayCount(STATE_TEXT)),
+    PropertyUIntConstant(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, 1, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES, PropertyArrayCount(STATE_TEXT)),
+};
+const uint16_t PROPERTY_TABLE_COUNT = PropertyArrayCount(PROPERTY_TABLE);
+uint16_t gPropertyRegistryIndex[PropertyRegistryIndexSize(PROPERTY_TABLE_COUNT)];
+PropertyRegistry gPropertyRegistry;
+PointGroup gPointList[1];
+
+static bool GetPropertyCharString(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, uint32_t maxElementCount, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    const PropertyEntry* entry = PropertyRegistryFind(&gPropertyRegistry, objectType, objectInstance, propertyIdentifier);
+    if (entry != NULL) {
+        return PropertyRegistryGetCharString(entry, value, valueElementCount, maxElementCount, useArrayIndex, propertyArrayIndex);
+    }
+    const PointGroup* group = PointListFind(gPointList, 1, objectType, objectInstance);
+    if (group == NULL) {
+        return false;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME && !useArrayIndex) {
+        *valueElementCount = PointListFormatName(group, objectInstance, value, maxElementCount);
+        return true;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_STATE_TEXT && group->stateText != NULL) {
+        PropertyEntry stateText = PropertyCharStringArray(objectType, objectInstance, propertyIdentifier, group->stateText, group->stateCount);
+        return PropertyRegistryGetCharString(&stateText, value, valueElementCount, maxElementCount, useArrayIndex, propertyArrayIndex);
+    }
+    return false;
+}
+
+static bool GetPropertyUInt(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    const PropertyEntry* entry = PropertyRegistryFind(&gPropertyRegistry, objectType, objectInstance, propertyIdentifier);
+    if (entry != NULL) {
+        return PropertyRegistryGetUInt(entry, value, useArrayIndex, propertyArrayIndex);
+    }
+    const PointGroup* group = PointListFind(gPointList, 1, objectType, objectInstance);
+    if (group == NULL || group->stateText == NULL) {
+        return false;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_STATE_TEXT && useArrayIndex && propertyArrayIndex == 0) {
+        *value = group->stateCount;
+        return true;
+    }
+    if (useArrayIndex) {
+        return false;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES) {
+        *value = group->stateCount;
+        return true;
+    }
+    if (propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE) {
+        *value = PointStoreGetUnsigned(PointStoreFind(objectType, objectInstance));
+        return true;
+    }
+    return false;
+}
+
+// The stack's callbacks, with its signatures
+static bool CallbackGetPropertyCharString(const uint32_t deviceInstance, const uint16_t objectType, const uint32_t objectInstance, const uint32_t propertyIdentifier, char* value, uint32_t* valueElementCount, const uint32_t maxElementCount, uint8_t* encodingType, const bool useArrayIndex, const uint32_t propertyArrayIndex)
+{
+    if (deviceInstance != DEVICE_INSTANCE) {
+        return false;
+    }
+    *encodingType = 0; // UTF-8
+    return GetPropertyCharString(objectType, objectInstance, propertyIdentifier, value, valueElementCount, maxElementCount, useArrayIndex, propertyArrayIndex);
+}
+
+static bool CallbackGetPropertyUInt(uint32_t deviceInstance, uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint32_t* value, bool useArrayIndex, uint32_t propertyArrayIndex)
+{
+    if (deviceInstance != DEVICE_INSTANCE) {
+        return false;
+    }
+    return GetPropertyUInt(objectType, objectInstance, propertyIdentifier, value, useArrayIndex, propertyArrayIndex);
+}
+
+// The response cache's volatile values, as EncodeVolatileProperty() in main.cpp
+static uint16_t EncodeVolatileProperty(uint16_t objectType, uint32_t objectInstance, uint32_t propertyIdentifier, uint8_t* buffer, uint16_t maxLength)
+{
+    if (propertyIdentifier != BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE) {
+        return 0;
+    }
+    uint16_t point = PointStoreFind(objectType, objectInstance);
+    if (point == POINT_INVALID) {
+        return 0;
+    }
+    return BACnetEncodeUnsigned(buffer, maxLength, PointStoreGetUnsigned(point));
+}
+
+// Stack model
+// ---------------------------------------------------------------------------
+const uint8_t STACK_MODEL_MAX_SPECIFICATIONS = 8;
+const uint8_t STACK_MODEL_MAX_REFERENCES = 16;
+
+struct StackModelProperty {
+    uint32_t propertyIdentifier;
+    bool required;
+};
+// Returned for ALL in this order, Property_List left out
+const StackModelProperty STACK_MODEL_MULTI_STATE_PROPERTIES[] = {
+    { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, true },
+    { BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, true },
+    { BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, true },
+    { BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE, true },
+    { BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS, true },
+    { BACNET_PROPERTY_IDENTIFIER_EVENT_STATE, true },
+    { BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE, true },
+    { BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES, true },
+    { BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, false },
+};
+const uint8_t STACK_MODEL_MULTI_STATE_PROPERTY_COUNT = sizeof(STACK_MODEL_MULTI_STATE_PROPERTIES) / sizeof(STACK_MODEL_MULTI_STATE_PROPERTIES[0]);
+
+// What the stack keeps for each object itself
+struct StackModelObject {
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint8_t statusFlags;
+    uint32_t eventState;
+    bool outOfService;
+};
+
+struct StackModelReference {
+    uint32_t propertyIdentifier;
+    uint32_t arrayIndex;
+};
+
+struct StackModelSpecification {
+    uint16_t objectType;
+    uint32_t objectInstance;
+    StackModelReference references[STACK_MODEL_MAX_REFERENCES];
+    uint8_t referenceCount;
+};
+
+StackModelObject gStackModelObjects[MAX_OBJECTS]; // Sorted by type and instance
+uint32_t gStackModelObjectCount = 0;
+uint8_t gStackModelReceived[RESPONSE_MAX_LENGTH];
+
+static bool StackModelObjectLess(const StackModelObject& object, const StackModelSpecification& specification)
+{
+    return object.objectType != specification.objectType ? object.objectType < specification.objectType : object.objectInstance < specification.objectInstance;
+}
+
+static const StackModelObject* StackModelFindObject(const StackModelSpecification& specification)
+{
+    const StackModelObject* end = gStackModelObjects + gStackModelObjectCount;
+    const StackModelObject* object = std::lower_bound((const StackModelObject*)gStackModelObjects, end, specification, StackModelObjectLess);
+    if (object == end || object->objectType != specification.objectType || object->objectInstance != specification.objectInstance) {
+        return NULL;
+    }
+    return object;
+}
+
+static bool StackModelSupports(uint32_t propertyIdentifier)
+{
+    for (uint8_t property = 0; property < STACK_MODEL_MULTI_STATE_PROPERTY_COUNT; property++) {
+        if (STACK_MODEL_MULTI_STATE_PROPERTIES[property].propertyIdentifier == propertyIdentifier) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t StackModelEncodeString(const StackModelObject* object, uint32_t propertyIdentifier, bool useArrayIndex, uint32_t arrayIndex, uint8_t* buffer, uint16_t maxLength)
+{
+    char value[256];
+    uint32_t valueLength = 0;
+    uint8_t encodingType;
+    if (!CallbackGetPropertyCharString(DEVICE_INSTANCE, object->objectType, object->objectInstance, propertyIdentifier, value, &valueLength, sizeof(value), &encodingType, useArrayIndex, arrayIndex)) {
+        return 0;
+    }
+    return BACnetEncodeCharacterString(buffer, maxLength, value, valueLength);
+}
+
+// One value, from the object or through the callbacks. Returns its length, 0 if it is not known.
+static uint16_t StackModelEncodeValue(const StackModelObject* object, uint32_t propertyIdentifier, uint32_t arrayIndex, uint8_t* buffer, uint16_t maxLength)
+{
+    uint32_t value;
+    switch (propertyIdentifier) {
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER:
+            return BACnetEncodeObjectIdentifier(buffer, maxLength, object->objectType, object->objectInstance);
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE:
+            return BACnetEncodeEnumerated(buffer, maxLength, object->objectType);
+        case BACNET_PROPERTY_IDENTIFIER_STATUS_FLAGS:
+        {
+            uint8_t setBits[4];
+            uint8_t setBitCount = 0;
+            for (uint8_t bit = 0; bit < 4; bit++) {
+                if (object->statusFlags & (0x08 >> bit)) {
+                    setBits[setBitCount++] = bit;
+                }
+            }
+            return BACnetEncodeBitString(buffer, maxLength, 4, setBits, setBitCount);
+        }
+        case BACNET_PROPERTY_IDENTIFIER_EVENT_STATE:
+            return BACnetEncodeEnumerated(buffer, maxLength, object->eventState);
+        case BACNET_PROPERTY_IDENTIFIER_OUT_OF_SERVICE:
+            return BACnetEncodeBoolean(buffer, maxLength, object->outOfService);
+        case BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME:
+            return StackModelEncodeString(object, propertyIdentifier, false, 0, buffer, maxLength);
+        case BACNET_PROPERTY_IDENTIFIER_STATE_TEXT: {
+            if (arrayIndex == 0) {
+                return CallbackGetPropertyUInt(DEVICE_INSTANCE, object->objectType, object->objectInstance, propertyIdentifier, &value, true, 0) ? BACnetEncodeUnsigned(buffer, maxLength, value) : 0;
+            }
+            if (arrayIndex != RESPONSE_CACHE_NO_INDEX) {
+                return StackModelEncodeString(object, propertyIdentifier, true, arrayIndex, buffer, maxLength);
+            }
+            // The whole array: its size, then each element
+            if (!CallbackGetPropertyUInt(DEVICE_INSTANCE, object->objectType, object->objectInstance, propertyIdentifier, &value, true, 0)) {
+                return 0;
+            }
+            uint16_t length = 0;
+            for (uint32_t element = 1; element <= value; element++) {
+                uint16_t elementLength = StackModelEncodeString(object, propertyIdentifier, true, element, buffer + length, maxLength - length);
+                if (elementLength == 0) {
+                    return 0;
+                }
+                length += elementLength;
+            }
+            return length;
+        }
+        default:
+            if (arrayIndex != RESPONSE_CACHE_NO_INDEX || !CallbackGetPropertyUInt(DEVICE_INSTANCE, object->objectType, object->objectInstance, propertyIdentifier, &value, false, 0)) {
+                return 0;
+            }
+            return BACnetEncodeUnsigned(buffer, maxLength, value);
+    }
+}
+
+static bool StackModelPutTag(uint8_t* buffer, uint16_t* offset, uint16_t maxLength, uint8_t tagNumber, uint8_t tagType)
+{
+    if (*offset >= maxLength) {
+        return false;
+    }
+    buffer[(*offset)++] = (uint8_t)(tagNumber << 4 | tagType);
+    return true;
+}
+
+// property [propertyTag], optional array index, value between opening and closing valueTag
+static bool StackModelEncodeResult(const StackModelObject* object, uint32_t propertyIdentifier, uint32_t arrayIndex, uint8_t propertyTag, uint8_t valueTag, uint8_t* buffer, uint16_t* offset, uint16_t maxLength)
+{
+    uint16_t length = BACnetEncodeContextUnsigned(buffer + *offset, maxLength - *offset, propertyTag, propertyIdentifier);
+    *offset += length;
+    if (length == 0) {
+        return false;
+    }
+    if (arrayIndex != RESPONSE_CACHE_NO_INDEX) {
+        length = BACnetEncodeContextUnsigned(buffer + *offset, maxLength - *offset, propertyTag + 1, arrayIndex);
+        *offset += length;
+        if (length == 0) {
+            return false;
+        }
+    }
+    if (!StackModelPutTag(buffer, offset, maxLength, valueTag, BACNET_TAG_OPENING)) {
+        return false;
+    }
+    length = StackModelEncodeValue(object, propertyIdentifier, arrayIndex, buffer + *offset, maxLength - *offset);
+    *offset += length;
+    return length > 0 && StackModelPutTag(buffer, offset, maxLength, valueTag, BACNET_TAG_CLOSING);
+}
+
+// Decodes a ReadProperty or ReadPropertyMultiple request. Returns the number of specifications.
+static uint8_t StackModelDecode(const uint8_t* apdu, uint16_t apduLength, uint8_t service, StackModelSpecification* specifications)
+{
+    uint16_t offset = 4;
+    if (service == BACNET_SERVICE_READ_PROPERTY) {
+        StackModelSpecification* specification = &specifications[0];
+        StackModelReference* reference = &specification->references[0];
+        reference->arrayIndex = RESPONSE_CACHE_NO_INDEX;
+        if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, &offset, 0, &specification->objectType, &specification->objectInstance) || !BACnetDecodeContextUnsigned(apdu, apduLength, &offset, 1, &reference->propertyIdentifier)) {
+            return 0;
+        }
+        if (offset < apduLength && !BACnetDecodeContextUnsigned(apdu, apduLength, &offset, 2, &reference->arrayIndex)) {
+            return 0;
+        }
+        specification->referenceCount = 1;
+        return 1;
+    }
+    uint8_t specificationCount = 0;
+    while (offset < apduLength) {
+        if (specificationCount >= STACK_MODEL_MAX_SPECIFICATIONS) {
+            return 0;
+        }
+        StackModelSpecification* specification = &specifications[specificationCount++];
+        specification->referenceCount = 0;
+        if (!BACnetDecodeContextObjectIdentifier(apdu, apduLength, &offset, 0, &specification->objectType, &specification->objectInstance) || !BACnetDecodeTag(apdu, apduLength, &offset, 1, BACNET_TAG_OPENING)) {
+            return 0;
+        }
+        while (!BACnetDecodeTag(apdu, apduLength, &offset, 1, BACNET_TAG_CLOSING)) {
+            if (specification->referenceCount >= STACK_MODEL_MAX_REFERENCES) {
+                return 0;
+            }
+            StackModelReference* reference = &specification->references[specification->referenceCount++];
+            reference->arrayIndex = RESPONSE_CACHE_NO_INDEX;
+            if (!BACnetDecodeContextUnsigned(apdu, apduLength, &offset, 0, &reference->propertyIdentifier)) {
+                return 0;
+            }
+            if (offset < apduLength && apdu[offset] == (1 << 4 | BACNET_TAG_CONTEXT | 1) && !BACnetDecodeContextUnsigned(apdu, apduLength, &offset, 1, &reference->arrayIndex)) {
+                return 0;
+            }
+        }
+    }
+    return specificationCount;
+}
+
+// Answers a request the way the stack does. Returns the length of the response, 0 if not answered.
+static uint16_t StackModelHandle(const uint8_t* message, uint16_t length, uint8_t* response, uint16_t maxLength)
+{
+    memcpy(gStackModelReceived, message, length); // The receive callback copies into the stack's buffer
+    BACnetFrame frame;
+    if (!BACnetFrameParse(gStackModelReceived, length, &frame) || frame.apduType != APDU_TYPE_CONFIRMED_REQUEST) {
+        return 0;
+    }
+    StackModelSpecification specifications[STACK_MODEL_MAX_SPECIFICATIONS];
+    uint8_t specificationCount = StackModelDecode(gStackModelReceived + frame.apduOffset, frame.apduLength, frame.serviceChoice, specifications);
+    if (specificationCount == 0) {
+        return 0;
+    }
+
+    uint8_t apdu[RESPONSE_MAX_LENGTH];
+    uint16_t apduMaxLength = BACnetMaxAPDUAccepted(gStackModelReceived[frame.apduOffset + 1]);
+    uint16_t offset = 0;
+    apdu[offset++] = APDU_TYPE_COMPLEX_ACK;
+    apdu[offset++] = frame.invokeId;
+    apdu[offset++] = frame.serviceChoice;
+    for (uint8_t offsetInRequest = 0; offsetInRequest < specificationCount; offsetInRequest++) {
+        const StackModelSpecification& specification = specifications[offsetInRequest];
+        const StackModelObject* object = StackModelFindObject(specification);
+        if (object == NULL) {
+            return 0;
+        }
+        uint16_t objectLength = BACnetEncodeContextObjectIdentifier(apdu + offset, apduMaxLength - offset, 0, object->objectType, object->objectInstance);
+        offset += objectLength;
+        if (objectLength == 0) {
+            return 0;
+        }
+        if (frame.serviceChoice == BACNET_SERVICE_READ_PROPERTY) {
+            const StackModelReference& reference = specification.references[0];
+            if (!StackModelSupports(reference.propertyIdentifier) || !StackModelEncodeResult(object, reference.propertyIdentifier, reference.arrayIndex, 1, 3, apdu, &offset, apduMaxLength)) {
+                return 0;
+            }
+            continue;
+        }
+        if (!StackModelPutTag(apdu, &offset, apduMaxLength, 1, BACNET_TAG_OPENING)) {
+            return 0;
+        }
+        for (uint8_t offsetInSpecification = 0; offsetInSpecification < specification.referenceCount; offsetInSpecification++) {
+            const StackModelReference& reference = specification.references[offsetInSpecification];
+            if (reference.propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_ALL || reference.propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_REQUIRED) {
+                for (uint8_t property = 0; property < STACK_MODEL_MULTI_STATE_PROPERTY_COUNT; property++) {
+                    if (reference.propertyIdentifier == BACNET_PROPERTY_IDENTIFIER_REQUIRED && !STACK_MODEL_MULTI_STATE_PROPERTIES[property].required) {
+                        continue;
+                    }
+                    if (!StackModelEncodeResult(object, STACK_MODEL_MULTI_STATE_PROPERTIES[property].propertyIdentifier, RESPONSE_CACHE_NO_INDEX, 2, 4, apdu, &offset, apduMaxLength)) {
+                        return 0;
+                    }
+                }
+                continue;
+            }
+            if (!StackModelSupports(reference.propertyIdentifier) || !StackModelEncodeResult(object, reference.propertyIdentifier, reference.arrayIndex, 2, 4, apdu, &offset, apduMaxLength)) {
+                return 0;
+            }
+        }
+        if (!StackModelPutTag(apdu, &offset, apduMaxLength, 1, BACNET_TAG_CLOSING)) {
+            return 0;
+        }
+    }
+
+    // The datagram: BVLC and NPDU, then the APDU
+    uint16_t responseLength = RESPONSE_HEADER_LENGTH + offset;
+    if (responseLength > maxLength) {
+        return 0;
+    }
+    response[0] = BVLC_TYPE_BACNET_IP;
+    response[1] = BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    response[2] = (uint8_t)(responseLength >> 8);
+    response[3] = (uint8_t)responseLength;
+    response[4] = NPDU_VERSION;
+    response[5] = 0;
+    memcpy(response + RESPONSE_HEADER_LENGTH, apdu, offset);
+    return responseLength;
+}
+
+// Setup
+// ---------------------------------------------------------------------------
+static uint16_t EncodeRequest(uint8_t* buffer, const BenchmarkRequest& request, uint32_t objectInstance)
+{
+    uint16_t length = 0;
+    buffer[length++] = BVLC_TYPE_BACNET_IP;
+    buffer[length++] = BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    length += 2; // Filled in below
+    buffer[length++] = NPDU_VERSION;
+    buffer[length++] = 0x04; // Expecting reply
+    buffer[length++] = APDU_TYPE_CONFIRMED_REQUEST;
+    buffer[length++] = MAX_APDU_1476;
+    buffer[length++] = 1; // Invoke id
+    buffer[length++] = request.service;
+    length += BACnetEncodeContextObjectIdentifier(buffer + length, 16, 0, BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, objectInstance);
+    if (request.service == BACNET_SERVICE_READ_PROPERTY) {
+        length += BACnetEncodeContextUnsigned(buffer + length, 8, 1, request.properties[0]);
+    } else {
+        buffer[length++] = 1 << 4 | BACNET_TAG_OPENING;
+        for (uint8_t property = 0; property < request.propertyCount; property++) {
+            length += BACnetEncodeContextUnsigned(buffer + length, 8, 0, request.properties[property]);
+        }
+        buffer[length++] = 1 << 4 | BACNET_TAG_CLOSING;
+    }
+    buffer[2] = (uint8_t)(length >> 8);
+    buffer[3] = (uint8_t)length;
+    return length;
+}
+
+// Adds the benchmark objects to the point store and the stack model
+static bool AddObjects(uint32_t objects)
+{
+    gPointList[0] = PointGroupStates(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, FIRST_INSTANCE, (uint16_t)objects, MakePropertyString("Benchmark MSV "), POINT_FLAG_WRITABLE, 2, STATE_TEXT);
+    if (!PropertyRegistryBegin(&gPropertyRegistry, PROPERTY_TABLE, PROPERTY_TABLE_COUNT, gPropertyRegistryIndex, PropertyArrayCount(gPropertyRegistryIndex))) {
+        return false;
+    }
+    for (uint32_t objectInstance = FIRST_INSTANCE; objectInstance < FIRST_INSTANCE + objects; objectInstance++) {
+        if (PointStoreAdd(BACNET_OBJECT_TYPE_MULTI_STATE_VALUE, objectInstance, 2) == POINT_INVALID) {
+            return false;
+        }
+        StackModelObject* object = &gStackModelObjects[gStackModelObjectCount++];
+        object->objectType = BACNET_OBJECT_TYPE_MULTI_STATE_VALUE;
+        object->objectInstance = objectInstance;
+        object->statusFlags = 0;
+        object->eventState = 0; // Normal
+        object->outOfService = false;
+    }
+    return true;
+}
+
+// The static values as CacheStaticProperties() in main.cpp caches them, then the property lists
+// learned from the stack model's answers
+static bool FillCache(ResponseCache* cache, uint32_t objects)
+{
+    ResponseCacheBegin(cache, EncodeVolatileProperty);
+    uint8_t value[RESPONSE_MAX_LENGTH];
+    for (uint32_t offset = 0; offset < objects; offset++) {
+        const StackModelObject* object = &gStackModelObjects[offset];
+        const uint32_t staticProperties[] = { BACNET_PROPERTY_IDENTIFIER_OBJECT_IDENTIFIER, BACNET_PROPERTY_IDENTIFIER_OBJECT_TYPE, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT };
+        for (uint32_t property = 0; property < sizeof(staticProperties) / sizeof(staticProperties[0]); property++) {
+            uint16_t length = StackModelEncodeValue(object, staticProperties[property], RESPONSE_CACHE_NO_INDEX, value, sizeof(value));
+            ResponseCacheAdd(cache, object->objectType, object->objectInstance, staticProperties[property], RESPONSE_CACHE_NO_INDEX, value, length);
+        }
+        for (uint32_t arrayIndex = 0; arrayIndex <= PropertyArrayCount(STATE_TEXT); arrayIndex++) {
+            uint16_t length = StackModelEncodeValue(object, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, arrayIndex, value, sizeof(value));
+            ResponseCacheAdd(cache, object->objectType, object->objectInstance, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT, arrayIndex, value, length);
+        }
+        ResponseCacheLearnPropertyLists(cache, object->objectType, object->objectInstance);
+
+        // What the receive callback and the send callback see in main.cpp
+        const BenchmarkRequest* listRequests[] = { &BENCHMARK_REQUESTS[4], &BENCHMARK_REQUESTS[5] };
+        for (uint32_t listRequest = 0; listRequest < 2; listRequest++) {
+            uint8_t request[64];
+            uint8_t response[RESPONSE_MAX_LENGTH];
+            uint16_t requestLength = EncodeRequest(request, *listRequests[listRequest], object->objectInstance);
+            BACnetFrame requestFrame;
+            BACnetFrame responseFrame;
+            if (!BACnetFrameParse(request, requestLength, &requestFrame) || ResponseCacheHandleRequest(cache, request, &requestFrame, response, sizeof(response)) != 0) {
+                return false;
+            }
+            ResponseCacheObserveRequest(cache, request, &requestFrame, CLIENT_ADDRESS);
+            uint16_t responseLength = StackModelHandle(request, requestLength, response, sizeof(response));
+            if (responseLength == 0 || !BACnetFrameParse(response, responseLength, &responseFrame)) {
+                return false;
+            }
+            ResponseCacheObserveResponse(cache, response, &responseFrame, CLIENT_ADDRESS, value, sizeof(value));
+        }
+    }
+    return cache->statistics.rejected == 0 && cache->statistics.listsLearned == 2 * objects;
+}
+
+// Measurement
+// ---------------------------------------------------------------------------
+struct BenchmarkRequests {
+    uint8_t messages[MAX_OBJECTS][64];
+    uint16_t lengths[MAX_OBJECTS];
+    uint32_t count;
+};
+
+// Average time per request in ns, or 0 if a request was not answered
+static double MeasureOnce(ResponseCache* cache, const BenchmarkRequests& requests, uint32_t iterations)
+{
+    uint8_t response[RESPONSE_MAX_LENGTH];
+    double startNs = BenchmarkNowNs();
+    uint32_t offset = 0;
+    for (uint32_t iteration = 0; iteration < iterations; iteration++, offset = offset + 1 == requests.count ? 0 : offset + 1) {
+        uint16_t responseLength;
+        if (cache != NULL) {
+            BACnetFrame frame;
+            responseLength = BACnetFrameParse(requests.messages[offset], requests.lengths[offset], &frame) ? ResponseCacheHandleRequest(cache, requests.messages[offset], &frame, response, sizeof(response)) : 0;
+        } else {
+            responseLength = StackModelHandle(requests.messages[offset], requests.lengths[offset], response, sizeof(response));
+        }
+        if (responseLength == 0) {
+            return 0;
+        }
+    }
+    return (BenchmarkNowNs() - startNs) / iterations;
+}
+
+// Median of settings.runs timed runs after one untimed run. cache NULL measures the stack model.
+static double Measure(ResponseCache* cache, const BenchmarkRequests& requests, const BenchmarkSettings& settings)
+{
+    return BenchmarkMedian(settings.runs, [&]() { return MeasureOnce(cache, requests, settings.iterations); });
+}
+
+// Returns the response length if the cache answers every request exactly as the stack model does, 0 otherwise
+static uint16_t CheckResponses(ResponseCache* cache, const BenchmarkRequests& requests)
+{
+    uint16_t responseLength = 0;
+    for (uint32_t offset = 0; offset < requests.count; offset++) {
+        uint8_t cached[RESPONSE_MAX_LENGTH];
+        uint8_t expected[RESPONSE_MAX_LENGTH];
+        BACnetFrame frame;
+        if (!BACnetFrameParse(requests.messages[offset], requests.lengths[offset], &frame)) {
+            return 0;
+        }
+        responseLength = ResponseCacheHandleRequest(cache, requests.messages[offset], &frame, cached, sizeof(cached));
+        if (responseLength == 0 || StackModelHandle(requests.messages[offset], requests.lengths[offset], expected, sizeof(expected)) != responseLength || memcmp(cached, expected, responseLength) != 0) {
+            return 0;
+        }
+    }
+    return responseLength;
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: cachebench [--objects n] [--iterations n] [--runs n] [--min-speedup x]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, BenchmarkSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--objects") == 0) {
+            settings->objects = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--iterations") == 0) {
+            settings->iterations = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--runs") == 0) {
+            settings->runs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--min-speedup") == 0) {
+            settings->minSpeedup = strtof(value, NULL);
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+    if (settings->objects == 0 || settings->objects > MAX_OBJECTS || settings->iterations == 0 || settings->runs == 0 || settings->runs > BENCHMARK_MAX_RUNS) {
+        printf("Error: --objects must be 1 to %u, --iterations at least 1, --runs 1 to %u\n", MAX_OBJECTS, BENCHMARK_MAX_RUNS);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    settings.objects = 8;
+    settings.iterations = 200000;
+    settings.runs = 5;
+    settings.minSpeedup = 0;
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    static ResponseCache cache;
+    if (!AddObjects(settings.objects)) {
+        printf("Error: Could not add %u objects\n", settings.objects);
+        return 1;
+    }
+    if (!FillCache(&cache, settings.objects)) {
+        printf("Error: The cache did not take every value and property list (%u did not fit, %u lists learned)\n", cache.statistics.rejected, cache.statistics.listsLearned);
+        return 1;
+    }
+    printf("FYI: %u objects, %u cached values in %u bytes, %u requests per measurement, median of %u runs\n", settings.objects, cache.statistics.entries, cache.statistics.arenaBytes, settings.iterations, settings.runs);
+    printf("%-28s | %8s | %12s | %12s | %8s\n", "Request", "Bytes", "Stack ns", "Cache ns", "Speedup");
+
+    float minRequestSpeedup = 0;
+    for (uint32_t offset = 0; offset < BENCHMARK_REQUEST_COUNT; offset++) {
+        const BenchmarkRequest& request = BENCHMARK_REQUESTS[offset];
+        BenchmarkRequests requests;
+        requests.count = settings.objects;
+        for (uint32_t object = 0; object < requests.count; object++) {
+            requests.lengths[object] = EncodeRequest(requests.messages[object], request, FIRST_INSTANCE + object);
+        }
+        uint16_t responseLength = CheckResponses(&cache, requests);
+        if (responseLength == 0) {
+            printf("Error: %s was not answered from the cache as the stack model answers it\n", request.name);
+            return 1;
+        }
+        double stackNs = Measure(NULL, requests, settings);
+        double cacheNs = Measure(&cache, requests, settings);
+        if (stackNs == 0 || cacheNs == 0) {
+            printf("Error: %s was not answered\n", request.name);
+            return 1;
+        }
+        float speedup = (float)(stackNs / cacheNs);
+        printf("%-28s | %8u | %12.1f | %12.1f | %7.2fx\n", request.name, responseLength, stackNs, cacheNs, speedup);
+        if (request.service == BACNET_SERVICE_READ_PROPERTY_MULTIPLE && (minRequestSpeedup == 0 || speedup < minRequestSpeedup)) {
+            minRequestSpeedup = speedup;
+        }
+    }
+
+    if (settings.minSpeedup > 0 && minRequestSpeedup < settings.minSpeedup) {
+        printf("Error: ReadPropertyMultiple speedup %.2fx is below %.2fx\n", minRequestSpeedup, settings.minSpeedup);
+        return 1;
+    }
+    return 0;
+}
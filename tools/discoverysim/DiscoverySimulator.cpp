@@ -0,0 +1,239 @@
+/**
+ * Who-Is storm simulator
+ * --------------------------------------
+ * Runs N simulated devices, each with its own copy of the discovery manager (src/Discovery.cpp),
+ * through a site controller reboot: several controllers broadcast Who-Is, and retry, at the same
+ * moment. Reports the largest I-Am burst seen in any --window-ms window, with the discovery
+ * manager and with every Who-Is answered immediately (the stack's behaviour without it).
+ *
+ * Simulated time advances in 1 ms steps; nothing is sent on the network.
+ *
+ * Build:  pio run -e discoverysim
+ * Usage:  .pio/build/discoverysim/program [options]
+ *   --devices <n>        Largest number of devices, runs 1, 2, 4, ... n (default 64)
+ *   --instance <n>       Device instance of the first device, the others follow (default 389001)
+ *   --window-ms <ms>     Burst window (default 10)
+ *   --max-burst <n>      Exit with an error if the largest burst with --devices devices is above n
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "BACnetFrame.h"
+#include "Discovery.h"
+
+const uint32_t SIMULATION_DURATION_MS = 3000;
+
+// The Who-Is storm: when, from which controller, and whether it is limited to a device range.
+struct SimulatedWhoIs {
+    uint32_t timeMs;
+    uint8_t source; // Last byte of the controller's IP address
+    bool ranged; // Only asks for the first simulated device
+};
+const SimulatedWhoIs SIMULATION_WHO_IS[] = {
+    { 0, 10, false }, // Controller A reboots
+    { 0, 11, false }, // Controller B reboots at the same moment
+    { 5, 12, true }, // Controller C looks for one device
+    { 200, 10, false }, // A retries
+    { 250, 11, false }, // B retries
+    { 1500, 10, false }, // A retries again after the rate limit
+};
+const uint32_t SIMULATION_WHO_IS_COUNT = sizeof(SIMULATION_WHO_IS) / sizeof(SIMULATION_WHO_IS[0]);
+
+struct SimulatorSettings {
+    uint32_t devices;
+    uint32_t firstInstance;
+    uint32_t windowMs;
+    uint32_t maxBurst;
+};
+
+struct SimulationResult {
+    uint32_t iAmCount;
+    uint32_t largestBurst;
+    uint32_t firstMs;
+    uint32_t lastMs;
+};
+
+// Encoding
+// ---------------------------------------------------------------------------
+static uint16_t EncodeIAm(uint8_t* buffer, uint32_t deviceInstance)
+{
+    uint32_t objectIdentifier = (8UL << 22) | deviceInstance;
+    const uint8_t frame[] = {
+        BVLC_TYPE_BACNET_IP, BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU, 0, 21, // BVLC
+        NPDU_VERSION, 0, // NPDU
+        APDU_TYPE_UNCONFIRMED_REQUEST, BACNET_UNCONFIRMED_SERVICE_I_AM,
+        0xC4, (uint8_t)(objectIdentifier >> 24), (uint8_t)(objectIdentifier >> 16), (uint8_t)(objectIdentifier >> 8), (uint8_t)objectIdentifier,
+        0x22, 0x05, 0xC4, // Max APDU 1476
+        0x91, 0x03, // No segmentation
+        0x22, 0x01, 0x85 // Vendor 389
+    };
+    memcpy(buffer, frame, sizeof(frame));
+    return sizeof(frame);
+}
+
+static uint16_t EncodeWhoIs(uint8_t* buffer, bool ranged, uint32_t deviceInstance)
+{
+    uint16_t length = 0;
+    buffer[length++] = BVLC_TYPE_BACNET_IP;
+    buffer[length++] = BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU;
+    length += 2; // Filled in below
+    buffer[length++] = NPDU_VERSION;
+    buffer[length++] = 0;
+    buffer[length++] = APDU_TYPE_UNCONFIRMED_REQUEST;
+    buffer[length++] = BACNET_UNCONFIRMED_SERVICE_WHO_IS;
+    if (ranged) {
+        for (uint8_t tag = 0; tag < 2; tag++) {
+            buffer[length++] = (uint8_t)((tag << 4) | 0x08 | 3);
+            buffer[length++] = (uint8_t)(deviceInstance >> 16);
+            buffer[length++] = (uint8_t)(deviceInstance >> 8);
+            buffer[length++] = (uint8_t)deviceInstance;
+        }
+    }
+    buffer[2] = 0;
+    buffer[3] = (uint8_t)length;
+    return length;
+}
+
+// Simulation
+// ---------------------------------------------------------------------------
+static uint32_t LargestBurst(std::vector<uint32_t>& sendTimesMs, uint32_t windowMs)
+{
+    std::sort(sendTimesMs.begin(), sendTimesMs.end());
+    uint32_t largest = 0;
+    size_t first = 0;
+    for (size_t last = 0; last < sendTimesMs.size(); last++) {
+        while (sendTimesMs[last] - sendTimesMs[first] >= windowMs) {
+            first++;
+        }
+        largest = std::max(largest, (uint32_t)(last - first + 1));
+    }
+    return largest;
+}
+
+static SimulationResult Simulate(const SimulatorSettings& settings, uint32_t deviceCount, bool protectedDevices)
+{
+    std::vector<DiscoveryState> devices(deviceCount);
+    for (uint32_t device = 0; device < deviceCount; device++) {
+        uint8_t iAm[DISCOVERY_I_AM_MAX_LENGTH];
+        DiscoveryBegin(&devices[device], settings.firstInstance + device);
+        DiscoveryCacheIAm(&devices[device], iAm, EncodeIAm(iAm, settings.firstInstance + device));
+    }
+
+    std::vector<uint32_t> sendTimesMs;
+    for (uint32_t nowMs = 0; nowMs < SIMULATION_DURATION_MS; nowMs++) {
+        for (uint32_t whoIs = 0; whoIs < SIMULATION_WHO_IS_COUNT; whoIs++) {
+            if (SIMULATION_WHO_IS[whoIs].timeMs != nowMs) {
+                continue;
+            }
+            uint8_t message[32];
+            uint16_t length = EncodeWhoIs(message, SIMULATION_WHO_IS[whoIs].ranged, settings.firstInstance);
+            uint8_t source[6] = { 192, 168, 1, SIMULATION_WHO_IS[whoIs].source, 0xBA, 0xC0 };
+            BACnetFrame frame;
+            BACnetFrameParse(message, length, &frame);
+
+            for (uint32_t device = 0; device < deviceCount; device++) {
+                if (protectedDevices) {
+                    DiscoveryHandleWhoIs(&devices[device], message, &frame, source, nowMs);
+                } else if (!SIMULATION_WHO_IS[whoIs].ranged || device == 0) {
+                    sendTimesMs.push_back(nowMs);
+                }
+            }
+        }
+
+        for (uint32_t device = 0; protectedDevices && device < deviceCount; device++) {
+            const uint8_t* iAm;
+            uint16_t iAmLength;
+            if (DiscoveryPoll(&devices[device], nowMs, &iAm, &iAmLength)) {
+                sendTimesMs.push_back(nowMs);
+            }
+        }
+    }
+
+    SimulationResult result;
+    result.iAmCount = (uint32_t)sendTimesMs.size();
+    result.largestBurst = LargestBurst(sendTimesMs, settings.windowMs);
+    result.firstMs = sendTimesMs.empty() ? 0 : *std::min_element(sendTimesMs.begin(), sendTimesMs.end());
+    result.lastMs = sendTimesMs.empty() ? 0 : *std::max_element(sendTimesMs.begin(), sendTimesMs.end());
+    return result;
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: discoverysim [--devices n] [--instance n] [--window-ms ms] [--max-burst n]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, SimulatorSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--devices") == 0) {
+            settings->devices = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--instance") == 0) {
+            settings->firstInstance = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--window-ms") == 0) {
+            settings->windowMs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--max-burst") == 0) {
+            settings->maxBurst = (uint32_t)strtoul(value, NULL, 10);
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+    if (settings->devices == 0 || settings->windowMs == 0) {
+        printf("Error: --devices and --window-ms must be at least 1\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    SimulatorSettings settings;
+    settings.devices = 64;
+    settings.firstInstance = 389001;
+    settings.windowMs = 10;
+    settings.maxBurst = 0;
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    printf("FYI: %u Who-Is over %u ms, largest I-Am burst in any %u ms window\n", SIMULATION_WHO_IS_COUNT, SIMULATION_DURATION_MS, settings.windowMs);
+    printf("%8s | %22s | %34s\n", "", "Answer every Who-Is", "Discovery manager");
+    printf("%8s | %10s %11s | %10s %11s %11s\n", "Devices", "I-Am sent", "Max burst", "I-Am sent", "Max burst", "Spread ms");
+
+    uint32_t largestBurst = 0;
+    for (uint32_t deviceCount = 1;; deviceCount = std::min(deviceCount * 2, settings.devices)) {
+        SimulationResult unprotected = Simulate(settings, deviceCount, false);
+        SimulationResult result = Simulate(settings, deviceCount, true);
+        printf("%8u | %10u %11u | %10u %11u %11u\n", deviceCount, unprotected.iAmCount, unprotected.largestBurst, result.iAmCount, result.largestBurst, result.lastMs - result.firstMs);
+        largestBurst = result.largestBurst;
+        if (deviceCount == settings.devices) {
+            break;
+        }
+    }
+
+    if (settings.maxBurst > 0 && largestBurst > settings.maxBurst) {
+        printf("Error: Largest burst %u with %u devices is above %u\n", largestBurst, settings.devices, settings.maxBurst);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,480 @@
+/**
+ * BACnet/IP load generator
+ * --------------------------------------
+ * Fires confirmed ReadProperty, ReadPropertyMultiple and WriteProperty requests at the LED
+ * Multi-state-value object of the ESP32 BACnet Server Example and reports requests/sec and
+ * p50/p99 round trip latency. With --object-count the requests are spread over a range of
+ * instances, e.g. the objects added with APPLICATION_BENCHMARK_POINTS.
+ *
+ * Intended to be run against the host-native build (pio run -e native) over 127.0.0.1, but works
+ * against a device on the network as well.
+ *
+ * Build:  pio run -e loadgen
+ * Usage:  .pio/build/loadgen/program [options]
+ *   --host <ip>         Server IP address (default 127.0.0.1)
+ *   --port <port>       Server UDP port (default 47808)
+ *   --device <instance> Device instance, only used for reporting (default 389001)
+ *   --object <instance> First object instance (default 1)
+ *   --object-type <n>   Object type (default 19, Multi-state-value). rpm and wp expect a Multi-state-value
+ *   --object-count <n>  Cycle through this many instances starting at --object (default 1)
+ *   --service <name>    rp, rpm, rpm-all, wp or mix (default mix). rpm-all reads property ALL
+ *   --count <n>         Number of requests to send (default 10000)
+ *   --window <n>        Maximum outstanding requests (default 1)
+ *   --timeout-ms <ms>   Per-request timeout (default 1000)
+ *   --min-rps <n>       Exit with an error if the measured requests/sec is below this value
+ *   --max-p99-us <n>    Exit with an error if the measured p99 latency is above this value
+ *   --wait-first-ms <ms> Before the run, repeat a ReadProperty every 10 ms until one is answered and
+ *                       report how long that took. Started together with the server this measures
+ *                       the time from boot to the first answered ReadProperty. Use --count 0 to
+ *                       only measure that.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+// BACnet constants
+// -----------------------------
+const uint8_t BVLC_TYPE_BACNET_IP = 0x81;
+const uint8_t BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU = 0x0A;
+const uint8_t NPDU_VERSION = 0x01;
+const uint8_t NPDU_CONTROL_EXPECTING_REPLY = 0x04;
+const uint8_t NPDU_CONTROL_NETWORK_MESSAGE = 0x80;
+const uint8_t NPDU_CONTROL_DESTINATION_SPECIFIER = 0x20;
+const uint8_t NPDU_CONTROL_SOURCE_SPECIFIER = 0x08;
+const uint8_t APDU_TYPE_CONFIRMED_REQUEST = 0x00;
+const uint8_t APDU_TYPE_SIMPLE_ACK = 0x20;
+const uint8_t APDU_TYPE_COMPLEX_ACK = 0x30;
+const uint8_t APDU_MAX_SEGMENTS_AND_APDU_1476 = 0x05;
+const uint32_t WAIT_FIRST_RETRY_MS = 10;
+const uint8_t BACNET_SERVICE_READ_PROPERTY = 12;
+const uint8_t BACNET_SERVICE_READ_PROPERTY_MULTIPLE = 14;
+const uint8_t BACNET_SERVICE_WRITE_PROPERTY = 15;
+const uint16_t BACNET_OBJECT_TYPE_MULTI_STATE_VALUE = 19;
+const uint8_t BACNET_PROPERTY_IDENTIFIER_ALL = 8;
+const uint8_t BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES = 74;
+const uint8_t BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME = 77;
+const uint8_t BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE = 85;
+const uint8_t BACNET_PROPERTY_IDENTIFIER_STATE_TEXT = 110;
+
+// Settings
+// -----------------------------
+enum LoadService {
+    LOAD_SERVICE_RP,
+    LOAD_SERVICE_RPM,
+    LOAD_SERVICE_WP,
+    LOAD_SERVICE_MIX,
+    LOAD_SERVICE_RPM_ALL
+};
+
+struct LoadSettings {
+    const char* host;
+    uint16_t port;
+    uint32_t deviceInstance;
+    uint32_t objectInstance;
+    uint16_t objectType;
+    uint32_t objectCount;
+    LoadService service;
+    uint32_t count;
+    uint32_t window;
+    uint32_t timeoutMs;
+    double minRequestsPerSecond;
+    double maxP99Us;
+    uint32_t waitFirstMs;
+};
+
+struct PendingRequest {
+    bool active;
+    uint64_t sentAtUs;
+};
+
+static uint64_t NowMicros()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000ULL;
+}
+
+// Encoding
+// ---------------------------------------------------------------------------
+static size_t EncodeObjectIdentifier(uint8_t* buffer, uint8_t contextTag, uint16_t objectType, uint32_t objectInstance)
+{
+    uint32_t objectIdentifier = ((uint32_t)objectType << 22) | (objectInstance & 0x3FFFFF);
+    buffer[0] = (uint8_t)((contextTag << 4) | 0x08 | 4);
+    buffer[1] = (uint8_t)(objectIdentifier >> 24);
+    buffer[2] = (uint8_t)(objectIdentifier >> 16);
+    buffer[3] = (uint8_t)(objectIdentifier >> 8);
+    buffer[4] = (uint8_t)(objectIdentifier);
+    return 5;
+}
+
+static size_t EncodeContextUInt8(uint8_t* buffer, uint8_t contextTag, uint8_t value)
+{
+    buffer[0] = (uint8_t)((contextTag << 4) | 0x08 | 1);
+    buffer[1] = value;
+    return 2;
+}
+
+// Builds a complete BVLC + NPDU + APDU confirmed request. Returns the datagram length.
+static size_t EncodeRequest(uint8_t* buffer, const LoadSettings& settings, LoadService service, uint32_t objectInstance, uint8_t invokeId)
+{
+    size_t offset = 4; // BVLC header, filled in below
+    buffer[offset++] = NPDU_VERSION;
+    buffer[offset++] = NPDU_CONTROL_EXPECTING_REPLY;
+    buffer[offset++] = APDU_TYPE_CONFIRMED_REQUEST;
+    buffer[offset++] = APDU_MAX_SEGMENTS_AND_APDU_1476;
+    buffer[offset++] = invokeId;
+
+    switch (service) {
+        default:
+        case LOAD_SERVICE_RP:
+            buffer[offset++] = BACNET_SERVICE_READ_PROPERTY;
+            offset += EncodeObjectIdentifier(buffer + offset, 0, settings.objectType, objectInstance);
+            offset += EncodeContextUInt8(buffer + offset, 1, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE);
+            break;
+        case LOAD_SERVICE_RPM:
+            buffer[offset++] = BACNET_SERVICE_READ_PROPERTY_MULTIPLE;
+            offset += EncodeObjectIdentifier(buffer + offset, 0, settings.objectType, objectInstance);
+            buffer[offset++] = 0x1E; // Opening tag 1, list of property references
+            offset += EncodeContextUInt8(buffer + offset, 0, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE);
+            offset += EncodeContextUInt8(buffer + offset, 0, BACNET_PROPERTY_IDENTIFIER_OBJECT_NAME);
+            offset += EncodeContextUInt8(buffer + offset, 0, BACNET_PROPERTY_IDENTIFIER_NUMBER_OF_STATES);
+            offset += EncodeContextUInt8(buffer + offset, 0, BACNET_PROPERTY_IDENTIFIER_STATE_TEXT);
+            buffer[offset++] = 0x1F; // Closing tag 1
+            break;
+        case LOAD_SERVICE_RPM_ALL:
+            buffer[offset++] = BACNET_SERVICE_READ_PROPERTY_MULTIPLE;
+            offset += EncodeObjectIdentifier(buffer + offset, 0, settings.objectType, objectInstance);
+            buffer[offset++] = 0x1E; // Opening tag 1, list of property references
+            offset += EncodeContextUInt8(buffer + offset, 0, BACNET_PROPERTY_IDENTIFIER_ALL);
+            buffer[offset++] = 0x1F; // Closing tag 1
+            break;
+        case LOAD_SERVICE_WP:
+            buffer[offset++] = BACNET_SERVICE_WRITE_PROPERTY;
+            offset += EncodeObjectIdentifier(buffer + offset, 0, settings.objectType, objectInstance);
+            offset += EncodeContextUInt8(buffer + offset, 1, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE);
+            buffer[offset++] = 0x3E; // Opening tag 3, property value
+            buffer[offset++] = 0x21; // Application tag unsigned, length 1
+            buffer[offset++] = 3; // Blink, the default LED mode
+            buffer[offset++] = 0x3F; // Closing tag 3
+            break;
+    }
+
+    buffer[0] = BVLC_TYPE_BACNET_IP;
+    buffer[1] = BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    buffer[2] = (uint8_t)(offset >> 8);
+    buffer[3] = (uint8_t)(offset);
+    return offset;
+}
+
+// Decoding
+// ---------------------------------------------------------------------------
+// Finds the APDU in a BACnet/IP datagram. Returns false for network layer messages and malformed datagrams.
+static bool FindAPDU(const uint8_t* buffer, size_t length, const uint8_t** apdu, size_t* apduLength)
+{
+    if (length < 6 || buffer[0] != BVLC_TYPE_BACNET_IP || buffer[4] != NPDU_VERSION) {
+        return false;
+    }
+    uint8_t control = buffer[5];
+    if (control & NPDU_CONTROL_NETWORK_MESSAGE) {
+        return false;
+    }
+    size_t offset = 6;
+    if (control & NPDU_CONTROL_DESTINATION_SPECIFIER) {
+        if (offset + 3 > length) {
+            return false;
+        }
+        offset += 3 + buffer[offset + 2];
+    }
+    if (control & NPDU_CONTROL_SOURCE_SPECIFIER) {
+        if (offset + 3 > length) {
+            return false;
+        }
+        offset += 3 + buffer[offset + 2];
+    }
+    if (control & NPDU_CONTROL_DESTINATION_SPECIFIER) {
+        offset += 1; // Hop count
+    }
+    if (offset + 2 > length) {
+        return false;
+    }
+    *apdu = buffer + offset;
+    *apduLength = length - offset;
+    return true;
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: loadgen [--host ip] [--port port] [--device instance] [--object instance]\n");
+    printf("               [--object-type n] [--object-count n]\n");
+    printf("               [--service rp|rpm|rpm-all|wp|mix] [--count n] [--window n] [--timeout-ms ms]\n");
+    printf("               [--min-rps n] [--max-p99-us n] [--wait-first-ms ms]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, LoadSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--host") == 0) {
+            settings->host = value;
+        } else if (strcmp(argument, "--port") == 0) {
+            settings->port = (uint16_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--device") == 0) {
+            settings->deviceInstance = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--object") == 0) {
+            settings->objectInstance = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--object-type") == 0) {
+            settings->objectType = (uint16_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--object-count") == 0) {
+            settings->objectCount = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--count") == 0) {
+            settings->count = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--window") == 0) {
+            settings->window = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--timeout-ms") == 0) {
+            settings->timeoutMs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--min-rps") == 0) {
+            settings->minRequestsPerSecond = strtod(value, NULL);
+        } else if (strcmp(argument, "--max-p99-us") == 0) {
+            settings->maxP99Us = strtod(value, NULL);
+        } else if (strcmp(argument, "--wait-first-ms") == 0) {
+            settings->waitFirstMs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--service") == 0) {
+            if (strcmp(value, "rp") == 0) {
+                settings->service = LOAD_SERVICE_RP;
+            } else if (strcmp(value, "rpm") == 0) {
+                settings->service = LOAD_SERVICE_RPM;
+            } else if (strcmp(value, "rpm-all") == 0) {
+                settings->service = LOAD_SERVICE_RPM_ALL;
+            } else if (strcmp(value, "wp") == 0) {
+                settings->service = LOAD_SERVICE_WP;
+            } else if (strcmp(value, "mix") == 0) {
+                settings->service = LOAD_SERVICE_MIX;
+            } else {
+                printf("Error: Unknown service [%s]\n", value);
+                return false;
+            }
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+
+    if (settings->window == 0 || settings->window > 255) {
+        printf("Error: --window must be between 1 and 255\n");
+        return false;
+    }
+    if (settings->objectCount == 0) {
+        printf("Error: --object-count must be at least 1\n");
+        return false;
+    }
+    return true;
+}
+
+static uint64_t Percentile(const std::vector<uint64_t>& sorted, double percentile)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(percentile / 100.0 * (double)(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char** argv)
+{
+    LoadSettings settings;
+    settings.host = "127.0.0.1";
+    settings.port = 47808;
+    settings.deviceInstance = 389001;
+    settings.objectInstance = 1;
+    settings.objectType = BACNET_OBJECT_TYPE_MULTI_STATE_VALUE;
+    settings.objectCount = 1;
+    settings.service = LOAD_SERVICE_MIX;
+    settings.count = 10000;
+    settings.window = 1;
+    settings.timeoutMs = 1000;
+    settings.minRequestsPerSecond = 0;
+    settings.maxP99Us = 0;
+    settings.waitFirstMs = 0;
+
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 2;
+    }
+
+    // Set up the socket
+    // ==========================================
+    int udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udpSocket < 0) {
+        printf("Error: socket() failed, errno=%d\n", errno);
+        return 1;
+    }
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(settings.port);
+    if (inet_pton(AF_INET, settings.host, &server.sin_addr) != 1) {
+        printf("Error: Invalid host [%s]\n", settings.host);
+        close(udpSocket);
+        return 2;
+    }
+
+    // Wait for the server
+    // ==========================================
+    uint8_t buffer[1500];
+    if (settings.waitFirstMs > 0) {
+        uint64_t waitStartUs = NowMicros();
+        bool answered = false;
+        uint32_t attempts = 0;
+        while (!answered && NowMicros() - waitStartUs < (uint64_t)settings.waitFirstMs * 1000ULL) {
+            size_t length = EncodeRequest(buffer, settings, LOAD_SERVICE_RP, settings.objectInstance, 0);
+            sendto(udpSocket, buffer, length, 0, (struct sockaddr*)&server, sizeof(server));
+            attempts++;
+
+            // Answers to earlier attempts count as well, the first one wins
+            struct pollfd descriptor;
+            descriptor.fd = udpSocket;
+            descriptor.events = POLLIN;
+            descriptor.revents = 0;
+            while (!answered && poll(&descriptor, 1, WAIT_FIRST_RETRY_MS) > 0) {
+                ssize_t received = recv(udpSocket, buffer, sizeof(buffer), 0);
+                const uint8_t* apdu = NULL;
+                size_t apduLength = 0;
+                answered = received > 0 && FindAPDU(buffer, (size_t)received, &apdu, &apduLength) && (apdu[0] & 0xF0) == APDU_TYPE_COMPLEX_ACK;
+            }
+        }
+        if (!answered) {
+            printf("Error: No ReadProperty answered within %u ms\n", settings.waitFirstMs);
+            close(udpSocket);
+            return 1;
+        }
+        printf("FYI: First ReadProperty answered after %.1f ms (%u attempts)\n", (double)(NowMicros() - waitStartUs) / 1000.0, attempts);
+    }
+
+    printf("FYI: Sending %u requests to device %u (%s:%u), window=%u\n", settings.count, settings.deviceInstance, settings.host, settings.port, settings.window);
+
+    // Run
+    // ==========================================
+    PendingRequest pending[256];
+    memset(pending, 0, sizeof(pending));
+    std::vector<uint64_t> latencies;
+    latencies.reserve(settings.count);
+
+    uint32_t sent = 0;
+    uint32_t outstanding = 0;
+    uint32_t errors = 0;
+    uint32_t timeouts = 0;
+    uint8_t nextInvokeId = 0;
+
+    uint64_t startUs = NowMicros();
+    while (sent < settings.count || outstanding > 0) {
+        // Keep the window full
+        while (sent < settings.count && outstanding < settings.window) {
+            while (pending[nextInvokeId].active) {
+                nextInvokeId++;
+            }
+            LoadService service = settings.service;
+            if (service == LOAD_SERVICE_MIX) {
+                service = (LoadService)(sent % 3);
+            }
+            size_t length = EncodeRequest(buffer, settings, service, settings.objectInstance + sent % settings.objectCount, nextInvokeId);
+            if (sendto(udpSocket, buffer, length, 0, (struct sockaddr*)&server, sizeof(server)) < 0) {
+                printf("Error: sendto() failed, errno=%d\n", errno);
+                close(udpSocket);
+                return 1;
+            }
+            pending[nextInvokeId].active = true;
+            pending[nextInvokeId].sentAtUs = NowMicros();
+            nextInvokeId++;
+            sent++;
+            outstanding++;
+        }
+
+        // Wait for a response
+        struct pollfd descriptor;
+        descriptor.fd = udpSocket;
+        descriptor.events = POLLIN;
+        descriptor.revents = 0;
+        int ready = poll(&descriptor, 1, 10);
+        uint64_t nowUs = NowMicros();
+
+        if (ready > 0) {
+            ssize_t received = recv(udpSocket, buffer, sizeof(buffer), 0);
+            const uint8_t* apdu = NULL;
+            size_t apduLength = 0;
+            if (received > 0 && FindAPDU(buffer, (size_t)received, &apdu, &apduLength)) {
+                uint8_t apduType = apdu[0] & 0xF0;
+                uint8_t invokeId = apdu[1];
+                if (apduType != APDU_TYPE_CONFIRMED_REQUEST && pending[invokeId].active) {
+                    pending[invokeId].active = false;
+                    outstanding--;
+                    if (apduType == APDU_TYPE_SIMPLE_ACK || apduType == APDU_TYPE_COMPLEX_ACK) {
+                        latencies.push_back(nowUs - pending[invokeId].sentAtUs);
+                    } else {
+                        errors++;
+                    }
+                }
+            }
+        }
+
+        // Expire requests that have timed out
+        for (int invokeId = 0; invokeId < 256; invokeId++) {
+            if (pending[invokeId].active && nowUs - pending[invokeId].sentAtUs > (uint64_t)settings.timeoutMs * 1000ULL) {
+                pending[invokeId].active = false;
+                outstanding--;
+                timeouts++;
+            }
+        }
+    }
+    uint64_t elapsedUs = NowMicros() - startUs;
+    close(udpSocket);
+
+    // Report
+    // ==========================================
+    std::sort(latencies.begin(), latencies.end());
+    double requestsPerSecond = elapsedUs > 0 ? (double)latencies.size() * 1000000.0 / (double)elapsedUs : 0;
+    uint64_t p50 = Percentile(latencies, 50);
+    uint64_t p99 = Percentile(latencies, 99);
+
+    printf("FYI: Completed: %zu, Errors: %u, Timeouts: %u, Elapsed: %.3f s\n", latencies.size(), errors, timeouts, (double)elapsedUs / 1000000.0);
+    printf("FYI: Requests/sec: %.1f\n", requestsPerSecond);
+    printf("FYI: Latency p50: %llu us, p99: %llu us\n", (unsigned long long)p50, (unsigned long long)p99);
+
+    bool failed = false;
+    if (errors > 0 || timeouts > 0) {
+        printf("Error: %u requests failed\n", errors + timeouts);
+        failed = true;
+    }
+    if (settings.minRequestsPerSecond > 0 && requestsPerSecond < settings.minRequestsPerSecond) {
+        printf("Error: Requests/sec %.1f is below the minimum %.1f\n", requestsPerSecond, settings.minRequestsPerSecond);
+        failed = true;
+    }
+    if (settings.maxP99Us > 0 && (double)p99 > settings.maxP99Us) {
+        printf("Error: p99 latency %llu us is above the maximum %.0f us\n", (unsigned long long)p99, settings.maxP99Us);
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
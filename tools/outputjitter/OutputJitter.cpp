@@ -0,0 +1,214 @@
+/**
+ * Output jitter measurement
+ * --------------------------------------
+ * Runs the output driver (src/OutputDriver.cpp) on the host mock of the output timer and measures
+ * how late its blink edges are, next to the blink the firmware used to do in loop(): compare
+ * millis() with the last toggle once per scan and toggle when the interval passed.
+ *
+ * Both blink the same period while a simulated scan loop runs. Each scan busy-waits for a random
+ * time up to --scan-us, standing in for fpLoop() and the rest of the scan, and every --spike-every
+ * scans it takes --spike-us instead, like a burst of requests. The polled blink can only toggle
+ * between scans, so its lateness follows the scan time; the driver's edges are timed by the output
+ * timer and do not depend on it. Halfway through, the driver's point is switched off and back to
+ * blinking to check the mode changes.
+ *
+ * On the host the timer is a thread, so the driver's figures include the host scheduler's wake-up
+ * latency. On the ESP32 the same histogram is in the 30 second status report ("Outputs").
+ *
+ * Build:  pio run -e outputjitter
+ * Usage:  .pio/build/outputjitter/program [options]
+ *   --seconds <n>       Length of the run (default 10)
+ *   --period-ms <n>     Blink period (default 20)
+ *   --scan-us <n>       Longest normal scan (default 2000)
+ *   --spike-us <n>      Length of a slow scan (default 15000)
+ *   --spike-every <n>   Every n-th scan is slow, 0 for never (default 200)
+ *   --max-p99-us <n>    Exit with an error if the driver's p99 jitter is above n
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "OutputDriver.h"
+#include "OutputHal.h"
+#include "PointStore.h"
+
+const uint16_t OBJECT_TYPE_MULTI_STATE_VALUE = 19;
+const uint32_t MODE_OFF = 0;
+const uint32_t MODE_BLINK = 1;
+const OutputMode OUTPUT_MODES[] = { OUTPUT_MODE_OFF, OUTPUT_MODE_BLINK };
+const uint8_t DRIVER_PIN = 1;
+const uint8_t POLLED_PIN = 2;
+
+struct JitterSettings {
+    uint32_t seconds;
+    uint32_t periodMs;
+    uint32_t scanUs;
+    uint32_t spikeUs;
+    uint32_t spikeEvery;
+    uint32_t maxP99Us;
+};
+
+// The point store timestamps changes with millis()
+unsigned long millis()
+{
+    return (unsigned long)(OutputHalNowUs() / 1000);
+}
+
+static void BusyWaitUs(uint32_t durationUs)
+{
+    uint64_t endUs = OutputHalNowUs() + durationUs;
+    while (OutputHalNowUs() < endUs) {
+    }
+}
+
+// The histogram of the polled blink uses the same buckets as the driver so the two can be compared directly
+static void RecordJitter(OutputStatistics* statistics, uint64_t lateUs)
+{
+    uint32_t jitterUs = (uint32_t)lateUs;
+    statistics->edges++;
+    statistics->jitterTotalUs += jitterUs;
+    HistogramRecord(&statistics->jitter, jitterUs);
+}
+
+static void PrintJitter(const char* name, const OutputStatistics* statistics, uint32_t pinEdges)
+{
+    printf("%-16s | %8u | %8u | %10.1f | %8u | %8u | %8u\n", name, statistics->edges, pinEdges, statistics->edges > 0 ? (double)statistics->jitterTotalUs / statistics->edges : 0.0, HistogramPercentileUs(&statistics->jitter, 50), HistogramPercentileUs(&statistics->jitter, 99), statistics->jitter.maxUs);
+}
+
+static void SetMode(uint16_t point, uint32_t mode)
+{
+    PointStoreWrite(point, mode);
+    PointChangeSet changes;
+    PointStoreTakeChanges(&changes);
+    OutputDriverApplyChanges(&changes);
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: outputjitter [--seconds n] [--period-ms n] [--scan-us n] [--spike-us n] [--spike-every n] [--max-p99-us n]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, JitterSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--seconds") == 0) {
+            settings->seconds = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--period-ms") == 0) {
+            settings->periodMs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--scan-us") == 0) {
+            settings->scanUs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--spike-us") == 0) {
+            settings->spikeUs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--spike-every") == 0) {
+            settings->spikeEvery = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--max-p99-us") == 0) {
+            settings->maxP99Us = (uint32_t)strtoul(value, NULL, 10);
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+    if (settings->seconds == 0 || settings->periodMs < 2) {
+        printf("Error: --seconds must be at least 1 and --period-ms at least 2\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    JitterSettings settings;
+    settings.seconds = 10;
+    settings.periodMs = 20;
+    settings.scanUs = 2000;
+    settings.spikeUs = 15000;
+    settings.spikeEvery = 200;
+    settings.maxP99Us = 0;
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    uint16_t point = PointStoreAdd(OBJECT_TYPE_MULTI_STATE_VALUE, 1, MODE_BLINK);
+    if (!OutputDriverBegin() || OutputDriverAdd(point, DRIVER_PIN, settings.periodMs, OUTPUT_MODES, sizeof(OUTPUT_MODES) / sizeof(OUTPUT_MODES[0])) == OUTPUT_INVALID) {
+        printf("Error: Could not start the output driver\n");
+        return 1;
+    }
+    printf("FYI: %u ms blink period, scans up to %u us, every %u-th scan %u us, %u seconds\n", settings.periodMs, settings.scanUs, settings.spikeEvery, settings.spikeUs, settings.seconds);
+
+    // The blink the way loop() did it, on the same half period
+    uint64_t halfPeriodUs = (uint64_t)settings.periodMs * 1000 / 2;
+    OutputStatistics polled;
+    memset(&polled, 0, sizeof(polled));
+    bool polledLevel = false;
+    uint64_t lastBlinkUs = OutputHalNowUs();
+
+    uint64_t startUs = OutputHalNowUs();
+    uint64_t endUs = startUs + (uint64_t)settings.seconds * 1000000;
+    uint64_t modeCheckUs = startUs + (endUs - startUs) / 2;
+    bool modeChecked = false;
+    bool modeChangesApplied = true;
+    uint32_t scans = 0;
+    srand(1);
+    for (uint64_t nowUs = startUs; nowUs < endUs; nowUs = OutputHalNowUs()) {
+        scans++;
+        bool spike = settings.spikeEvery > 0 && scans % settings.spikeEvery == 0;
+        BusyWaitUs(spike ? settings.spikeUs : (settings.scanUs > 0 ? (uint32_t)rand() % settings.scanUs : 0));
+
+        nowUs = OutputHalNowUs();
+        if (nowUs - lastBlinkUs >= halfPeriodUs) {
+            RecordJitter(&polled, nowUs - lastBlinkUs - halfPeriodUs);
+            lastBlinkUs = nowUs;
+            polledLevel = !polledLevel;
+            OutputHalWrite(POLLED_PIN, polledLevel);
+        }
+
+        if (!modeChecked && nowUs >= modeCheckUs) {
+            modeChecked = true;
+            SetMode(point, MODE_OFF);
+            modeChangesApplied = OutputDriverGetMode(0) == OUTPUT_MODE_OFF && !OutputHalMockGetLevel(DRIVER_PIN);
+            uint32_t edges = OutputHalMockGetEdgeCount(DRIVER_PIN);
+            BusyWaitUs((uint32_t)halfPeriodUs * 3);
+            modeChangesApplied = modeChangesApplied && OutputHalMockGetEdgeCount(DRIVER_PIN) == edges;
+            SetMode(point, MODE_BLINK);
+            modeChangesApplied = modeChangesApplied && OutputDriverGetMode(0) == OUTPUT_MODE_BLINK && OutputHalMockGetLevel(DRIVER_PIN);
+            lastBlinkUs = OutputHalNowUs(); // Not counted against the polled blink
+        }
+    }
+    SetMode(point, MODE_OFF);
+
+    OutputStatistics driver;
+    OutputDriverGetStatistics(&driver);
+    uint64_t expectedEdges = (uint64_t)(OutputHalNowUs() - startUs) / halfPeriodUs;
+    printf("FYI: %u scans, about %u edges expected per output\n", scans, (uint32_t)expectedEdges);
+    printf("%-16s | %8s | %8s | %10s | %8s | %8s | %8s\n", "Output", "Edges", "Pin", "Mean us", "p50 <us", "p99 <us", "Max us");
+    PrintJitter("Output timer", &driver, OutputHalMockGetEdgeCount(DRIVER_PIN));
+    PrintJitter("Polled in loop", &polled, OutputHalMockGetEdgeCount(POLLED_PIN));
+    printf("FYI: Output timer restarted the blink %u times\n", driver.restarts);
+
+    if (!modeChangesApplied) {
+        printf("Error: Switching the output off and back to blinking was not applied\n");
+        return 1;
+    }
+    uint32_t p99Us = HistogramPercentileUs(&driver.jitter, 99);
+    if (settings.maxP99Us > 0 && p99Us > settings.maxP99Us) {
+        printf("Error: Output timer p99 jitter <%u us is above %u us\n", p99Us, settings.maxP99Us);
+        return 1;
+    }
+    return 0;
+}
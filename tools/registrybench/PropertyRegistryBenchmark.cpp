@@ -0,0 +1,239 @@
+/**
+ * Property registry benchmark
+ * --------------------------------------
+ * Measures the CPU time of PropertyRegistryFind() (src/PropertyRegistry.cpp) as the number of
+ * objects in the table grows from 1 to --objects, doubling each step. Every object has the same
+ * four properties, and the keys are looked up in a shuffled order so consecutive lookups land in
+ * different parts of the index. A linear scan of the same table is measured for comparison, as is
+ * a lookup of a property that is not in the table.
+ *
+ * Each measurement is run once untimed to warm the caches, then --runs times; the median is printed.
+ *
+ * Build:  pio run -e registrybench
+ * Usage:  .pio/build/registrybench/program [options]
+ *   --objects <n>      Largest number of objects (default 2000)
+ *   --iterations <n>   Lookups per measurement (default 200000)
+ *   --runs <n>         Timed runs per measurement (default 5)
+ *   --max-growth <x>   Exit with an error if a lookup takes more than x times as long with the
+ *                      most objects as with one
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "PropertyRegistry.h"
+
+#include "../Benchmark.h"
+
+const uint16_t OBJECT_TYPE_ANALOG_VALUE = 2;
+const uint16_t OBJECT_TYPE_BINARY_VALUE = 5;
+const uint16_t OBJECT_TYPE_MULTI_STATE_VALUE = 19;
+const uint32_t PROPERTY_DESCRIPTION = 28;
+const uint32_t PROPERTY_OBJECT_NAME = 77;
+const uint32_t PROPERTY_PRESENT_VALUE = 85;
+const uint32_t PROPERTY_RELINQUISH_DEFAULT = 104;
+const uint32_t PROPERTY_PROFILE_NAME = 168; // Not in the table, used for misses
+const uint32_t PROPERTIES_PER_OBJECT = 4;
+const uint32_t MAX_OBJECTS = (PROPERTY_REGISTRY_EMPTY_SLOT - 1) / PROPERTIES_PER_OBJECT;
+
+struct BenchmarkSettings {
+    uint32_t objects;
+    uint32_t iterations;
+    uint32_t runs;
+    float maxGrowth;
+};
+
+struct BenchmarkKey {
+    uint16_t objectType;
+    uint32_t objectInstance;
+    uint32_t propertyIdentifier;
+};
+
+static bool GetPresentValue(uint32_t* value)
+{
+    *value = 1;
+    return true;
+}
+
+// Table
+// ---------------------------------------------------------------------------
+struct BenchmarkTable {
+    std::vector<PropertyEntry> entries;
+    std::vector<uint16_t> index;
+    std::vector<BenchmarkKey> keys; // Every entry in shuffled order
+    std::vector<BenchmarkKey> misses;
+    PropertyRegistry registry;
+};
+
+static bool BuildTable(BenchmarkTable* table, uint32_t objectCount)
+{
+    const uint16_t OBJECT_TYPES[] = { OBJECT_TYPE_ANALOG_VALUE, OBJECT_TYPE_BINARY_VALUE, OBJECT_TYPE_MULTI_STATE_VALUE };
+    const PropertyString NAME = MakePropertyString("Point");
+    const PropertyString DESCRIPTION = MakePropertyString("Benchmark point");
+    table->entries.clear();
+    table->keys.clear();
+    table->misses.clear();
+    for (uint32_t object = 0; object < objectCount; object++) {
+        uint16_t objectType = OBJECT_TYPES[object % 3];
+        uint32_t objectInstance = 1 + object / 3;
+        table->entries.push_back(PropertyCharString(objectType, objectInstance, PROPERTY_OBJECT_NAME, NAME));
+        table->entries.push_back(PropertyCharString(objectType, objectInstance, PROPERTY_DESCRIPTION, DESCRIPTION));
+        table->entries.push_back(PropertyUInt(objectType, objectInstance, PROPERTY_PRESENT_VALUE, GetPresentValue, NULL));
+        table->entries.push_back(PropertyUIntConstant(objectType, objectInstance, PROPERTY_RELINQUISH_DEFAULT, 0));
+        BenchmarkKey miss = { objectType, objectInstance, PROPERTY_PROFILE_NAME };
+        table->misses.push_back(miss);
+    }
+    for (size_t entry = 0; entry < table->entries.size(); entry++) {
+        BenchmarkKey key = { table->entries[entry].objectType, table->entries[entry].objectInstance, table->entries[entry].propertyIdentifier };
+        table->keys.push_back(key);
+    }
+    srand(objectCount);
+    for (size_t key = table->keys.size(); key > 1; key--) {
+        std::swap(table->keys[key - 1], table->keys[rand() % key]);
+    }
+
+    table->index.resize(PropertyRegistryIndexSize((uint32_t)table->entries.size()));
+    return PropertyRegistryBegin(&table->registry, table->entries.data(), (uint16_t)table->entries.size(), table->index.data(), (uint32_t)table->index.size());
+}
+
+// Lookups
+// ---------------------------------------------------------------------------
+enum BenchmarkLookup {
+    BENCHMARK_FIND,
+    BENCHMARK_FIND_MISS,
+    BENCHMARK_SCAN,
+    BENCHMARK_LOOKUP_COUNT
+};
+const char* const BENCHMARK_LOOKUP_NAMES[] = { "Find ns", "Miss ns", "Scan ns" };
+
+static const PropertyEntry* ScanTable(const PropertyRegistry* registry, const BenchmarkKey& key)
+{
+    for (uint16_t entry = 0; entry < registry->entryCount; entry++) {
+        const PropertyEntry* candidate = &registry->entries[entry];
+        if (candidate->objectType == key.objectType && candidate->objectInstance == key.objectInstance && candidate->propertyIdentifier == key.propertyIdentifier) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+// Average time per lookup in ns, or 0 if a lookup returned the wrong entry
+static double MeasureOnce(const BenchmarkTable& table, uint32_t iterations, BenchmarkLookup lookup)
+{
+    const std::vector<BenchmarkKey>& keys = lookup == BENCHMARK_FIND_MISS ? table.misses : table.keys;
+    uint32_t correct = 0;
+    double startNs = BenchmarkNowNs();
+    for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        const BenchmarkKey& key = keys[iteration % keys.size()];
+        const PropertyEntry* entry = lookup == BENCHMARK_SCAN ? ScanTable(&table.registry, key) : PropertyRegistryFind(&table.registry, key.objectType, key.objectInstance, key.propertyIdentifier);
+        if (lookup == BENCHMARK_FIND_MISS) {
+            correct += entry == NULL;
+        } else {
+            correct += entry != NULL && entry->propertyIdentifier == key.propertyIdentifier && entry->objectInstance == key.objectInstance;
+        }
+    }
+    double elapsedNs = BenchmarkNowNs() - startNs;
+    return correct == iterations ? elapsedNs / iterations : 0;
+}
+
+// Median of settings.runs timed runs after one untimed run
+static double Measure(const BenchmarkTable& table, const BenchmarkSettings& settings, BenchmarkLookup lookup)
+{
+    // A scan of a large table costs thousands of times a lookup, keep its runs to a similar duration
+    uint32_t iterations = lookup == BENCHMARK_SCAN ? settings.iterations / (table.registry.entryCount / 8 + 1) + 1 : settings.iterations;
+    return BenchmarkMedian(settings.runs, [&]() { return MeasureOnce(table, iterations, lookup); });
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: registrybench [--objects n] [--iterations n] [--runs n] [--max-growth x]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, BenchmarkSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--objects") == 0) {
+            settings->objects = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--iterations") == 0) {
+            settings->iterations = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--runs") == 0) {
+            settings->runs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--max-growth") == 0) {
+            settings->maxGrowth = strtof(value, NULL);
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+    if (settings->objects == 0 || settings->objects > MAX_OBJECTS || settings->iterations == 0 || settings->runs == 0 || settings->runs > BENCHMARK_MAX_RUNS) {
+        printf("Error: --objects must be 1 to %u, --iterations at least 1, --runs 1 to %u\n", MAX_OBJECTS, BENCHMARK_MAX_RUNS);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    settings.objects = 2000;
+    settings.iterations = 200000;
+    settings.runs = 5;
+    settings.maxGrowth = 0;
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    printf("FYI: %u properties per object, %u lookups per measurement, median of %u runs\n", PROPERTIES_PER_OBJECT, settings.iterations, settings.runs);
+    printf("%8s | %8s | %8s | %10s | %10s | %10s\n", "Objects", "Entries", "Slots", BENCHMARK_LOOKUP_NAMES[0], BENCHMARK_LOOKUP_NAMES[1], BENCHMARK_LOOKUP_NAMES[2]);
+    BenchmarkTable table;
+    double firstNs = 0;
+    double lastNs = 0;
+    for (uint32_t objectCount = 1;; objectCount = objectCount * 2 < settings.objects ? objectCount * 2 : settings.objects) {
+        if (!BuildTable(&table, objectCount)) {
+            printf("Error: Could not build the index for %u objects\n", objectCount);
+            return 1;
+        }
+        double lookupNs[BENCHMARK_LOOKUP_COUNT];
+        for (uint32_t lookup = 0; lookup < BENCHMARK_LOOKUP_COUNT; lookup++) {
+            lookupNs[lookup] = Measure(table, settings, (BenchmarkLookup)lookup);
+            if (lookupNs[lookup] == 0) {
+                printf("Error: %s with %u objects returned the wrong entry\n", BENCHMARK_LOOKUP_NAMES[lookup], objectCount);
+                return 1;
+            }
+        }
+        if (objectCount == 1) {
+            firstNs = lookupNs[BENCHMARK_FIND];
+        }
+        lastNs = lookupNs[BENCHMARK_FIND];
+        printf("%8u | %8u | %8u | %10.1f | %10.1f | %10.1f\n", objectCount, (uint32_t)table.entries.size(), (uint32_t)table.index.size(), lookupNs[BENCHMARK_FIND], lookupNs[BENCHMARK_FIND_MISS], lookupNs[BENCHMARK_SCAN]);
+        if (objectCount == settings.objects) {
+            break;
+        }
+    }
+
+    double growth = lastNs / firstNs;
+    printf("FYI: A lookup with %u objects is %.2fx the cost with one\n", settings.objects, growth);
+    if (settings.maxGrowth > 0 && growth > settings.maxGrowth) {
+        printf("Error: A lookup grows %.2fx from 1 to %u objects, more than %.2fx\n", growth, settings.objects, settings.maxGrowth);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+/**
+ * Send path benchmark
+ * --------------------------------------
+ * Compares the CPU time of the two ways the send callback has addressed a datagram:
+ * - String: the original callback. It queried the broadcast address from WiFi on every broadcast,
+ *   formatted the destination as a dotted quad, had WiFiUDP parse it back, copied the payload into
+ *   the WiFiUDP transmit buffer and sent from there.
+ * - Binary: TransportSend() (src/Transport.cpp). It builds the socket address from the 6 byte
+ *   connection string, or from the cached broadcast address, and sends from the caller's buffer.
+ *
+ * Both are timed with the sendto() to a local sink socket and, to show the addressing cost on its
+ * own, without it. The string path is modelled on the host: WiFi.localIP()/subnetMask() are the
+ * native stubs, so the ESP32's call into the network task for each of them is not included.
+ *
+ * Each measurement is run once untimed to warm the caches, then --runs times; the median is printed.
+ *
+ * Build:  pio run -e sendbench
+ * Usage:  .pio/build/sendbench/program [options]
+ *   --iterations <n>   Sends per measurement (default 200000)
+ *   --runs <n>         Timed runs per measurement (default 5)
+ *   --length <n>       Datagram length in bytes (default 64)
+ *   --port <n>         UDP port the transport binds to (default 47809)
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "NativeArduino.h"
+#include "Transport.h"
+
+#include "../Benchmark.h"
+
+const uint16_t WIFI_UDP_TX_BUFFER_SIZE = 1460; // WiFiUDP allocates its transmit buffer with this size
+
+struct BenchmarkSettings {
+    uint32_t iterations;
+    uint32_t runs;
+    uint16_t length;
+    uint16_t port;
+};
+
+// String send path
+// ---------------------------------------------------------------------------
+static int gStringSocket = -1;
+static uint8_t gStringTransmitBuffer[WIFI_UDP_TX_BUFFER_SIZE];
+
+static void GetWiFiBroadcastAddress(uint8_t* broadcastAddress)
+{
+    IPAddress localIP = WiFi.localIP();
+    IPAddress subnetMask = WiFi.subnetMask();
+    broadcastAddress[0] = localIP[0] | ~subnetMask[0];
+    broadcastAddress[1] = localIP[1] | ~subnetMask[1];
+    broadcastAddress[2] = localIP[2] | ~subnetMask[2];
+    broadcastAddress[3] = localIP[3] | ~subnetMask[3];
+}
+
+// Formats the destination and parses it back, as CallbackSendMessage() and WiFiUDP::beginPacket() did
+static bool PrepareString(const uint8_t* connectionString, bool broadcast, struct sockaddr_in* destination)
+{
+    char destinationIPAddressAsString[32];
+    if (broadcast) {
+        uint8_t broadcastIPAddress[4];
+        GetWiFiBroadcastAddress(broadcastIPAddress);
+        snprintf(destinationIPAddressAsString, 32, "%u.%u.%u.%u", broadcastIPAddress[0], broadcastIPAddress[1], broadcastIPAddress[2], broadcastIPAddress[3]);
+    } else {
+        snprintf(destinationIPAddressAsString, 32, "%u.%u.%u.%u", connectionString[0], connectionString[1], connectionString[2], connectionString[3]);
+    }
+    uint16_t udpPort = 0;
+    udpPort += connectionString[4] * 256;
+    udpPort += connectionString[5];
+
+    memset(destination, 0, sizeof(*destination));
+    destination->sin_family = AF_INET;
+    destination->sin_port = htons(udpPort);
+    return inet_aton(destinationIPAddressAsString, &destination->sin_addr) != 0;
+}
+
+static uint16_t SendString(const uint8_t* message, uint16_t messageLength, const uint8_t* connectionString, bool broadcast, bool send)
+{
+    struct sockaddr_in destination;
+    if (!PrepareString(connectionString, broadcast, &destination)) {
+        return 0;
+    }
+    memcpy(gStringTransmitBuffer, message, messageLength); // WiFiUDP::write()
+    if (!send) {
+        return messageLength;
+    }
+    return sendto(gStringSocket, gStringTransmitBuffer, messageLength, 0, (struct sockaddr*)&destination, sizeof(destination)) == (ssize_t)messageLength ? messageLength : 0;
+}
+
+// Binary send path
+// ---------------------------------------------------------------------------
+// The addressing part of TransportSend(), for the measurement without sendto()
+static uint16_t PrepareBinary(const uint8_t* message, uint16_t messageLength, const uint8_t* connectionString, bool broadcast)
+{
+    (void)message;
+    struct sockaddr_in destination;
+    memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    if (broadcast) {
+        if (!TransportGetBroadcastAddress((uint8_t*)&destination.sin_addr.s_addr)) {
+            return 0;
+        }
+    } else {
+        memcpy(&destination.sin_addr.s_addr, connectionString, 4);
+    }
+    destination.sin_port = htons((uint16_t)(connectionString[4] * 256 + connectionString[5]));
+    // Keep the compiler from dropping the address
+    __asm__ __volatile__("" : : "r"(&destination) : "memory");
+    return messageLength;
+}
+
+// Measurement
+// ---------------------------------------------------------------------------
+enum BenchmarkPath {
+    BENCHMARK_STRING,
+    BENCHMARK_BINARY
+};
+
+// Average time per send in ns, or 0 if a send failed
+static double MeasureOnce(const BenchmarkSettings& settings, BenchmarkPath path, bool broadcast, bool send, const uint8_t* message, const uint8_t* connectionString)
+{
+    uint32_t sent = 0;
+    double startNs = BenchmarkNowNs();
+    for (uint32_t iteration = 0; iteration < settings.iterations; iteration++) {
+        uint16_t length;
+        if (path == BENCHMARK_STRING) {
+            length = SendString(message, settings.length, connectionString, broadcast, send);
+        } else if (send) {
+            length = TransportSend(message, settings.length, connectionString, broadcast);
+        } else {
+            length = PrepareBinary(message, settings.length, connectionString, broadcast);
+        }
+        sent += length == settings.length;
+    }
+    double elapsedNs = BenchmarkNowNs() - startNs;
+    return sent == settings.iterations ? elapsedNs / settings.iterations : 0;
+}
+
+// Median of settings.runs timed runs after one untimed run
+static double Measure(const BenchmarkSettings& settings, BenchmarkPath path, bool broadcast, bool send, const uint8_t* message, const uint8_t* connectionString)
+{
+    return BenchmarkMedian(settings.runs, [&]() { return MeasureOnce(settings, path, broadcast, send, message, connectionString); });
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: sendbench [--iterations n] [--runs n] [--length n] [--port n]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, BenchmarkSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--iterations") == 0) {
+            settings->iterations = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--runs") == 0) {
+            settings->runs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--length") == 0) {
+            settings->length = (uint16_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--port") == 0) {
+            settings->port = (uint16_t)strtoul(value, NULL, 10);
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+    if (settings->iterations == 0 || settings->runs == 0 || settings->runs > BENCHMARK_MAX_RUNS || settings->length == 0 || settings->length > WIFI_UDP_TX_BUFFER_SIZE || settings->port == 0) {
+        printf("Error: --iterations must be at least 1, --runs 1 to %u, --length 1 to %u, --port not 0\n", BENCHMARK_MAX_RUNS, WIFI_UDP_TX_BUFFER_SIZE);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    settings.iterations = 200000;
+    settings.runs = 5;
+    settings.length = 64;
+    settings.port = 47809;
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    // The datagrams go to a sink socket that is never read; the kernel drops what does not fit.
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in sinkAddress;
+    memset(&sinkAddress, 0, sizeof(sinkAddress));
+    sinkAddress.sin_family = AF_INET;
+    sinkAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t sinkAddressLength = sizeof(sinkAddress);
+    gStringSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    int enable = 1;
+    setsockopt(gStringSocket, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+    if (sink < 0 || gStringSocket < 0 || bind(sink, (struct sockaddr*)&sinkAddress, sizeof(sinkAddress)) != 0 || getsockname(sink, (struct sockaddr*)&sinkAddress, &sinkAddressLength) != 0 || !TransportBegin(settings.port)) {
+        printf("Error: Could not open the sockets\n");
+        return 1;
+    }
+    IPAddress localIP = WiFi.localIP();
+    IPAddress subnetMask = WiFi.subnetMask();
+    uint8_t localIPAddress[4] = { localIP[0], localIP[1], localIP[2], localIP[3] };
+    uint8_t subnetMaskBytes[4] = { subnetMask[0], subnetMask[1], subnetMask[2], subnetMask[3] };
+    TransportSetBroadcastAddress(localIPAddress, subnetMaskBytes);
+
+    uint16_t sinkPort = ntohs(sinkAddress.sin_port);
+    uint8_t connectionString[6] = { 127, 0, 0, 1, (uint8_t)(sinkPort / 256), (uint8_t)(sinkPort % 256) };
+    uint8_t message[WIFI_UDP_TX_BUFFER_SIZE];
+    for (uint16_t offset = 0; offset < settings.length; offset++) {
+        message[offset] = (uint8_t)offset;
+    }
+
+    printf("FYI: %u byte datagrams, %u sends per measurement, median of %u runs\n", settings.length, settings.iterations, settings.runs);
+    printf("%-24s | %10s | %10s | %8s\n", "Path", "String ns", "Binary ns", "Speedup");
+    const char* const NAMES[] = { "Unicast, addressing", "Broadcast, addressing", "Unicast, with sendto", "Broadcast, with sendto" };
+    for (uint32_t row = 0; row < 4; row++) {
+        bool broadcast = (row % 2) == 1;
+        bool send = row >= 2;
+        double stringNs = Measure(settings, BENCHMARK_STRING, broadcast, send, message, connectionString);
+        double binaryNs = Measure(settings, BENCHMARK_BINARY, broadcast, send, message, connectionString);
+        if (stringNs == 0 || binaryNs == 0) {
+            printf("Error: %s failed to send\n", NAMES[row]);
+            return 1;
+        }
+        printf("%-24s | %10.1f | %10.1f | %7.2fx\n", NAMES[row], stringNs, binaryNs, stringNs / binaryNs);
+    }
+    close(sink);
+    close(gStringSocket);
+    return 0;
+}
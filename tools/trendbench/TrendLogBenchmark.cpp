@@ -0,0 +1,324 @@
+/**
+ * Trend log benchmark
+ * --------------------------------------
+ * Fills trend logs (src/TrendLog.cpp) with a series of typical point histories and reports the
+ * bytes each record takes in the delta encoded ring, against a plain array of timestamp, value and
+ * status records. Every record is read back and compared with what was logged.
+ *
+ * Then measures the CPU time of answering ReadRange (src/ReadRange.cpp) by position, sequence
+ * number and time at the oldest, middle and newest end of the log, with a max APDU of 1476 bytes.
+ * The time includes finding the first record and encoding every record the response holds.
+ *
+ * Build:  pio run -e trendbench
+ * Usage:  .pio/build/trendbench/program [options]
+ *   --records <n>              Records per log (default 10000)
+ *   --interval <s>             Seconds between records (default 10)
+ *   --iterations <n>           Requests per measurement (default 2000)
+ *   --max-bytes-per-record <x> Exit with an error if a series takes more than x bytes per record
+ *   --max-latency-us <x>       Exit with an error if a ReadRange takes longer than x us
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "BACnetFrame.h"
+#include "ReadRange.h"
+#include "TrendLog.h"
+
+#include "../Benchmark.h"
+
+const uint32_t TREND_LOG_INSTANCE = 1;
+const uint8_t MAX_APDU_1476 = 0x05;
+const uint16_t RESPONSE_MAX_LENGTH = 1500; // One Ethernet frame
+const uint32_t FIRST_TIMESTAMP = 1767225600; // 2026-01-01 UTC, the logs are stamped with wall-clock time
+const uint32_t MAX_RECORDS = 65535; // One block per record in the worst case, see FillLog()
+
+struct BenchmarkSettings {
+    uint32_t records;
+    uint32_t interval;
+    uint32_t iterations;
+    float maxBytesPerRecord;
+    float maxLatencyUs;
+};
+
+// What a log holds without delta encoding
+struct PlainRecord {
+    uint32_t timestamp;
+    uint32_t value;
+    uint8_t statusFlags;
+};
+
+// Series
+// ---------------------------------------------------------------------------
+enum BenchmarkSeries {
+    SERIES_MODE_STEADY,
+    SERIES_MODE_BUSY,
+    SERIES_TEMPERATURE,
+    SERIES_NOISE,
+    SERIES_COUNT
+};
+const char* const SERIES_NAMES[] = { "Mode, changes hourly", "Mode, changes every record", "Temperature, 0.1 steps", "Noise, random REAL" };
+const TrendLogValueType SERIES_VALUE_TYPES[] = { TREND_LOG_VALUE_UNSIGNED, TREND_LOG_VALUE_UNSIGNED, TREND_LOG_VALUE_REAL, TREND_LOG_VALUE_REAL };
+
+static uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Value of a series at a record. Deterministic, so the log can be checked against it.
+static void SeriesRecord(BenchmarkSeries series, const BenchmarkSettings& settings, uint32_t record, PlainRecord* plain)
+{
+    plain->timestamp = FIRST_TIMESTAMP + record * settings.interval;
+    plain->statusFlags = 0;
+    switch (series) {
+        case SERIES_MODE_STEADY:
+            plain->value = 1 + (plain->timestamp / 3600) % 3;
+            break;
+        case SERIES_MODE_BUSY:
+            plain->value = 1 + record % 3;
+            break;
+        case SERIES_TEMPERATURE: {
+            // A daily cycle, as a sensor with 0.1 degree resolution reports it
+            float degrees = 21.0f + 3.0f * (float)sin((double)plain->timestamp * 2.0 * M_PI / 86400.0);
+            plain->value = FloatBits(roundf(degrees * 10.0f) / 10.0f);
+            plain->statusFlags = record % 1000 < 10 ? 0x02 : 0; // A short fault now and then
+            break;
+        }
+        default:
+            plain->value = FloatBits((float)rand() / (float)RAND_MAX * 100.0f);
+            break;
+    }
+}
+
+// Logs every record of a series. The ring is large enough that nothing is dropped.
+static void FillLog(TrendLog* log, std::vector<TrendLogBlock>* blocks, std::vector<PlainRecord>* plain, BenchmarkSeries series, const BenchmarkSettings& settings)
+{
+    blocks->resize(settings.records);
+    plain->resize(settings.records);
+    TrendLogBegin(log, SERIES_VALUE_TYPES[series], blocks->data(), (uint16_t)settings.records, NULL, NULL);
+    srand(1);
+    for (uint32_t record = 0; record < settings.records; record++) {
+        SeriesRecord(series, settings, record, &(*plain)[record]);
+        TrendLogAppend(log, (*plain)[record].timestamp, (*plain)[record].value, (*plain)[record].statusFlags);
+    }
+}
+
+// Returns the number of records that differ from what was logged
+static uint32_t CheckLog(const TrendLog* log, const std::vector<PlainRecord>& plain)
+{
+    if (log->statistics.recordCount != plain.size()) {
+        return (uint32_t)plain.size();
+    }
+    uint32_t errors = 0;
+    TrendLogCursor cursor;
+    bool more = TrendLogSeek(log, 1, &cursor);
+    for (uint32_t record = 0; record < plain.size(); record++) {
+        const PlainRecord& expected = plain[record];
+        if (!more || cursor.record.sequence != record + 1 || cursor.record.timestamp != expected.timestamp || cursor.record.value != expected.value || cursor.record.statusFlags != expected.statusFlags) {
+            errors++;
+        }
+        more = TrendLogNext(log, &cursor);
+    }
+    return errors;
+}
+
+// Requests
+// ---------------------------------------------------------------------------
+enum BenchmarkRange {
+    RANGE_ALL,
+    RANGE_POSITION,
+    RANGE_SEQUENCE,
+    RANGE_TIME
+};
+
+struct BenchmarkRequest {
+    const char* name;
+    BenchmarkRange range;
+    uint32_t numerator; // Reference at numerator / 4 of the log
+    int32_t count;
+};
+const BenchmarkRequest BENCHMARK_REQUESTS[] = {
+    { "All records", RANGE_ALL, 0, 0 },
+    { "By position, oldest", RANGE_POSITION, 0, 100 },
+    { "By position, middle", RANGE_POSITION, 2, 100 },
+    { "By position, newest", RANGE_POSITION, 4, -100 },
+    { "By sequence, middle", RANGE_SEQUENCE, 2, 100 },
+    { "By time, oldest", RANGE_TIME, 0, 100 },
+    { "By time, middle", RANGE_TIME, 2, 100 },
+    { "By time, newest", RANGE_TIME, 4, -100 },
+};
+const uint32_t BENCHMARK_REQUEST_COUNT = sizeof(BENCHMARK_REQUESTS) / sizeof(BENCHMARK_REQUESTS[0]);
+
+static uint16_t EncodeSigned(uint8_t* buffer, int32_t value)
+{
+    uint8_t length = 1;
+    while (length < 4 && (value >> (8 * length - 1)) != 0 && (value >> (8 * length - 1)) != -1) {
+        length++;
+    }
+    buffer[0] = BACNET_APPLICATION_TAG_SIGNED << 4 | length;
+    for (uint8_t offset = 0; offset < length; offset++) {
+        buffer[1 + offset] = (uint8_t)(value >> (8 * (length - 1 - offset)));
+    }
+    return 1 + length;
+}
+
+static uint16_t EncodeRequest(uint8_t* buffer, const BenchmarkRequest& request, const std::vector<PlainRecord>& plain)
+{
+    uint32_t record = request.numerator * (uint32_t)(plain.size() - 1) / 4;
+    uint16_t length = 0;
+    buffer[length++] = BVLC_TYPE_BACNET_IP;
+    buffer[length++] = BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    length += 2; // Filled in below
+    buffer[length++] = NPDU_VERSION;
+    buffer[length++] = 0x04; // Expecting reply
+    buffer[length++] = APDU_TYPE_CONFIRMED_REQUEST;
+    buffer[length++] = MAX_APDU_1476;
+    buffer[length++] = 1; // Invoke id
+    buffer[length++] = BACNET_SERVICE_READ_RANGE;
+    length += BACnetEncodeContextObjectIdentifier(buffer + length, 16, 0, BACNET_OBJECT_TYPE_TREND_LOG, TREND_LOG_INSTANCE);
+    length += BACnetEncodeContextUnsigned(buffer + length, 8, 1, BACNET_PROPERTY_IDENTIFIER_LOG_BUFFER);
+    uint8_t tagNumber = request.range == RANGE_POSITION ? 3 : request.range == RANGE_SEQUENCE ? 6 : 7;
+    if (request.range != RANGE_ALL) {
+        buffer[length++] = (uint8_t)(tagNumber << 4 | BACNET_TAG_OPENING);
+        if (request.range == RANGE_TIME) {
+            length += BACnetEncodeDateTime(buffer + length, 16, plain[record].timestamp);
+        } else {
+            length += BACnetEncodeUnsigned(buffer + length, 8, record + 1); // Position and sequence number are the same, nothing was dropped
+        }
+        length += EncodeSigned(buffer + length, request.count);
+        buffer[length++] = (uint8_t)(tagNumber << 4 | BACNET_TAG_CLOSING);
+    }
+    buffer[2] = (uint8_t)(length >> 8);
+    buffer[3] = (uint8_t)length;
+    return length;
+}
+
+// Returns the average time per request in ns, or 0 if the request was not answered
+static double Measure(ReadRangeState* state, const BenchmarkSettings& settings, const uint8_t* request, const BACnetFrame* frame, uint16_t* responseLength, uint32_t* records)
+{
+    uint8_t response[RESPONSE_MAX_LENGTH];
+    uint32_t recordsBefore = state->statistics.recordsSent;
+    double startNs = BenchmarkNowNs();
+    for (uint32_t iteration = 0; iteration < settings.iterations; iteration++) {
+        *responseLength = ReadRangeHandleRequest(state, request, frame, response, sizeof(response));
+        if (*responseLength == 0) {
+            return 0;
+        }
+    }
+    double elapsedNs = BenchmarkNowNs() - startNs;
+    *records = (state->statistics.recordsSent - recordsBefore) / settings.iterations;
+    return elapsedNs / settings.iterations;
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: trendbench [--records n] [--interval s] [--iterations n] [--max-bytes-per-record x] [--max-latency-us x]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, BenchmarkSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--records") == 0) {
+            settings->records = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--interval") == 0) {
+            settings->interval = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--iterations") == 0) {
+            settings->iterations = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--max-bytes-per-record") == 0) {
+            settings->maxBytesPerRecord = strtof(value, NULL);
+        } else if (strcmp(argument, "--max-latency-us") == 0) {
+            settings->maxLatencyUs = strtof(value, NULL);
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+    if (settings->records < 2 || settings->records > MAX_RECORDS || settings->interval == 0 || settings->iterations == 0) {
+        printf("Error: --records must be 2 to %u, --interval and --iterations at least 1\n", MAX_RECORDS);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    settings.records = 10000;
+    settings.interval = 10;
+    settings.iterations = 2000;
+    settings.maxBytesPerRecord = 0;
+    settings.maxLatencyUs = 0;
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Storage
+    printf("FYI: %u records per log, one every %u s, %u byte blocks; a plain record takes %u bytes\n", settings.records, settings.interval, TREND_LOG_BLOCK_BYTES, (uint32_t)sizeof(PlainRecord));
+    printf("%-28s | %8s | %8s | %14s | %8s\n", "Series", "Blocks", "Bytes", "Bytes/record", "Saving");
+    bool failed = false;
+    static TrendLog log;
+    std::vector<TrendLogBlock> blocks;
+    std::vector<PlainRecord> plain;
+    for (uint32_t series = 0; series < SERIES_COUNT; series++) {
+        FillLog(&log, &blocks, &plain, (BenchmarkSeries)series, settings);
+        uint32_t errors = CheckLog(&log, plain);
+        if (errors > 0) {
+            printf("Error: %s: %u records read back differ from the ones logged\n", SERIES_NAMES[series], errors);
+            return 1;
+        }
+        const TrendLogStatistics& statistics = log.statistics;
+        float bytesPerRecord = (float)statistics.bytesUsed / (float)statistics.recordCount;
+        printf("%-28s | %8u | %8u | %14.2f | %7.1fx\n", SERIES_NAMES[series], statistics.blocksUsed, statistics.bytesUsed, bytesPerRecord, (float)sizeof(PlainRecord) / bytesPerRecord);
+        if (settings.maxBytesPerRecord > 0 && bytesPerRecord > settings.maxBytesPerRecord) {
+            printf("Error: %s takes %.2f bytes per record, more than %.2f\n", SERIES_NAMES[series], bytesPerRecord, settings.maxBytesPerRecord);
+            failed = true;
+        }
+    }
+
+    // ReadRange, on the temperature log
+    FillLog(&log, &blocks, &plain, SERIES_TEMPERATURE, settings);
+    ReadRangeLog readRangeLog = { TREND_LOG_INSTANCE, &log };
+    static ReadRangeState state;
+    ReadRangeBegin(&state, &readRangeLog, 1);
+    printf("\nFYI: ReadRange of the %s log, %u requests per measurement\n", SERIES_NAMES[SERIES_TEMPERATURE], settings.iterations);
+    printf("%-28s | %8s | %8s | %12s\n", "Request", "Records", "Bytes", "Latency us");
+    for (uint32_t offset = 0; offset < BENCHMARK_REQUEST_COUNT; offset++) {
+        const BenchmarkRequest& request = BENCHMARK_REQUESTS[offset];
+        uint8_t message[64];
+        BACnetFrame frame;
+        uint16_t length = EncodeRequest(message, request, plain);
+        uint16_t responseLength = 0;
+        uint32_t records = 0;
+        double latencyNs = BACnetFrameParse(message, length, &frame) ? Measure(&state, settings, message, &frame, &responseLength, &records) : 0;
+        if (latencyNs == 0 || records == 0) {
+            printf("Error: %s was not answered\n", request.name);
+            return 1;
+        }
+        printf("%-28s | %8u | %8u | %12.2f\n", request.name, records, responseLength, latencyNs / 1000.0);
+        if (settings.maxLatencyUs > 0 && latencyNs / 1000.0 > settings.maxLatencyUs) {
+            printf("Error: %s takes %.2f us, more than %.2f us\n", request.name, latencyNs / 1000.0, settings.maxLatencyUs);
+            failed = true;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,383 @@
+/**
+ * Virtual devices benchmark
+ * --------------------------------------
+ * Measures the CPU time of answering requests for the virtual devices (src/VirtualDevices.cpp) as
+ * the number of hosted devices grows from 1 to --devices, doubling each step. Requests are spread
+ * evenly over the devices, so every device's tables are touched. The time includes parsing the
+ * request, finding the device and object, encoding the reply and handing it to the send function,
+ * which only counts it.
+ *
+ * Measured per device count:
+ * - ReadProperty of a present value
+ * - ReadPropertyMultiple of ALL properties of an object
+ * - WriteProperty of a present value
+ * - Device instance lookup through the index, and a scan of the devices for comparison
+ * - A global Who-Is, per I-Am sent once the jitter delays have passed
+ *
+ * Each measurement is run once untimed to warm the caches, then --runs times; the median is printed.
+ *
+ * Build:  pio run -e virtualbench
+ * Usage:  .pio/build/virtualbench/program [options]
+ *   --devices <n>      Largest number of devices (default 64, at most VIRTUAL_DEVICES_MAX_DEVICES)
+ *   --objects <n>      Objects per device (default 8)
+ *   --iterations <n>   Requests per measurement (default 20000)
+ *   --runs <n>         Timed runs per measurement (default 5)
+ *   --max-growth <x>   Exit with an error if a request takes more than x times as long with the
+ *                      most devices as with one
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "BACnetFrame.h"
+#include "VirtualDevices.h"
+
+#include "../Benchmark.h"
+
+const uint16_t NETWORK_NUMBER = 1000;
+const uint16_t VENDOR_IDENTIFIER = 389;
+const uint32_t FIRST_DEVICE_INSTANCE = 389100;
+const uint8_t MAX_APDU_1476 = 0x05;
+const uint16_t REQUEST_MAX_LENGTH = 64;
+const uint16_t MAX_OBJECTS = 1000;
+const uint8_t REQUESTER_ADDRESS[] = { 127, 0, 0, 1, 0xBA, 0xC0 }; // B/IP address the replies go to
+
+struct BenchmarkSettings {
+    uint32_t devices;
+    uint32_t objects;
+    uint32_t iterations;
+    uint32_t runs;
+    float maxGrowth;
+};
+
+// Counts what the virtual devices send, and checks every reply is an acknowledgement
+struct BenchmarkSink {
+    uint32_t messages;
+    uint32_t bytes;
+    uint32_t failures;
+};
+
+static void BenchmarkSend(void* context, const uint8_t* message, uint16_t length, const uint8_t* address, bool broadcast)
+{
+    (void)address;
+    BenchmarkSink* sink = (BenchmarkSink*)context;
+    sink->messages++;
+    sink->bytes += length;
+    BACnetFrame frame;
+    if (!BACnetFrameParse(message, length, &frame) || (!broadcast && frame.apduType != APDU_TYPE_COMPLEX_ACK && frame.apduType != APDU_TYPE_SIMPLE_ACK)) {
+        sink->failures++;
+    }
+}
+
+// Devices
+// ---------------------------------------------------------------------------
+struct BenchmarkDevices {
+    std::vector<VirtualObject> objects; // The same table for every device
+    std::vector<uint32_t> presentValues; // settings.objects per device
+    std::vector<char> names;
+};
+
+static void BuildObjects(BenchmarkDevices* devices, const BenchmarkSettings& settings)
+{
+    const uint16_t OBJECT_TYPES[] = { BACNET_OBJECT_TYPE_ANALOG_VALUE, BACNET_OBJECT_TYPE_BINARY_VALUE, BACNET_OBJECT_TYPE_MULTI_STATE_VALUE };
+    const char* const OBJECT_NAMES[] = { "Temperature", "Run status", "Mode" };
+    devices->objects.resize(settings.objects);
+    for (uint32_t object = 0; object < settings.objects; object++) {
+        VirtualObject* definition = &devices->objects[object];
+        definition->objectType = OBJECT_TYPES[object % 3];
+        definition->objectInstance = 1 + object / 3;
+        definition->name.value = OBJECT_NAMES[object % 3];
+        definition->name.length = (uint32_t)strlen(OBJECT_NAMES[object % 3]);
+        definition->stateCount = definition->objectType == BACNET_OBJECT_TYPE_MULTI_STATE_VALUE ? 3 : 0;
+        definition->writable = true;
+    }
+}
+
+static bool AddDevices(VirtualDevices* state, BenchmarkDevices* devices, BenchmarkSink* sink, const BenchmarkSettings& settings, uint32_t deviceCount)
+{
+    const uint32_t NAME_LENGTH = 32;
+    devices->presentValues.assign(deviceCount * settings.objects, 1);
+    devices->names.resize(deviceCount * NAME_LENGTH);
+    VirtualDevicesBegin(state, NETWORK_NUMBER, VENDOR_IDENTIFIER, BenchmarkSend, sink);
+    for (uint32_t device = 0; device < deviceCount; device++) {
+        char* name = &devices->names[device * NAME_LENGTH];
+        snprintf(name, NAME_LENGTH, "Virtual device %u", device + 1);
+        if (VirtualDevicesAdd(state, FIRST_DEVICE_INSTANCE + device, name, devices->objects.data(), (uint16_t)settings.objects, &devices->presentValues[device * settings.objects]) == VIRTUAL_DEVICE_NONE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Requests
+// ---------------------------------------------------------------------------
+enum BenchmarkService {
+    BENCHMARK_READ_PROPERTY,
+    BENCHMARK_READ_PROPERTY_MULTIPLE,
+    BENCHMARK_WRITE_PROPERTY,
+    BENCHMARK_SERVICE_COUNT
+};
+const char* const BENCHMARK_SERVICE_NAMES[] = { "RP ns", "RPM ALL ns", "WP ns" };
+
+// A confirmed request routed to a device on the virtual network, for one of its objects
+static uint16_t EncodeRequest(uint8_t* buffer, BenchmarkService service, uint16_t deviceNumber, const VirtualObject* object, uint8_t invokeId)
+{
+    uint16_t length = 0;
+    buffer[length++] = BVLC_TYPE_BACNET_IP;
+    buffer[length++] = BVLC_FUNCTION_ORIGINAL_UNICAST_NPDU;
+    length += 2; // Filled in below
+    buffer[length++] = NPDU_VERSION;
+    buffer[length++] = NPDU_CONTROL_DESTINATION_SPECIFIER | 0x04; // Expecting reply
+    buffer[length++] = (uint8_t)(NETWORK_NUMBER >> 8);
+    buffer[length++] = (uint8_t)NETWORK_NUMBER;
+    buffer[length++] = VIRTUAL_DEVICE_MAC_LENGTH;
+    buffer[length++] = (uint8_t)(deviceNumber >> 8);
+    buffer[length++] = (uint8_t)deviceNumber;
+    buffer[length++] = 255; // Hop count
+    buffer[length++] = APDU_TYPE_CONFIRMED_REQUEST;
+    buffer[length++] = MAX_APDU_1476;
+    buffer[length++] = invokeId;
+    buffer[length++] = service == BENCHMARK_READ_PROPERTY ? BACNET_SERVICE_READ_PROPERTY : service == BENCHMARK_READ_PROPERTY_MULTIPLE ? BACNET_SERVICE_READ_PROPERTY_MULTIPLE : BACNET_SERVICE_WRITE_PROPERTY;
+    length += BACnetEncodeContextObjectIdentifier(buffer + length, 8, 0, object->objectType, object->objectInstance);
+    if (service == BENCHMARK_READ_PROPERTY_MULTIPLE) {
+        buffer[length++] = 1 << 4 | BACNET_TAG_OPENING;
+        length += BACnetEncodeContextUnsigned(buffer + length, 8, 0, BACNET_PROPERTY_IDENTIFIER_ALL);
+        buffer[length++] = 1 << 4 | BACNET_TAG_CLOSING;
+    } else {
+        length += BACnetEncodeContextUnsigned(buffer + length, 8, 1, BACNET_PROPERTY_IDENTIFIER_PRESENT_VALUE);
+    }
+    if (service == BENCHMARK_WRITE_PROPERTY) {
+        buffer[length++] = 3 << 4 | BACNET_TAG_OPENING;
+        if (object->objectType == BACNET_OBJECT_TYPE_ANALOG_VALUE) {
+            length += BACnetEncodeReal(buffer + length, 8, 21.5f);
+        } else if (object->objectType == BACNET_OBJECT_TYPE_BINARY_VALUE) {
+            length += BACnetEncodeEnumerated(buffer + length, 8, 1);
+        } else {
+            length += BACnetEncodeUnsigned(buffer + length, 8, 2);
+        }
+        buffer[length++] = 3 << 4 | BACNET_TAG_CLOSING;
+    }
+    buffer[2] = (uint8_t)(length >> 8);
+    buffer[3] = (uint8_t)length;
+    return length;
+}
+
+static uint16_t EncodeGlobalWhoIs(uint8_t* buffer)
+{
+    uint16_t length = 0;
+    buffer[length++] = BVLC_TYPE_BACNET_IP;
+    buffer[length++] = BVLC_FUNCTION_ORIGINAL_BROADCAST_NPDU;
+    length += 2; // Filled in below
+    buffer[length++] = NPDU_VERSION;
+    buffer[length++] = NPDU_CONTROL_DESTINATION_SPECIFIER;
+    buffer[length++] = 0xFF; // Global broadcast
+    buffer[length++] = 0xFF;
+    buffer[length++] = 0; // No DADR
+    buffer[length++] = 255; // Hop count
+    buffer[length++] = APDU_TYPE_UNCONFIRMED_REQUEST;
+    buffer[length++] = BACNET_UNCONFIRMED_SERVICE_WHO_IS;
+    buffer[2] = (uint8_t)(length >> 8);
+    buffer[3] = (uint8_t)length;
+    return length;
+}
+
+// Average time per request in ns, or 0 if a request was not acknowledged
+static double MeasureServiceOnce(VirtualDevices* state, const std::vector<uint8_t>& requests, const std::vector<uint16_t>& lengths, BenchmarkSink* sink, uint32_t iterations)
+{
+    uint32_t requestCount = (uint32_t)lengths.size();
+    uint32_t failuresBefore = sink->failures;
+    uint32_t messagesBefore = sink->messages;
+    double startNs = BenchmarkNowNs();
+    for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        uint32_t request = iteration % requestCount;
+        VirtualDevicesHandleMessage(state, &requests[request * REQUEST_MAX_LENGTH], lengths[request], REQUESTER_ADDRESS, 0);
+    }
+    double elapsedNs = BenchmarkNowNs() - startNs;
+    if (sink->failures != failuresBefore || sink->messages - messagesBefore != iterations) {
+        return 0;
+    }
+    return elapsedNs / iterations;
+}
+
+// Returns the median time per request in ns. Request i goes to device i % deviceCount and object
+// i % objects, so consecutive requests touch different devices.
+static double MeasureService(VirtualDevices* state, const BenchmarkDevices& devices, BenchmarkSink* sink, const BenchmarkSettings& settings, uint32_t deviceCount, BenchmarkService service)
+{
+    uint32_t requestCount = deviceCount * settings.objects;
+    std::vector<uint8_t> requests(requestCount * REQUEST_MAX_LENGTH);
+    std::vector<uint16_t> lengths(requestCount);
+    for (uint32_t request = 0; request < requestCount; request++) {
+        lengths[request] = EncodeRequest(&requests[request * REQUEST_MAX_LENGTH], service, (uint16_t)(1 + request % deviceCount), &devices.objects[request % settings.objects], (uint8_t)request);
+    }
+
+    return BenchmarkMedian(settings.runs, [&]() { return MeasureServiceOnce(state, requests, lengths, sink, settings.iterations); });
+}
+
+// Lookups
+// ---------------------------------------------------------------------------
+static const VirtualDevice* ScanDevices(const VirtualDevices* state, uint32_t deviceInstance)
+{
+    for (uint16_t device = 0; device < state->deviceCount; device++) {
+        if (state->devices[device].deviceInstance == deviceInstance) {
+            return &state->devices[device];
+        }
+    }
+    return NULL;
+}
+
+// Average time per lookup in ns of every device in turn, indexed or by a scan
+static double MeasureLookupOnce(const VirtualDevices* state, uint32_t iterations, uint32_t deviceCount, bool indexed)
+{
+    uint32_t found = 0;
+    double startNs = BenchmarkNowNs();
+    for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        uint32_t deviceInstance = FIRST_DEVICE_INSTANCE + iteration % deviceCount;
+        const VirtualDevice* device = indexed ? VirtualDevicesFind(state, deviceInstance) : ScanDevices(state, deviceInstance);
+        found += device != NULL && device->deviceInstance == deviceInstance;
+    }
+    double elapsedNs = BenchmarkNowNs() - startNs;
+    return found == iterations ? elapsedNs / iterations : 0;
+}
+
+static double MeasureLookup(const VirtualDevices* state, const BenchmarkSettings& settings, uint32_t deviceCount, bool indexed)
+{
+    return BenchmarkMedian(settings.runs, [&]() { return MeasureLookupOnce(state, settings.iterations, deviceCount, indexed); });
+}
+
+// Who-Is
+// ---------------------------------------------------------------------------
+// Time per I-Am sent in ns for global Who-Is answered by every device, or 0 if a device did not answer
+static double MeasureWhoIsOnce(VirtualDevices* state, uint32_t iterations, uint32_t deviceCount)
+{
+    uint8_t whoIs[REQUEST_MAX_LENGTH];
+    uint16_t whoIsLength = EncodeGlobalWhoIs(whoIs);
+    uint32_t iAmBefore = state->statistics.iAmSent;
+    double startNs = BenchmarkNowNs();
+    for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        // Far enough apart that the requester is not rate limited
+        uint32_t nowMs = iteration * (DISCOVERY_RATE_LIMIT_MS + DISCOVERY_JITTER_MAX_MS);
+        uint32_t nextDueMs;
+        VirtualDevicesHandleMessage(state, whoIs, whoIsLength, REQUESTER_ADDRESS, nowMs);
+        VirtualDevicesPoll(state, nowMs + DISCOVERY_JITTER_MAX_MS, &nextDueMs);
+    }
+    double elapsedNs = BenchmarkNowNs() - startNs;
+    uint32_t iAmSent = state->statistics.iAmSent - iAmBefore;
+    return iAmSent == iterations * deviceCount ? elapsedNs / iAmSent : 0;
+}
+
+// The requester's rate limit entry carries over between runs, so each starts from a fresh set of devices
+static double MeasureWhoIs(VirtualDevices* state, BenchmarkDevices* devices, BenchmarkSink* sink, const BenchmarkSettings& settings, uint32_t deviceCount)
+{
+    uint32_t iterations = settings.iterations / deviceCount + 1;
+    return BenchmarkMedian(settings.runs, [&]() { return AddDevices(state, devices, sink, settings, deviceCount) ? MeasureWhoIsOnce(state, iterations, deviceCount) : 0; });
+}
+
+// Arguments
+// ---------------------------------------------------------------------------
+static void PrintUsage()
+{
+    printf("Usage: virtualbench [--devices n] [--objects n] [--iterations n] [--runs n] [--max-growth x]\n");
+}
+
+static bool ParseArguments(int argc, char** argv, BenchmarkSettings* settings)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argument, "--help") == 0) {
+            return false;
+        }
+        if (value == NULL) {
+            printf("Error: Missing value for %s\n", argument);
+            return false;
+        }
+        i++;
+
+        if (strcmp(argument, "--devices") == 0) {
+            settings->devices = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--objects") == 0) {
+            settings->objects = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--iterations") == 0) {
+            settings->iterations = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--runs") == 0) {
+            settings->runs = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argument, "--max-growth") == 0) {
+            settings->maxGrowth = strtof(value, NULL);
+        } else {
+            printf("Error: Unknown argument [%s]\n", argument);
+            return false;
+        }
+    }
+    if (settings->devices == 0 || settings->devices > VIRTUAL_DEVICES_CAPACITY || settings->objects == 0 || settings->objects > MAX_OBJECTS || settings->iterations == 0 || settings->runs == 0 || settings->runs > BENCHMARK_MAX_RUNS) {
+        printf("Error: --devices must be 1 to %u, --objects 1 to %u, --iterations at least 1, --runs 1 to %u\n", VIRTUAL_DEVICES_CAPACITY, MAX_OBJECTS, BENCHMARK_MAX_RUNS);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    settings.devices = 64;
+    settings.objects = 8;
+    settings.iterations = 20000;
+    settings.runs = 5;
+    settings.maxGrowth = 0;
+    if (!ParseArguments(argc, argv, &settings)) {
+        PrintUsage();
+        return 1;
+    }
+
+    printf("FYI: %u objects per device, %u requests per measurement, median of %u runs, index of %u slots\n", settings.objects, settings.iterations, settings.runs, VIRTUAL_DEVICES_INDEX_SIZE);
+    printf("%8s | %10s | %10s | %10s | %10s | %10s | %12s\n", "Devices", BENCHMARK_SERVICE_NAMES[0], BENCHMARK_SERVICE_NAMES[1], BENCHMARK_SERVICE_NAMES[2], "Find ns", "Scan ns", "Who-Is ns/IAm");
+    static VirtualDevices state;
+    BenchmarkDevices devices;
+    BenchmarkSink sink = { 0, 0, 0 };
+    BuildObjects(&devices, settings);
+    double firstNs[BENCHMARK_SERVICE_COUNT] = { 0 };
+    double lastNs[BENCHMARK_SERVICE_COUNT] = { 0 };
+    for (uint32_t deviceCount = 1;; deviceCount = deviceCount * 2 < settings.devices ? deviceCount * 2 : settings.devices) {
+        if (!AddDevices(&state, &devices, &sink, settings, deviceCount)) {
+            printf("Error: Could not add %u devices\n", deviceCount);
+            return 1;
+        }
+        double serviceNs[BENCHMARK_SERVICE_COUNT];
+        for (uint32_t service = 0; service < BENCHMARK_SERVICE_COUNT; service++) {
+            serviceNs[service] = MeasureService(&state, devices, &sink, settings, deviceCount, (BenchmarkService)service);
+            if (serviceNs[service] == 0) {
+                printf("Error: %s with %u devices was not answered with an acknowledgement\n", BENCHMARK_SERVICE_NAMES[service], deviceCount);
+                return 1;
+            }
+            if (deviceCount == 1) {
+                firstNs[service] = serviceNs[service];
+            }
+            lastNs[service] = serviceNs[service];
+        }
+        double findNs = MeasureLookup(&state, settings, deviceCount, true);
+        double scanNs = MeasureLookup(&state, settings, deviceCount, false);
+
+        double whoIsNs = MeasureWhoIs(&state, &devices, &sink, settings, deviceCount);
+        if (whoIsNs == 0 || findNs == 0 || scanNs == 0) {
+            printf("Error: Lookups or Who-Is with %u devices did not find every device\n", deviceCount);
+            return 1;
+        }
+        printf("%8u | %10.1f | %10.1f | %10.1f | %10.1f | %10.1f | %12.1f\n", deviceCount, serviceNs[0], serviceNs[1], serviceNs[2], findNs, scanNs, whoIsNs);
+        if (deviceCount == settings.devices) {
+            break;
+        }
+    }
+
+    bool failed = false;
+    for (uint32_t service = 0; service < BENCHMARK_SERVICE_COUNT; service++) {
+        double growth = lastNs[service] / firstNs[service];
+        printf("FYI: %s with %u devices is %.2fx the cost with one\n", BENCHMARK_SERVICE_NAMES[service], settings.devices, growth);
+        if (settings.maxGrowth > 0 && growth > settings.maxGrowth) {
+            printf("Error: %s grows %.2fx from 1 to %u devices, more than %.2fx\n", BENCHMARK_SERVICE_NAMES[service], growth, settings.devices, settings.maxGrowth);
+            failed = true;
+        }
+    }
+    return failed ? 1 : 0;
+}